@@ -6,6 +6,7 @@
 
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -19,13 +20,20 @@ Status BuildTable(const std::string& dbname,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
+                  Iterator* range_del_iter,
                   FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->num_entries = 0;
+  meta->num_deletions = 0;
+  meta->num_range_deletions = 0;
   iter->SeekToFirst();
+  if (range_del_iter != NULL) {
+    range_del_iter->SeekToFirst();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || (range_del_iter != NULL && range_del_iter->Valid())) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -33,11 +41,43 @@ Status BuildTable(const std::string& dbname,
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    bool has_bounds = iter->Valid();
+    if (has_bounds) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
       builder->Add(key, iter->value());
+      meta->num_entries++;
+      if (ExtractValueType(key) == kTypeDeletion) {
+        meta->num_deletions++;
+      }
+    }
+
+    if (range_del_iter != NULL) {
+      const InternalKeyComparator* icmp =
+          static_cast<const InternalKeyComparator*>(options.comparator);
+      for (; range_del_iter->Valid(); range_del_iter->Next()) {
+        ParsedInternalKey ikey;
+        if (!ParseInternalKey(range_del_iter->key(), &ikey) ||
+            ikey.type != kTypeRangeDeletion) {
+          s = Status::Corruption("bad range tombstone");
+          break;
+        }
+        builder->AddRangeTombstone(range_del_iter->key(),
+                                   range_del_iter->value());
+        ExtendBoundsForTombstone(*icmp, ikey.user_key, range_del_iter->value(),
+                                 ikey.sequence, has_bounds,
+                                 &meta->smallest, &meta->largest);
+        has_bounds = true;
+        meta->num_entries++;
+        meta->num_deletions++;
+        meta->num_range_deletions++;
+      }
+      if (s.ok()) {
+        s = range_del_iter->status();
+      }
     }
 
     // Finish and check for builder errors
@@ -6,12 +6,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "db/db_impl.h"
+#include "db/memtable.h"
 #include "db/version_set.h"
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/merger.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -31,15 +35,20 @@
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, 100 keys per MultiGet
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      crc32cportable -- same as crc32c but without the crc32 instruction
 //      acquireload   -- load N*1000 times
+//      mergeiter<K>  -- scan N keys spread over K memtables through a
+//                       merging iterator, e.g. mergeiter4, mergeiter50
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      blockcachestats -- Print block cache hits and misses by block kind
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -56,9 +65,13 @@ static const char* FLAGS_benchmarks =
     "readreverse,"
     "fill100K,"
     "crc32c,"
+    "crc32cportable,"
     "snappycomp,"
     "snappyuncomp,"
     "acquireload,"
+    "mergeiter4,"
+    "mergeiter12,"
+    "mergeiter50,"
     ;
 
 // Number of key/values to place in database
@@ -77,6 +90,13 @@ static int FLAGS_value_size = 100;
 // their original size after compression
 static double FLAGS_compression_ratio = 0.5;
 
+// Compression for all levels: none, snappy, lz4 or zstd.
+static const char* FLAGS_compression = "snappy";
+
+// Comma-separated compression per level, e.g. "lz4,lz4,lz4,zstd".
+// Overrides --compression when non-empty.
+static const char* FLAGS_compression_per_level = "";
+
 // Print histogram of operation timings
 static bool FLAGS_histogram = false;
 
@@ -88,18 +108,88 @@ static int FLAGS_write_buffer_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Number of bytes to use as a cache of compressed blocks, behind the
+// cache of uncompressed data.  Negative means no compressed cache.
+static int FLAGS_compressed_cache_size = -1;
+
+// Directory of a persistent cache of blocks, behind the caches above.
+// NULL means no persistent cache.
+static const char* FLAGS_persistent_cache_path = NULL;
+
+// Number of bytes the persistent cache may keep on disk.
+static int FLAGS_persistent_cache_size = 1 << 30;
+
+// Number of bytes to use as a cache of rows found by point lookups.
+// Negative means no row cache.
+static int FLAGS_row_cache_size = -1;
+
+// Fraction of --cache_size reserved for high priority and repeatedly
+// used blocks.  0 makes the cache a plain LRU.
+static double FLAGS_cache_high_pri_pool_ratio = 0.5;
+
+// If true, --cache_size creates a CLOCK cache instead of an LRU cache.
+static bool FLAGS_clock_cache = false;
+
+// The cache has 2^cache_shard_bits shards.  Negative picks a count
+// from the cache size.
+static int FLAGS_cache_shard_bits = 4;
+
+// If true, the LRU cache refuses inserts instead of exceeding its size
+// when pinned blocks fill it.
+static bool FLAGS_cache_strict_capacity = false;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// Maximum number of concurrent background compactions.  The Env's LOW
+// priority thread pool is sized to match.
+static int FLAGS_max_background_compactions = 1;
+
+// Maximum number of threads a single compaction is split across.
+static int FLAGS_max_subcompactions = 1;
+
+// Bytes compactions read ahead of their inputs (0 for automatic).
+static int FLAGS_compaction_readahead_size = 0;
+
+// Fraction of deletions at which a table is compacted (0 to disable).
+static double FLAGS_deletion_compaction_ratio = 0;
+
+// Bytes sequential scans read ahead (0 for automatic).
+static int FLAGS_readahead_size = 0;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, --bloom_bits builds cache-line-blocked bloom filters.
+static bool FLAGS_bloom_blocked = false;
+
+// If true, --bloom_bits builds one filter per table instead of one per
+// 2KB of data.
+static bool FLAGS_whole_table_filter = false;
+
+// Length of the key prefix that filters are built on and that
+// seekrandom seeks within (0 for no prefix extractor).
+static int FLAGS_prefix_size = 0;
+
+// If true, partition the index (and whole-table filter) of each table.
+static bool FLAGS_partition_index = false;
+
+// If true, keep index and filter blocks in the block cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
 static bool FLAGS_use_existing_db = false;
 
+// If true, writers of a group commit insert into the memtable in parallel.
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// If true, overlap the log write of a write group with the memtable
+// insert of the previous group.
+static bool FLAGS_enable_pipelined_write = false;
+
 // Use the db with the following name.
 static const char* FLAGS_db = NULL;
 
@@ -303,7 +393,11 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
+  PersistentCache* persistent_cache_;
+  Cache* row_cache_;
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
@@ -311,6 +405,7 @@ class Benchmark {
   WriteOptions write_options_;
   int reads_;
   int heap_counter_;
+  int merge_children_;
 
   void PrintHeader() {
     const int kKeySize = 16;
@@ -388,16 +483,30 @@ class Benchmark {
 
  public:
   Benchmark()
-  : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : NULL),
-    filter_policy_(FLAGS_bloom_bits >= 0
-                   ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                   : NULL),
+  : cache_(FLAGS_cache_size < 0 ? NULL
+           : FLAGS_clock_cache
+               ? NewClockCache(FLAGS_cache_size, FLAGS_cache_shard_bits)
+               : NewLRUCache(FLAGS_cache_size, FLAGS_cache_shard_bits,
+                             FLAGS_cache_strict_capacity,
+                             FLAGS_cache_high_pri_pool_ratio)),
+    compressed_cache_(FLAGS_compressed_cache_size < 0 ? NULL
+                      : NewLRUCache(FLAGS_compressed_cache_size)),
+    persistent_cache_(NULL),
+    row_cache_(FLAGS_row_cache_size < 0 ? NULL
+               : NewLRUCache(FLAGS_row_cache_size)),
+    filter_policy_(FLAGS_bloom_bits < 0 ? NULL
+                   : FLAGS_bloom_blocked
+                   ? NewBlockedBloomFilterPolicy(FLAGS_bloom_bits)
+                   : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+    prefix_extractor_(FLAGS_prefix_size <= 0 ? NULL
+                      : NewFixedPrefixTransform(FLAGS_prefix_size)),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
     entries_per_batch_(1),
     reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-    heap_counter_(0) {
+    heap_counter_(0),
+    merge_children_(0) {
     std::vector<std::string> files;
     Env::Default()->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -408,12 +517,26 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (FLAGS_persistent_cache_path != NULL) {
+      Status s = NewPersistentCache(Env::Default(), FLAGS_persistent_cache_path,
+                                    FLAGS_persistent_cache_size,
+                                    &persistent_cache_);
+      if (!s.ok()) {
+        fprintf(stderr, "open persistent cache error: %s\n",
+                s.ToString().c_str());
+        exit(1);
+      }
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete row_cache_;
+    delete compressed_cache_;
+    delete persistent_cache_;
     delete filter_policy_;
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -476,6 +599,8 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -496,8 +621,13 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("crc32cportable")) {
+        method = &Benchmark::Crc32cPortable;
       } else if (name == Slice("acquireload")) {
         method = &Benchmark::AcquireLoad;
+      } else if (name.starts_with("mergeiter")) {
+        merge_children_ = atoi(name.ToString().c_str() + strlen("mergeiter"));
+        method = &Benchmark::MergeIter;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -508,6 +638,8 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("blockcachestats")) {
+        PrintStats("leveldb.block-cache-stats");
       } else {
         if (name != Slice()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -611,14 +743,30 @@ class Benchmark {
   }
 
   void Crc32c(ThreadState* thread) {
+    DoCrc32c(thread, false);
+  }
+
+  void Crc32cPortable(ThreadState* thread) {
+    DoCrc32c(thread, true);
+  }
+
+  void DoCrc32c(ThreadState* thread, bool portable) {
     // Checksum about 500MB of data total
     const int size = 4096;
-    const char* label = "(4K per op)";
+    const char* label;
+    if (portable) {
+      label = "(4K per op, portable)";
+    } else if (crc32c::IsHardwareAccelerated()) {
+      label = "(4K per op, sse4.2)";
+    } else {
+      label = "(4K per op, portable)";
+    }
     std::string data(size, 'x');
     int64_t bytes = 0;
     uint32_t crc = 0;
     while (bytes < 500 * 1048576) {
-      crc = crc32c::Value(data.data(), size);
+      crc = portable ? crc32c::ExtendPortable(0, data.data(), size)
+                     : crc32c::Value(data.data(), size);
       thread->stats.FinishedSingleOp();
       bytes += size;
     }
@@ -645,6 +793,48 @@ class Benchmark {
     if (ptr == NULL) exit(1); // Disable unused variable warning.
   }
 
+  void MergeIter(ThreadState* thread) {
+    if (merge_children_ <= 0) {
+      thread->stats.AddMessage("(number of children must be positive)");
+      return;
+    }
+    // Deal the keys round-robin so that every step of the scan moves to
+    // a different child, as with overlapping level-0 files.
+    InternalKeyComparator icmp(BytewiseComparator());
+    std::vector<MemTable*> mems(merge_children_);
+    for (int c = 0; c < merge_children_; c++) {
+      mems[c] = new MemTable(icmp);
+      mems[c]->Ref();
+    }
+    RandomGenerator gen;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", i);
+      mems[i % merge_children_]->Add(i + 1, kTypeValue, key,
+                                     gen.Generate(value_size_));
+    }
+
+    std::vector<Iterator*> children(merge_children_);
+    for (int c = 0; c < merge_children_; c++) {
+      children[c] = mems[c]->NewIterator();
+    }
+    Iterator* iter = NewMergingIterator(&icmp, &children[0], merge_children_);
+    int64_t bytes = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+    }
+    delete iter;
+    for (int c = 0; c < merge_children_; c++) {
+      mems[c]->Unref();
+    }
+
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d children)", merge_children_);
+    thread->stats.AddMessage(msg);
+    thread->stats.AddBytes(bytes);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -697,9 +887,33 @@ class Benchmark {
     Options options;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.compressed_block_cache = compressed_cache_;
+    options.persistent_cache = persistent_cache_;
+    options.row_cache = row_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_open_files = FLAGS_open_files;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.compaction_readahead_size = FLAGS_compaction_readahead_size;
+    options.deletion_compaction_ratio = FLAGS_deletion_compaction_ratio;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
     options.filter_policy = filter_policy_;
+    options.whole_table_filter = FLAGS_whole_table_filter;
+    options.prefix_extractor = prefix_extractor_;
+    options.partition_index = FLAGS_partition_index;
+    options.cache_index_and_filter_blocks =
+        FLAGS_cache_index_and_filter_blocks;
+    options.compression = StringToCompression(FLAGS_compression);
+    Slice per_level(FLAGS_compression_per_level);
+    while (!per_level.empty()) {
+      const char* comma = strchr(per_level.data(), ',');
+      size_t len = (comma == NULL) ? per_level.size() : comma - per_level.data();
+      options.compression_per_level.push_back(
+          StringToCompression(Slice(per_level.data(), len)));
+      per_level.remove_prefix(comma == NULL ? len : len + 1);
+    }
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -707,6 +921,20 @@ class Benchmark {
     }
   }
 
+  static CompressionType StringToCompression(const Slice& name) {
+    if (name == Slice("none")) {
+      return kNoCompression;
+    } else if (name == Slice("snappy")) {
+      return kSnappyCompression;
+    } else if (name == Slice("lz4")) {
+      return kLZ4Compression;
+    } else if (name == Slice("zstd")) {
+      return kZstdCompression;
+    }
+    fprintf(stderr, "unknown compression '%s'\n", name.ToString().c_str());
+    exit(1);
+  }
+
   void OpenBench(ThreadState* thread) {
     for (int i = 0; i < num_; i++) {
       delete db_;
@@ -754,7 +982,9 @@ class Benchmark {
   }
 
   void ReadSequential(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
@@ -767,7 +997,9 @@ class Benchmark {
   }
 
   void ReadReverse(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToLast(); i < reads_ && iter->Valid(); iter->Prev()) {
@@ -797,6 +1029,36 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    const int kBatch = 100;
+    std::vector<std::string> key_data(kBatch);
+    std::vector<Slice> keys(kBatch);
+    std::vector<std::string> values;
+    int found = 0;
+    for (int i = 0; i < reads_; i += kBatch) {
+      const int n = std::min(kBatch, reads_ - i);
+      keys.resize(n);
+      for (int j = 0; j < n; j++) {
+        char key[100];
+        const int k = thread->rand.Next() % FLAGS_num;
+        snprintf(key, sizeof(key), "%016d", k);
+        key_data[j] = key;
+        keys[j] = key_data[j];
+      }
+      std::vector<Status> statuses = db_->MultiGet(options, keys, &values);
+      for (int j = 0; j < n; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -824,6 +1086,7 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_seek = (prefix_extractor_ != NULL);
     int found = 0;
     for (int i = 0; i < reads_; i++) {
       Iterator* iter = db_->NewIterator(options);
@@ -948,12 +1211,21 @@ int main(int argc, char** argv) {
       FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
     } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
       FLAGS_compression_ratio = d;
+    } else if (sscanf(argv[i], "--cache_high_pri_pool_ratio=%lf%c",
+                      &d, &junk) == 1) {
+      FLAGS_cache_high_pri_pool_ratio = d;
     } else if (sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_histogram = n;
     } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_existing_db = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -966,10 +1238,59 @@ int main(int argc, char** argv) {
       FLAGS_write_buffer_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (strncmp(argv[i], "--persistent_cache_path=", 24) == 0) {
+      FLAGS_persistent_cache_path = argv[i] + 24;
+    } else if (sscanf(argv[i], "--persistent_cache_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_persistent_cache_size = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_row_cache_size = n;
+    } else if (sscanf(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = n;
+    } else if (sscanf(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_shard_bits = n;
+    } else if (sscanf(argv[i], "--cache_strict_capacity=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_cache_strict_capacity = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--bloom_blocked=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_bloom_blocked = n;
+    } else if (sscanf(argv[i], "--whole_table_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_whole_table_filter = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
+    } else if (sscanf(argv[i], "--partition_index=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_partition_index = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf(argv[i], "--compaction_readahead_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_compaction_readahead_size = n;
+    } else if (sscanf(argv[i], "--deletion_compaction_ratio=%lf%c",
+                      &d, &junk) == 1) {
+      FLAGS_deletion_compaction_ratio = d;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1) {
+      FLAGS_readahead_size = n;
+    } else if (strncmp(argv[i], "--compression=", 14) == 0) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (strncmp(argv[i], "--compression_per_level=", 24) == 0) {
+      FLAGS_compression_per_level = argv[i] + 24;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -985,6 +1306,9 @@ int main(int argc, char** argv) {
       FLAGS_db = default_db_path.c_str();
   }
 
+  leveldb::Env::Default()->SetBackgroundThreads(
+      FLAGS_max_background_compactions, leveldb::Env::LOW);
+
   leveldb::Benchmark benchmark;
   benchmark.Run();
   return 0;
@@ -17,6 +17,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -32,6 +33,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/thread_local.h"
 
 namespace leveldb
 {
@@ -47,7 +49,18 @@ namespace leveldb
         bool done;
         port::CondVar cv;
         
-        explicit Writer(port::Mutex* mu) : cv(mu) { }
+        // Parallel memtable insert (see Options::allow_concurrent_memtable_write).
+        // The group leader sets insert_leader on each follower that must
+        // insert its own batch, and counts them in its pending_inserts.
+        Writer* insert_leader;
+        int pending_inserts;
+        
+        // Pipelined writes (see Options::enable_pipelined_write): last sequence
+        // number of the group this writer leads, while it waits in
+        // memtable_writers_.
+        SequenceNumber last_sequence;
+        
+        explicit Writer(port::Mutex* mu) : cv(mu), insert_leader(NULL), pending_inserts(0), last_sequence(0) { }
     };
     
     struct DBImpl::CompactionState
@@ -60,12 +73,25 @@ namespace leveldb
         // we can drop all entries for the same key with sequence numbers < S.
         SequenceNumber smallest_snapshot;
         
+        // User key range [*begin,*end) handled by this state.  NULL means
+        // unbounded.  Only subcompactions have a bounded range.
+        const std::string* begin;
+        const std::string* end;
+        
+        // User key from which the next output holds the range tombstones
+        // of the compaction; unbounded if !has_tombstones_begin.
+        std::string tombstones_begin;
+        bool has_tombstones_begin;
+        
         // Files produced by compaction
         struct Output
         {
             uint64_t number;
             uint64_t file_size;
             InternalKey smallest, largest;
+            uint64_t num_entries;
+            uint64_t num_deletions;
+            uint64_t num_range_deletions;
         };
         std::vector<Output> outputs;
         
@@ -110,7 +136,7 @@ namespace leveldb
             return 0;
          }
          */
-        explicit CompactionState(Compaction* c): compaction(c), outfile(NULL), builder(NULL), total_bytes(0) {}
+        explicit CompactionState(Compaction* c): compaction(c), begin(NULL), end(NULL), has_tombstones_begin(false), outfile(NULL), builder(NULL), total_bytes(0) {}
     };
     
     // Fix user-supplied options to be reasonable
@@ -120,12 +146,16 @@ namespace leveldb
         if (static_cast<V>(*ptr) > maxvalue) *ptr = maxvalue;
         if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
     }
-    Options SanitizeOptions(const std::string& dbname, const InternalKeyComparator* icmp, const InternalFilterPolicy* ipolicy, const Options& src)
+    Options SanitizeOptions(const std::string& dbname, const InternalKeyComparator* icmp, const InternalFilterPolicy* ipolicy,
+                            const InternalPrefixTransform* iprefix, const Options& src)
     {
         Options result = src;
         result.comparator = icmp;
         result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
+        result.prefix_extractor = (src.prefix_extractor != NULL) ? iprefix : NULL;
         ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
+        ClipToRange(&result.max_background_compactions, 1,                  64);
+        ClipToRange(&result.max_subcompactions,         1,                  64);
         ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
         ClipToRange(&result.block_size,        1<<10,                       4<<20);
         if (result.info_log == NULL)
@@ -151,7 +181,8 @@ namespace leveldb
     : env_(raw_options.env),
     internal_comparator_(raw_options.comparator),
     internal_filter_policy_(raw_options.filter_policy),
-    options_(SanitizeOptions(dbname, &internal_comparator_, &internal_filter_policy_, raw_options)),
+    internal_prefix_extractor_(raw_options.prefix_extractor),
+    options_(SanitizeOptions(dbname, &internal_comparator_, &internal_filter_policy_, &internal_prefix_extractor_, raw_options)),
     owns_info_log_(options_.info_log != raw_options.info_log),
     owns_cache_(options_.block_cache != raw_options.block_cache),
     dbname_(dbname),
@@ -164,12 +195,18 @@ namespace leveldb
     logfile_number_(0),
     log_(NULL),
     seed_(0),
+    super_version_(NULL),
+    local_sv_(new ThreadLocalPtr(&DBImpl::UnrefSuperVersionHandler)),
     tmp_batch_(new WriteBatch),
-    bg_compaction_scheduled_(false),
-    manual_compaction_(NULL)
+    bg_compaction_scheduled_(0),
+    bg_flush_scheduled_(false),
+    manifest_writing_(false),
+    manifest_cv_(&mutex_),
+    manual_compaction_(NULL),
+    deleting_files_in_range_(0),
+    flushing_below_level0_(false)
     {
         mem_->Ref();
-        has_imm_.Release_Store(NULL);
         
         // Reserve ten files or so for other uses and give the rest to TableCache.
         const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
@@ -183,12 +220,22 @@ namespace leveldb
         // Wait for background work to finish
         mutex_.Lock();
         shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-        while (bg_compaction_scheduled_)
+        while (bg_compaction_scheduled_ > 0 || bg_flush_scheduled_)
         {
             bg_cv_.Wait();
         }
+        assert(compaction_queue_.empty());
         mutex_.Unlock();
         
+        // Drop the references cached by reader threads before our own, so
+        // that UnrefSuperVersionHandler() never has the last one.
+        delete local_sv_;
+        if (super_version_ != NULL)
+        {
+            MutexLock l(&mutex_);
+            UnrefSuperVersionLocked(super_version_);
+        }
+        
         if (db_lock_ != NULL)
         {
             env_->UnlockFile(db_lock_);
@@ -515,7 +562,18 @@ namespace leveldb
         return status;
     }
     
-    Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+    Options DBImpl::TableOptionsForLevel(int level) const
+    {
+        Options result = options_;
+        const std::vector<CompressionType>& per_level = options_.compression_per_level;
+        if (!per_level.empty())
+        {
+            result.compression = per_level[std::min<size_t>(level, per_level.size() - 1)];
+        }
+        return result;
+    }
+    
+    Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base, uint64_t* pending_number)
     {
         mutex_.AssertHeld();
         const uint64_t start_micros = env_->NowMicros();
@@ -523,19 +581,29 @@ namespace leveldb
         meta.number = versions_->NewFileNumber();
         pending_outputs_.insert(meta.number);
         Iterator* iter = mem->NewIterator();
+        Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
         Log(options_.info_log, "Level-0 table #%llu: started", (unsigned long long) meta.number);
         
         Status s;
         {
             mutex_.Unlock();
-            s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+            s = BuildTable(dbname_, env_, TableOptionsForLevel(0), table_cache_, iter, range_del_iter, &meta);
             mutex_.Lock();
         }
         
         Log(options_.info_log, "Level-0 table #%llu: %lld bytes %s", (unsigned long long) meta.number, (unsigned long long) meta.file_size, s.ToString().c_str());
         delete iter;
-        pending_outputs_.erase(meta.number);
-        
+        delete range_del_iter;
+        if (base == NULL || !s.ok() || meta.file_size == 0)
+        {
+            pending_outputs_.erase(meta.number);
+        } else
+        {
+            // Compactions running on other threads may delete obsolete files
+            // before our edit is installed, so CompactMemTable() keeps the
+            // number protected until LogAndApply() has finished.
+            *pending_number = meta.number;
+        }
         
         // Note that if file_size is zero, the file has been deleted and
         // should not be added to the manifest.
@@ -546,9 +614,24 @@ namespace leveldb
             const Slice max_user_key = meta.largest.user_key();
             if (base != NULL)
             {
-                level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+                // Wait out any other MANIFEST write here, so that nothing
+                // drops the mutex between the check below and the caller's
+                // LogAndApply().
+                while (manifest_writing_)
+                {
+                    manifest_cv_.Wait();
+                }
+            }
+            if (base != NULL && bg_compaction_scheduled_ == 0)
+            {
+                // Compactions in flight may install outputs overlapping any level
+                // but 0, so only push the table deeper when none are scheduled.
+                level = versions_->current()->PickLevelForMemTableOutput(min_user_key, max_user_key);
+                // Compactions picked while the edit is logged would not see
+                // the table; hold them off until CompactMemTable() is done.
+                flushing_below_level0_ = (level > 0);
             }
-            edit->AddFile(level, meta.number, meta.file_size, meta.smallest, meta.largest);
+            edit->AddFile(level, meta.number, meta.file_size, meta.smallest, meta.largest, meta.num_entries, meta.num_deletions, meta.num_range_deletions);
         }
         
         CompactionStats stats;
@@ -567,7 +650,8 @@ namespace leveldb
         VersionEdit edit;
         Version* base = versions_->current();
         base->Ref();
-        Status s = WriteLevel0Table(imm_, &edit, base);
+        uint64_t pending_number = 0;
+        Status s = WriteLevel0Table(imm_, &edit, base, &pending_number);
         base->Unref();
         
         if (s.ok() && shutting_down_.Acquire_Load())
@@ -580,7 +664,12 @@ namespace leveldb
         {
             edit.SetPrevLogNumber(0);
             edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-            s = versions_->LogAndApply(&edit, &mutex_);
+            s = LogAndApply(&edit);
+        }
+        flushing_below_level0_ = false;
+        if (pending_number != 0)
+        {
+            pending_outputs_.erase(pending_number);
         }
         
         if (s.ok())
@@ -588,7 +677,7 @@ namespace leveldb
             // Commit to the new state
             imm_->Unref();
             imm_ = NULL;
-            has_imm_.Release_Store(NULL);
+            InstallSuperVersion();
             DeleteObsoleteFiles();
         } else
         {
@@ -617,6 +706,79 @@ namespace leveldb
         }
     }
     
+    Status DBImpl::DeleteFilesInRange(const Slice* begin, const Slice* end)
+    {
+        MutexLock l(&mutex_);
+        if (!bg_error_.ok())
+        {
+            return bg_error_;
+        }
+        
+        InternalKey begin_storage, end_storage;
+        if (begin != NULL)
+        {
+            begin_storage = InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek);
+        }
+        if (end != NULL)
+        {
+            end_storage = InternalKey(*end, 0, static_cast<ValueType>(0));
+        }
+        const Comparator* ucmp = user_comparator();
+        Version* base = versions_->current();
+        VersionEdit edit;
+        std::vector<FileMetaData*> deleted;
+        for (int level = 0; level < config::kNumLevels; level++)
+        {
+            std::vector<FileMetaData*> files;
+            base->GetOverlappingInputs(level, (begin != NULL ? &begin_storage : NULL), (end != NULL ? &end_storage : NULL), &files);
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                FileMetaData* f = files[i];
+                if (f->being_compacted ||
+                    (begin != NULL && ucmp->Compare(f->smallest.user_key(), *begin) < 0) ||
+                    (end != NULL && ucmp->Compare(f->largest.user_key(), *end) > 0))
+                {
+                    continue;
+                }
+                edit.DeleteFile(level, f->number);
+                deleted.push_back(f);
+            }
+        }
+        if (deleted.empty())
+        {
+            return Status::OK();
+        }
+        
+        // Keep compactions from picking the files while the edit is logged.
+        // Automatic compactions skip busy files; manual ones are held off.
+        base->Ref();
+        for (size_t i = 0; i < deleted.size(); i++)
+        {
+            deleted[i]->being_compacted = true;
+        }
+        deleting_files_in_range_++;
+        Status s = LogAndApply(&edit);
+        deleting_files_in_range_--;
+        for (size_t i = 0; i < deleted.size(); i++)
+        {
+            // Nothing else could have claimed them, so the marks are ours
+            assert(deleted[i]->being_compacted);
+            deleted[i]->being_compacted = false;
+        }
+        base->Unref();
+        VersionSet::LevelSummaryStorage tmp;
+        Log(options_.info_log, "Deleted %d files in range: %s; %s\n",
+            static_cast<int>(deleted.size()), s.ToString().c_str(), versions_->LevelSummary(&tmp));
+        if (s.ok())
+        {
+            DeleteObsoleteFiles();
+        }
+        // A manual compaction may be waiting for this call to finish
+        MaybeScheduleCompaction();
+        bg_cv_.SignalAll();
+        return s;
+    }
+    
     void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end)
     {
         assert(level >= 0);
@@ -693,25 +855,77 @@ namespace leveldb
         }
     }
     
-    void DBImpl::MaybeScheduleCompaction()
+    Status DBImpl::LogAndApply(VersionEdit* edit)
     {
         mutex_.AssertHeld();
-        if (bg_compaction_scheduled_)
+        // VersionSet::LogAndApply() drops the mutex while writing the MANIFEST,
+        // so wait for any other thread that is in the middle of it.
+        while (manifest_writing_)
         {
-            // Already scheduled
-        } else if (shutting_down_.Acquire_Load())
+            manifest_cv_.Wait();
+        }
+        manifest_writing_ = true;
+        Status s = versions_->LogAndApply(edit, &mutex_);
+        manifest_writing_ = false;
+        manifest_cv_.SignalAll();
+        if (s.ok())
+        {
+            InstallSuperVersion();
+        }
+        return s;
+    }
+    
+    void DBImpl::MaybeScheduleCompaction()
+    {
+        mutex_.AssertHeld();
+        if (shutting_down_.Acquire_Load())
         {
             // DB is being deleted; no more background compactions
+            return;
         } else if (!bg_error_.ok())
         {
             // Already got an error; no more changes
-        } else if (imm_ == NULL && manual_compaction_ == NULL && !versions_->NeedsCompaction())
+            return;
+        }
+        
+        // Memtable flushes go to the HIGH priority pool so that they never
+        // queue up behind long-running compactions.
+        if (imm_ != NULL && !bg_flush_scheduled_)
         {
-            // No work to be done
-        } else
+            bg_flush_scheduled_ = true;
+            env_->Schedule(&DBImpl::BGWorkFlush, this, Env::HIGH);
+        }
+        
+        if (flushing_below_level0_)
+        {
+            // CompactMemTable() schedules them once its table is installed
+            return;
+        }
+        
+        if (manual_compaction_ != NULL)
+        {
+            // A manual compaction runs alone, once the automatic ones and
+            // DeleteFilesInRange() calls drain.
+            if (bg_compaction_scheduled_ == 0 && deleting_files_in_range_ == 0)
+            {
+                bg_compaction_scheduled_++;
+                env_->Schedule(&DBImpl::BGWork, this, Env::LOW);
+            }
+            return;
+        }
+        
+        // Pick as many non-overlapping compactions as we are allowed to run.
+        while (bg_compaction_scheduled_ < options_.max_background_compactions && versions_->NeedsCompaction())
         {
-            bg_compaction_scheduled_ = true;
-            env_->Schedule(&DBImpl::BGWork, this);
+            Compaction* c = versions_->PickCompaction();
+            if (c == NULL)
+            {
+                // Remaining work conflicts with running compactions
+                break;
+            }
+            compaction_queue_.push_back(c);
+            bg_compaction_scheduled_++;
+            env_->Schedule(&DBImpl::BGWork, this, Env::LOW);
         }
     }
     
@@ -720,22 +934,30 @@ namespace leveldb
         reinterpret_cast<DBImpl*>(db)->BackgroundCall();
     }
     
+    void DBImpl::BGWorkFlush(void* db)
+    {
+        reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+    }
+    
     void DBImpl::BackgroundCall()
     {
         MutexLock l(&mutex_);
-        assert(bg_compaction_scheduled_);
-        if (shutting_down_.Acquire_Load())
-        {
-            // No more background work when shutting down.
-        } else if (!bg_error_.ok())
+        assert(bg_compaction_scheduled_ > 0);
+        if (shutting_down_.Acquire_Load() || !bg_error_.ok())
         {
-            // No more background work after a background error.
+            // No more background work when shutting down or after a
+            // background error.  Drop the compaction picked for this call.
+            if (!compaction_queue_.empty())
+            {
+                delete compaction_queue_.front();
+                compaction_queue_.pop_front();
+            }
         } else
         {
             BackgroundCompaction();
         }
         
-        bg_compaction_scheduled_ = false;
+        bg_compaction_scheduled_--;
         
         // Previous compaction may have produced too many files in a level,
         // so reschedule another compaction if needed.
@@ -743,21 +965,47 @@ namespace leveldb
         bg_cv_.SignalAll();
     }
     
-    void DBImpl::BackgroundCompaction()
+    void DBImpl::BackgroundFlushCall()
     {
-        mutex_.AssertHeld();
-        
-        if (imm_ != NULL)
+        MutexLock l(&mutex_);
+        assert(bg_flush_scheduled_);
+        if (shutting_down_.Acquire_Load())
+        {
+            // No more background work when shutting down.
+        } else if (!bg_error_.ok())
+        {
+            // No more background work after a background error.
+        } else if (imm_ != NULL)
         {
             CompactMemTable();
-            return;
         }
         
+        bg_flush_scheduled_ = false;
+        
+        // The flush may have produced enough level-0 files to need a compaction.
+        MaybeScheduleCompaction();
+        bg_cv_.SignalAll();
+    }
+    
+    void DBImpl::BackgroundCompaction()
+    {
+        mutex_.AssertHeld();
+        
         Compaction* c;
-        bool is_manual = (manual_compaction_ != NULL);
+        bool is_manual = false;
         InternalKey manual_end;
-        if (is_manual)
+        if (!compaction_queue_.empty())
+        {
+            c = compaction_queue_.front();
+            compaction_queue_.pop_front();
+        } else if (manual_compaction_ != NULL && deleting_files_in_range_ > 0)
+        {
+            // Scheduled before a DeleteFilesInRange() claimed its files; that
+            // call schedules the manual compaction again when it is done.
+            return;
+        } else if (manual_compaction_ != NULL)
         {
+            is_manual = true;
             ManualCompaction* m = manual_compaction_;
             c = versions_->CompactRange(m->level, m->begin, m->end);
             m->done = (c == NULL);
@@ -772,7 +1020,8 @@ namespace leveldb
                 (m->done ? "(end)" : manual_end.DebugString().c_str()));
         } else
         {
-            c = versions_->PickCompaction();
+            // Work was cancelled (e.g. the manual compaction gave up)
+            return;
         }
         
         Status status;
@@ -785,8 +1034,8 @@ namespace leveldb
             assert(c->num_input_files(0) == 1);
             FileMetaData* f = c->input(0, 0);
             c->edit()->DeleteFile(c->level(), f->number);
-            c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest, f->largest);
-            status = versions_->LogAndApply(c->edit(), &mutex_);
+            c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest, f->largest, f->num_entries, f->num_deletions, f->num_range_deletions);
+            status = LogAndApply(c->edit());
             if (!status.ok())
             {
                 RecordBackgroundError(status);
@@ -875,6 +1124,9 @@ namespace leveldb
             out.number = file_number;
             out.smallest.Clear();
             out.largest.Clear();
+            out.num_entries = 0;
+            out.num_deletions = 0;
+            out.num_range_deletions = 0;
             compact->outputs.push_back(out);
             mutex_.Unlock();
         }
@@ -884,7 +1136,7 @@ namespace leveldb
         Status s = env_->NewWritableFile(fname, &compact->outfile);
         if (s.ok())
         {
-            compact->builder = new TableBuilder(options_, compact->outfile);
+            compact->builder = new TableBuilder(TableOptionsForLevel(compact->compaction->level() + 1), compact->outfile);
         }
         return s;
     }
@@ -901,6 +1153,7 @@ namespace leveldb
         // Check for iterator errors
         Status s = input->status();
         const uint64_t current_entries = compact->builder->NumEntries();
+        const uint64_t current_tombstones = compact->builder->NumRangeTombstones();
         if (s.ok())
         {
             s = compact->builder->Finish();
@@ -926,7 +1179,7 @@ namespace leveldb
         delete compact->outfile;
         compact->outfile = NULL;
         
-        if (s.ok() && current_entries > 0)
+        if (s.ok() && (current_entries > 0 || current_tombstones > 0))
         {
             // Verify that the table is usable
             Iterator* iter = table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
@@ -944,6 +1197,59 @@ namespace leveldb
     }
     
     
+    Status DBImpl::AddRangeTombstonesToOutput(CompactionState* compact, const RangeTombstoneList& tombstones, const Slice* upper)
+    {
+        const Comparator* ucmp = user_comparator();
+        const std::vector<RangeTombstone>& list = tombstones.tombstones();
+        Status s;
+        for (size_t i = 0; i < list.size() && s.ok(); i++)
+        {
+            const RangeTombstone& t = list[i];
+            Slice begin = t.begin;
+            Slice end = t.end;
+            if (compact->has_tombstones_begin && ucmp->Compare(begin, compact->tombstones_begin) < 0)
+            {
+                begin = compact->tombstones_begin;
+            }
+            if (upper != NULL && ucmp->Compare(end, *upper) > 0)
+            {
+                end = *upper;
+            }
+            if (ucmp->Compare(begin, end) >= 0)
+            {
+                // Outside of the range of this output
+                continue;
+            }
+            if (t.sequence <= compact->smallest_snapshot && compact->compaction->IsBaseLevelForRange(begin, end))
+            {
+                // All the data it deletes is being dropped by this compaction
+                continue;
+            }
+            if (compact->builder == NULL)
+            {
+                s = OpenCompactionOutputFile(compact);
+                if (!s.ok())
+                {
+                    break;
+                }
+            }
+            const bool has_bounds = (compact->builder->NumEntries() > 0 || compact->builder->NumRangeTombstones() > 0);
+            InternalKey key(begin, t.sequence, kTypeRangeDeletion);
+            compact->builder->AddRangeTombstone(key.Encode(), end);
+            CompactionState::Output* out = compact->current_output();
+            ExtendBoundsForTombstone(internal_comparator_, begin, end, t.sequence, has_bounds, &out->smallest, &out->largest);
+            out->num_entries++;
+            out->num_deletions++;
+            out->num_range_deletions++;
+        }
+        if (upper != NULL)
+        {
+            compact->tombstones_begin.assign(upper->data(), upper->size());
+            compact->has_tombstones_begin = true;
+        }
+        return s;
+    }
+    
     Status DBImpl::InstallCompactionResults(CompactionState* compact)
     {
         mutex_.AssertHeld();
@@ -960,63 +1266,85 @@ namespace leveldb
         for (size_t i = 0; i < compact->outputs.size(); i++)
         {
             const CompactionState::Output& out = compact->outputs[i];
-            compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size, out.smallest, out.largest);
+            compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size, out.smallest, out.largest, out.num_entries, out.num_deletions, out.num_range_deletions);
         }
-        return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+        return LogAndApply(compact->compaction->edit());
     }
     
-    Status DBImpl::DoCompactionWork(CompactionState* compact)
+    Status DBImpl::DoCompactionRange(CompactionState* compact)
     {
-        const uint64_t start_micros = env_->NowMicros();
-        int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
-        
-        Log(options_.info_log,  "Compacting %d@%d + %d@%d files",
-            compact->compaction->num_input_files(0),
-            compact->compaction->level(),
-            compact->compaction->num_input_files(1),
-            compact->compaction->level() + 1);
-        
-        assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
-        assert(compact->builder == NULL);
-        assert(compact->outfile == NULL);
-        if (snapshots_.empty())
+        Iterator* input = versions_->MakeInputIterator(compact->compaction);
+        if (compact->begin != NULL)
         {
-            compact->smallest_snapshot = versions_->LastSequence();
+            InternalKey start(*compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+            input->Seek(start.Encode());
         } else
         {
-            compact->smallest_snapshot = snapshots_.oldest()->number_;
+            input->SeekToFirst();
         }
+        const Comparator* ucmp = user_comparator();
+        Status status;
         
-        // Release mutex while we're actually doing the compaction work
-        mutex_.Unlock();
+        // The range tombstones of the inputs drop the entries they delete
+        // for all snapshots, and are passed on to the outputs.
+        RangeTombstoneList tombstones(ucmp);
+        for (int which = 0; which < 2 && status.ok(); which++)
+        {
+            for (int i = 0; i < compact->compaction->num_input_files(which) && status.ok(); i++)
+            {
+                const FileMetaData* f = compact->compaction->input(which, i);
+                if (f->num_range_deletions > 0)
+                {
+                    status = table_cache_->AddRangeTombstones(f->number, f->file_size, &tombstones);
+                }
+            }
+        }
+        tombstones.Finish();
+        if (compact->begin != NULL)
+        {
+            compact->tombstones_begin = *compact->begin;
+            compact->has_tombstones_begin = true;
+        }
         
-        Iterator* input = versions_->MakeInputIterator(compact->compaction);
-        input->SeekToFirst();
-        Status status;
         ParsedInternalKey ikey;
         std::string current_user_key;
         bool has_current_user_key = false;
         SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-        for (; input->Valid() && !shutting_down_.Acquire_Load(); )
+        // Set when the current output should be finished.  With range
+        // tombstones, outputs are only split between user keys, so that
+        // the tombstones of each output apply to all its entries.
+        bool finish_pending = false;
+        // Note: immutable memtables are flushed concurrently by the HIGH
+        // priority pool (see MaybeScheduleCompaction()), so there is no need
+        // to interrupt this loop for them.
+        for (; status.ok() && input->Valid() && !shutting_down_.Acquire_Load(); )
         {
-            // Prioritize immutable compaction work
-            if (has_imm_.NoBarrier_Load() != NULL)
+            Slice key = input->key();
+            if (compact->end != NULL && key.size() >= 8 && ucmp->Compare(ExtractUserKey(key), *compact->end) >= 0)
             {
-                const uint64_t imm_start = env_->NowMicros();
-                mutex_.Lock();
-                if (imm_ != NULL)
-                {
-                    CompactMemTable();
-                    bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
-                }
-                mutex_.Unlock();
-                imm_micros += (env_->NowMicros() - imm_start);
+                // The rest belongs to the next subcompaction
+                break;
             }
-            
-            Slice key = input->key();
             if (compact->compaction->ShouldStopBefore(key) && compact->builder != NULL)
             {
-                status = FinishCompactionOutputFile(compact, input);
+                finish_pending = true;
+            }
+            if (finish_pending && compact->builder != NULL)
+            {
+                if (tombstones.empty())
+                {
+                    status = FinishCompactionOutputFile(compact, input);
+                    finish_pending = false;
+                } else if (key.size() >= 8 && ucmp->Compare(ExtractUserKey(key), compact->current_output()->largest.user_key()) != 0)
+                {
+                    const Slice upper = ExtractUserKey(key);
+                    status = AddRangeTombstonesToOutput(compact, tombstones, &upper);
+                    if (status.ok())
+                    {
+                        status = FinishCompactionOutputFile(compact, input);
+                    }
+                    finish_pending = false;
+                }
                 if (!status.ok())
                 {
                     break;
@@ -1055,6 +1383,10 @@ namespace leveldb
                     //     few iterations of this loop (by rule (A) above).
                     // Therefore this deletion marker is obsolete and can be dropped.
                     drop = true;
+                } else if (!tombstones.empty() && tombstones.MaxCoveringSequence(ikey.user_key, compact->smallest_snapshot) > ikey.sequence)
+                {
+                    // Deleted by a range tombstone that every snapshot sees
+                    drop = true;
                 }
                 
                 last_sequence_for_key = ikey.sequence;
@@ -1086,14 +1418,25 @@ namespace leveldb
                 }
                 compact->current_output()->largest.DecodeFrom(key);
                 compact->builder->Add(key, input->value());
+                compact->current_output()->num_entries++;
+                if (has_current_user_key && ikey.type == kTypeDeletion)
+                {
+                    compact->current_output()->num_deletions++;
+                }
                 
                 // Close output file if it is big enough
                 if (compact->builder->FileSize() >= compact->compaction->MaxOutputFileSize())
                 {
-                    status = FinishCompactionOutputFile(compact, input);
-                    if (!status.ok())
+                    if (tombstones.empty())
                     {
-                        break;
+                        status = FinishCompactionOutputFile(compact, input);
+                        if (!status.ok())
+                        {
+                            break;
+                        }
+                    } else
+                    {
+                        finish_pending = true;
                     }
                 }
             }
@@ -1105,6 +1448,15 @@ namespace leveldb
         {
             status = Status::IOError("Deleting DB during compaction");
         }
+        if (status.ok() && !tombstones.empty())
+        {
+            Slice end;
+            if (compact->end != NULL)
+            {
+                end = *compact->end;
+            }
+            status = AddRangeTombstonesToOutput(compact, tombstones, compact->end != NULL ? &end : NULL);
+        }
         if (status.ok() && compact->builder != NULL)
         {
             status = FinishCompactionOutputFile(compact, input);
@@ -1115,9 +1467,46 @@ namespace leveldb
         }
         delete input;
         input = NULL;
+        return status;
+    }
+    
+    Status DBImpl::DoCompactionWork(CompactionState* compact)
+    {
+        const uint64_t start_micros = env_->NowMicros();
+        
+        Log(options_.info_log,  "Compacting %d@%d + %d@%d files",
+            compact->compaction->num_input_files(0),
+            compact->compaction->level(),
+            compact->compaction->num_input_files(1),
+            compact->compaction->level() + 1);
+        
+        assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+        assert(compact->builder == NULL);
+        assert(compact->outfile == NULL);
+        if (snapshots_.empty())
+        {
+            compact->smallest_snapshot = versions_->LastSequence();
+        } else
+        {
+            compact->smallest_snapshot = snapshots_.oldest()->number_;
+        }
+        
+        // Release mutex while we're actually doing the compaction work
+        mutex_.Unlock();
+        
+        std::vector<std::string> boundaries;
+        versions_->GetSubcompactionBoundaries(compact->compaction, options_.max_subcompactions, &boundaries);
+        Status status;
+        if (boundaries.empty())
+        {
+            status = DoCompactionRange(compact);
+        } else
+        {
+            status = RunSubcompactions(compact, boundaries);
+        }
         
         CompactionStats stats;
-        stats.micros = env_->NowMicros() - start_micros - imm_micros;
+        stats.micros = env_->NowMicros() - start_micros;
         for (int which = 0; which < 2; which++)
         {
             for (int i = 0; i < compact->compaction->num_input_files(which); i++)
@@ -1146,55 +1535,314 @@ namespace leveldb
         return status;
     }
     
-    namespace
+    // One key range of a compaction that has been split across threads
+    struct DBImpl::SubcompactionJob
     {
-        struct IterState
-        {
-            port::Mutex* mu;
-            Version* version;
-            MemTable* mem;
-            MemTable* imm;
-        };
+        CompactionState* state;
+        Status status;
+    };
+    
+    // The pieces of a split compaction.  Each goes to the first thread that
+    // asks for it: a LOW pool thread scheduled for it, or the compaction's
+    // own thread, which takes the pieces the pool has not got to rather than
+    // wait behind other work.  Pool calls may run after the compaction is
+    // over, so the batch is reference counted and has its own mutex.
+    struct DBImpl::SubcompactionBatch
+    {
+        DBImpl* db;
+        port::Mutex mu;
+        port::CondVar cv;               // Signalled when a piece is finished
+        std::vector<SubcompactionJob> jobs;
+        size_t next_job;                // First piece no thread has taken
+        size_t running;                 // Pieces taken but not finished
+        int refs;                       // Compaction thread and pending pool calls
         
-        static void CleanupIteratorState(void* arg1, void* arg2)
+        SubcompactionBatch() : cv(&mu), next_job(0), running(0), refs(0) { }
+        
+        // Run pieces until none are left to take.
+        void RunJobs()
         {
-            IterState* state = reinterpret_cast<IterState*>(arg1);
-            state->mu->Lock();
-            state->mem->Unref();
-            if (state->imm != NULL) state->imm->Unref();
-            state->version->Unref();
-            state->mu->Unlock();
-            delete state;
+            MutexLock l(&mu);
+            while (next_job < jobs.size())
+            {
+                SubcompactionJob* job = &jobs[next_job++];
+                running++;
+                mu.Unlock();
+                job->status = db->DoCompactionRange(job->state);
+                mu.Lock();
+                running--;
+                cv.SignalAll();
+            }
         }
-    }  // namespace
+        
+        void Unref()
+        {
+            mu.Lock();
+            const bool last = (--refs == 0);
+            mu.Unlock();
+            if (last)
+            {
+                delete this;
+            }
+        }
+    };
     
-    Iterator* DBImpl::NewInternalIterator(const ReadOptions& options, SequenceNumber* latest_snapshot, uint32_t* seed)
+    void DBImpl::BGWorkSubcompaction(void* arg)
     {
-        IterState* cleanup = new IterState;
+        SubcompactionBatch* batch = reinterpret_cast<SubcompactionBatch*>(arg);
+        batch->RunJobs();
+        batch->Unref();
+    }
+    
+    Status DBImpl::RunSubcompactions(CompactionState* compact, const std::vector<std::string>& boundaries)
+    {
+        const size_t n = boundaries.size() + 1;
+        SubcompactionBatch* batch = new SubcompactionBatch;
+        batch->db = this;
+        batch->jobs.resize(n);
+        batch->refs = n;
+        mutex_.Lock();
+        for (size_t i = 0; i < n; i++)
+        {
+            CompactionState* state = new CompactionState(versions_->NewSubcompaction(compact->compaction));
+            state->smallest_snapshot = compact->smallest_snapshot;
+            state->begin = (i == 0 ? NULL : &boundaries[i - 1]);
+            state->end = (i == n - 1 ? NULL : &boundaries[i]);
+            batch->jobs[i].state = state;
+        }
+        mutex_.Unlock();
+        
+        Log(options_.info_log, "Compaction split into %d subcompactions", static_cast<int>(n));
+        for (size_t i = 1; i < n; i++)
+        {
+            env_->Schedule(&DBImpl::BGWorkSubcompaction, batch, Env::LOW);
+        }
+        batch->RunJobs();
+        {
+            MutexLock l(&batch->mu);
+            while (batch->running > 0)
+            {
+                batch->cv.Wait();
+            }
+        }
+        
         mutex_.Lock();
+        // Hand all outputs to "compact", in key order, so that they are
+        // installed by one edit and released by CleanupCompaction().
+        Status status;
+        for (size_t i = 0; i < n; i++)
+        {
+            CompactionState* state = batch->jobs[i].state;
+            if (status.ok())
+            {
+                status = batch->jobs[i].status;
+            }
+            compact->outputs.insert(compact->outputs.end(), state->outputs.begin(), state->outputs.end());
+            compact->total_bytes += state->total_bytes;
+            state->outputs.clear();
+            delete state->compaction;
+            CleanupCompaction(state);
+        }
+        mutex_.Unlock();
+        batch->Unref();
+        return status;
+    }
+    
+    struct DBImpl::SuperVersion
+    {
+        DBImpl* db;
+        MemTable* mem;
+        MemTable* imm;
+        Version* current;
+        port::AtomicUint64 refs;
+        
+        SuperVersion* Ref()
+        {
+            refs.FetchAdd(1);
+            return this;
+        }
+        
+        // Returns true if the last reference was dropped.
+        bool Unref()
+        {
+            uint64_t old_refs = refs.FetchAdd(static_cast<uint64_t>(-1));
+            assert(old_refs > 0);
+            return old_refs == 1;
+        }
+    };
+    
+    namespace
+    {
+        // Marks a thread-local slot whose SuperVersion is being used by its
+        // thread.  A NULL slot holds nothing, either because the thread has
+        // not read yet or because InstallSuperVersion() emptied it.
+        static char sv_in_use_dummy;
+        static void* const kSVInUse = &sv_in_use_dummy;
+    }  // namespace
+    
+    void DBImpl::InstallSuperVersion()
+    {
+        mutex_.AssertHeld();
+        SuperVersion* sv = new SuperVersion;
+        sv->db = this;
+        sv->mem = mem_;
+        sv->imm = imm_;
+        sv->current = versions_->current();
+        sv->mem->Ref();
+        if (sv->imm != NULL) sv->imm->Ref();
+        sv->current->Ref();
+        sv->refs.NoBarrier_Store(1);
+        
+        SuperVersion* old = super_version_;
+        super_version_ = sv;
+        
+        std::vector<void*> cached;
+        local_sv_->Scrape(&cached, NULL);
+        for (size_t i = 0; i < cached.size(); i++)
+        {
+            // A thread using its copy drops it in ReturnSuperVersion()
+            if (cached[i] != kSVInUse)
+            {
+                UnrefSuperVersionLocked(static_cast<SuperVersion*>(cached[i]));
+            }
+        }
+        if (old != NULL)
+        {
+            UnrefSuperVersionLocked(old);
+        }
+    }
+    
+    DBImpl::SuperVersion* DBImpl::AcquireSuperVersion()
+    {
+        void* ptr = local_sv_->Swap(kSVInUse);
+        assert(ptr != kSVInUse);
+        SuperVersion* sv = static_cast<SuperVersion*>(ptr);
+        if (sv == NULL)
+        {
+            MutexLock l(&mutex_);
+            sv = super_version_->Ref();
+        }
+        return sv;
+    }
+    
+    void DBImpl::ReturnSuperVersion(SuperVersion* sv)
+    {
+        if (!local_sv_->CompareAndSwap(kSVInUse, sv))
+        {
+            // A newer SuperVersion was installed while sv was in use
+            UnrefSuperVersion(sv);
+        }
+    }
+    
+    void DBImpl::UnrefSuperVersion(SuperVersion* sv)
+    {
+        if (sv->Unref())
+        {
+            MutexLock l(&mutex_);
+            CleanupSuperVersion(sv);
+        }
+    }
+    
+    void DBImpl::UnrefSuperVersionLocked(SuperVersion* sv)
+    {
+        mutex_.AssertHeld();
+        if (sv->Unref())
+        {
+            CleanupSuperVersion(sv);
+        }
+    }
+    
+    void DBImpl::CleanupSuperVersion(SuperVersion* sv)
+    {
+        mutex_.AssertHeld();
+        sv->mem->Unref();
+        if (sv->imm != NULL) sv->imm->Unref();
+        sv->current->Unref();
+        delete sv;
+    }
+    
+    void DBImpl::UnrefSuperVersionHandler(void* ptr)
+    {
+        SuperVersion* sv = static_cast<SuperVersion*>(ptr);
+        sv->db->UnrefSuperVersion(sv);
+    }
+    
+    void DBImpl::CleanupIteratorState(void* arg1, void* arg2)
+    {
+        UnrefSuperVersionHandler(arg1);
+    }
+    
+    // Adds the range tombstones of "mem", if any, to *range_del.
+    static Status AddMemTableRangeTombstones(MemTable* mem, const Comparator* ucmp, RangeDelAggregator* range_del)
+    {
+        Iterator* iter = mem->NewRangeTombstoneIterator();
+        if (iter == NULL)
+        {
+            return Status::OK();
+        }
+        RangeTombstoneList* list = new RangeTombstoneList(ucmp);
+        Status s = list->AddFrom(iter);
+        delete iter;
+        list->Finish();
+        range_del->AddOwnedList(list);
+        return s;
+    }
+    
+    Iterator* DBImpl::NewInternalIterator(const ReadOptions& options, SequenceNumber* latest_snapshot, uint32_t* seed,
+                                          RangeDelAggregator** range_del)
+    {
+        // Take our own reference while the thread-local one keeps sv alive.
+        SuperVersion* sv = AcquireSuperVersion();
+        sv->Ref();
+        ReturnSuperVersion(sv);
+        
+        // Read the sequence after pinning sv so that compactions cannot
+        // have dropped entries it needs.
         *latest_snapshot = versions_->LastSequence();
         
+        if (range_del != NULL)
+        {
+            const SequenceNumber snapshot = (options.snapshot != NULL ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_ : *latest_snapshot);
+            RangeDelAggregator* aggregator = new RangeDelAggregator(snapshot);
+            const RangeTombstoneList* version_list = NULL;
+            Status s = AddMemTableRangeTombstones(sv->mem, user_comparator(), aggregator);
+            if (s.ok() && sv->imm != NULL)
+            {
+                s = AddMemTableRangeTombstones(sv->imm, user_comparator(), aggregator);
+            }
+            if (s.ok())
+            {
+                // The list stays valid while the iterator keeps sv alive
+                s = sv->current->GetRangeTombstones(&version_list);
+            }
+            if (!s.ok())
+            {
+                delete aggregator;
+                UnrefSuperVersion(sv);
+                *range_del = NULL;
+                return NewErrorIterator(s);
+            }
+            aggregator->AddList(version_list);
+            if (aggregator->empty())
+            {
+                delete aggregator;
+                aggregator = NULL;
+            }
+            *range_del = aggregator;
+        }
+        
         // Collect together all needed child iterators
         std::vector<Iterator*> list;
-        list.push_back(mem_->NewIterator());
-        mem_->Ref();
-        if (imm_ != NULL)
+        list.push_back(sv->mem->NewIterator());
+        if (sv->imm != NULL)
         {
-            list.push_back(imm_->NewIterator());
-            imm_->Ref();
+            list.push_back(sv->imm->NewIterator());
         }
-        versions_->current()->AddIterators(options, &list);
+        sv->current->AddIterators(options, &list);
         Iterator* internal_iter = NewMergingIterator(&internal_comparator_, &list[0], list.size());
-        versions_->current()->Ref();
+        internal_iter->RegisterCleanup(CleanupIteratorState, sv, NULL);
         
-        cleanup->mu = &mutex_;
-        cleanup->mem = mem_;
-        cleanup->imm = imm_;
-        cleanup->version = versions_->current();
-        internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
-        
-        *seed = ++seed_;
-        mutex_.Unlock();
+        *seed = static_cast<uint32_t>(seed_.FetchAdd(1) + 1);
         return internal_iter;
     }
     
@@ -1214,7 +1862,7 @@ namespace leveldb
     Status DBImpl::Get(const ReadOptions& options, const Slice& key, std::string* value)
     {
         Status s;
-        MutexLock l(&mutex_);
+        SuperVersion* sv = AcquireSuperVersion();
         SequenceNumber snapshot;
         if (options.snapshot != NULL)
         {
@@ -1224,51 +1872,163 @@ namespace leveldb
             snapshot = versions_->LastSequence();
         }
         
-        MemTable* mem = mem_;
-        MemTable* imm = imm_;
-        Version* current = versions_->current();
-        mem->Ref();
-        if (imm != NULL) imm->Ref();
-        current->Ref();
-        
         bool have_stat_update = false;
         Version::GetStats stats;
         
-        // Unlock while reading from files and memtables
+        // First look in the memtable, then in the immutable memtable (if any).
+        LookupKey lkey(key, snapshot);
+        if (sv->mem->Get(lkey, value, &s))
         {
-            mutex_.Unlock();
-            // First look in the memtable, then in the immutable memtable (if any).
-            LookupKey lkey(key, snapshot);
-            if (mem->Get(lkey, value, &s))
+            // Done
+        } else if (sv->imm != NULL && sv->imm->Get(lkey, value, &s))
+        {
+            // Done
+        } else
+        {
+            s = sv->current->Get(options, lkey, value, &stats);
+            have_stat_update = true;
+        }
+        
+        // Only reads that had to look at more than one file charge a seek.
+        if (have_stat_update && stats.seek_file != NULL)
+        {
+            MutexLock l(&mutex_);
+            if (sv->current->UpdateStats(stats))
             {
-                // Done
-            } else if (imm != NULL && imm->Get(lkey, value, &s))
+                MaybeScheduleCompaction();
+            }
+        }
+        ReturnSuperVersion(sv);
+        return s;
+    }
+    
+    namespace
+    {
+        // Orders positions in a vector of keys by user key
+        struct KeyIndexLess
+        {
+            const Comparator* ucmp;
+            const std::vector<Slice>* keys;
+            bool operator()(size_t a, size_t b) const
             {
-                // Done
-            } else
+                return ucmp->Compare((*keys)[a], (*keys)[b]) < 0;
+            }
+        };
+    }  // namespace
+    
+    std::vector<Status> DBImpl::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys, std::vector<std::string>* values)
+    {
+        const size_t n = keys.size();
+        std::vector<Status> statuses(n);
+        values->resize(n);
+        
+        SuperVersion* sv = AcquireSuperVersion();
+        SequenceNumber snapshot;
+        if (options.snapshot != NULL)
+        {
+            snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+        } else
+        {
+            snapshot = versions_->LastSequence();
+        }
+        
+        MemTable* mem = sv->mem;
+        MemTable* imm = sv->imm;
+        Version* current = sv->current;
+        std::vector<Version::GetStats> stats;
+        
+        {
+            // Sort the keys so that keys in the same file are looked up together.
+            std::vector<size_t> order(n);
+            for (size_t i = 0; i < n; i++)
             {
-                s = current->Get(options, lkey, value, &stats);
-                have_stat_update = true;
+                order[i] = i;
+            }
+            KeyIndexLess less;
+            less.ucmp = user_comparator();
+            less.keys = &keys;
+            std::sort(order.begin(), order.end(), less);
+            
+            // First look in the memtables; keys not resolved there are looked
+            // up in the current version, still in sorted order.
+            std::vector<LookupKey*> lkeys(n);
+            std::vector<const LookupKey*> pending_keys;
+            std::vector<std::string*> pending_values;
+            std::vector<size_t> pending_index;
+            for (size_t j = 0; j < n; j++)
+            {
+                const size_t i = order[j];
+                lkeys[i] = new LookupKey(keys[i], snapshot);
+                std::string* value = &(*values)[i];
+                if (mem->Get(*lkeys[i], value, &statuses[i]))
+                {
+                    // Done
+                } else if (imm != NULL && imm->Get(*lkeys[i], value, &statuses[i]))
+                {
+                    // Done
+                } else
+                {
+                    pending_keys.push_back(lkeys[i]);
+                    pending_values.push_back(value);
+                    pending_index.push_back(i);
+                }
+            }
+            
+            if (!pending_keys.empty())
+            {
+                const size_t m = pending_keys.size();
+                std::vector<Status> pending_statuses(m);
+                stats.resize(m);
+                current->MultiGet(options, m, &pending_keys[0], &pending_values[0], &pending_statuses[0], &stats[0]);
+                for (size_t j = 0; j < m; j++)
+                {
+                    statuses[pending_index[j]] = pending_statuses[j];
+                }
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                delete lkeys[i];
             }
-            mutex_.Lock();
         }
         
-        if (have_stat_update && current->UpdateStats(stats))
+        bool have_seek = false;
+        for (size_t j = 0; j < stats.size(); j++)
         {
-            MaybeScheduleCompaction();
+            if (stats[j].seek_file != NULL)
+            {
+                have_seek = true;
+            }
         }
-        mem->Unref();
-        if (imm != NULL) imm->Unref();
-        current->Unref();
-        return s;
+        if (have_seek)
+        {
+            MutexLock l(&mutex_);
+            bool need_compaction = false;
+            for (size_t j = 0; j < stats.size(); j++)
+            {
+                if (current->UpdateStats(stats[j]))
+                {
+                    need_compaction = true;
+                }
+            }
+            if (need_compaction)
+            {
+                MaybeScheduleCompaction();
+            }
+        }
+        ReturnSuperVersion(sv);
+        return statuses;
     }
     
     Iterator* DBImpl::NewIterator(const ReadOptions& options)
     {
         SequenceNumber latest_snapshot;
         uint32_t seed;
-        Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-        return NewDBIterator(this, user_comparator(), iter, (options.snapshot != NULL ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_ : latest_snapshot), seed);
+        RangeDelAggregator* range_del;
+        Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed, &range_del);
+        const SliceTransform* prefix_extractor = internal_prefix_extractor_.user_transform();
+        return NewDBIterator(this, user_comparator(), iter, (options.snapshot != NULL ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_ : latest_snapshot), seed,
+                             options.iterate_lower_bound, options.iterate_upper_bound,
+                             options.prefix_seek ? prefix_extractor : NULL, range_del);
     }
     
     void DBImpl::RecordReadSample(Slice key)
@@ -1312,8 +2072,30 @@ namespace leveldb
         
         MutexLock l(&mutex_);
         writers_.push_back(&w);
-        while (!w.done && &w != writers_.front())
+        // With pipelined writes, followers leave writers_ once their group
+        // has been logged and wait here until it reaches the memtable.
+        while (!w.done && (writers_.empty() || &w != writers_.front()))
         {
+            if (w.insert_leader != NULL)
+            {
+                // Our batch has been logged by the group leader; apply it to
+                // the memtable alongside the rest of the group.
+                Writer* leader = w.insert_leader;
+                MemTable* mem = mem_;
+                mutex_.Unlock();
+                Status s = WriteBatchInternal::InsertInto(w.batch, mem, true);
+                mutex_.Lock();
+                w.insert_leader = NULL;
+                if (!s.ok() && leader->status.ok())
+                {
+                    leader->status = s;
+                }
+                if (--leader->pending_inserts == 0)
+                {
+                    leader->cv.Signal();
+                }
+                continue;
+            }
             w.cv.Wait();
         }
         if (w.done)
@@ -1324,11 +2106,35 @@ namespace leveldb
         // May temporarily unlock and wait.
         Status status = MakeRoomForWrite(my_batch == NULL);
         uint64_t last_sequence = versions_->LastSequence();
+        if (!memtable_writers_.empty())
+        {
+            // Account for groups that are logged but not yet applied.
+            last_sequence = memtable_writers_.back()->last_sequence;
+        }
         Writer* last_writer = &w;
+        // A pipelined group outlives the next group's use of tmp_batch_.
+        WriteBatch group_batch;
+        const bool pipelined = options_.enable_pipelined_write;
         if (status.ok() && my_batch != NULL)
         {  // NULL batch is for compactions
-            WriteBatch* updates = BuildBatchGroup(&last_writer);
+            WriteBatch* updates = BuildBatchGroup(&last_writer, pipelined ? &group_batch : tmp_batch_);
             WriteBatchInternal::SetSequence(updates, last_sequence + 1);
+            // Only worth it if the group holds more than one batch.
+            const bool parallel_insert = !pipelined && options_.allow_concurrent_memtable_write && updates != my_batch;
+            if (parallel_insert)
+            {
+                // Give every batch its own range of the group's sequence numbers.
+                SequenceNumber seq = last_sequence + 1;
+                for (std::deque<Writer*>::iterator iter = writers_.begin(); ; ++iter)
+                {
+                    if ((*iter)->batch != NULL)
+                    {
+                        WriteBatchInternal::SetSequence((*iter)->batch, seq);
+                        seq += WriteBatchInternal::Count((*iter)->batch);
+                    }
+                    if (*iter == last_writer) break;
+                }
+            }
             last_sequence += WriteBatchInternal::Count(updates);
             
             // Add to log and apply to memtable.  We can release the lock
@@ -1347,7 +2153,7 @@ namespace leveldb
                         sync_error = true;
                     }
                 }
-                if (status.ok())
+                if (status.ok() && !parallel_insert && !pipelined)
                 {
                     status = WriteBatchInternal::InsertInto(updates, mem_);
                 }
@@ -1360,6 +2166,14 @@ namespace leveldb
                     RecordBackgroundError(status);
                 }
             }
+            if (status.ok() && parallel_insert)
+            {
+                status = InsertBatchGroup(&w, last_writer);
+            }
+            if (pipelined)
+            {
+                return ApplyPipelinedGroup(&w, last_writer, updates, last_sequence, status);
+            }
             if (updates == tmp_batch_) tmp_batch_->Clear();
             
             versions_->SetLastSequence(last_sequence);
@@ -1387,9 +2201,115 @@ namespace leveldb
         return status;
     }
     
+    // REQUIRES: mutex_ is held
+    // REQUIRES: "leader" is at the front of the writer queue and its group,
+    // which ends at "last_writer", has been logged
+    Status DBImpl::InsertBatchGroup(Writer* leader, Writer* last_writer)
+    {
+        mutex_.AssertHeld();
+        assert(writers_.front() == leader);
+        MemTable* mem = mem_;
+        leader->status = Status::OK();
+        leader->pending_inserts = 0;
+        if (leader != last_writer)
+        {
+            std::deque<Writer*>::iterator iter = writers_.begin();
+            ++iter;  // Advance past "leader"
+            for (; ; ++iter)
+            {
+                Writer* w = *iter;
+                if (w->batch != NULL)
+                {
+                    w->insert_leader = leader;
+                    leader->pending_inserts++;
+                    w->cv.Signal();
+                }
+                if (w == last_writer) break;
+            }
+        }
+        
+        mutex_.Unlock();
+        Status status = WriteBatchInternal::InsertInto(leader->batch, mem, true);
+        mutex_.Lock();
+        while (leader->pending_inserts > 0)
+        {
+            leader->cv.Wait();
+        }
+        if (status.ok())
+        {
+            // Errors reported by the followers
+            status = leader->status;
+        }
+        return status;
+    }
+    
+    // REQUIRES: mutex_ is held
+    // REQUIRES: "leader" is at the front of the writer queue and its group,
+    // which ends at "last_writer" and holds "updates", has been logged with
+    // result "status"
+    Status DBImpl::ApplyPipelinedGroup(Writer* leader, Writer* last_writer, WriteBatch* updates, SequenceNumber last_sequence, Status status)
+    {
+        mutex_.AssertHeld();
+        assert(writers_.front() == leader);
+        
+        // Leave the writer queue so that the next group can write its log
+        // record while this one is applied to the memtable.
+        std::vector<Writer*> group;
+        while (true)
+        {
+            Writer* ready = writers_.front();
+            writers_.pop_front();
+            group.push_back(ready);
+            if (ready == last_writer) break;
+        }
+        if (!writers_.empty())
+        {
+            writers_.front()->cv.Signal();
+        }
+        
+        // Groups reach the memtable in log order, so each one publishes
+        // sequence numbers whose data is already there.
+        leader->last_sequence = last_sequence;
+        memtable_writers_.push_back(leader);
+        while (memtable_writers_.front() != leader)
+        {
+            leader->cv.Wait();
+        }
+        
+        if (status.ok())
+        {
+            // mem_ is not switched while memtable_writers_ is non-empty.
+            MemTable* mem = mem_;
+            mutex_.Unlock();
+            status = WriteBatchInternal::InsertInto(updates, mem);
+            mutex_.Lock();
+        }
+        versions_->SetLastSequence(last_sequence);
+        memtable_writers_.pop_front();
+        
+        for (size_t i = 0; i < group.size(); i++)
+        {
+            if (group[i] != leader)
+            {
+                group[i]->status = status;
+                group[i]->done = true;
+                group[i]->cv.Signal();
+            }
+        }
+        if (!memtable_writers_.empty())
+        {
+            memtable_writers_.front()->cv.Signal();
+        } else if (!writers_.empty())
+        {
+            // May be waiting in MakeRoomForWrite() for us to finish
+            writers_.front()->cv.Signal();
+        }
+        return status;
+    }
+    
     // REQUIRES: Writer list must be non-empty
     // REQUIRES: First writer must have a non-NULL batch
-    WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer)
+    WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer, WriteBatch* scratch)
     {
         assert(!writers_.empty());
         Writer* first = writers_.front();
@@ -1432,7 +2352,7 @@ namespace leveldb
                 if (result == first->batch)
                 {
                     // Switch to temporary batch instead of disturbing caller's batch
-                    result = tmp_batch_;
+                    result = scratch;
                     assert(WriteBatchInternal::Count(result) == 0);
                     WriteBatchInternal::Append(result, first->batch);
                 }
@@ -1485,6 +2405,10 @@ namespace leveldb
                 // There are too many level-0 files.
                 Log(options_.info_log, "Too many L0 files; waiting...\n");
                 bg_cv_.Wait();
+            } else if (!memtable_writers_.empty())
+            {
+                // Pipelined groups are still being applied to mem_.
+                writers_.front()->cv.Wait();
             } else
             {
                 // Attempt to switch to a new memtable and trigger compaction of old
@@ -1504,9 +2428,9 @@ namespace leveldb
                 logfile_number_ = new_log_number;
                 log_ = new log::Writer(lfile);
                 imm_ = mem_;
-                has_imm_.Release_Store(imm_);
                 mem_ = new MemTable(internal_comparator_);
                 mem_->Ref();
+                InstallSuperVersion();
                 force = false;   // Do not force another compaction if have room
                 MaybeScheduleCompaction();
             }
@@ -1569,6 +2493,25 @@ namespace leveldb
         {
             *value = versions_->current()->DebugString();
             return true;
+        } else if (in == "block-cache-stats")
+        {
+            static const char* kKindNames[BlockCacheStats::kNumKinds] = { "data", "index", "filter", "row", "compressed", "persistent" };
+            const BlockCacheStats& stats = table_cache_->block_cache_stats();
+            char buf[200];
+            snprintf(buf, sizeof(buf), "%-10s %12s %12s %8s\n", "Block", "Hits", "Misses", "HitRate");
+            value->append(buf);
+            for (int kind = 0; kind < BlockCacheStats::kNumKinds; kind++)
+            {
+                uint64_t hits = stats.hits[kind].NoBarrier_Load();
+                uint64_t misses = stats.misses[kind].NoBarrier_Load();
+                snprintf(buf, sizeof(buf), "%-10s %12llu %12llu %8.4f\n",
+                         kKindNames[kind],
+                         static_cast<unsigned long long>(hits),
+                         static_cast<unsigned long long>(misses),
+                         hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0);
+                value->append(buf);
+            }
+            return true;
         }
         
         return false;
@@ -1616,6 +2559,39 @@ namespace leveldb
         return Write(opt, &batch);
     }
     
+    Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin, const Slice& end)
+    {
+        WriteBatch batch;
+        batch.DeleteRange(begin, end);
+        return Write(opt, &batch);
+    }
+    
+    Status DB::DeleteFilesInRange(const Slice* begin, const Slice* end)
+    {
+        return Status::NotSupported("DeleteFilesInRange");
+    }
+    
+    std::vector<Status> DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys, std::vector<std::string>* values)
+    {
+        // Read every key from the same state of the database.
+        ReadOptions read_options = options;
+        if (options.snapshot == NULL)
+        {
+            read_options.snapshot = GetSnapshot();
+        }
+        std::vector<Status> result(keys.size());
+        values->resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            result[i] = Get(read_options, keys[i], &(*values)[i]);
+        }
+        if (options.snapshot == NULL)
+        {
+            ReleaseSnapshot(read_options.snapshot);
+        }
+        return result;
+    }
+    
     DB::~DB() { }
     
     Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr)
@@ -1637,7 +2613,7 @@ namespace leveldb
                 impl->logfile_ = lfile;
                 impl->logfile_number_ = new_log_number;
                 impl->log_ = new log::Writer(lfile);
-                s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+                s = impl->LogAndApply(&edit);
             }
             if (s.ok())
             {
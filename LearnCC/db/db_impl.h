@@ -7,6 +7,7 @@
 
 #include <deque>
 #include <set>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
@@ -18,8 +19,12 @@
 namespace leveldb
 {
     
+    class Compaction;
     class MemTable;
+    class RangeDelAggregator;
+    class RangeTombstoneList;
     class TableCache;
+    class ThreadLocalPtr;
     class Version;
     class VersionEdit;
     class VersionSet;
@@ -35,12 +40,14 @@ namespace leveldb
         virtual Status Delete(const WriteOptions&, const Slice& key);
         virtual Status Write(const WriteOptions& options, WriteBatch* updates);
         virtual Status Get(const ReadOptions& options, const Slice& key, std::string* value);
+        virtual std::vector<Status> MultiGet(const ReadOptions& options, const std::vector<Slice>& keys, std::vector<std::string>* values);
         virtual Iterator* NewIterator(const ReadOptions&);
         virtual const Snapshot* GetSnapshot();
         virtual void ReleaseSnapshot(const Snapshot* snapshot);
         virtual bool GetProperty(const Slice& property, std::string* value);
         virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
         virtual void CompactRange(const Slice* begin, const Slice* end);
+        virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
         
         // Extra methods (for testing) that are not in the public DB interface
         
@@ -67,9 +74,34 @@ namespace leveldb
     private:
         friend class DB;
         struct CompactionState;
+        struct SubcompactionJob;
+        struct SubcompactionBatch;
+        struct SuperVersion;
         struct Writer;
         
-        Iterator* NewInternalIterator(const ReadOptions&, SequenceNumber* latest_snapshot, uint32_t* seed);
+        // If "range_del" is non-NULL, also stores in *range_del the range
+        // tombstones that apply to the returned iterator at the snapshot of
+        // the read, or NULL if there are none.
+        Iterator* NewInternalIterator(const ReadOptions&, SequenceNumber* latest_snapshot, uint32_t* seed,
+                                      RangeDelAggregator** range_del = NULL);
+        
+        // Replace super_version_ with one built from mem_, imm_ and the
+        // current version, and drop the copies cached by reader threads.
+        void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        
+        // Return the latest SuperVersion, normally the one cached by the
+        // calling thread, without taking mutex_.  It stays valid until it is
+        // handed back with ReturnSuperVersion() by the same thread.
+        SuperVersion* AcquireSuperVersion();
+        void ReturnSuperVersion(SuperVersion* sv);
+        
+        // Drop a reference to sv, cleaning it up if it was the last one.
+        // Acquires mutex_ in that case, so must be called without it.
+        void UnrefSuperVersion(SuperVersion* sv);
+        void UnrefSuperVersionLocked(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        void CleanupSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        static void UnrefSuperVersionHandler(void* ptr);
+        static void CleanupIteratorState(void* arg1, void* arg2);
         
         Status NewDB();
         
@@ -90,28 +122,49 @@ namespace leveldb
         
         Status RecoverLogFile(uint64_t log_number, VersionEdit* edit, SequenceNumber* max_sequence) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
         
-        Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        // Options for writing a table to "level", with the compression
+        // chosen by options_.compression_per_level.
+        Options TableOptionsForLevel(int level) const;
+        
+        Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base, uint64_t* pending_number = NULL) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
         
         Status MakeRoomForWrite(bool force /* compact even if there is room? */) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-        WriteBatch* BuildBatchGroup(Writer** last_writer);
+        WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* scratch);
+        Status InsertBatchGroup(Writer* leader, Writer* last_writer) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        Status ApplyPipelinedGroup(Writer* leader, Writer* last_writer, WriteBatch* updates, SequenceNumber last_sequence, Status status) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
         
         void RecordBackgroundError(const Status& s);
         
+        // Apply *edit to the current version.  Unlike VersionSet::LogAndApply()
+        // this may be called concurrently from several background threads.
+        Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        
         void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
         static void BGWork(void* db);
+        static void BGWorkFlush(void* db);
         void BackgroundCall();
+        void BackgroundFlushCall();
         void  BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
         void CleanupCompaction(CompactionState* compact) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
         Status DoCompactionWork(CompactionState* compact) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        Status DoCompactionRange(CompactionState* compact);
+        Status RunSubcompactions(CompactionState* compact, const std::vector<std::string>& boundaries);
+        static void BGWorkSubcompaction(void* arg);
         
         Status OpenCompactionOutputFile(CompactionState* compact);
         Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+        
+        // Add to the current output, opening one if needed, the parts of
+        // "tombstones" from compact->tombstones_begin up to *upper (or
+        // without limit if upper is NULL) that may still delete data.
+        Status AddRangeTombstonesToOutput(CompactionState* compact, const RangeTombstoneList& tombstones, const Slice* upper);
         Status InstallCompactionResults(CompactionState* compact) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
         
         // Constant after construction
         Env* const env_;
         const InternalKeyComparator internal_comparator_;
         const InternalFilterPolicy internal_filter_policy_;
+        const InternalPrefixTransform internal_prefix_extractor_;
         const Options options_;  // options_.comparator == &internal_comparator_
         bool owns_info_log_;
         bool owns_cache_;
@@ -129,24 +182,44 @@ namespace leveldb
         port::CondVar bg_cv_;          // Signalled when background work finishes
         MemTable* mem_;
         MemTable* imm_;                // Memtable being compacted
-        port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
         WritableFile* logfile_;
         uint64_t logfile_number_;
         log::Writer* log_;
-        uint32_t seed_;                // For sampling.
+        port::AtomicUint64 seed_;      // For sampling.
+        
+        // Latest {mem_, imm_, current version} for readers.  Each reader
+        // thread caches a reference to it in local_sv_; installing a new one
+        // empties those caches.
+        SuperVersion* super_version_;
+        ThreadLocalPtr* local_sv_;
         
         // Queue of writers.
         std::deque<Writer*> writers_;
         WriteBatch* tmp_batch_;
         
+        // Leaders of pipelined write groups that have been logged but not yet
+        // applied to mem_, in log order.
+        std::deque<Writer*> memtable_writers_;
+        
         SnapshotList snapshots_;
         
         // Set of table files to protect from deletion because they are
         // part of ongoing compactions.
         std::set<uint64_t> pending_outputs_;
         
-        // Has a background compaction been scheduled or is running?
-        bool bg_compaction_scheduled_;
+        // Number of background compactions scheduled or running.
+        int bg_compaction_scheduled_;
+        
+        // Has a memtable flush been scheduled or is running?
+        bool bg_flush_scheduled_;
+        
+        // Compactions picked by MaybeScheduleCompaction(), waiting for a
+        // background thread.  Their input files are already claimed.
+        std::deque<Compaction*> compaction_queue_;
+        
+        // Is some thread inside VersionSet::LogAndApply()?
+        bool manifest_writing_;
+        port::CondVar manifest_cv_;    // Signalled when manifest_writing_ drops
         
         // Information for a manual compaction
         struct ManualCompaction
@@ -159,6 +232,16 @@ namespace leveldb
         };
         ManualCompaction* manual_compaction_;
         
+        // Number of DeleteFilesInRange() calls whose files are claimed while
+        // their edit is logged.  A manual compaction does not start while
+        // this is non-zero, since it does not check for busy inputs.
+        int deleting_files_in_range_;
+        
+        // Is a memtable flush logging a table below level 0?  No compaction
+        // is scheduled meanwhile, since it could pick its inputs from the
+        // version without that table and write over its key range.
+        bool flushing_below_level0_;
+        
         VersionSet* versions_;
         
         // Have we encountered a background error in paranoid mode?
@@ -195,7 +278,8 @@ namespace leveldb
     
     // Sanitize db options.  The caller should delete result.info_log if
     // it is not equal to src.info_log.
-    extern Options SanitizeOptions(const std::string& db, const InternalKeyComparator* icmp, const InternalFilterPolicy* ipolicy, const Options& src);
+    extern Options SanitizeOptions(const std::string& db, const InternalKeyComparator* icmp, const InternalFilterPolicy* ipolicy,
+                                   const InternalPrefixTransform* iprefix, const Options& src);
     
 }  // namespace leveldb
 
@@ -7,8 +7,10 @@
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -56,11 +58,18 @@ namespace leveldb
                 kReverse
             };
             
-            DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s, uint32_t seed)
-            : db_(db), user_comparator_(cmp), iter_(iter), sequence_(s), direction_(kForward), valid_(false), rnd_(seed), bytes_counter_(RandomPeriod())
+            DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s, uint32_t seed,
+                   const Slice* lower_bound, const Slice* upper_bound, const SliceTransform* prefix_extractor,
+                   RangeDelAggregator* range_del)
+            : db_(db), user_comparator_(cmp), iter_(iter), sequence_(s), lower_bound_(lower_bound), upper_bound_(upper_bound),
+            prefix_extractor_(prefix_extractor), range_del_(range_del), direction_(kForward), valid_(false), rnd_(seed), bytes_counter_(RandomPeriod())
             {
             }
-            virtual ~DBIter() { delete iter_; }
+            virtual ~DBIter()
+            {
+                delete iter_;
+                delete range_del_;
+            }
             virtual bool Valid() const { return valid_; }
             virtual Slice key() const
             {
@@ -74,12 +83,15 @@ namespace leveldb
             }
             virtual Status status() const
             {
-                if (status_.ok())
+                if (!status_.ok())
                 {
-                    return iter_->status();
+                    return status_;
+                } else if (!seek_status_.ok())
+                {
+                    return seek_status_;
                 } else
                 {
-                    return status_;
+                    return iter_->status();
                 }
             }
             
@@ -93,6 +105,31 @@ namespace leveldb
             void FindNextUserEntry(bool skipping, std::string* skip);
             void FindPrevUserEntry();
             bool ParseKey(ParsedInternalKey* key);
+            void SeekInternal(const Slice& user_key);
+            
+            // A value deleted by a range tombstone is handled as if a
+            // deletion marker had replaced it.
+            inline void ApplyRangeTombstones(ParsedInternalKey* ikey) const
+            {
+                if (range_del_ != NULL && ikey->type == kTypeValue && range_del_->ShouldDelete(*ikey))
+                {
+                    ikey->type = kTypeDeletion;
+                }
+            }
+            
+            // Returns true iff "user_key" may be yielded: it is not past the
+            // upper bound (or before the lower bound if !forward) and it
+            // has the prefix of the last Seek() in prefix mode.
+            inline bool InRange(const Slice& user_key, bool forward) const
+            {
+                if (forward ? (upper_bound_ != NULL && user_comparator_->Compare(user_key, *upper_bound_) >= 0)
+                    : (lower_bound_ != NULL && user_comparator_->Compare(user_key, *lower_bound_) < 0))
+                {
+                    return false;
+                }
+                return (prefix_extractor_ == NULL ||
+                        (prefix_extractor_->InDomain(user_key) && prefix_extractor_->Transform(user_key) == Slice(prefix_)));
+            }
             
             inline void SaveKey(const Slice& k, std::string* dst)
             {
@@ -121,8 +158,14 @@ namespace leveldb
             const Comparator* const user_comparator_;
             Iterator* const iter_;
             SequenceNumber const sequence_;
+            const Slice* const lower_bound_;    // NULL if there is no lower bound
+            const Slice* const upper_bound_;    // NULL if there is no upper bound
+            const SliceTransform* const prefix_extractor_;  // Non-NULL in prefix mode
+            std::string prefix_;        // Of the last Seek() target in prefix mode
+            RangeDelAggregator* const range_del_;   // NULL if there are no range tombstones
             
             Status status_;
+            Status seek_status_;        // Why the last positioning call failed
             std::string saved_key_;     // == current key when direction_==kReverse
             std::string saved_value_;   // == current raw value when direction_==kReverse
             Direction direction_;
@@ -168,7 +211,17 @@ namespace leveldb
                 // use the normal skipping code below.
                 if (!iter_->Valid())
                 {
-                    iter_->SeekToFirst();
+                    if (lower_bound_ != NULL || prefix_extractor_ != NULL)
+                    {
+                        // Start from the entries for this->key(), as the
+                        // entries before the range may have been skipped.
+                        std::string start;
+                        AppendInternalKey(&start, ParsedInternalKey(saved_key_, kMaxSequenceNumber, kValueTypeForSeek));
+                        iter_->Seek(start);
+                    } else
+                    {
+                        iter_->SeekToFirst();
+                    }
                 } else
                 {
                     iter_->Next();
@@ -196,8 +249,16 @@ namespace leveldb
             assert(direction_ == kForward);
             do {
                 ParsedInternalKey ikey;
-                if (ParseKey(&ikey) && ikey.sequence <= sequence_)
+                if (!ParseKey(&ikey))
                 {
+                    // Skip corrupted entries
+                } else if (!InRange(ikey.user_key, true))
+                {
+                    // Past the end of the range, deleted or not
+                    break;
+                } else if (ikey.sequence <= sequence_)
+                {
+                    ApplyRangeTombstones(&ikey);
                     switch (ikey.type)
                     {
                         case kTypeDeletion:
@@ -218,6 +279,9 @@ namespace leveldb
                                 return;
                             }
                             break;
+                        case kTypeRangeDeletion:
+                            // Kept apart from the entries iterated over
+                            break;
                     } // switch
                 }
                 iter_->Next();
@@ -267,13 +331,25 @@ namespace leveldb
             {
                 do {
                     ParsedInternalKey ikey;
-                    if (ParseKey(&ikey) && ikey.sequence <= sequence_)
+                    if (!ParseKey(&ikey))
+                    {
+                        // Skip corrupted entries
+                    } else if (upper_bound_ != NULL && user_comparator_->Compare(ikey.user_key, *upper_bound_) >= 0)
+                    {
+                        // Past the end of the range, where the children
+                        // may have left iter_ after SeekToLast()
+                    } else if (!InRange(ikey.user_key, false))
+                    {
+                        // Before the start of the range
+                        break;
+                    } else if (ikey.sequence <= sequence_)
                     {
                         if ((value_type != kTypeDeletion) && user_comparator_->Compare(ikey.user_key, saved_key_) < 0)
                         {
                             // We encountered a non-deleted value in entries for previous keys,
                             break;
                         }
+                        ApplyRangeTombstones(&ikey);
                         value_type = ikey.type;
                         if (value_type == kTypeDeletion)
                         {
@@ -308,13 +384,37 @@ namespace leveldb
             }
         }
         
+        // Positions iter_ at the first entry of "user_key" or after it that
+        // is visible at sequence_.  Uses saved_key_ as temporary storage.
+        void DBIter::SeekInternal(const Slice& user_key)
+        {
+            saved_key_.clear();
+            AppendInternalKey(&saved_key_, ParsedInternalKey(user_key, sequence_, kValueTypeForSeek));
+            iter_->Seek(saved_key_);
+        }
+        
         void DBIter::Seek(const Slice& target)
         {
+            seek_status_ = Status::OK();
             direction_ = kForward;
             ClearSavedValue();
-            saved_key_.clear();
-            AppendInternalKey(&saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-            iter_->Seek(saved_key_);
+            Slice start = target;
+            if (lower_bound_ != NULL && user_comparator_->Compare(target, *lower_bound_) < 0)
+            {
+                start = *lower_bound_;
+            }
+            if (prefix_extractor_ != NULL)
+            {
+                if (!prefix_extractor_->InDomain(start))
+                {
+                    seek_status_ = Status::NotSupported("Seek() outside of the prefix extractor domain with prefix_seek");
+                    valid_ = false;
+                    return;
+                }
+                Slice prefix = prefix_extractor_->Transform(start);
+                prefix_.assign(prefix.data(), prefix.size());
+            }
+            SeekInternal(start);
             if (iter_->Valid())
             {
                 FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -326,9 +426,22 @@ namespace leveldb
         
         void DBIter::SeekToFirst()
         {
+            seek_status_ = Status::OK();
             direction_ = kForward;
             ClearSavedValue();
-            iter_->SeekToFirst();
+            if (prefix_extractor_ != NULL)
+            {
+                seek_status_ = Status::NotSupported("SeekToFirst() with prefix_seek");
+                valid_ = false;
+                return;
+            }
+            if (lower_bound_ != NULL)
+            {
+                SeekInternal(*lower_bound_);
+            } else
+            {
+                iter_->SeekToFirst();
+            }
             if (iter_->Valid())
             {
                 FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -340,17 +453,42 @@ namespace leveldb
         
         void DBIter::SeekToLast()
         {
+            seek_status_ = Status::OK();
+            if (prefix_extractor_ != NULL)
+            {
+                seek_status_ = Status::NotSupported("SeekToLast() with prefix_seek");
+                valid_ = false;
+                return;
+            }
             direction_ = kReverse;
             ClearSavedValue();
-            iter_->SeekToLast();
+            if (upper_bound_ != NULL)
+            {
+                // Start from the last entry before the bound
+                std::string limit;
+                AppendInternalKey(&limit, ParsedInternalKey(*upper_bound_, kMaxSequenceNumber, kValueTypeForSeek));
+                iter_->Seek(limit);
+                if (iter_->Valid())
+                {
+                    iter_->Prev();
+                } else
+                {
+                    iter_->SeekToLast();
+                }
+            } else
+            {
+                iter_->SeekToLast();
+            }
             FindPrevUserEntry();
         }
         
     }  // anonymous namespace
     
-    Iterator* NewDBIterator(DBImpl*db, const Comparator*user_key_comparator, Iterator*internal_iter, SequenceNumber sequence, uint32_t seed)
+    Iterator* NewDBIterator(DBImpl*db, const Comparator*user_key_comparator, Iterator*internal_iter, SequenceNumber sequence, uint32_t seed,
+                            const Slice* lower_bound, const Slice* upper_bound, const SliceTransform* prefix_extractor,
+                            RangeDelAggregator* range_del)
     {
-        return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+        return new DBIter(db, user_key_comparator, internal_iter, sequence, seed, lower_bound, upper_bound, prefix_extractor, range_del);
     }
     
 }  // namespace leveldb
@@ -13,11 +13,19 @@ namespace leveldb
 {
     
     class DBImpl;
+    class RangeDelAggregator;
     
     // Return a new iterator that converts internal keys (yielded by
     // "*internal_iter") that were live at the specified "sequence" number
-    // into appropriate user keys.
-    extern Iterator* NewDBIterator(DBImpl*db, const Comparator*user_key_comparator, Iterator*internal_iter, SequenceNumber sequence, uint32_t seed);
+    // into appropriate user keys.  The iterator yields only user keys in
+    // [*lower_bound, *upper_bound); a NULL bound leaves that end open.  If
+    // "prefix_extractor" is non-NULL, it only yields the user keys with the
+    // prefix of the last Seek() target (see ReadOptions::prefix_seek).  If
+    // "range_del" is non-NULL, the entries it deletes are skipped; the
+    // iterator takes ownership of it.
+    extern Iterator* NewDBIterator(DBImpl*db, const Comparator*user_key_comparator, Iterator*internal_iter, SequenceNumber sequence, uint32_t seed,
+                                   const Slice* lower_bound, const Slice* upper_bound, const SliceTransform* prefix_extractor,
+                                   RangeDelAggregator* range_del);
     
 }  // namespace leveldb
 
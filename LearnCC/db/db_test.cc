@@ -2,6 +2,8 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
+
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "db/db_impl.h"
@@ -10,6 +12,7 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -75,6 +78,9 @@ class SpecialEnv : public EnvWrapper {
   // Force write to manifest files to fail while this pointer is non-NULL
   port::AtomicPointer manifest_write_error_;
 
+  // Manifest Sync() calls are blocked while this pointer is non-NULL.
+  port::AtomicPointer delay_manifest_sync_;
+
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
@@ -86,6 +92,7 @@ class SpecialEnv : public EnvWrapper {
     count_random_reads_ = false;
     manifest_sync_error_.Release_Store(NULL);
     manifest_write_error_.Release_Store(NULL);
+    delay_manifest_sync_.Release_Store(NULL);
   }
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
@@ -139,9 +146,11 @@ class SpecialEnv : public EnvWrapper {
       Status Sync() {
         if (env_->manifest_sync_error_.Acquire_Load() != NULL) {
           return Status::IOError("simulated sync error");
-        } else {
-          return base_->Sync();
         }
+        while (env_->delay_manifest_sync_.Acquire_Load() != NULL) {
+          DelayMilliseconds(100);
+        }
+        return base_->Sync();
       }
     };
 
@@ -189,12 +198,21 @@ class SpecialEnv : public EnvWrapper {
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  Cache* row_cache_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
     kDefault,
     kFilter,
+    kWholeTableFilter,
+    kPartitionedIndex,
+    kPartitionedIndexBlockFilter,
+    kCacheIndexAndFilterBlocks,
+    kRowCache,
     kUncompressed,
+    kConcurrentCompactions,
+    kConcurrentMemtableWrite,
+    kPipelinedWrite,
     kEnd
   };
   int option_config_;
@@ -209,6 +227,7 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    row_cache_ = NewLRUCache(1 << 20);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -218,14 +237,17 @@ class DBTest {
   ~DBTest() {
     delete db_;
     DestroyDB(dbname_, Options());
+    SetBackgroundThreadsFor(kDefault);
     delete env_;
     delete filter_policy_;
+    delete row_cache_;
   }
 
   // Switch to a fresh database with the next option configuration to
   // test.  Return false if there are no more configurations to test.
   bool ChangeOptions() {
     option_config_++;
+    SetBackgroundThreadsFor(option_config_);
     if (option_config_ >= kEnd) {
       return false;
     } else {
@@ -234,6 +256,14 @@ class DBTest {
     }
   }
 
+  // The LOW pool of Env::Default() is shared by the whole process, so only
+  // kConcurrentCompactions widens it and every other configuration puts
+  // it back to the single thread it starts with.
+  void SetBackgroundThreadsFor(int config) {
+    Env::Default()->SetBackgroundThreads(
+        config == kConcurrentCompactions ? 4 : 1, Env::LOW);
+  }
+
   // Return the current option configuration.
   Options CurrentOptions() {
     Options options;
@@ -241,9 +271,40 @@ class DBTest {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kWholeTableFilter:
+        options.filter_policy = filter_policy_;
+        options.whole_table_filter = true;
+        break;
+      case kPartitionedIndex:
+        options.filter_policy = filter_policy_;
+        options.whole_table_filter = true;
+        options.partition_index = true;
+        break;
+      case kPartitionedIndexBlockFilter:
+        // Small blocks so that index partitions land between data blocks
+        options.filter_policy = filter_policy_;
+        options.partition_index = true;
+        options.block_size = 256;
+        break;
+      case kCacheIndexAndFilterBlocks:
+        options.filter_policy = filter_policy_;
+        options.cache_index_and_filter_blocks = true;
+        break;
+      case kRowCache:
+        options.row_cache = row_cache_;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kConcurrentCompactions:
+        options.max_background_compactions = 4;
+        break;
+      case kConcurrentMemtableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
       default:
         break;
     }
@@ -293,6 +354,10 @@ class DBTest {
     return db_->Delete(WriteOptions(), k);
   }
 
+  Status DeleteRange(const std::string& begin, const std::string& end) {
+    return db_->DeleteRange(WriteOptions(), begin, end);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = NULL) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -362,6 +427,9 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
           }
         }
         iter->Next();
@@ -618,6 +686,68 @@ TEST(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, BlockCacheStatsProperty) {
+  ASSERT_OK(Put("a", "va"));
+  Compact("a", "b");
+  ASSERT_EQ("va", Get("a"));
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.block-cache-stats", &stats));
+  ASSERT_TRUE(stats.find("data") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("index") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("filter") != std::string::npos) << stats;
+
+  // The table's index block was read when it was opened, and its data
+  // block by the Get()
+  uint64_t hits, misses;
+  const char* data_row = strstr(stats.c_str(), "data");
+  ASSERT_EQ(2, sscanf(data_row, "data %llu %llu",
+                      reinterpret_cast<unsigned long long*>(&hits),
+                      reinterpret_cast<unsigned long long*>(&misses)));
+  ASSERT_GE(hits + misses, 1);
+  const char* index_row = strstr(stats.c_str(), "index");
+  ASSERT_EQ(2, sscanf(index_row, "index %llu %llu",
+                      reinterpret_cast<unsigned long long*>(&hits),
+                      reinterpret_cast<unsigned long long*>(&misses)));
+  ASSERT_GE(misses, 1);
+}
+
+TEST(DBTest, RowCache) {
+  Cache* row_cache = NewLRUCache(1 << 20);
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.row_cache = row_cache;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("x", "vx"));
+  Compact("a", "x");
+  const Snapshot* s1 = db_->GetSnapshot();
+  ASSERT_OK(Put("a", "va2"));
+  dbfull()->TEST_CompactMemTable();
+
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ("va2", Get("a"));
+    ASSERT_EQ("va", Get("a", s1));
+    ASSERT_EQ("vx", Get("x"));
+    ASSERT_EQ("vx", Get("x", s1));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+  }
+  // Reads without a snapshot fill the row cache.  The cached "x" is
+  // old enough for s1, but the cached "a" of the newer table is not.
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.block-cache-stats", &stats));
+  unsigned long long hits, misses;
+  ASSERT_EQ(2, sscanf(strstr(stats.c_str(), "row"), "row %llu %llu",
+                      &hits, &misses));
+  ASSERT_EQ(2 + 2 + 3, hits) << stats;
+  ASSERT_GT(row_cache->GetUsage(), 0);
+  db_->ReleaseSnapshot(s1);
+
+  delete db_;
+  db_ = NULL;
+  delete row_cache;
+}
+
 TEST(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -848,6 +978,69 @@ TEST(DBTest, IterMultiWithDelete) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, IterateBounds) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    ASSERT_OK(Put("e", "ve"));
+    ASSERT_OK(Delete("c"));
+
+    Slice lower("b"), upper("e");
+    ReadOptions options;
+    options.iterate_lower_bound = &lower;
+    options.iterate_upper_bound = &upper;
+    Iterator* iter = db_->NewIterator(options);
+
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->Seek("a");
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Seek("c");
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Seek("e");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    delete iter;
+
+    // Only one of the bounds
+    options.iterate_lower_bound = NULL;
+    iter = db_->NewIterator(options);
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "a->va");
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    delete iter;
+
+    options.iterate_lower_bound = &lower;
+    options.iterate_upper_bound = NULL;
+    iter = db_->NewIterator(options);
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "e->ve");
+    iter->Seek("a");
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    delete iter;
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, Recover) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -960,6 +1153,56 @@ TEST(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    // Spread keys over two levels, level-0 and the memtable.
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), "old" + Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
+    for (int i = 0; i < 100; i += 3) {
+      ASSERT_OK(Put(Key(i), "l0" + Key(i)));
+    }
+    ASSERT_OK(Delete(Key(10)));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int i = 0; i < 100; i += 7) {
+      ASSERT_OK(Put(Key(i), "mem" + Key(i)));
+    }
+    ASSERT_OK(Delete(Key(20)));
+
+    // Unsorted, with duplicates and missing keys
+    std::vector<std::string> key_strings;
+    for (int i = 99; i >= 0; i -= 2) {
+      key_strings.push_back(Key(i));
+      key_strings.push_back(Key(i + 1000));
+    }
+    key_strings.push_back(Key(7));
+    key_strings.push_back(Key(10));
+    key_strings.push_back(Key(20));
+    std::vector<Slice> keys(key_strings.begin(), key_strings.end());
+
+    for (int pass = 0; pass < 2; pass++) {
+      ReadOptions options;
+      options.snapshot = (pass == 0) ? NULL : snapshot;
+      std::vector<std::string> values;
+      std::vector<Status> statuses = db_->MultiGet(options, keys, &values);
+      ASSERT_EQ(keys.size(), statuses.size());
+      ASSERT_EQ(keys.size(), values.size());
+      for (size_t i = 0; i < keys.size(); i++) {
+        std::string expected;
+        Status s = db_->Get(options, keys[i], &expected);
+        ASSERT_EQ(s.ToString(), statuses[i].ToString());
+        if (s.ok()) {
+          ASSERT_EQ(expected, values[i]);
+        }
+      }
+    }
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;        // Large write buffer
@@ -986,6 +1229,36 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Four disjoint 250K files; with nothing else in the DB they are all
+  // placed at level-2.
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 100; i++) {
+    values.push_back(RandomString(&rnd, 10000));
+    ASSERT_OK(Put(Key(i), values[i]));
+    if (i % 25 == 24) {
+      dbfull()->TEST_CompactMemTable();
+    }
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(2), 4);
+
+  // Less than one output file worth of data, so anything more than one
+  // output comes from splitting the compaction.
+  dbfull()->TEST_CompactRange(2, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(2), 0);
+  ASSERT_GT(NumTableFilesAtLevel(3), 1);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+  ASSERT_LE(dbfull()->TEST_MaxNextLevelOverlappingBytes(), 20*1048576);
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1281,6 +1554,376 @@ TEST(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
+TEST(DBTest, DeleteRangeMemTable) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    ASSERT_OK(DeleteRange("b", "d"));
+    ASSERT_OK(DeleteRange("z", "x"));   // Empty range: no effect
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("(a->va)(d->vd)", Contents());
+
+    // Later writes are not deleted
+    ASSERT_OK(Put("c", "vc2"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, DeleteRangeAcrossLevels) {
+  do {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(Put(Key(i), "v" + NumberToString(i)));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(DeleteRange(Key(2), Key(5)));
+    ASSERT_OK(Put(Key(3), "new3"));
+    const std::string expected =
+        "(key000000->v0)(key000001->v1)(key000003->new3)(key000005->v5)"
+        "(key000006->v6)(key000007->v7)(key000008->v8)(key000009->v9)";
+    ASSERT_EQ(expected, Contents());
+
+    // A table with the tombstone, and then one holding only it
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ(expected, Contents());
+    ASSERT_EQ("NOT_FOUND", Get(Key(2)));
+    ASSERT_EQ("new3", Get(Key(3)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(4)));
+    ASSERT_OK(DeleteRange(Key(8), Key(100)));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("NOT_FOUND", Get(Key(9)));
+    ASSERT_EQ("v7", Get(Key(7)));
+
+    // The snapshot still sees the deleted values
+    ASSERT_EQ("v2", Get(Key(2), snapshot));
+    ASSERT_EQ("v9", Get(Key(9), snapshot));
+
+    // Compactions keep the tombstones and the values the snapshot needs
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("NOT_FOUND", Get(Key(2)));
+    ASSERT_EQ("new3", Get(Key(3)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(9)));
+    ASSERT_EQ("v2", Get(Key(2), snapshot));
+    ASSERT_EQ("v3", Get(Key(3), snapshot));
+    ASSERT_EQ(
+        "(key000000->v0)(key000001->v1)(key000003->new3)(key000005->v5)"
+        "(key000006->v6)(key000007->v7)",
+        Contents());
+    ASSERT_EQ("[ v2 ]", AllEntriesFor(Key(2)));
+
+    // Once no snapshot needs them, the deleted values are dropped
+    db_->ReleaseSnapshot(snapshot);
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      dbfull()->TEST_CompactRange(level, NULL, NULL);
+    }
+    ASSERT_EQ("[ ]", AllEntriesFor(Key(2)));
+    ASSERT_EQ("[ new3 ]", AllEntriesFor(Key(3)));
+    ASSERT_EQ("[ ]", AllEntriesFor(Key(9)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(4)));
+
+    Reopen();
+    ASSERT_EQ(
+        "(key000000->v0)(key000001->v1)(key000003->new3)(key000005->v5)"
+        "(key000006->v6)(key000007->v7)",
+        Contents());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, DeleteRangeOlderLevels) {
+  // Deleted values in lower levels than the tombstone
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_OK(DeleteRange(Key(100), Key(900)));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(500)));
+  ASSERT_NE("NOT_FOUND", Get(Key(99)));
+  ASSERT_NE("NOT_FOUND", Get(Key(900)));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek(Key(50));
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(50 + 100, count);
+  iter->Seek(Key(100));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(900), iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(99), iter->key().ToString());
+  delete iter;
+
+  // The compaction drops the deleted values and their space is reclaimed
+  const uint64_t before = Size(Key(100), Key(900));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_LT(Size(Key(100), Key(900)), before / 10);
+  ASSERT_EQ("NOT_FOUND", Get(Key(500)));
+  ASSERT_NE("NOT_FOUND", Get(Key(950)));
+}
+
+namespace {
+struct DeleteFilesState {
+  DBTest* test;
+  Status status;
+  port::AtomicPointer done;
+};
+
+static void DeleteFilesBody(void* arg) {
+  DeleteFilesState* state = reinterpret_cast<DeleteFilesState*>(arg);
+  const std::string begin_key = Key(200), end_key = Key(800);
+  Slice begin(begin_key), end(end_key);
+  state->status = state->test->db_->DeleteFilesInRange(&begin, &end);
+  state->done.Release_Store(state);
+}
+
+struct BackgroundOpState {
+  DBTest* test;
+  int level;
+  port::AtomicPointer done;
+};
+
+static void CompactRangeBody(void* arg) {
+  BackgroundOpState* state = reinterpret_cast<BackgroundOpState*>(arg);
+  reinterpret_cast<DBImpl*>(state->test->db_)->TEST_CompactRange(state->level, NULL, NULL);
+  state->done.Release_Store(state);
+}
+
+static void CompactMemTableBody(void* arg) {
+  BackgroundOpState* state = reinterpret_cast<BackgroundOpState*>(arg);
+  reinterpret_cast<DBImpl*>(state->test->db_)->TEST_CompactMemTable();
+  state->done.Release_Store(state);
+}
+}  // namespace
+
+TEST(DBTest, FlushBelowLevel0DuringCompactRange) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // Level-1 files on both sides of "m", over level-2 files of the same keys
+  for (int i = 0; i < 2; i++) {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_OK(Put("z", "vz"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ("0,2,2", FilesPerLevel());
+
+  // Hold the flush of "m", which fits in level 2, in LogAndApply(), and
+  // start a manual compaction of level 1 into level 2 meanwhile
+  env_->delay_manifest_sync_.Release_Store(env_);
+  ASSERT_OK(Put("m", "vm"));
+  BackgroundOpState flusher;
+  flusher.test = this;
+  flusher.done.Release_Store(NULL);
+  env_->StartThread(CompactMemTableBody, &flusher);
+  DelayMilliseconds(200);
+  BackgroundOpState compactor;
+  compactor.test = this;
+  compactor.level = 1;
+  compactor.done.Release_Store(NULL);
+  env_->StartThread(CompactRangeBody, &compactor);
+  DelayMilliseconds(200);
+  env_->delay_manifest_sync_.Release_Store(NULL);
+
+  while (flusher.done.Acquire_Load() == NULL ||
+         compactor.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(100);
+  }
+
+  // The compaction output does not overlap the flushed table in its level
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vm", Get("m"));
+  ASSERT_EQ("vz", Get("z"));
+}
+
+TEST(DBTest, DeleteFilesInRangeDuringCompactRange) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // Ten level-2 files of 100 keys each
+  for (int f = 0; f < 10; f++) {
+    for (int i = f * 100; i < (f + 1) * 100; i++) {
+      ASSERT_OK(Put(Key(i), "v"));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ("0,0,10", FilesPerLevel());
+
+  // Hold DeleteFilesInRange() in LogAndApply(), which drops the mutex,
+  // and start a manual compaction of the files it is deleting meanwhile
+  env_->delay_manifest_sync_.Release_Store(env_);
+  DeleteFilesState deleter;
+  deleter.test = this;
+  deleter.done.Release_Store(NULL);
+  env_->StartThread(DeleteFilesBody, &deleter);
+  DelayMilliseconds(200);
+  BackgroundOpState compactor;
+  compactor.test = this;
+  compactor.level = 2;
+  compactor.done.Release_Store(NULL);
+  env_->StartThread(CompactRangeBody, &compactor);
+  DelayMilliseconds(200);
+  ASSERT_TRUE(compactor.done.Acquire_Load() == NULL);
+  env_->delay_manifest_sync_.Release_Store(NULL);
+
+  while (deleter.done.Acquire_Load() == NULL ||
+         compactor.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(100);
+  }
+  ASSERT_OK(deleter.status);
+
+  // The compaction ran after the deletion and did not bring the files back
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ((i >= 200 && i < 800) ? "NOT_FOUND" : "v", Get(Key(i))) << i;
+  }
+  ASSERT_EQ("0,0,0,1", FilesPerLevel());
+}
+
+TEST(DBTest, DeleteRangeOpensOnlyTablesWithTombstones) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  // Tables of disjoint ranges, which go below level 0 and are opened
+  // lazily by iterators
+  for (int t = 0; t < 3; t++) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(Put(Key(100 * t + i), "v"));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+
+  // Loading the tombstones of a new version opens no table
+  Reopen(&options);
+  env_->random_read_counter_.Reset();
+  delete db_->NewIterator(ReadOptions());
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+
+  // Only the table with a tombstone is opened, even after a reopen
+  ASSERT_OK(DeleteRange(Key(1000), Key(1010)));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  Reopen(&options);
+  env_->random_read_counter_.Reset();
+  delete db_->NewIterator(ReadOptions());
+  ASSERT_GT(env_->random_read_counter_.Read(), 0);
+  ASSERT_EQ("v", Get(Key(205)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(1005)));
+}
+
+TEST(DBTest, DeletionTriggeredCompaction) {
+  for (int enabled = 0; enabled < 2; enabled++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.deletion_compaction_ratio = enabled ? 0.5 : 0;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < 2000; i++) {
+      ASSERT_OK(Put(Key(i), "v"));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("0,0,1", FilesPerLevel());
+
+    // A file of deletions lands on top of the values, in level 1, which
+    // is far from full
+    for (int i = 0; i < 1900; i++) {
+      ASSERT_OK(Delete(Key(i)));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    if (!enabled) {
+      ASSERT_EQ("0,1,1", FilesPerLevel());
+      ASSERT_EQ("[ DEL, v ]", AllEntriesFor(Key(0)));
+      continue;
+    }
+
+    // It is compacted into level 2, which drops the deleted values
+    for (int i = 0; i < 100 && NumTableFilesAtLevel(1) > 0; i++) {
+      DelayMilliseconds(100);
+    }
+    ASSERT_EQ("0,0,1", FilesPerLevel());
+    ASSERT_EQ("[ ]", AllEntriesFor(Key(0)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(1899)));
+    ASSERT_EQ("v", Get(Key(1900)));
+  }
+}
+
+TEST(DBTest, DeleteFilesInRange) {
+  // Ten files of 100 keys each
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_OK(Put(Key(i), values[i]));
+    if (i % 100 == 99) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  const int files_before = TotalTableFiles();
+  const int disk_files_before = CountFiles();
+  ASSERT_EQ(10, files_before);
+  ASSERT_OK(Put(Key(500), "in memtable"));
+
+  const std::string begin_key = Key(200), end_key = Key(800);
+  Slice begin(begin_key), end(end_key);
+  ASSERT_OK(db_->DeleteFilesInRange(&begin, &end));
+  const int deleted = files_before - TotalTableFiles();
+  ASSERT_EQ(6, deleted);   // Keys 200..799
+  ASSERT_EQ(disk_files_before - deleted, CountFiles());
+  ASSERT_LT(Size(Key(200), Key(800)), 200000);
+
+  // Keys outside the range and in the memtable are kept, as are keys in
+  // the file straddling the end of the range
+  int kept = 0;
+  for (int i = 0; i < 1000; i++) {
+    const std::string v = Get(Key(i));
+    if (i == 500) {
+      ASSERT_EQ("in memtable", v);
+    } else if (i < 200 || i > 800) {
+      ASSERT_EQ(values[i], v) << i;
+    } else if (v != "NOT_FOUND") {
+      ASSERT_EQ(values[i], v) << i;
+      kept++;
+    }
+  }
+  ASSERT_EQ(1, kept);      // Key 800
+
+  // DeleteRange() removes the rest
+  ASSERT_OK(DeleteRange(Key(200), Key(801)));
+  for (int i = 200; i <= 800; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i)));
+  }
+  ASSERT_EQ(values[199], Get(Key(199)));
+  ASSERT_EQ(values[801], Get(Key(801)));
+
+  // An unbounded range holds every file
+  ASSERT_OK(db_->DeleteFilesInRange(NULL, NULL));
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(999)));
+
+  Reopen();
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(999)));
+}
+
 TEST(DBTest, OverlapInLevel0) {
   do {
     ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
@@ -1726,6 +2369,174 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST(DBTest, IterateBoundsSkipFilesAndBlocks) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  // One table of live keys, and a newer one that deletes all but the
+  // first ten of them
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), std::string(1000, 'v')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 10; i < N; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  // And a table outside of the bounds
+  ASSERT_OK(Put("zzz", "v"));
+  dbfull()->TEST_CompactMemTable();
+
+  // Open all tables before counting
+  env_->delay_data_sync_.Release_Store(env_);
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  delete iter;
+
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(11, count);
+  const int unbounded_reads = env_->random_read_counter_.Read();
+
+  Slice upper(Key(10));
+  ReadOptions bounded;
+  bounded.iterate_upper_bound = &upper;
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(bounded);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(10, count);
+  const int bounded_reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d unbounded reads, %d bounded reads\n",
+          unbounded_reads, bounded_reads);
+  ASSERT_LE(bounded_reads * 10, unbounded_reads);
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+}
+
+TEST(DBTest, PrefixSeek) {
+  const SliceTransform* prefix_extractor = NewDelimitedPrefixTransform(':');
+  for (int whole_table_filter = 0; whole_table_filter <= 1; whole_table_filter++) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.whole_table_filter = (whole_table_filter == 1);
+    options.prefix_extractor = prefix_extractor;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    // Three tables with tenants "a" and "c", and only the first with "b"
+    char buf[100];
+    for (int t = 0; t < 3; t++) {
+      for (int i = 0; i < 20; i++) {
+        snprintf(buf, sizeof(buf), "a:%02d", i);
+        ASSERT_OK(Put(buf, std::string(100, 'a')));
+        snprintf(buf, sizeof(buf), "c:%02d", i);
+        ASSERT_OK(Put(buf, std::string(100, 'c')));
+        if (t == 0) {
+          snprintf(buf, sizeof(buf), "b:%02d", i);
+          ASSERT_OK(Put(buf, "b" + NumberToString(i)));
+        }
+      }
+      dbfull()->TEST_CompactMemTable();
+    }
+    ASSERT_OK(Delete("b:10"));
+    ASSERT_EQ("b3", Get("b:03"));
+
+    // Open all tables before counting
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->SeekToFirst();
+    delete iter;
+
+    ReadOptions prefix_options;
+    prefix_options.prefix_seek = true;
+    iter = db_->NewIterator(prefix_options);
+    int count = 0;
+    for (iter->Seek("b:"); iter->Valid(); iter->Next()) {
+      ASSERT_TRUE(iter->key().starts_with("b:"));
+      count++;
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_EQ(19, count);
+
+    iter->Seek("b:12");
+    ASSERT_EQ(IterStatus(iter), "b:12->b12");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b:11->b11");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b:09->b9");
+    iter->Seek("b:01");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b:00->b0");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->Seek("b:19");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->Seek("a:99");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    ASSERT_OK(iter->status());
+    delete iter;
+
+    // A prefix that no table holds is found missing without reading
+    env_->random_read_counter_.Reset();
+    iter = db_->NewIterator(prefix_options);
+    iter->Seek("ab:");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->Seek("bb:");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    ASSERT_EQ(0, env_->random_read_counter_.Read());
+    delete iter;
+
+    // While a total order iterator reads every table
+    env_->random_read_counter_.Reset();
+    iter = db_->NewIterator(ReadOptions());
+    iter->Seek("bb:");
+    ASSERT_EQ(IterStatus(iter), "c:00->" + std::string(100, 'c'));
+    ASSERT_GE(env_->random_read_counter_.Read(), 3);
+    delete iter;
+
+    // Prefix iterators have to be positioned by Seek()
+    iter = db_->NewIterator(prefix_options);
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    ASSERT_TRUE(iter->status().IsNotSupportedError());
+    delete iter;
+    iter = db_->NewIterator(prefix_options);
+    iter->Seek("b");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    ASSERT_TRUE(iter->status().IsNotSupportedError());
+
+    // A valid Seek() afterwards clears the error
+    iter->Seek("c:");
+    ASSERT_EQ(IterStatus(iter), "c:00->" + std::string(100, 'c'));
+    ASSERT_OK(iter->status());
+    delete iter;
+
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+  delete prefix_extractor;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -1733,6 +2544,66 @@ static const int kNumThreads = 4;
 static const int kTestSeconds = 10;
 static const int kNumKeys = 1000;
 
+TEST(DBTest, CompressionPerLevel) {
+  Options options = CurrentOptions();
+  options.compression_per_level.push_back(kNoCompression);
+  options.compression_per_level.push_back(kLZ4Compression);
+  options.compression_per_level.push_back(kZstdCompression);
+  Reopen(&options);
+
+  Random rnd(301);
+  std::map<std::string, std::string> values;
+  for (int i = 0; i < 200; i++) {
+    std::string v;
+    test::CompressibleString(&rnd, 0.25, 1000, &v);
+    values[Key(i)] = v;
+    ASSERT_OK(Put(Key(i), v));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // Levels past the end of the vector use its last entry
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(Put(Key(i), values[Key(i)]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  dbfull()->TEST_CompactRange(2, NULL, NULL);
+
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[Key(i)], Get(Key(i)));
+  }
+}
+
+TEST(DBTest, ReadsSeeWritesAcrossMemTableSwitches) {
+  // Reads use a cached {mem, imm, version} bundle, which must be replaced
+  // whenever a memtable is switched or flushed.
+  do {
+    Iterator* iter = NULL;
+    for (int i = 0; i < 500; i++) {
+      std::string value = NumberToString(i);
+      ASSERT_OK(Put(Key(i % 10), value));
+      ASSERT_EQ(value, Get(Key(i % 10)));
+      if (i % 50 == 49) {
+        if (iter == NULL) {
+          iter = db_->NewIterator(ReadOptions());
+        }
+        dbfull()->TEST_CompactMemTable();
+        ASSERT_EQ(value, Get(Key(i % 10)));
+      }
+    }
+    // The iterator keeps the state it was created from
+    iter->SeekToFirst();
+    ASSERT_EQ(Key(0), iter->key().ToString());
+    ASSERT_EQ("40", iter->value().ToString());
+    delete iter;
+  } while (ChangeOptions());
+}
+
 struct MTState {
   DBTest* test;
   port::AtomicPointer stop;
@@ -1878,6 +2749,12 @@ class ModelDB: public DB {
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void DeleteRange(const Slice& begin, const Slice& end) {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2056,6 +2933,151 @@ TEST(DBTest, Randomized) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, DeleteRangeRandomized) {
+  Random rnd(test::RandomSeed());
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.write_buffer_size = 10000;  // Many flushes and compactions
+    DestroyAndReopen(&options);
+    ModelDB model(options);
+    const int N = 5000;
+    const Snapshot* model_snap = NULL;
+    const Snapshot* db_snap = NULL;
+    for (int step = 0; step < N; step++) {
+      const int p = rnd.Uniform(100);
+      const std::string k = Key(rnd.Uniform(300));
+      if (p < 70) {
+        const std::string v = RandomString(&rnd, rnd.Uniform(200));
+        ASSERT_OK(model.Put(WriteOptions(), k, v));
+        ASSERT_OK(db_->Put(WriteOptions(), k, v));
+      } else if (p < 80) {
+        ASSERT_OK(model.Delete(WriteOptions(), k));
+        ASSERT_OK(db_->Delete(WriteOptions(), k));
+      } else if (p < 90) {
+        const std::string limit = Key(rnd.Uniform(300));
+        ASSERT_OK(model.DeleteRange(WriteOptions(), k, limit));
+        ASSERT_OK(db_->DeleteRange(WriteOptions(), k, limit));
+      } else if (p < 95) {
+        ASSERT_OK(dbfull()->TEST_CompactMemTable());
+      } else {
+        const std::string limit = Key(rnd.Uniform(300));
+        Slice begin(k), end(limit);
+        db_->CompactRange(&begin, &end);
+      }
+
+      if ((step % 100) == 0) {
+        ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+        ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+        for (int i = 0; i < 20; i++) {
+          const std::string key = Key(rnd.Uniform(300));
+          std::string expected = "NOT_FOUND";
+          Iterator* miter = model.NewIterator(ReadOptions());
+          miter->Seek(key);
+          if (miter->Valid() && miter->key() == key) {
+            expected = miter->value().ToString();
+          }
+          delete miter;
+          ASSERT_EQ(expected, Get(key)) << key;
+        }
+        if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+        if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+        if ((step % 1000) == 0) {
+          Reopen(&options);
+          ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+        }
+        model_snap = model.GetSnapshot();
+        db_snap = db_->GetSnapshot();
+      }
+    }
+    if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+    if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+  } while (ChangeOptions());
+}
+
+// Scans random bounded ranges of "db" forwards, backwards and from a
+// Seek(), and checks every direction against "model".
+static void CheckBoundedScans(DB* db, const KVMap& model, Random* rnd) {
+  for (int i = 0; i < 100; i++) {
+    const std::string lo = Key(rnd->Uniform(37000));
+    const std::string hi = Key(rnd->Uniform(37000));
+    Slice lower(lo), upper(hi);
+    ReadOptions options;
+    if (!rnd->OneIn(3)) options.iterate_lower_bound = &lower;
+    if (!rnd->OneIn(3)) options.iterate_upper_bound = &upper;
+    std::vector<std::string> expected;
+    for (KVMap::const_iterator it = model.begin(); it != model.end(); ++it) {
+      if ((options.iterate_lower_bound == NULL || it->first >= lo) &&
+          (options.iterate_upper_bound == NULL || it->first < hi)) {
+        expected.push_back(it->first + "->" + it->second);
+      }
+    }
+
+    Iterator* iter = db->NewIterator(options);
+    std::vector<std::string> forward, reverse;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward.push_back(iter->key().ToString() + "->" + iter->value().ToString());
+    }
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      reverse.push_back(iter->key().ToString() + "->" + iter->value().ToString());
+    }
+    std::reverse(reverse.begin(), reverse.end());
+    ASSERT_TRUE(forward == expected) << lo << " " << hi;
+    ASSERT_TRUE(reverse == expected) << lo << " " << hi;
+
+    const std::string target = Key(rnd->Uniform(37000));
+    size_t pos = 0;
+    while (pos < expected.size() &&
+           expected[pos].substr(0, target.size()) < target) {
+      pos++;
+    }
+    iter->Seek(target);
+    ASSERT_EQ(pos < expected.size(), iter->Valid());
+    if (iter->Valid()) {
+      ASSERT_EQ(expected[pos], iter->key().ToString() + "->" + iter->value().ToString());
+      iter->Prev();
+      ASSERT_EQ(pos > 0, iter->Valid());
+      if (iter->Valid()) {
+        ASSERT_EQ(expected[pos - 1], iter->key().ToString() + "->" + iter->value().ToString());
+      }
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+}
+
+TEST(DBTest, IterateBoundsRandomized) {
+  Random rnd(test::RandomSeed());
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.write_buffer_size = 10000;  // Many flushes and compactions
+    options.block_size = 256;
+    DestroyAndReopen(&options);
+    KVMap model;
+    // Sparse keys, so that index keys are shortened between blocks
+    for (int step = 0; step < 3000; step++) {
+      const std::string k = Key(37 * rnd.Uniform(1000));
+      if (rnd.OneIn(5)) {
+        model.erase(k);
+        ASSERT_OK(Delete(k));
+      } else {
+        const std::string v = RandomString(&rnd, rnd.Uniform(100));
+        model[k] = v;
+        ASSERT_OK(Put(k, v));
+      }
+      if (step == 2000) {
+        // Bounds that fall in the gap between the last key of a block
+        // and its index key leave nothing else to stop the iterators of
+        // a single sorted run.
+        db_->CompactRange(NULL, NULL);
+        CheckBoundedScans(db_, model, &rnd);
+      }
+    }
+    CheckBoundedScans(db_, model, &rnd);
+  } while (ChangeOptions());
+}
+
 std::string MakeKey(unsigned int num) {
   char buf[30];
   snprintf(buf, sizeof(buf), "%016u", num);
@@ -132,13 +132,19 @@ namespace leveldb
     {
         // We rely on the fact that the code in table.cc does not mind us
         // adjusting keys[].
+        // Adjacent duplicates (versions of a key, or the prefixes of
+        // neighbouring keys) are added once.
         Slice* mkey = const_cast<Slice*>(keys);
+        int m = 0;
         for (int i = 0; i < n; i++)
         {
-            mkey[i] = ExtractUserKey(keys[i]);
-            // TODO(sanjay): Suppress dups?
+            Slice user_key = ExtractUserKey(keys[i]);
+            if (m == 0 || user_key != mkey[m - 1])
+            {
+                mkey[m++] = user_key;
+            }
         }
-        user_policy_->CreateFilter(keys, n, dst);
+        user_policy_->CreateFilter(keys, m, dst);
     }
     
     bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const
@@ -146,6 +152,63 @@ namespace leveldb
         return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
     }
     
+    namespace
+    {
+        // Hands the user part of each key to a builder of the user policy
+        class InternalFilterBuilder : public FilterPolicy::Builder
+        {
+        private:
+            FilterPolicy::Builder* const user_builder_;
+            
+        public:
+            explicit InternalFilterBuilder(FilterPolicy::Builder* b) : user_builder_(b) { }
+            virtual ~InternalFilterBuilder() { delete user_builder_; }
+            
+            virtual void AddKey(const Slice& key)
+            {
+                user_builder_->AddKey(ExtractUserKey(key));
+            }
+            
+            virtual void Finish(std::string* dst)
+            {
+                user_builder_->Finish(dst);
+            }
+        };
+    }  // namespace
+    
+    FilterPolicy::Builder* InternalFilterPolicy::NewBuilder() const
+    {
+        FilterPolicy::Builder* user_builder = user_policy_->NewBuilder();
+        return (user_builder == NULL) ? NULL : new InternalFilterBuilder(user_builder);
+    }
+    
+    /***********************************************************************************
+     类：InternalPrefixTransform 内部前缀提取器
+     **********************************************************************************/
+    
+    const char* InternalPrefixTransform::Name() const
+    {
+        return user_transform_->Name();
+    }
+    
+    Slice InternalPrefixTransform::Transform(const Slice& key) const
+    {
+        Slice prefix = user_transform_->Transform(ExtractUserKey(key));
+        // The prefix is part of the user key, so the 8 bytes after it are
+        // still within "key".
+        return Slice(prefix.data(), prefix.size() + 8);
+    }
+    
+    bool InternalPrefixTransform::InDomain(const Slice& key) const
+    {
+        return user_transform_->InDomain(ExtractUserKey(key));
+    }
+    
+    bool InternalPrefixTransform::SamePrefix(const Slice& a, const Slice& b) const
+    {
+        return user_transform_->SamePrefix(ExtractUserKey(a), ExtractUserKey(b));
+    }
+    
     /***********************************************************************************
      类：LookupKey
      **********************************************************************************/
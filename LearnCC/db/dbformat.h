@@ -10,6 +10,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -43,6 +44,10 @@ namespace leveldb
         // Approximate gap in bytes between samples of data read during iteration.
         static const int kReadBytesPeriod = 1048576; // 2^20
         
+        // Minimum number of entries of a table before the fraction of them
+        // that are deletions can trigger its compaction.
+        static const int kMinEntriesForDeletionCompaction = 1000;
+        
     }  // namespace config
     
     class InternalKey;
@@ -53,7 +58,8 @@ namespace leveldb
     enum ValueType
     {
         kTypeDeletion = 0x0,
-        kTypeValue = 0x1
+        kTypeValue = 0x1,
+        kTypeRangeDeletion = 0x2    // Only in WriteBatches and range tombstone storage
     };
     // kValueTypeForSeek defines the ValueType that should be passed when
     // constructing a ParsedInternalKey object for seeking to a particular
@@ -61,7 +67,7 @@ namespace leveldb
     // and the value type is embedded as the low 8 bits in the sequence
     // number in internal keys, we need to use the highest-numbered
     // ValueType, not the lowest).
-    static const ValueType kValueTypeForSeek = kTypeValue;
+    static const ValueType kValueTypeForSeek = kTypeRangeDeletion;
     
     typedef uint64_t SequenceNumber;
     
@@ -147,6 +153,27 @@ namespace leveldb
         virtual const char* Name() const;
         virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
         virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
+        virtual Builder* NewBuilder() const;
+    };
+    
+    // Prefix extractor wrapper that maps an internal key to the prefix of
+    // its user key.  The result is that prefix followed by the next 8
+    // bytes of the internal key, which take the place of the tag: like an
+    // internal key, InternalFilterPolicy turns it into its user part, so
+    // tables add and probe prefixes the same way as keys.  The 8 bytes are
+    // arbitrary, so results must only be compared with SamePrefix().
+    class InternalPrefixTransform : public SliceTransform
+    {
+    private:
+        const SliceTransform* const user_transform_;
+    public:
+        explicit InternalPrefixTransform(const SliceTransform* t) : user_transform_(t) { }
+        virtual const char* Name() const;
+        virtual Slice Transform(const Slice& key) const;
+        virtual bool InDomain(const Slice& key) const;
+        virtual bool SamePrefix(const Slice& a, const Slice& b) const;
+        
+        const SliceTransform* user_transform() const { return user_transform_; }
     };
     
     
@@ -209,7 +236,7 @@ namespace leveldb
         result->sequence = num >> 8;  // 向右移动8位，获得高56位，存储的是sequence
         result->type = static_cast<ValueType>(c);
         result->user_key = Slice(internal_key.data(), n - 8);
-        return (c <= static_cast<unsigned char>(kTypeValue));
+        return (c <= static_cast<unsigned char>(kTypeRangeDeletion));
     }
     
     /***********************************************************************************
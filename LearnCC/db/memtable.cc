@@ -8,6 +8,7 @@
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb
 {
@@ -25,7 +26,8 @@ namespace leveldb
         return Slice(p, len);
     }
     
-    MemTable::MemTable(const InternalKeyComparator& cmp) : comparator_(cmp), refs_(0), table_(comparator_, &arena_)
+    MemTable::MemTable(const InternalKeyComparator& cmp) : comparator_(cmp), refs_(0), table_(comparator_, &arena_),
+    range_del_table_(comparator_, &arena_), range_del_fragments_(cmp.user_comparator())
     {
         
     }
@@ -90,18 +92,29 @@ namespace leveldb
         return new MemTableIterator(&table_);
     }
     
-    void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key, const Slice& value)
+    Iterator* MemTable::NewRangeTombstoneIterator()
+    {
+        Table::Iterator iter(&range_del_table_);
+        iter.SeekToFirst();
+        return iter.Valid() ? new MemTableIterator(&range_del_table_) : NULL;
+    }
+    
+    void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key, const Slice& value, bool concurrently)
     {
         // Format of an entry is concatenation of:
         //  key_size     : varint32 of internal_key.size()
         //  key bytes    : char[internal_key.size()]
         //  value_size   : varint32 of value.size()
         //  value bytes  : char[value.size()]
+        if (type == kTypeRangeDeletion && comparator_.comparator.user_comparator()->Compare(key, value) >= 0)
+        {
+            return;  // Deletes nothing
+        }
         size_t key_size = key.size();
         size_t val_size = value.size();
         size_t internal_key_size = key_size + 8;
         const size_t encoded_len = VarintLength(internal_key_size) + internal_key_size + VarintLength(val_size) + val_size;
-        char* buf = arena_.Allocate(encoded_len);
+        char* buf = concurrently ? arena_.AllocateConcurrently(encoded_len) : arena_.Allocate(encoded_len);
         char* p = EncodeVarint32(buf, internal_key_size); // 将长度存储到p中
         memcpy(p, key.data(), key_size); // 接着p中存储key
         p += key_size;
@@ -113,11 +126,41 @@ namespace leveldb
         /**
          buf的结构：(key.size+7+1等同internal_key.size)的EncodeVarint32编码 + key + (sequence+type)的EncodeFixed64编码 + value.size的EncodeVarint32编码 + value
          */
-        table_.Insert(buf);
+        if (type == kTypeRangeDeletion)
+        {
+            MutexLock l(&range_del_mutex_);
+            range_del_fragments_.Add(key, value, s);
+        }
+        Table* table = (type == kTypeRangeDeletion ? &range_del_table_ : &table_);
+        if (concurrently)
+        {
+            table->InsertConcurrently(buf);
+        } else
+        {
+            table->Insert(buf);
+        }
+    }
+    
+    SequenceNumber MemTable::MaxCoveringTombstone(const Slice& user_key, SequenceNumber snapshot)
+    {
+        Table::Iterator iter(&range_del_table_);
+        iter.SeekToFirst();
+        if (!iter.Valid())
+        {
+            return 0;
+        }
+        MutexLock l(&range_del_mutex_);
+        return range_del_fragments_.MaxCoveringSequence(user_key, snapshot);
     }
     
     bool MemTable::Get(const LookupKey& key, std::string* value, Status* s)
     {
+        // A range tombstone here is newer than any entry it covers in older
+        // memtables and tables, so it settles the lookup unless this
+        // memtable has a newer entry for the key.
+        const Slice ikey = key.internal_key();
+        const SequenceNumber covering = MaxCoveringTombstone(key.user_key(), DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8);
+        
         Slice memkey = key.memtable_key();
         Table::Iterator iter(&table_);
         iter.Seek(memkey.data());
@@ -139,6 +182,11 @@ namespace leveldb
             {
                 // Correct user key
                 const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+                if ((tag >> 8) < covering)
+                {
+                    *s = Status::NotFound(Slice());
+                    return true;
+                }
                 switch (static_cast<ValueType>(tag & 0xff))
                 {
                     case kTypeValue:
@@ -148,11 +196,17 @@ namespace leveldb
                         return true;
                     }
                     case kTypeDeletion:
+                    case kTypeRangeDeletion:
                         *s = Status::NotFound(Slice());
                         return true;
                 }
             }
         }
+        if (covering > 0)
+        {
+            *s = Status::NotFound(Slice());
+            return true;
+        }
         return false;
     }
     
@@ -8,7 +8,9 @@
 #include <string>
 #include "leveldb/db.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "db/skiplist.h"
+#include "port/port.h"
 #include "util/arena.h"
 
 namespace leveldb
@@ -54,14 +56,24 @@ namespace leveldb
         // db/format.{h,cc} module.
         Iterator* NewIterator();
         
+        // Return an iterator over the range tombstones of the memtable, or
+        // NULL if it has none.  Its keys are internal keys holding the
+        // begin of each range, and its values are the ends (see
+        // db/range_del.h).  Same lifetime rules as NewIterator().
+        Iterator* NewRangeTombstoneIterator();
+        
         // Add an entry into memtable that maps key to value at the
         // specified sequence number and with the specified type.
-        // Typically value will be empty if type==kTypeDeletion.
-        void Add(SequenceNumber seq, ValueType type, const Slice& key, const Slice& value);
+        // Typically value will be empty if type==kTypeDeletion.  If
+        // type==kTypeRangeDeletion, key and value are the begin and end
+        // of the deleted range.
+        // If "concurrently" is true, other threads may be adding to the
+        // memtable at the same time, as long as they also pass true.
+        void Add(SequenceNumber seq, ValueType type, const Slice& key, const Slice& value, bool concurrently = false);
         
         // If memtable contains a value for key, store it in *value and return true.
-        // If memtable contains a deletion for key, store a NotFound() error
-        // in *status and return true.
+        // If memtable contains a deletion for key, or a range tombstone
+        // that covers it, store a NotFound() error in *status and return true.
         // Else, return false.
         bool Get(const LookupKey& key, std::string* value, Status* s);
         
@@ -79,10 +91,21 @@ namespace leveldb
         
         typedef SkipList<const char*, KeyComparator> Table;
         
+        // Returns the largest sequence number, no larger than "snapshot",
+        // of a range tombstone covering "user_key", or 0 if there is none.
+        SequenceNumber MaxCoveringTombstone(const Slice& user_key, SequenceNumber snapshot);
+        
         KeyComparator comparator_;
         int refs_;
         Arena arena_; // 一个内存池
         Table table_;
+        Table range_del_table_;     // Range tombstones, apart from table_
+        
+        // The tombstones of range_del_table_, split into fragments for
+        // MaxCoveringTombstone().  Updated before range_del_table_, so that
+        // a reader that finds that table empty needs no lock.
+        port::Mutex range_del_mutex_;
+        RangeTombstoneFragments range_del_fragments_;   // Guarded by range_del_mutex_
         
         // No copying allowed
         MemTable(const MemTable&);
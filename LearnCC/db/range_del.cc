@@ -0,0 +1,245 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace leveldb
+{
+
+    namespace
+    {
+        struct BoundLess
+        {
+            const Comparator* ucmp;
+            bool operator()(const std::string& a, const std::string& b) const
+            {
+                return ucmp->Compare(a, b) < 0;
+            }
+        };
+
+        struct BoundEqual
+        {
+            const Comparator* ucmp;
+            bool operator()(const std::string& a, const std::string& b) const
+            {
+                return ucmp->Compare(a, b) == 0;
+            }
+        };
+
+        struct KeyBeforeBound
+        {
+            const Comparator* ucmp;
+            bool operator()(const Slice& key, const std::string& bound) const
+            {
+                return ucmp->Compare(key, bound) < 0;
+            }
+        };
+    }  // namespace
+
+    RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : ucmp_(user_comparator), finished_(false)
+    {
+    }
+
+    void RangeTombstoneList::Add(const Slice& begin, const Slice& end, SequenceNumber seq)
+    {
+        assert(!finished_);
+        if (ucmp_->Compare(begin, end) >= 0)
+        {
+            return;
+        }
+        RangeTombstone t;
+        t.begin.assign(begin.data(), begin.size());
+        t.end.assign(end.data(), end.size());
+        t.sequence = seq;
+        tombstones_.push_back(t);
+    }
+
+    Status RangeTombstoneList::AddFrom(Iterator* iter)
+    {
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next())
+        {
+            ParsedInternalKey ikey;
+            if (!ParseInternalKey(iter->key(), &ikey) || ikey.type != kTypeRangeDeletion)
+            {
+                return Status::Corruption("bad range tombstone");
+            }
+            Add(ikey.user_key, iter->value(), ikey.sequence);
+        }
+        return iter->status();
+    }
+
+    void RangeTombstoneList::Finish()
+    {
+        assert(!finished_);
+        finished_ = true;
+        if (tombstones_.empty())
+        {
+            return;
+        }
+
+        BoundLess less;
+        less.ucmp = ucmp_;
+        BoundEqual equal;
+        equal.ucmp = ucmp_;
+        for (size_t i = 0; i < tombstones_.size(); i++)
+        {
+            bounds_.push_back(tombstones_[i].begin);
+            bounds_.push_back(tombstones_[i].end);
+        }
+        std::sort(bounds_.begin(), bounds_.end(), less);
+        bounds_.erase(std::unique(bounds_.begin(), bounds_.end(), equal), bounds_.end());
+
+        std::vector<std::vector<SequenceNumber> > covering(bounds_.size() - 1);
+        for (size_t i = 0; i < tombstones_.size(); i++)
+        {
+            const RangeTombstone& t = tombstones_[i];
+            size_t f = std::lower_bound(bounds_.begin(), bounds_.end(), t.begin, less) - bounds_.begin();
+            for (; ucmp_->Compare(bounds_[f], t.end) < 0; f++)
+            {
+                covering[f].push_back(t.sequence);
+            }
+        }
+        offsets_.push_back(0);
+        for (size_t f = 0; f < covering.size(); f++)
+        {
+            std::sort(covering[f].begin(), covering[f].end(), std::greater<SequenceNumber>());
+            seqs_.insert(seqs_.end(), covering[f].begin(), covering[f].end());
+            offsets_.push_back(seqs_.size());
+        }
+    }
+
+    SequenceNumber RangeTombstoneList::MaxCoveringSequence(const Slice& user_key, SequenceNumber snapshot) const
+    {
+        assert(finished_);
+        KeyBeforeBound before;
+        before.ucmp = ucmp_;
+        // The fragment holding user_key starts at the last bound <= user_key
+        const size_t next = std::upper_bound(bounds_.begin(), bounds_.end(), user_key, before) - bounds_.begin();
+        if (next == 0 || next == bounds_.size())
+        {
+            return 0;
+        }
+        const size_t f = next - 1;
+        for (size_t i = offsets_[f]; i < offsets_[f + 1]; i++)
+        {
+            if (seqs_[i] <= snapshot)
+            {
+                return seqs_[i];
+            }
+        }
+        return 0;
+    }
+
+    RangeTombstoneFragments::RangeTombstoneFragments(const Comparator* user_comparator)
+    : ucmp_(user_comparator), fragments_(BoundLess(user_comparator))
+    {
+    }
+
+    RangeTombstoneFragments::FragmentMap::iterator RangeTombstoneFragments::Split(const Slice& bound)
+    {
+        const std::string key(bound.data(), bound.size());
+        FragmentMap::iterator next = fragments_.upper_bound(key);
+        if (next != fragments_.begin())
+        {
+            FragmentMap::iterator prev = next;
+            --prev;
+            if (ucmp_->Compare(prev->first, bound) == 0)
+            {
+                return prev;
+            }
+            // The new fragment starts with the tombstones of the one it
+            // splits
+            return fragments_.insert(next, std::make_pair(key, prev->second));
+        }
+        return fragments_.insert(next, std::make_pair(key, std::vector<SequenceNumber>()));
+    }
+
+    void RangeTombstoneFragments::Add(const Slice& begin, const Slice& end, SequenceNumber seq)
+    {
+        if (ucmp_->Compare(begin, end) >= 0)
+        {
+            return;
+        }
+        FragmentMap::iterator first = Split(begin);
+        FragmentMap::iterator last = Split(end);
+        for (FragmentMap::iterator it = first; it != last; ++it)
+        {
+            std::vector<SequenceNumber>& seqs = it->second;
+            seqs.insert(std::lower_bound(seqs.begin(), seqs.end(), seq, std::greater<SequenceNumber>()), seq);
+        }
+    }
+
+    SequenceNumber RangeTombstoneFragments::MaxCoveringSequence(const Slice& user_key, SequenceNumber snapshot) const
+    {
+        FragmentMap::const_iterator it = fragments_.upper_bound(user_key.ToString());
+        if (it == fragments_.begin())
+        {
+            return 0;
+        }
+        --it;
+        const std::vector<SequenceNumber>& seqs = it->second;
+        for (size_t i = 0; i < seqs.size(); i++)
+        {
+            if (seqs[i] <= snapshot)
+            {
+                return seqs[i];
+            }
+        }
+        return 0;
+    }
+
+    void ExtendBoundsForTombstone(const InternalKeyComparator& icmp, const Slice& begin, const Slice& end, SequenceNumber seq,
+                                  bool has_bounds, InternalKey* smallest, InternalKey* largest)
+    {
+        InternalKey lower(begin, seq, kTypeRangeDeletion);
+        InternalKey upper(end, kMaxSequenceNumber, kTypeRangeDeletion);
+        if (!has_bounds || icmp.Compare(lower, *smallest) < 0)
+        {
+            *smallest = lower;
+        }
+        if (!has_bounds || icmp.Compare(upper, *largest) > 0)
+        {
+            *largest = upper;
+        }
+    }
+
+    RangeDelAggregator::~RangeDelAggregator()
+    {
+        for (size_t i = 0; i < owned_lists_.size(); i++)
+        {
+            delete owned_lists_[i];
+        }
+    }
+
+    void RangeDelAggregator::AddList(const RangeTombstoneList* list)
+    {
+        if (!list->empty())
+        {
+            lists_.push_back(list);
+        }
+    }
+
+    void RangeDelAggregator::AddOwnedList(RangeTombstoneList* list)
+    {
+        owned_lists_.push_back(list);
+        AddList(list);
+    }
+
+    bool RangeDelAggregator::ShouldDelete(const ParsedInternalKey& ikey) const
+    {
+        for (size_t i = 0; i < lists_.size(); i++)
+        {
+            if (lists_[i]->MaxCoveringSequence(ikey.user_key, snapshot_) > ikey.sequence)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+}  // namespace leveldb
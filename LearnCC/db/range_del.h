@@ -0,0 +1,161 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone, written by DB::DeleteRange(), deletes the entries of
+// the user keys in [begin, end) whose sequence number is smaller than its
+// own, for every reader whose snapshot sees it.  Memtables and tables keep
+// their tombstones apart from their other entries, as internal keys
+// holding the begin of each range (with type kTypeRangeDeletion) that map
+// to the end of the range.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb
+{
+
+    struct RangeTombstone
+    {
+        std::string begin;
+        std::string end;              // Exclusive
+        SequenceNumber sequence;
+    };
+
+    // A set of range tombstones that answers which of them cover a user
+    // key.  Tombstones are added first, then Finish() indexes them.  After
+    // that a RangeTombstoneList may be safely accessed concurrently from
+    // multiple threads.
+    class RangeTombstoneList
+    {
+    public:
+        explicit RangeTombstoneList(const Comparator* user_comparator);
+
+        // Empty ranges are ignored.
+        // REQUIRES: Finish() has not been called
+        void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+        // Add the tombstones yielded by "iter" in the format of memtables
+        // and tables.  Returns the status of "iter", or a corruption error
+        // if it yields a malformed key.  Does not delete "iter".
+        // REQUIRES: Finish() has not been called
+        Status AddFrom(Iterator* iter);
+
+        void Finish();
+
+        bool empty() const { return tombstones_.empty(); }
+
+        // The tombstones as they were added
+        const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+        // Returns the largest sequence number, no larger than "snapshot", of
+        // a tombstone covering "user_key", or 0 if there is none.
+        // REQUIRES: Finish() has been called
+        SequenceNumber MaxCoveringSequence(const Slice& user_key, SequenceNumber snapshot) const;
+
+    private:
+        const Comparator* const ucmp_;
+        std::vector<RangeTombstone> tombstones_;
+        bool finished_;
+
+        // The boundaries of all tombstones, sorted, split the key space
+        // into fragments.  Fragment i is [bounds_[i], bounds_[i+1]), and the
+        // tombstones that cover it have the sequence numbers
+        // seqs_[offsets_[i] .. offsets_[i+1]-1], in decreasing order.
+        std::vector<std::string> bounds_;
+        std::vector<size_t> offsets_;
+        std::vector<SequenceNumber> seqs_;
+
+        // No copying allowed
+        RangeTombstoneList(const RangeTombstoneList&);
+        void operator=(const RangeTombstoneList&);
+    };
+
+    // Range tombstones kept split into fragments as they are added, for a
+    // set that keeps growing (that of a memtable), so that a lookup does
+    // not have to go through all of them.  Not thread-safe.
+    class RangeTombstoneFragments
+    {
+    public:
+        explicit RangeTombstoneFragments(const Comparator* user_comparator);
+
+        // Empty ranges are ignored.
+        void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+        // Returns the largest sequence number, no larger than "snapshot", of
+        // a tombstone covering "user_key", or 0 if there is none.
+        SequenceNumber MaxCoveringSequence(const Slice& user_key, SequenceNumber snapshot) const;
+
+    private:
+        struct BoundLess
+        {
+            explicit BoundLess(const Comparator* c) : ucmp(c) { }
+            const Comparator* ucmp;
+            bool operator()(const std::string& a, const std::string& b) const
+            {
+                return ucmp->Compare(a, b) < 0;
+            }
+        };
+
+        // Maps each bound to the sequence numbers, in decreasing order, of
+        // the tombstones that cover the fragment from it to the next bound.
+        typedef std::map<std::string, std::vector<SequenceNumber>, BoundLess> FragmentMap;
+
+        // Makes "bound" the start of a fragment and returns it.
+        FragmentMap::iterator Split(const Slice& bound);
+
+        const Comparator* const ucmp_;
+        FragmentMap fragments_;
+
+        // No copying allowed
+        RangeTombstoneFragments(const RangeTombstoneFragments&);
+        void operator=(const RangeTombstoneFragments&);
+    };
+
+    // Widens the bounds of a table, [*smallest, *largest] if "has_bounds",
+    // to cover the tombstone [begin, end) with sequence number "seq".  The
+    // largest key of a range that ends at "end" is a sentinel that sorts
+    // before every entry of "end", which the tombstone does not cover.
+    extern void ExtendBoundsForTombstone(const InternalKeyComparator& icmp, const Slice& begin, const Slice& end, SequenceNumber seq,
+                                         bool has_bounds, InternalKey* smallest, InternalKey* largest);
+    
+    // Tells which entries are deleted by the range tombstones of several
+    // lists (say, those of the memtables and of a Version) for a reader at
+    // a given snapshot.
+    class RangeDelAggregator
+    {
+    public:
+        explicit RangeDelAggregator(SequenceNumber snapshot) : snapshot_(snapshot) { }
+        ~RangeDelAggregator();
+
+        // "list" must remain live while this aggregator is in use.
+        void AddList(const RangeTombstoneList* list);
+
+        // Like AddList(), but this aggregator deletes "list" when done.
+        void AddOwnedList(RangeTombstoneList* list);
+
+        bool empty() const { return lists_.empty(); }
+
+        // Returns true iff a tombstone that the snapshot sees deletes "ikey".
+        bool ShouldDelete(const ParsedInternalKey& ikey) const;
+
+    private:
+        const SequenceNumber snapshot_;
+        std::vector<const RangeTombstoneList*> lists_;
+        std::vector<RangeTombstoneList*> owned_lists_;
+
+        // No copying allowed
+        RangeDelAggregator(const RangeDelAggregator&);
+        void operator=(const RangeDelAggregator&);
+    };
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
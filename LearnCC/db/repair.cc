@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -49,7 +50,8 @@ class Repairer {
         env_(options.env),
         icmp_(options.comparator),
         ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        iprefix_(options.prefix_extractor),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, &iprefix_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -101,6 +103,7 @@ class Repairer {
   Env* const env_;
   InternalKeyComparator const icmp_;
   InternalFilterPolicy const ipolicy_;
+  InternalPrefixTransform const iprefix_;
   Options const options_;
   bool owns_info_log_;
   bool owns_cache_;
@@ -224,8 +227,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = NULL;
     if (status.ok()) {
@@ -293,6 +299,10 @@ class Repairer {
       }
 
       counter++;
+      t.meta.num_entries++;
+      if (parsed.type == kTypeDeletion) {
+        t.meta.num_deletions++;
+      }
       if (empty) {
         empty = false;
         t.meta.smallest.DecodeFrom(key);
@@ -306,6 +316,26 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+    if (status.ok()) {
+      // The key range of the table also covers its range tombstones
+      RangeTombstoneList tombstones(icmp_.user_comparator());
+      status = table_cache_->AddRangeTombstones(t.meta.number,
+                                                t.meta.file_size,
+                                                &tombstones);
+      for (size_t i = 0; i < tombstones.tombstones().size(); i++) {
+        const RangeTombstone& tombstone = tombstones.tombstones()[i];
+        ExtendBoundsForTombstone(icmp_, tombstone.begin, tombstone.end,
+                                 tombstone.sequence, !empty,
+                                 &t.meta.smallest, &t.meta.largest);
+        empty = false;
+        t.meta.num_entries++;
+        t.meta.num_deletions++;
+        t.meta.num_range_deletions++;
+        if (tombstone.sequence > t.max_sequence) {
+          t.max_sequence = tombstone.sequence;
+        }
+      }
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t.meta.number,
         counter,
@@ -396,7 +426,12 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+                    t.meta.smallest, t.meta.largest,
+                    t.meta.num_entries, t.meta.num_deletions,
+                    t.meta.num_range_deletions);
+    }
+    if (options_.deletion_compaction_ratio <= 0) {
+      edit_.ClearEntryCounts();
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -365,6 +365,67 @@ static void RunConcurrent(int run) {
   }
 }
 
+// Several threads calling InsertConcurrently() on the same list.
+struct InsertState {
+  SkipList<Key, Comparator>* list;
+  int num_threads;
+  int keys_per_thread;
+  port::Mutex mu;
+  port::CondVar cv;
+  int next_id;   // Protected by mu
+  int running;   // Protected by mu
+
+  InsertState() : cv(&mu), next_id(0), running(0) { }
+};
+
+static void ConcurrentInserter(void* arg) {
+  InsertState* state = reinterpret_cast<InsertState*>(arg);
+  state->mu.Lock();
+  const int id = state->next_id++;
+  state->mu.Unlock();
+  // Interleave the keys of all threads so that inserts collide.
+  for (int i = 0; i < state->keys_per_thread; i++) {
+    state->list->InsertConcurrently(
+        static_cast<Key>(i) * state->num_threads + id);
+  }
+  state->mu.Lock();
+  state->running--;
+  state->cv.Signal();
+  state->mu.Unlock();
+}
+
+TEST(SkipTest, ConcurrentInsert) {
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+  InsertState state;
+  state.list = &list;
+  state.num_threads = 4;
+  state.keys_per_thread = 20000;
+  state.running = state.num_threads;
+  for (int i = 0; i < state.num_threads; i++) {
+    Env::Default()->StartThread(ConcurrentInserter, &state);
+  }
+  state.mu.Lock();
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+  state.mu.Unlock();
+
+  const Key total = static_cast<Key>(state.num_threads) * state.keys_per_thread;
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < total; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < total; k += 97) {
+    ASSERT_TRUE(list.Contains(k));
+  }
+}
+
 TEST(SkipTest, Concurrent1) { RunConcurrent(1); }
 TEST(SkipTest, Concurrent2) { RunConcurrent(2); }
 TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
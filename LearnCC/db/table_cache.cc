@@ -5,6 +5,7 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
@@ -16,16 +17,42 @@ namespace leveldb
     {
         RandomAccessFile* file;
         Table* table;
+        RangeTombstoneList* range_tombstones;   // NULL if the table has none
     };
     
     static void DeleteEntry(const Slice& key, void* value)
     {
         TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+        delete tf->range_tombstones;
         delete tf->table;
         delete tf->file;
         delete tf;
     }
     
+    static void DeleteRow(const Slice& key, void* value)
+    {
+        delete reinterpret_cast<std::string*>(value);
+    }
+    
+    // Passes the entry found by Table::InternalGet() on, and keeps a copy
+    // of it for the row cache.
+    struct RowSaver
+    {
+        void* arg;
+        void (*saver)(void*, const Slice&, const Slice&);
+        bool found;
+        std::string row;    // Length prefixed internal key, then value
+    };
+    
+    static void SaveRow(void* arg, const Slice& ikey, const Slice& v)
+    {
+        RowSaver* rs = reinterpret_cast<RowSaver*>(arg);
+        rs->found = true;
+        PutLengthPrefixedSlice(&rs->row, ikey);
+        rs->row.append(v.data(), v.size());
+        (*rs->saver)(rs->arg, ikey, v);
+    }
+    
     static void UnrefEntry(void* arg1, void* arg2)
     {
         Cache* cache = reinterpret_cast<Cache*>(arg1);
@@ -35,7 +62,8 @@ namespace leveldb
     
     // entries缓存容量大小
     TableCache::TableCache(const std::string& dbname, const Options* options, int entries)
-    : env_(options->env), dbname_(dbname), options_(options), cache_(NewLRUCache(entries))
+    : env_(options->env), dbname_(dbname), options_(options), cache_(NewLRUCache(entries)),
+    row_cache_id_(options->row_cache != NULL ? options->row_cache->NewId() : 0)
     {
     }
     
@@ -67,7 +95,23 @@ namespace leveldb
             }
             if (s.ok())
             {
-                s = Table::Open(*options_, file, file_size, &table);
+                s = Table::Open(*options_, file, file_size, &stats_, &table);
+            }
+            RangeTombstoneList* range_tombstones = NULL;
+            Iterator* range_del_iter = (s.ok() ? table->NewRangeTombstoneIterator() : NULL);
+            if (range_del_iter != NULL)
+            {
+                const Comparator* ucmp = static_cast<const InternalKeyComparator*>(options_->comparator)->user_comparator();
+                range_tombstones = new RangeTombstoneList(ucmp);
+                s = range_tombstones->AddFrom(range_del_iter);
+                range_tombstones->Finish();
+                delete range_del_iter;
+                if (!s.ok())
+                {
+                    delete range_tombstones;
+                    delete table;
+                    table = NULL;
+                }
             }
             
             if (!s.ok())
@@ -81,6 +125,7 @@ namespace leveldb
                 TableAndFile* tf = new TableAndFile;
                 tf->file = file;
                 tf->table = table;
+                tf->range_tombstones = range_tombstones;
                 *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
             }
         }
@@ -102,7 +147,32 @@ namespace leveldb
         }
         
         Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-        Iterator* result = table->NewIterator(options);
+        Iterator* result;
+        if (options.iterate_lower_bound == NULL && options.iterate_upper_bound == NULL)
+        {
+            result = table->NewIterator(options);
+        } else
+        {
+            // The table holds internal keys.  The first internal key of a
+            // user key stands for it, so that no entry of a user key in
+            // range is ever out of the bounds given to the table.
+            ReadOptions table_options = options;
+            InternalKey lower, upper;
+            Slice lower_key, upper_key;
+            if (options.iterate_lower_bound != NULL)
+            {
+                lower.SetFrom(ParsedInternalKey(*options.iterate_lower_bound, kMaxSequenceNumber, kValueTypeForSeek));
+                lower_key = lower.Encode();
+                table_options.iterate_lower_bound = &lower_key;
+            }
+            if (options.iterate_upper_bound != NULL)
+            {
+                upper.SetFrom(ParsedInternalKey(*options.iterate_upper_bound, kMaxSequenceNumber, kValueTypeForSeek));
+                upper_key = upper.Encode();
+                table_options.iterate_upper_bound = &upper_key;
+            }
+            result = table->NewIterator(table_options);
+        }
         result->RegisterCleanup(&UnrefEntry, cache_, handle);
         if (tableptr != NULL)
         {
@@ -111,15 +181,132 @@ namespace leveldb
         return result;
     }
     
+    // Sets *covering for the lookup of internal key "k" in "tf".
+    static void FindCoveringTombstone(TableAndFile* tf, const Slice& k, SequenceNumber* covering)
+    {
+        ParsedInternalKey lookup;
+        *covering = 0;
+        if (tf->range_tombstones != NULL && ParseInternalKey(k, &lookup))
+        {
+            *covering = tf->range_tombstones->MaxCoveringSequence(lookup.user_key, lookup.sequence);
+        }
+    }
+    
     Status TableCache::Get(const ReadOptions& options, uint64_t file_number, uint64_t file_size,
-                           const Slice& k, void* arg, void (*saver)(void*, const Slice&, const Slice&))
+                           const Slice& k, void* arg, void (*saver)(void*, const Slice&, const Slice&),
+                           SequenceNumber* covering_tombstone)
     {
+        // The range tombstones of the table apply to a row cache hit too,
+        // so the table is looked up first.
         Cache::Handle* handle = NULL;
         Status s = FindTable(file_number, file_size, &handle);
-        if (s.ok())
+        if (!s.ok())
+        {
+            return s;
+        }
+        TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+        FindCoveringTombstone(tf, k, covering_tombstone);
+        
+        // A row cache entry holds the newest entry for a user key in a
+        // table, so it answers any lookup whose sequence number sees it.
+        Cache* row_cache = options_->row_cache;
+        ParsedInternalKey lookup;
+        std::string row_key;
+        if (row_cache != NULL && ParseInternalKey(k, &lookup))
+        {
+            PutFixed64(&row_key, row_cache_id_);
+            PutFixed64(&row_key, file_number);
+            row_key.append(lookup.user_key.data(), lookup.user_key.size());
+            Cache::Handle* row_handle = row_cache->Lookup(row_key);
+            if (row_handle != NULL)
+            {
+                Slice row = *reinterpret_cast<std::string*>(row_cache->Value(row_handle));
+                Slice found_key;
+                ParsedInternalKey found;
+                if (GetLengthPrefixedSlice(&row, &found_key) && ParseInternalKey(found_key, &found) &&
+                    found.sequence <= lookup.sequence)
+                {
+                    stats_.Record(BlockCacheStats::kRow, true);
+                    (*saver)(arg, found_key, row);
+                    row_cache->Release(row_handle);
+                    cache_->Release(handle);
+                    return Status::OK();
+                }
+                row_cache->Release(row_handle);
+            }
+            stats_.Record(BlockCacheStats::kRow, false);
+        }
+        
+        Table* t = tf->table;
+        if (row_key.empty() || options.snapshot != NULL)
         {
-            Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
             s = t->InternalGet(options, k, arg, saver);
+        } else
+        {
+            // Without a snapshot every entry in the table is visible, so
+            // the entry found is the newest one for the key
+            RowSaver rs;
+            rs.arg = arg;
+            rs.saver = saver;
+            rs.found = false;
+            s = t->InternalGet(options, k, &rs, &SaveRow);
+            Slice row = rs.row;
+            Slice found_key;
+            ParsedInternalKey found;
+            if (s.ok() && rs.found && GetLengthPrefixedSlice(&row, &found_key) &&
+                ParseInternalKey(found_key, &found) && found.user_key == lookup.user_key)
+            {
+                std::string* value = new std::string;
+                value->swap(rs.row);
+                Cache::Handle* row_handle = row_cache->Insert(row_key, value, row_key.size() + value->size(), &DeleteRow);
+                if (row_handle != NULL)
+                {
+                    row_cache->Release(row_handle);
+                } else
+                {
+                    delete value;
+                }
+            }
+        }
+        cache_->Release(handle);
+        return s;
+    }
+    
+    Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number, uint64_t file_size,
+                                int n, const Slice* keys, void* const* args,
+                                void (*saver)(void*, const Slice&, const Slice&),
+                                SequenceNumber* covering_tombstones)
+    {
+        Cache::Handle* handle = NULL;
+        Status s = FindTable(file_number, file_size, &handle);
+        if (s.ok())
+        {
+            TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+            for (int i = 0; i < n; i++)
+            {
+                FindCoveringTombstone(tf, keys[i], &covering_tombstones[i]);
+            }
+            s = tf->table->InternalMultiGet(options, n, keys, args, saver);
+            cache_->Release(handle);
+        }
+        return s;
+    }
+    
+    Status TableCache::AddRangeTombstones(uint64_t file_number, uint64_t file_size, RangeTombstoneList* list)
+    {
+        Cache::Handle* handle = NULL;
+        Status s = FindTable(file_number, file_size, &handle);
+        if (s.ok())
+        {
+            const RangeTombstoneList* range_tombstones = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->range_tombstones;
+            if (range_tombstones != NULL)
+            {
+                const std::vector<RangeTombstone>& tombstones = range_tombstones->tombstones();
+                for (size_t i = 0; i < tombstones.size(); i++)
+                {
+                    list->Add(tombstones[i].begin, tombstones[i].end, tombstones[i].sequence);
+                }
+            }
             cache_->Release(handle);
         }
         return s;
@@ -13,11 +13,13 @@
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
 #include "port/port.h"
+#include "table/format.h"
 
 namespace leveldb
 {
     
     class Env;
+    class RangeTombstoneList;
     
     class TableCache
     {
@@ -35,22 +37,46 @@ namespace leveldb
         Iterator* NewIterator(const ReadOptions& options, uint64_t file_number, uint64_t file_size, Table** tableptr = NULL);
         
         // If a seek to internal key "k" in specified file finds an entry,
-        // call (*handle_result)(arg, found_key, found_value).
+        // call (*handle_result)(arg, found_key, found_value).  Stores in
+        // *covering_tombstone the largest sequence number, no larger than
+        // that of "k", of a range tombstone of the file that covers the
+        // user key of "k", or 0 if there is none.
         Status Get(const ReadOptions& options,
                    uint64_t file_number,
                    uint64_t file_size,
                    const Slice& k,
                    void* arg,
-                   void (*handle_result)(void*, const Slice&, const Slice&));
+                   void (*handle_result)(void*, const Slice&, const Slice&),
+                   SequenceNumber* covering_tombstone);
+        
+        // Get() for the sorted internal keys keys[0..n-1], passing args[i] to
+        // (*handle_result) and covering_tombstones+i for keys[i].  The table
+        // is looked up only once.
+        Status MultiGet(const ReadOptions& options,
+                        uint64_t file_number,
+                        uint64_t file_size,
+                        int n,
+                        const Slice* keys,
+                        void* const* args,
+                        void (*handle_result)(void*, const Slice&, const Slice&),
+                        SequenceNumber* covering_tombstones);
+        
+        // Add the range tombstones of the specified file to *list.
+        Status AddRangeTombstones(uint64_t file_number, uint64_t file_size, RangeTombstoneList* list);
         
         // Evict any entry for the specified file number
         void Evict(uint64_t file_number);
         
+        // Block cache hits and misses of the tables opened through this cache
+        const BlockCacheStats& block_cache_stats() const { return stats_; }
+        
     private:
         Env* const env_;
         const std::string dbname_;
         const Options* options_;
         Cache* cache_;
+        uint64_t row_cache_id_;     // Prefix of our keys in options_->row_cache
+        BlockCacheStats stats_;
         
         Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
     };
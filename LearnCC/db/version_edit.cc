@@ -21,7 +21,9 @@ namespace leveldb {
         kDeletedFile          = 6,
         kNewFile              = 7,
         // 8 was used for large value refs
-        kPrevLogNumber        = 9
+        kPrevLogNumber        = 9,
+        kNewFileWithCounts    = 10,  // kNewFile followed by the entry counts
+        kNewFileWithRangeDels = 11   // kNewFileWithCounts followed by the range tombstone count
     };
     
     void VersionEdit::Clear()
@@ -85,12 +87,24 @@ namespace leveldb {
         for (size_t i = 0; i < new_files_.size(); i++)
         {
             const FileMetaData& f = new_files_[i].second;
-            PutVarint32(dst, kNewFile);
+            // Files without counts or range tombstones keep the old format
+            const bool has_range_dels = (f.num_range_deletions > 0);
+            const bool has_counts = (f.num_entries > 0 || has_range_dels);
+            PutVarint32(dst, has_range_dels ? kNewFileWithRangeDels : (has_counts ? kNewFileWithCounts : kNewFile));
             PutVarint32(dst, new_files_[i].first);  // level
             PutVarint64(dst, f.number);
             PutVarint64(dst, f.file_size);
             PutLengthPrefixedSlice(dst, f.smallest.Encode());
             PutLengthPrefixedSlice(dst, f.largest.Encode());
+            if (has_counts)
+            {
+                PutVarint64(dst, f.num_entries);
+                PutVarint64(dst, f.num_deletions);
+            }
+            if (has_range_dels)
+            {
+                PutVarint64(dst, f.num_range_deletions);
+            }
         }
     }
     
@@ -202,6 +216,9 @@ namespace leveldb {
                     break;
                     
                 case kNewFile:
+                    f.num_entries = 0;
+                    f.num_deletions = 0;
+                    f.num_range_deletions = 0;
                     if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) && GetVarint64(&input, &f.file_size) && GetInternalKey(&input, &f.smallest) && GetInternalKey(&input, &f.largest))
                     {
                         new_files_.push_back(std::make_pair(level, f));
@@ -210,6 +227,27 @@ namespace leveldb {
                     }
                     break;
                     
+                case kNewFileWithCounts:
+                    f.num_range_deletions = 0;
+                    if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) && GetVarint64(&input, &f.file_size) && GetInternalKey(&input, &f.smallest) && GetInternalKey(&input, &f.largest) &&
+                        GetVarint64(&input, &f.num_entries) && GetVarint64(&input, &f.num_deletions))
+                    {
+                        new_files_.push_back(std::make_pair(level, f));
+                    } else {
+                        msg = "new-file entry";
+                    }
+                    break;
+                    
+                case kNewFileWithRangeDels:
+                    if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) && GetVarint64(&input, &f.file_size) && GetInternalKey(&input, &f.smallest) && GetInternalKey(&input, &f.largest) &&
+                        GetVarint64(&input, &f.num_entries) && GetVarint64(&input, &f.num_deletions) && GetVarint64(&input, &f.num_range_deletions))
+                    {
+                        new_files_.push_back(std::make_pair(level, f));
+                    } else {
+                        msg = "new-file entry";
+                    }
+                    break;
+                    
                 default:
                     msg = "unknown tag";
                     break;
@@ -285,6 +323,18 @@ namespace leveldb {
             r.append(f.smallest.DebugString());
             r.append(" .. ");
             r.append(f.largest.DebugString());
+            if (f.num_entries > 0)
+            {
+                r.append(" entries ");
+                AppendNumberTo(&r, f.num_entries);
+                r.append(" deletions ");
+                AppendNumberTo(&r, f.num_deletions);
+            }
+            if (f.num_range_deletions > 0)
+            {
+                r.append(" range deletions ");
+                AppendNumberTo(&r, f.num_range_deletions);
+            }
         }
         r.append("\n}\n");
         return r;
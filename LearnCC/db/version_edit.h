@@ -23,8 +23,12 @@ namespace leveldb
         uint64_t file_size;         // File size in bytes
         InternalKey smallest;       // Smallest internal key served by table
         InternalKey largest;        // Largest internal key served by table
+        bool being_compacted;       // Is an input of a running compaction?
+        uint64_t num_entries;       // Entries and range tombstones in table; 0 if unknown
+        uint64_t num_deletions;     // Deletion markers and range tombstones in table
+        uint64_t num_range_deletions;   // Range tombstones in table
         
-        FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }  // 2^10==1024 1<<30==2^30==3*1024
+        FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0), being_compacted(false), num_entries(0), num_deletions(0), num_range_deletions(0) { }  // 2^10==1024 1<<30==2^30==3*1024
     };
     
     class VersionEdit
@@ -68,16 +72,35 @@ namespace leveldb
         // Add the specified file at the specified number.
         // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
         // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
-        void AddFile(int level, uint64_t file, uint64_t file_size, const InternalKey& smallest, const InternalKey& largest)
+        // "num_entries" and "num_deletions" count the entries of the file and
+        // how many of them are deletions, or are 0 if not known.
+        // "num_range_deletions" counts the range tombstones of the file,
+        // which are only read from files where it is not 0.
+        void AddFile(int level, uint64_t file, uint64_t file_size, const InternalKey& smallest, const InternalKey& largest,
+                     uint64_t num_entries = 0, uint64_t num_deletions = 0, uint64_t num_range_deletions = 0)
         {
             FileMetaData f;
             f.number = file;
             f.file_size = file_size;
             f.smallest = smallest;
             f.largest = largest;
+            f.num_entries = num_entries;
+            f.num_deletions = num_deletions;
+            f.num_range_deletions = num_range_deletions;
             new_files_.push_back(std::make_pair(level, f));
         }
         
+        // Forget the entry counts of the added files, so that those without
+        // range tombstones are written in the format older builds read.
+        void ClearEntryCounts()
+        {
+            for (size_t i = 0; i < new_files_.size(); i++)
+            {
+                new_files_[i].second.num_entries = 0;
+                new_files_[i].second.num_deletions = 0;
+            }
+        }
+        
         // Delete the specified "file" from the specified "level".
         void DeleteFile(int level, uint64_t file)
         {
@@ -39,6 +39,49 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, EntryCounts) {
+  static const uint64_t kBig = 1ull << 50;
+
+  // Files with and without counts, which must not inherit the counts of
+  // the file decoded before them
+  VersionEdit edit;
+  for (int i = 0; i < 4; i++) {
+    edit.AddFile(i, 300 + i, 400 + i,
+                 InternalKey("foo", 500 + i, kTypeValue),
+                 InternalKey("zoo", 600 + i, kTypeDeletion),
+                 (i % 2 == 0) ? kBig + i : 0, (i % 2 == 0) ? i : 0);
+    TestEncodeDecode(edit);
+  }
+}
+
+TEST(VersionEditTest, RangeDeletionCounts) {
+  // Files with range tombstones, with and without the other counts,
+  // between files without them
+  VersionEdit edit;
+  for (int i = 0; i < 6; i++) {
+    edit.AddFile(i, 300 + i, 400 + i,
+                 InternalKey("foo", 500 + i, kTypeValue),
+                 InternalKey("zoo", 600 + i, kTypeDeletion),
+                 (i % 3 == 0) ? 10 + i : 0, (i % 3 == 0) ? i : 0,
+                 (i % 2 == 0) ? 1 + i : 0);
+    TestEncodeDecode(edit);
+  }
+}
+
+TEST(VersionEditTest, ClearEntryCounts) {
+  // Without its counts a file is encoded as it was before they existed
+  VersionEdit with_counts, without_counts;
+  with_counts.AddFile(1, 300, 400, InternalKey("foo", 500, kTypeValue),
+                      InternalKey("zoo", 600, kTypeDeletion), 10, 4);
+  without_counts.AddFile(1, 300, 400, InternalKey("foo", 500, kTypeValue),
+                         InternalKey("zoo", 600, kTypeDeletion));
+  std::string encoded, expected;
+  with_counts.ClearEntryCounts();
+  with_counts.EncodeTo(&encoded);
+  without_counts.EncodeTo(&expected);
+  ASSERT_EQ(expected, encoded);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -10,6 +10,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -17,6 +18,7 @@
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb
 {
@@ -60,6 +62,19 @@ namespace leveldb
         return sum;
     }
     
+    // Returns true iff some file in "files" is an input of a running compaction.
+    static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files)
+    {
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            if (files[i]->being_compacted)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    
     Version::~Version()
     {
         assert(refs_ == 0);
@@ -82,6 +97,7 @@ namespace leveldb
                 }
             }
         }
+        delete range_tombstones_;
     }
     
     int FindFile(const InternalKeyComparator& icmp, const std::vector<FileMetaData*>& files, const Slice& key)
@@ -170,33 +186,88 @@ namespace leveldb
     class Version::LevelFileNumIterator : public Iterator
     {
     public:
-        LevelFileNumIterator(const InternalKeyComparator& icmp, const std::vector<FileMetaData*>* flist): icmp_(icmp), flist_(flist), index_(flist->size())
-        {        // Marks as invalid
+        // Only the files that may hold user keys in [*lower_bound,
+        // *upper_bound) are visited.  A NULL bound leaves that end open.
+        // If "prefix_extractor" is non-NULL, after a Seek() the iterator
+        // also ends at the files that can only hold keys of other prefixes
+        // than the target: as the keys of a prefix are contiguous, a file
+        // that starts after the target with another prefix (or ends
+        // before it with another prefix) and the ones beyond it hold none.
+        LevelFileNumIterator(const InternalKeyComparator& icmp, const std::vector<FileMetaData*>* flist,
+                             const Slice* lower_bound, const Slice* upper_bound, const SliceTransform* prefix_extractor)
+        : icmp_(icmp), flist_(flist), begin_(0), end_(flist->size()), prefix_extractor_(prefix_extractor), has_prefix_(false)
+        {
+            if (lower_bound != NULL)
+            {
+                InternalKey start(*lower_bound, kMaxSequenceNumber, kValueTypeForSeek);
+                begin_ = FindFile(icmp_, *flist_, start.Encode());
+            }
+            if (upper_bound != NULL)
+            {
+                // Find the first file that starts at or after the bound
+                const Comparator* ucmp = icmp_.user_comparator();
+                uint32_t left = begin_;
+                uint32_t right = end_;
+                while (left < right)
+                {
+                    uint32_t mid = (left + right) / 2;
+                    if (ucmp->Compare((*flist_)[mid]->smallest.user_key(), *upper_bound) < 0)
+                    {
+                        left = mid + 1;
+                    } else
+                    {
+                        right = mid;
+                    }
+                }
+                end_ = right;
+            }
+            index_ = end_;  // Marks as invalid
         }
         virtual bool Valid() const
         {
-            return index_ < flist_->size();
+            return index_ < end_;
         }
         virtual void Seek(const Slice& target)
         {
-            index_ = FindFile(icmp_, *flist_, target);
+            index_ = std::min<uint32_t>(std::max<uint32_t>(FindFile(icmp_, *flist_, target), begin_), end_);
+            const Slice user_target = ExtractUserKey(target);
+            has_prefix_ = (prefix_extractor_ != NULL && prefix_extractor_->InDomain(user_target));
+            if (has_prefix_)
+            {
+                Slice prefix = prefix_extractor_->Transform(user_target);
+                prefix_.assign(prefix.data(), prefix.size());
+                if (Valid() && !HasPrefix((*flist_)[index_]->smallest.user_key()) &&
+                    icmp_.user_comparator()->Compare((*flist_)[index_]->smallest.user_key(), user_target) > 0)
+                {
+                    index_ = end_;
+                }
+            }
+        }
+        virtual void SeekToFirst()
+        {
+            has_prefix_ = false;
+            index_ = begin_;
         }
-        virtual void SeekToFirst() { index_ = 0; }
         virtual void SeekToLast()
         {
-            index_ = flist_->empty() ? 0 : flist_->size() - 1;
+            has_prefix_ = false;
+            index_ = (begin_ == end_) ? end_ : end_ - 1;
         }
         virtual void Next()
         {
             assert(Valid());
             index_++;
+            if (has_prefix_ && Valid() && !HasPrefix((*flist_)[index_]->smallest.user_key()))
+            {
+                index_ = end_;
+            }
         }
         virtual void Prev()
         {
             assert(Valid());
-            if (index_ == 0)
+            if (index_ == begin_ || (has_prefix_ && !HasPrefix((*flist_)[index_ - 1]->largest.user_key())))
             {
-                index_ = flist_->size();  // Marks as invalid
+                index_ = end_;  // Marks as invalid
             } else
             {
                 index_--;
@@ -216,9 +287,19 @@ namespace leveldb
         }
         virtual Status status() const { return Status::OK(); }
     private:
+        bool HasPrefix(const Slice& user_key) const
+        {
+            return prefix_extractor_->InDomain(user_key) && prefix_extractor_->Transform(user_key) == Slice(prefix_);
+        }
+        
         const InternalKeyComparator icmp_;
         const std::vector<FileMetaData*>* const flist_;
+        uint32_t begin_;    // First file that may be in range
+        uint32_t end_;      // One past the last file that may be in range
         uint32_t index_;
+        const SliceTransform* const prefix_extractor_;
+        std::string prefix_;    // Of the last Seek() target, if has_prefix_
+        bool has_prefix_;
         
         // Backing store for value().  Holds the file number and size.
         mutable char value_buf_[16];
@@ -238,15 +319,41 @@ namespace leveldb
     
     Iterator* Version::NewConcatenatingIterator(const ReadOptions& options, int level) const
     {
-        return NewTwoLevelIterator(new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator, vset_->table_cache_, options);
+        // The options of the DB hold the internal version of its prefix
+        // extractor, while file boundaries are compared as user keys.
+        const SliceTransform* prefix_extractor = NULL;
+        if (options.prefix_seek && vset_->options_->prefix_extractor != NULL)
+        {
+            prefix_extractor = static_cast<const InternalPrefixTransform*>(vset_->options_->prefix_extractor)->user_transform();
+        }
+        return NewTwoLevelIterator(new LevelFileNumIterator(vset_->icmp_, &files_[level], options.iterate_lower_bound, options.iterate_upper_bound,
+                                                            prefix_extractor),
+                                   &GetFileIterator, vset_->table_cache_, options);
+    }
+    
+    // Returns true iff *f may hold user keys within the iterate bounds of
+    // "options".
+    static bool FileInIterateBounds(const Comparator* ucmp, const ReadOptions& options, const FileMetaData* f)
+    {
+        if (AfterFile(ucmp, options.iterate_lower_bound, f))
+        {
+            return false;
+        }
+        return (options.iterate_upper_bound == NULL ||
+                ucmp->Compare(f->smallest.user_key(), *options.iterate_upper_bound) < 0);
     }
     
     void Version::AddIterators(const ReadOptions& options, std::vector<Iterator*>* iters)
     {
-        // Merge all level zero files together since they may overlap
+        // Merge all level zero files together since they may overlap.
+        // Files outside the iterate bounds are left out.
+        const Comparator* ucmp = vset_->icmp_.user_comparator();
         for (size_t i = 0; i < files_[0].size(); i++)
         {
-            iters->push_back(vset_->table_cache_->NewIterator(options, files_[0][i]->number, files_[0][i]->file_size));
+            if (FileInIterateBounds(ucmp, options, files_[0][i]))
+            {
+                iters->push_back(vset_->table_cache_->NewIterator(options, files_[0][i]->number, files_[0][i]->file_size));
+            }
         }
         
         // For levels > 0, we can use a concatenating iterator that sequentially
@@ -277,7 +384,21 @@ namespace leveldb
             const Comparator* ucmp;
             Slice user_key;
             std::string* value;
+            SequenceNumber sequence;    // Of the entry found
         };
+        
+        // Treat the key as deleted if a range tombstone of the file just
+        // searched covers it and is newer than the entry found there, if
+        // any.  The tombstone is also newer than any entry for the key in
+        // the files searched after this one.
+        inline void ApplyCoveringTombstone(Saver* saver, SequenceNumber covering)
+        {
+            if (covering > 0 && (saver->state == kNotFound ||
+                                 ((saver->state == kFound || saver->state == kDeleted) && saver->sequence < covering)))
+            {
+                saver->state = kDeleted;
+            }
+        }
     }
     static void SaveValue(void* arg, const Slice& ikey, const Slice& v)
     {
@@ -291,6 +412,7 @@ namespace leveldb
             if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0)
             {
                 s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+                s->sequence = parsed_key.sequence;
                 if (s->state == kFound)
                 {
                     s->value->assign(v.data(), v.size()); // 赋值
@@ -442,11 +564,13 @@ namespace leveldb
                 saver.ucmp = ucmp;
                 saver.user_key = user_key;
                 saver.value = value;
-                s = vset_->table_cache_->Get(options, f->number, f->file_size, ikey, &saver, SaveValue);
+                SequenceNumber covering;
+                s = vset_->table_cache_->Get(options, f->number, f->file_size, ikey, &saver, SaveValue, &covering);
                 if (!s.ok())
                 {
                     return s;
                 }
+                ApplyCoveringTombstone(&saver, covering);
                 switch (saver.state)
                 {
                     case kNotFound:
@@ -466,6 +590,205 @@ namespace leveldb
         return Status::NotFound(Slice());  // Use an empty error message for speed
     }
     
+    namespace
+    {
+        // Progress of one key of Version::MultiGet()
+        struct MultiGetState
+        {
+            Saver saver;
+            Slice ikey;
+            Status* status;
+            Version::GetStats* stats;
+            FileMetaData* last_file_read;
+            int last_file_read_level;
+            bool done;
+        };
+    }  // namespace
+    
+    // Look up all keys of "batch" in "f", which is at "level", with one
+    // table lookup.  *keys and *args are scratch space.
+    static void MultiGetFromFile(TableCache* table_cache, const ReadOptions& options, FileMetaData* f, int level,
+                                 const std::vector<MultiGetState*>& batch, std::vector<Slice>* keys, std::vector<void*>* args)
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+        keys->clear();
+        args->clear();
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            MultiGetState* st = batch[i];
+            if (st->last_file_read != NULL && st->stats->seek_file == NULL)
+            {
+                // We have had more than one seek for this read.  Charge the 1st file.
+                st->stats->seek_file = st->last_file_read;
+                st->stats->seek_file_level = st->last_file_read_level;
+            }
+            st->last_file_read = f;
+            st->last_file_read_level = level;
+            keys->push_back(st->ikey);
+            args->push_back(&st->saver);
+        }
+        
+        std::vector<SequenceNumber> covering(batch.size());
+        Status s = table_cache->MultiGet(options, f->number, f->file_size, keys->size(), &(*keys)[0], &(*args)[0], SaveValue, &covering[0]);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            MultiGetState* st = batch[i];
+            if (!s.ok())
+            {
+                *st->status = s;
+                st->done = true;
+                continue;
+            }
+            ApplyCoveringTombstone(&st->saver, covering[i]);
+            switch (st->saver.state)
+            {
+                case kNotFound:
+                    break;      // Keep searching in other files
+                case kFound:
+                    st->done = true;
+                    break;
+                case kDeleted:
+                    *st->status = Status::NotFound(Slice());  // Use empty error message for speed
+                    st->done = true;
+                    break;
+                case kCorrupt:
+                    *st->status = Status::Corruption("corrupted key for ", st->saver.user_key);
+                    st->done = true;
+                    break;
+            }
+        }
+    }
+    
+    void Version::MultiGet(const ReadOptions& options, int n, const LookupKey* const* keys, std::string* const* values, Status* statuses, GetStats* stats)
+    {
+        const Comparator* ucmp = vset_->icmp_.user_comparator();
+        std::vector<MultiGetState> states(n);
+        for (int i = 0; i < n; i++)
+        {
+            MultiGetState* st = &states[i];
+            st->saver.state = kNotFound;
+            st->saver.ucmp = ucmp;
+            st->saver.user_key = keys[i]->user_key();
+            st->saver.value = values[i];
+            st->ikey = keys[i]->internal_key();
+            st->status = &statuses[i];
+            st->stats = &stats[i];
+            st->stats->seek_file = NULL;
+            st->stats->seek_file_level = -1;
+            st->last_file_read = NULL;
+            st->last_file_read_level = -1;
+            st->done = false;
+            statuses[i] = Status::OK();
+        }
+        
+        // As in Get(), search level-by-level, but visit each file only once
+        // for all the keys that may be in it.
+        std::vector<MultiGetState*> batch;
+        std::vector<Slice> scratch_keys;
+        std::vector<void*> scratch_args;
+        for (int level = 0; level < config::kNumLevels; level++)
+        {
+            const size_t num_files = files_[level].size();
+            if (num_files == 0) continue;
+            
+            if (level == 0)
+            {
+                // Level-0 files may overlap each other, so visit them all from
+                // newest to oldest.
+                std::vector<FileMetaData*> tmp(files_[0]);
+                std::sort(tmp.begin(), tmp.end(), NewestFirst);
+                for (size_t j = 0; j < tmp.size(); j++)
+                {
+                    FileMetaData* f = tmp[j];
+                    batch.clear();
+                    for (int i = 0; i < n; i++)
+                    {
+                        const Slice user_key = states[i].saver.user_key;
+                        if (!states[i].done && ucmp->Compare(user_key, f->smallest.user_key()) >= 0 && ucmp->Compare(user_key, f->largest.user_key()) <= 0)
+                        {
+                            batch.push_back(&states[i]);
+                        }
+                    }
+                    MultiGetFromFile(vset_->table_cache_, options, f, level, batch, &scratch_keys, &scratch_args);
+                }
+            } else
+            {
+                int i = 0;
+                while (i < n)
+                {
+                    if (states[i].done)
+                    {
+                        i++;
+                        continue;
+                    }
+                    // Binary search to find earliest index whose largest key >= ikey.
+                    uint32_t index = FindFile(vset_->icmp_, files_[level], states[i].ikey);
+                    if (index >= num_files)
+                    {
+                        // This and all later keys are past the last file
+                        break;
+                    }
+                    FileMetaData* f = files_[level][index];
+                    batch.clear();
+                    for (; i < n; i++)
+                    {
+                        if (states[i].done) continue;
+                        if (vset_->icmp_.Compare(states[i].ikey, f->largest.Encode()) > 0) break;
+                        if (ucmp->Compare(states[i].saver.user_key, f->smallest.user_key()) >= 0)
+                        {
+                            batch.push_back(&states[i]);
+                        }
+                    }
+                    MultiGetFromFile(vset_->table_cache_, options, f, level, batch, &scratch_keys, &scratch_args);
+                }
+            }
+        }
+        
+        for (int i = 0; i < n; i++)
+        {
+            if (!states[i].done)
+            {
+                statuses[i] = Status::NotFound(Slice());  // Use an empty error message for speed
+            }
+        }
+    }
+    
+    Status Version::GetRangeTombstones(const RangeTombstoneList** list)
+    {
+        MutexLock l(&range_tombstones_mutex_);
+        if (range_tombstones_ == NULL)
+        {
+            RangeTombstoneList* result = new RangeTombstoneList(vset_->icmp_.user_comparator());
+            Status s;
+            for (int level = 0; level < config::kNumLevels && s.ok(); level++)
+            {
+                for (size_t i = 0; i < files_[level].size() && s.ok(); i++)
+                {
+                    // Only the files with tombstones need to be opened
+                    const FileMetaData* f = files_[level][i];
+                    if (f->num_range_deletions > 0)
+                    {
+                        s = vset_->table_cache_->AddRangeTombstones(f->number, f->file_size, result);
+                    }
+                }
+            }
+            if (!s.ok())
+            {
+                // Not kept, so that a later call may try again
+                delete result;
+                *list = NULL;
+                return s;
+            }
+            result->Finish();
+            range_tombstones_ = result;
+        }
+        *list = range_tombstones_;
+        return Status::OK();
+    }
+    
     bool Version::UpdateStats(const GetStats& stats)
     {
         FileMetaData* f = stats.seek_file;
@@ -900,6 +1223,13 @@ namespace leveldb
     
     Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu)
     {
+        if (options_->deletion_compaction_ratio <= 0)
+        {
+            // Nothing reads the counts; keep the manifest readable by
+            // builds that do not know them
+            edit->ClearEntryCounts();
+        }
+        
         if (edit->has_log_number_)
         {
             assert(edit->log_number_ >= log_number_);
@@ -915,7 +1245,7 @@ namespace leveldb
         }
         
         edit->SetNextFile(next_file_number_);
-        edit->SetLastSequence(last_sequence_);
+        edit->SetLastSequence(last_sequence_.NoBarrier_Load());
         
         Version* v = new Version(this);
         {
@@ -1120,7 +1450,7 @@ namespace leveldb
             AppendVersion(v);
             manifest_file_number_ = next_file;
             next_file_number_ = next_file + 1;
-            last_sequence_ = last_sequence;
+            last_sequence_.Release_Store(last_sequence);
             log_number_ = log_number;
             prev_log_number_ = prev_log_number;
         }
@@ -1166,6 +1496,7 @@ namespace leveldb
                 score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
             }
             
+            v->compaction_scores_[level] = score;
             if (score > best_score) // 得到分数最大的
             {
                 best_level = level;
@@ -1175,6 +1506,32 @@ namespace leveldb
         
         v->compaction_level_ = best_level;
         v->compaction_score_ = best_score;
+        
+        // Look for the file that is the most full of deletions.  Files in the
+        // last level are left alone: there is no level to compact them into.
+        const double ratio = options_->deletion_compaction_ratio;
+        if (ratio > 0)
+        {
+            double best_ratio = ratio;
+            for (int level = 0; level < config::kNumLevels-1; level++)
+            {
+                for (size_t i = 0; i < v->files_[level].size(); i++)
+                {
+                    FileMetaData* f = v->files_[level][i];
+                    if (f->being_compacted || f->num_entries < static_cast<uint64_t>(config::kMinEntriesForDeletionCompaction))
+                    {
+                        continue;
+                    }
+                    const double deleted = static_cast<double>(f->num_deletions) / f->num_entries;
+                    if (deleted >= best_ratio)
+                    {
+                        v->deletion_file_to_compact_ = f;
+                        v->deletion_file_to_compact_level_ = level;
+                        best_ratio = deleted;
+                    }
+                }
+            }
+        }
     }
     
     Status VersionSet::WriteSnapshot(log::Writer* log)
@@ -1202,9 +1559,13 @@ namespace leveldb
             const std::vector<FileMetaData*>& files = current_->files_[level];
             for (size_t i = 0; i < files.size(); i++) {
                 const FileMetaData* f = files[i];
-                edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+                edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest, f->num_entries, f->num_deletions, f->num_range_deletions);
             }
         }
+        if (options_->deletion_compaction_ratio <= 0)
+        {
+            edit.ClearEntryCounts();
+        }
         
         std::string record;
         edit.EncodeTo(&record);
@@ -1359,6 +1720,7 @@ namespace leveldb
         ReadOptions options;
         options.verify_checksums = options_->paranoid_checks;
         options.fill_cache = false;
+        options.readahead_size = options_->compaction_readahead_size;
         
         // Level-0 files have to be merged together.  For other levels,
         // we will make a concatenating iterator per level.
@@ -1380,7 +1742,7 @@ namespace leveldb
                 } else
                 {
                     // Create concatenating iterator for the files from this level
-                    list[num++] = NewTwoLevelIterator(new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]), &GetFileIterator, table_cache_, options);
+                    list[num++] = NewTwoLevelIterator(new Version::LevelFileNumIterator(icmp_, &c->inputs_[which], NULL, NULL, NULL), &GetFileIterator, table_cache_, options);
                 }
             }
         }
@@ -1390,52 +1752,195 @@ namespace leveldb
         return result;
     }
     
+    Compaction* VersionSet::NewSubcompaction(Compaction* c)
+    {
+        Compaction* sub = new Compaction(c->level());
+        sub->input_version_ = c->input_version_;
+        sub->input_version_->Ref();
+        sub->inputs_[0] = c->inputs_[0];
+        sub->inputs_[1] = c->inputs_[1];
+        sub->grandparents_ = c->grandparents_;
+        return sub;
+    }
+    
+    namespace
+    {
+        struct InternalKeyLess
+        {
+            const InternalKeyComparator* icmp;
+            explicit InternalKeyLess(const InternalKeyComparator* c) : icmp(c) { }
+            bool operator()(const InternalKey& a, const InternalKey& b) const
+            {
+                return icmp->Compare(a, b) < 0;
+            }
+        };
+    }  // namespace
+    
+    void VersionSet::GetSubcompactionBoundaries(Compaction* c, int max_pieces, std::vector<std::string>* boundaries)
+    {
+        boundaries->clear();
+        if (max_pieces <= 1)
+        {
+            return;
+        }
+        
+        // Candidate split points are the boundaries of the input files.
+        std::vector<InternalKey> keys;
+        for (int which = 0; which < 2; which++)
+        {
+            for (size_t i = 0; i < c->inputs_[which].size(); i++)
+            {
+                keys.push_back(c->inputs_[which][i]->smallest);
+                keys.push_back(c->inputs_[which][i]->largest);
+            }
+        }
+        std::sort(keys.begin(), keys.end(), InternalKeyLess(&icmp_));
+        
+        // Splits happen between user keys, so that every version of a key is
+        // handled by the same piece.
+        const Comparator* user_cmp = icmp_.user_comparator();
+        std::vector<std::string> user_keys;
+        std::vector<uint64_t> offsets;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            const Slice user_key = keys[i].user_key();
+            if (!user_keys.empty() && user_cmp->Compare(user_key, user_keys.back()) == 0)
+            {
+                continue;
+            }
+            user_keys.push_back(user_key.ToString());
+            offsets.push_back(ApproximateOffsetOf(c->input_version_, InternalKey(user_key, kMaxSequenceNumber, kValueTypeForSeek)));
+        }
+        if (user_keys.size() < 3)
+        {
+            return;
+        }
+        
+        const uint64_t target = (offsets.back() - offsets.front()) / max_pieces;
+        if (target == 0)
+        {
+            return;
+        }
+        uint64_t next = offsets.front() + target;
+        // Neither the first nor the last key makes a useful split point.
+        for (size_t i = 1; i + 1 < user_keys.size(); i++)
+        {
+            if (offsets[i] >= next)
+            {
+                boundaries->push_back(user_keys[i]);
+                if (static_cast<int>(boundaries->size()) == max_pieces - 1)
+                {
+                    break;
+                }
+                next = offsets[i] + target;
+            }
+        }
+    }
+    
     Compaction* VersionSet::PickCompaction()
     {
-        Compaction* c;
-        int level;
+        // Order the levels that need a size compaction by decreasing score.
+        // The best level may be busy with another compaction, in which case
+        // we fall back to the next one.
+        int levels[config::kNumLevels];
+        int num_levels = 0;
+        for (int level = 0; level < config::kNumLevels - 1; level++)
+        {
+            const double score = current_->compaction_scores_[level];
+            if (score >= 1)
+            {
+                int i = num_levels++;
+                while (i > 0 && current_->compaction_scores_[levels[i-1]] < score)
+                {
+                    levels[i] = levels[i-1];
+                    i--;
+                }
+                levels[i] = level;
+            }
+        }
         
         // We prefer compactions triggered by too much data in a level over
         // the compactions triggered by seeks.
-        const bool size_compaction = (current_->compaction_score_ >= 1);
-        const bool seek_compaction = (current_->file_to_compact_ != NULL);
-        if (size_compaction)
+        for (int i = 0; i < num_levels; i++)
         {
-            level = current_->compaction_level_;
-            assert(level >= 0);
+            const int level = levels[i];
             assert(level+1 < config::kNumLevels);
-            c = new Compaction(level);
+            const std::vector<FileMetaData*>& files = current_->files_[level];
             
-            // Pick the first file that comes after compact_pointer_[level]
-            for (size_t i = 0; i < current_->files_[level].size(); i++)
+            // Pick the first idle file that comes after compact_pointer_[level]
+            FileMetaData* first_idle = NULL;
+            FileMetaData* picked = NULL;
+            for (size_t j = 0; j < files.size(); j++)
             {
-                FileMetaData* f = current_->files_[level][i];
+                FileMetaData* f = files[j];
+                if (f->being_compacted)
+                {
+                    continue;
+                }
+                if (first_idle == NULL)
+                {
+                    first_idle = f;
+                }
                 if (compact_pointer_[level].empty() || icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0)
                 {
-                    c->inputs_[0].push_back(f);
+                    picked = f;
                     break;
                 }
             }
-            if (c->inputs_[0].empty())
+            if (picked == NULL)
             {
                 // Wrap-around to the beginning of the key space
-                c->inputs_[0].push_back(current_->files_[level][0]);
+                picked = first_idle;
             }
-        } else if (seek_compaction)
-        {
-            level = current_->file_to_compact_level_;
-            c = new Compaction(level);
-            c->inputs_[0].push_back(current_->file_to_compact_);
-        } else
+            if (picked == NULL)
+            {
+                continue;  // Every file in this level is being compacted
+            }
+            
+            Compaction* c = new Compaction(level);
+            c->inputs_[0].push_back(picked);
+            if (SetupInputs(c))
+            {
+                return c;
+            }
+            delete c;
+        }
+        
+        FileMetaData* f = current_->file_to_compact_;
+        if (f != NULL && !f->being_compacted)
         {
-            return NULL;
+            Compaction* c = new Compaction(current_->file_to_compact_level_);
+            c->inputs_[0].push_back(f);
+            if (SetupInputs(c))
+            {
+                return c;
+            }
+            delete c;
         }
         
+        // Last come the files that are mostly deletions
+        f = current_->deletion_file_to_compact_;
+        if (f != NULL && !f->being_compacted)
+        {
+            Compaction* c = new Compaction(current_->deletion_file_to_compact_level_);
+            c->for_deletions_ = true;
+            c->inputs_[0].push_back(f);
+            if (SetupInputs(c))
+            {
+                return c;
+            }
+            delete c;
+        }
+        return NULL;
+    }
+    
+    bool VersionSet::SetupInputs(Compaction* c)
+    {
         c->input_version_ = current_;
         c->input_version_->Ref();
         
         // Files in level 0 may overlap each other, so pick up all overlapping ones
-        if (level == 0)
+        if (c->level() == 0)
         {
             InternalKey smallest, largest;
             GetRange(c->inputs_[0], &smallest, &largest);
@@ -1446,18 +1951,25 @@ namespace leveldb
             assert(!c->inputs_[0].empty());
         }
         
-        SetupOtherInputs(c);
-        
-        return c;
+        if (AnyBeingCompacted(c->inputs_[0]) || !SetupOtherInputs(c))
+        {
+            return false;
+        }
+        c->MarkFilesBeingCompacted(true);
+        return true;
     }
     
-    void VersionSet::SetupOtherInputs(Compaction* c)
+    bool VersionSet::SetupOtherInputs(Compaction* c)
     {
         const int level = c->level();
         InternalKey smallest, largest;
         GetRange(c->inputs_[0], &smallest, &largest);
         
         current_->GetOverlappingInputs(level+1, &smallest, &largest, &c->inputs_[1]);
+        if (AnyBeingCompacted(c->inputs_[1]))
+        {
+            return false;
+        }
         
         // Get entire range covered by compaction
         InternalKey all_start, all_limit;
@@ -1472,13 +1984,13 @@ namespace leveldb
             const int64_t inputs0_size = TotalFileSize(c->inputs_[0]);
             const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
             const int64_t expanded0_size = TotalFileSize(expanded0);
-            if (expanded0.size() > c->inputs_[0].size() && inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit)
+            if (expanded0.size() > c->inputs_[0].size() && inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit && !AnyBeingCompacted(expanded0))
             {
                 InternalKey new_start, new_limit;
                 GetRange(expanded0, &new_start, &new_limit);
                 std::vector<FileMetaData*> expanded1;
                 current_->GetOverlappingInputs(level+1, &new_start, &new_limit, &expanded1);
-                if (expanded1.size() == c->inputs_[1].size())
+                if (expanded1.size() == c->inputs_[1].size() && !AnyBeingCompacted(expanded1))
                 {
                     Log(options_->info_log,
                         "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
@@ -1516,6 +2028,7 @@ namespace leveldb
         // key range next time.
         compact_pointer_[level] = largest.Encode().ToString();
         c->edit_.SetCompactPointer(level, largest);
+        return true;
     }
     
     Compaction* VersionSet::CompactRange(int level, const InternalKey* begin, const InternalKey* end)
@@ -1551,7 +2064,12 @@ namespace leveldb
         c->input_version_ = current_;
         c->input_version_->Ref();
         c->inputs_[0] = inputs;
+        // Manual compactions run while no other compaction is in progress
+        // and no DeleteFilesInRange() holds files (see
+        // DBImpl::MaybeScheduleCompaction()), so none of the inputs can be
+        // busy.
         SetupOtherInputs(c);
+        c->MarkFilesBeingCompacted(true);
         return c;
     }
     
@@ -1559,7 +2077,7 @@ namespace leveldb
      类：Compaction
      *****************************************************************************************************/
     
-    Compaction::Compaction(int level): level_(level), max_output_file_size_(MaxFileSizeForLevel(level)),
+    Compaction::Compaction(int level): level_(level), inputs_marked_(false), for_deletions_(false), max_output_file_size_(MaxFileSizeForLevel(level)),
     input_version_(NULL), grandparent_index_(0), seen_key_(false), overlapped_bytes_(0)
     {
         for (int i = 0; i < config::kNumLevels; i++)
@@ -1570,18 +2088,16 @@ namespace leveldb
     
     Compaction::~Compaction()
     {
-        if (input_version_ != NULL)
-        {
-            input_version_->Unref();
-        }
+        ReleaseInputs();
     }
     
     bool Compaction::IsTrivialMove() const
     {
         // Avoid a move if there is lots of overlapping grandparent data.
         // Otherwise, the move could create a parent file that will require
-        // a very expensive merge later on.
-        return (num_input_files(0) == 1 && num_input_files(1) == 0 && TotalFileSize(grandparents_) <= kMaxGrandParentOverlapBytes);
+        // a very expensive merge later on.  Neither move a file picked for
+        // its deletions, which only a merge can drop.
+        return (!for_deletions_ && num_input_files(0) == 1 && num_input_files(1) == 0 && TotalFileSize(grandparents_) <= kMaxGrandParentOverlapBytes);
     }
     
     void Compaction::AddInputDeletions(VersionEdit* edit)
@@ -1622,6 +2138,18 @@ namespace leveldb
         return true;
     }
     
+    bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end)
+    {
+        for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++)
+        {
+            if (input_version_->OverlapInLevel(lvl, &begin, &end))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    
     bool Compaction::ShouldStopBefore(const Slice& internal_key)
     {
         // Scan to find earliest grandparent file that contains key.
@@ -1647,8 +2175,26 @@ namespace leveldb
         }
     }
     
+    void Compaction::MarkFilesBeingCompacted(bool mark)
+    {
+        for (int which = 0; which < 2; which++)
+        {
+            for (size_t i = 0; i < inputs_[which].size(); i++)
+            {
+                assert(inputs_[which][i]->being_compacted != mark);
+                inputs_[which][i]->being_compacted = mark;
+            }
+        }
+        inputs_marked_ = mark;
+    }
+    
     void Compaction::ReleaseInputs()
     {
+        if (inputs_marked_)
+        {
+            // Must happen before the Unref() below, which may delete the files.
+            MarkFilesBeingCompacted(false);
+        }
         if (input_version_ != NULL)
         {
             input_version_->Unref();
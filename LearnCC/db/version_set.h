@@ -31,6 +31,7 @@ namespace leveldb
     class Compaction;
     class Iterator;
     class MemTable;
+    class RangeTombstoneList;
     class TableBuilder;
     class TableCache;
     class Version;
@@ -72,6 +73,19 @@ namespace leveldb
         };
         Status Get(const ReadOptions&, const LookupKey& key, std::string* val, GetStats* stats);
         
+        // Get() for keys[0..n-1], which must be sorted by user key.  Stores
+        // the result for keys[i] in *values[i], statuses[i] and stats[i].
+        // Each level is walked once, and keys that land in the same file are
+        // looked up together.
+        // REQUIRES: lock is not held
+        void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys, std::string* const* values, Status* statuses, GetStats* stats);
+        
+        // Sets *list to the range tombstones of all the files of this
+        // version, which are read from the files that have any when this
+        // is first called.  *list stays valid while this version is live.
+        // REQUIRES: lock is not held
+        Status GetRangeTombstones(const RangeTombstoneList** list);
+        
         // Adds "stats" into the current state.  Returns true if a new
         // compaction may need to be triggered, false otherwise.
         // REQUIRES: lock is held
@@ -134,19 +148,40 @@ namespace leveldb
         FileMetaData* file_to_compact_;
         int file_to_compact_level_;
         
+        // File with the largest fraction of deletions, if that reaches
+        // Options::deletion_compaction_ratio.  Initialized by Finalize().
+        FileMetaData* deletion_file_to_compact_;
+        int deletion_file_to_compact_level_;
+        
         // Level that should be compacted next and its compaction score.
         // Score < 1 means compaction is not strictly needed.  These fields
         // are initialized by Finalize().
         double compaction_score_;
         int compaction_level_;
         
+        // Compaction score of every level, so that PickCompaction() can fall
+        // back to another level while the best one is busy.  Initialized by
+        // Finalize().
+        double compaction_scores_[config::kNumLevels];
+        
+        // Filled in by the first call to GetRangeTombstones()
+        port::Mutex range_tombstones_mutex_;
+        RangeTombstoneList* range_tombstones_;
+        
         explicit Version(VersionSet* vset)
         : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
+        deletion_file_to_compact_(NULL),
+        deletion_file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1)
+        compaction_level_(-1),
+        range_tombstones_(NULL)
         {
+            for (int level = 0; level < config::kNumLevels; level++)
+            {
+                compaction_scores_[level] = -1;
+            }
         }
         
         ~Version();
@@ -198,14 +233,15 @@ namespace leveldb
         // Return the combined file size of all files at the specified level.
         int64_t NumLevelBytes(int level) const;
         
-        // Return the last sequence number.
-        uint64_t LastSequence() const { return last_sequence_; }
+        // Return the last sequence number.  May be called without holding
+        // the DB mutex; all writes up to the returned sequence are visible.
+        uint64_t LastSequence() const { return last_sequence_.Acquire_Load(); }
         
         // Set the last sequence number to s.
         void SetLastSequence(uint64_t s)
         {
-            assert(s >= last_sequence_);
-            last_sequence_ = s;
+            assert(s >= last_sequence_.NoBarrier_Load());
+            last_sequence_.Release_Store(s);
         }
         
         // Mark the specified file number as used.
@@ -222,6 +258,10 @@ namespace leveldb
         // Returns NULL if there is no compaction to be done.
         // Otherwise returns a pointer to a heap-allocated object that
         // describes the compaction.  Caller should delete the result.
+        //
+        // Files that are inputs of a compaction returned earlier and not yet
+        // deleted are never picked again, so several compactions returned by
+        // this method may run concurrently.
         Compaction* PickCompaction();
         
         // Return a compaction object for compacting the range [begin,end] in
@@ -238,11 +278,24 @@ namespace leveldb
         // The caller should delete the iterator when no longer needed.
         Iterator* MakeInputIterator(Compaction* c);
         
+        // Return a compaction over the same inputs as "*c" with its own
+        // output-splitting state, so that several threads can each process a
+        // disjoint key range of "*c".  The result does not claim the input
+        // files; the caller should delete it with the DB mutex held.
+        // REQUIRES: DB mutex held
+        Compaction* NewSubcompaction(Compaction* c);
+        
+        // Split the key range of "*c" into at most "max_pieces" ranges holding
+        // roughly the same amount of data.  Stores the user keys at which the
+        // ranges start, except for the first one, in sorted order in
+        // *boundaries; leaves it empty if the compaction is not worth splitting.
+        void GetSubcompactionBoundaries(Compaction* c, int max_pieces, std::vector<std::string>* boundaries);
+        
         // Returns true iff some level needs a compaction.
         bool NeedsCompaction() const
         {
             Version* v = current_;
-            return (v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL);
+            return (v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL) || (v->deletion_file_to_compact_ != NULL);
         }
         
         // Add all files listed in any live version to *live.
@@ -278,7 +331,14 @@ namespace leveldb
                        InternalKey* smallest,
                        InternalKey* largest);
         
-        void SetupOtherInputs(Compaction* c);
+        // Returns false if the compaction would need a file that is already
+        // being compacted.
+        bool SetupOtherInputs(Compaction* c);
+        
+        // Fill in the rest of a compaction whose inputs_[0] holds its seed
+        // file, and claim all its input files.  Returns false (leaving the
+        // files unclaimed) if the compaction conflicts with a running one.
+        bool SetupInputs(Compaction* c);
         
         // Save current contents to *log
         Status WriteSnapshot(log::Writer* log);
@@ -292,7 +352,7 @@ namespace leveldb
         const InternalKeyComparator icmp_;
         uint64_t next_file_number_;
         uint64_t manifest_file_number_;
-        uint64_t last_sequence_;
+        port::AtomicUint64 last_sequence_;
         uint64_t log_number_;
         uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
         
@@ -346,12 +406,18 @@ namespace leveldb
         // in levels greater than "level+1".
         bool IsBaseLevelForKey(const Slice& user_key);
         
+        // Like IsBaseLevelForKey(), for all the user keys in [begin, end].
+        // Unlike it, may be called for ranges in any order.
+        bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+        
         // Returns true iff we should stop building the current output
         // before processing "internal_key".
         bool ShouldStopBefore(const Slice& internal_key);
         
         // Release the input version for the compaction, once the compaction
-        // is successful.
+        // is successful.  Also makes the input files available to other
+        // compactions again.
+        // REQUIRES: DB mutex held
         void ReleaseInputs();
         
     private:
@@ -360,7 +426,12 @@ namespace leveldb
         
         explicit Compaction(int level);
         
+        // Set FileMetaData::being_compacted on every input file to "mark".
+        void MarkFilesBeingCompacted(bool mark);
+        
         int level_;
+        bool inputs_marked_;  // Did this compaction claim its input files?
+        bool for_deletions_;  // Picked to get rid of deletions?
         uint64_t max_output_file_size_;
         Version* input_version_;
         VersionEdit edit_;
@@ -8,7 +8,8 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -35,6 +36,8 @@ namespace leveldb {
     
     WriteBatch::Handler::~Handler() { }
     
+    void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) { }
+    
     void WriteBatch::Clear()
     {
         rep_.clear();
@@ -77,6 +80,15 @@ namespace leveldb {
                         return Status::Corruption("bad WriteBatch Delete");
                     }
                     break;
+                case kTypeRangeDeletion:
+                    if (GetLengthPrefixedSlice(&input, &key) && GetLengthPrefixedSlice(&input, &value))
+                    {
+                        handler->DeleteRange(key, value);
+                    } else
+                    {
+                        return Status::Corruption("bad WriteBatch DeleteRange");
+                    }
+                    break;
                 default:
                     return Status::Corruption("unknown WriteBatch tag");
             }
@@ -125,6 +137,14 @@ namespace leveldb {
         PutLengthPrefixedSlice(&rep_, key);
     }
     
+    void WriteBatch::DeleteRange(const Slice& begin, const Slice& end)
+    {
+        WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+        rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+        PutLengthPrefixedSlice(&rep_, begin);
+        PutLengthPrefixedSlice(&rep_, end);
+    }
+    
     namespace
     {
         class MemTableInserter : public WriteBatch::Handler
@@ -132,25 +152,32 @@ namespace leveldb {
         public:
             SequenceNumber sequence_;
             MemTable* mem_;
+            bool concurrently_;
             
             virtual void Put(const Slice& key, const Slice& value)
             {
-                mem_->Add(sequence_, kTypeValue, key, value);
+                mem_->Add(sequence_, kTypeValue, key, value, concurrently_);
                 sequence_++;
             }
             virtual void Delete(const Slice& key)
             {
-                mem_->Add(sequence_, kTypeDeletion, key, Slice());
+                mem_->Add(sequence_, kTypeDeletion, key, Slice(), concurrently_);
+                sequence_++;
+            }
+            virtual void DeleteRange(const Slice& begin, const Slice& end)
+            {
+                mem_->Add(sequence_, kTypeRangeDeletion, begin, end, concurrently_);
                 sequence_++;
             }
         };
     }  // namespace
     
-    Status WriteBatchInternal::InsertInto(const WriteBatch* b, MemTable* memtable)
+    Status WriteBatchInternal::InsertInto(const WriteBatch* b, MemTable* memtable, bool concurrently)
     {
         MemTableInserter inserter;
         inserter.sequence_ = WriteBatchInternal::Sequence(b);
         inserter.mem_ = memtable;
+        inserter.concurrently_ = concurrently;
         return b->Iterate(&inserter);
     }
     
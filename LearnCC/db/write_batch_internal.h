@@ -43,7 +43,9 @@ namespace leveldb
         
         static void SetContents(WriteBatch* batch, const Slice& contents);
         
-        static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
+        // If "concurrently" is true, other threads may insert into "memtable"
+        // at the same time (see MemTable::Add()).
+        static Status InsertInto(const WriteBatch* batch, MemTable* memtable, bool concurrently = false);
         
         static void Append(WriteBatch* dst, const WriteBatch* src);
     };
@@ -30,6 +30,43 @@ namespace leveldb
     // of Cache uses a least-recently-used eviction policy.
     extern Cache* NewLRUCache(size_t capacity);
     
+    // Like NewLRUCache(capacity), but up to high_pri_pool_ratio of the
+    // capacity is reserved for entries inserted with Cache::HIGH priority
+    // and for entries that were looked up at least once after they were
+    // inserted.  Other entries are inserted at the midpoint of the LRU list
+    // and are evicted first, so a scan that touches many blocks once cannot
+    // push out the ones that are used repeatedly.  A ratio of 0 gives a
+    // plain LRU cache.  NewLRUCache(capacity) uses a ratio of 0.5.
+    extern Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+    
+    // Like NewLRUCache(capacity), but split in 2^num_shard_bits shards
+    // (16 by default), each with its own lock.  More shards reduce
+    // contention between threads; fewer keep each shard of a small cache
+    // big enough to be useful.  A negative num_shard_bits picks a count
+    // that gives each shard at least 512KB, up to 64 shards.
+    //
+    // Entries are never evicted while a client holds a handle to them, so
+    // by default usage may exceed the capacity when many are pinned.  If
+    // strict_capacity_limit is true, Insert() instead returns NULL when
+    // the entry does not fit, and the caller keeps ownership of "value".
+    extern Cache* NewLRUCache(size_t capacity, int num_shard_bits, bool strict_capacity_limit);
+    extern Cache* NewLRUCache(size_t capacity, int num_shard_bits, bool strict_capacity_limit, double high_pri_pool_ratio);
+    
+    // Create a new cache with a fixed size capacity, split in
+    // 2^num_shard_bits shards, that evicts entries with the CLOCK
+    // algorithm.  Lookup() and Release() take no locks, so threads that
+    // read the same hot blocks do not contend on a shard mutex.  Entries
+    // inserted with Cache::HIGH priority or looked up often survive more
+    // sweeps of the clock.
+    //
+    // Each shard is a hash table with a fixed number of slots, sized for
+    // entries of about estimated_entry_charge (4KB, the default
+    // Options::block_size, if not given).  A shard also evicts entries
+    // when its table fills up.  A negative num_shard_bits picks the shard
+    // count as for NewLRUCache().
+    extern Cache* NewClockCache(size_t capacity, int num_shard_bits);
+    extern Cache* NewClockCache(size_t capacity, int num_shard_bits, size_t estimated_entry_charge);
+    
     class Cache
     {
     public:
@@ -42,17 +79,26 @@ namespace leveldb
         // Opaque handle to an entry stored in the cache.
         struct Handle { };
         
+        // Entries inserted with HIGH priority are kept in preference to LOW
+        // priority ones, within limits set by the implementation.
+        enum Priority { HIGH, LOW };
+        
         // Insert a mapping from key->value into the cache and assign it
         // the specified charge against the total cache capacity.
         //
         // Returns a handle that corresponds to the mapping.  The caller
         // must call this->Release(handle) when the returned mapping is no
-        // longer needed.
+        // longer needed.  Caches with a strict capacity limit return NULL
+        // if the entry does not fit; the caller then still owns "value".
         //
         // When the inserted entry is no longer needed, the key and
         // value will be passed to "deleter".
         virtual Handle* Insert(const Slice& key, void* value, size_t charge, void (*deleter)(const Slice& key, void* value)) = 0;
         
+        // Same as above, but with an eviction priority for the entry.  The
+        // default implementation ignores the priority.
+        virtual Handle* Insert(const Slice& key, void* value, size_t charge, void (*deleter)(const Slice& key, void* value), Priority priority);
+        
         // If the cache has no mapping for "key", returns NULL.
         //
         // Else return a handle that corresponds to the mapping.  The caller
@@ -82,6 +128,15 @@ namespace leveldb
         // its cache keys.
         virtual uint64_t NewId() = 0;
         
+        // Returns the total charge of the entries held by the cache,
+        // including those erased or evicted while clients still reference
+        // them.  Implementations that do not track usage return 0.
+        virtual size_t GetUsage() const;
+        
+        // Returns the part of GetUsage() held by entries that clients
+        // currently reference, which the cache cannot evict.
+        virtual size_t GetPinnedUsage() const;
+        
     private:
         void LRU_Remove(Handle* e);
         void LRU_Append(Handle* e);
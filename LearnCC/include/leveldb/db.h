@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 
@@ -67,6 +68,14 @@ namespace leveldb
         // Note: consider setting options.sync = true.
         virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
         
+        // Remove the database entries (if any) for the keys in ["begin",
+        // "end").  This writes a single range tombstone instead of one
+        // deletion per key; reads skip the entries it covers, and
+        // compactions drop them.  Returns OK on success, and a non-OK
+        // status on error.  It is not an error if the range is empty.
+        // Note: consider setting options.sync = true.
+        virtual Status DeleteRange(const WriteOptions& options, const Slice& begin, const Slice& end);
+        
         // Apply the specified updates to the database.
         // Returns OK on success, non-OK on failure.
         // Note: consider setting options.sync = true.
@@ -81,6 +90,13 @@ namespace leveldb
         // May return some other Status on an error.
         virtual Status Get(const ReadOptions& options, const Slice& key, std::string* value) = 0;
         
+        // Look up several keys at once.  (*values)[i] and the i-th returned
+        // status hold the result of Get() for keys[i]; all keys are read
+        // from the same state of the database.  This is cheaper than
+        // calling Get() for each key since the keys are sorted and looked
+        // up together, sharing table and block reads.
+        virtual std::vector<Status> MultiGet(const ReadOptions& options, const std::vector<Slice>& keys, std::vector<std::string>* values);
+        
         // Return a heap-allocated iterator over the contents of the database.
         // The result of NewIterator() is initially invalid (caller must
         // call one of the Seek methods on the iterator before using it).
@@ -113,6 +129,11 @@ namespace leveldb
         //     about the internal operation of the DB.
         //  "leveldb.sstables" - returns a multi-line string that describes all
         //     of the sstables that make up the db contents.
+        //  "leveldb.block-cache-stats" - returns a table of the block cache
+        //     hits, misses and hit rate for data, index and filter blocks,
+        //     and of the row cache, compressed block cache and persistent
+        //     cache (see Options::row_cache, compressed_block_cache and
+        //     persistent_cache).
         virtual bool GetProperty(const Slice& property, std::string* value) = 0;
         
         // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -137,6 +158,18 @@ namespace leveldb
         //    db->CompactRange(NULL, NULL);
         virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
         
+        // Delete the table files whose keys all lie in [*begin,*end], with
+        // the same meaning of NULL as for CompactRange(), without reading
+        // or rewriting any data.  This is much cheaper than deleting the
+        // keys, but only removes data from whole files: keys in the range
+        // that are in files straddling its bounds, or are not yet in any
+        // file, are kept, and an older value of a key may reappear if its
+        // newer value was in a deleted file.  Call DeleteRange() for the
+        // same range afterwards to hide what remains.  Files that are being
+        // compacted are kept as well.  The default implementation returns
+        // a NotSupported status.
+        virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+        
     private:
         // No copying allowed
         DB(const DB&);
@@ -35,6 +35,11 @@ namespace leveldb
         Env() { }
         virtual ~Env();
         
+        // Priority of a background work item.  HIGH is meant for short,
+        // latency-sensitive jobs (e.g. memtable flushes) that should not queue
+        // behind long-running LOW priority jobs (e.g. compactions).
+        enum Priority { LOW, HIGH, TOTAL };
+        
         // Return a default environment suitable for the current operating
         // system.  Sophisticated users may wish to provide their own Env
         // implementation instead of relying on this default environment.
@@ -112,13 +117,24 @@ namespace leveldb
         // REQUIRES: lock has not already been unlocked.
         virtual Status UnlockFile(FileLock* lock) = 0;
         
-        // Arrange to run "(*function)(arg)" once in a background thread.
+        // Arrange to run "(*function)(arg)" once in a background thread, in
+        // the thread pool specified by "pri".
         //
         // "function" may run in an unspecified thread.  Multiple functions
         // added to the same Env may run concurrently in different threads.
         // I.e., the caller may not assume that background work items are
         // serialized.
-        virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
+        virtual void Schedule(void (*function)(void* arg), void* arg, Priority pri = LOW) = 0;
+        
+        // Set the number of background threads used by the thread pool for
+        // "pri".  May be called at any time; surplus threads exit once they
+        // finish their current work item.  The default implementation ignores
+        // the request.
+        virtual void SetBackgroundThreads(int number, Priority pri = LOW) { }
+        
+        // Return the number of work items waiting to run in the thread pool
+        // for "pri".
+        virtual int GetThreadPoolQueueLen(Priority pri = LOW) const { return 0; }
         
         // Start a new thread, invoking "function(arg)" within the new thread.
         // When "function(arg)" returns, the thread will be destroyed.
@@ -315,9 +331,17 @@ namespace leveldb
             return target_->LockFile(f, l);
         }
         Status UnlockFile(FileLock* l) { return target_->UnlockFile(l); }
-        void Schedule(void (*f)(void*), void* a)
+        void Schedule(void (*f)(void*), void* a, Priority pri = LOW)
+        {
+            return target_->Schedule(f, a, pri);
+        }
+        void SetBackgroundThreads(int number, Priority pri = LOW)
+        {
+            return target_->SetBackgroundThreads(number, pri);
+        }
+        int GetThreadPoolQueueLen(Priority pri = LOW) const
         {
-            return target_->Schedule(f, a);
+            return target_->GetThreadPoolQueueLen(pri);
         }
         void StartThread(void (*f)(void*), void* a)
         {
@@ -25,6 +25,20 @@ class Slice;
 class FilterPolicy
 {
  public:
+  // Builds a filter from keys added one at a time, so that the caller
+  // does not have to keep them all until the filter is made.
+  class Builder
+  {
+   public:
+    virtual ~Builder();
+
+    virtual void AddKey(const Slice& key) = 0;
+
+    // Append to *dst a filter that matches the keys added since the
+    // previous call, as CreateFilter() would, and start over.
+    virtual void Finish(std::string* dst) = 0;
+  };
+
   virtual ~FilterPolicy();
 
   // Return the name of this policy.  Note that if the filter encoding
@@ -48,6 +62,11 @@ class FilterPolicy
   // This method may return true or false if the key was not on the
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+  // Return a new Builder for the filters of this policy, or NULL if the
+  // policy only makes them with CreateFilter().  The caller must delete
+  // the result.  The default implementation returns NULL.
+  virtual Builder* NewBuilder() const;
 };
 
 // Return a new filter policy that uses a bloom filter with approximately
@@ -66,6 +85,17 @@ class FilterPolicy
 // trailing spaces in keys.
 extern const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy like NewBloomFilterPolicy(), except that
+// all the probes for a key fall within a single 64-byte cache line, so
+// a lookup costs one cache miss instead of up to k.  The price is a
+// slightly higher false positive rate for the same bits_per_key.
+//
+// The filters it builds use a different encoding (and Name()) from
+// NewBloomFilterPolicy(); tables written with the old policy stay
+// readable only while that policy is configured.  The same comparator
+// caveat as NewBloomFilterPolicy() applies.
+extern const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key);
+
 }
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
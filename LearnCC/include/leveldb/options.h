@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <vector>
 
 namespace leveldb
 {
@@ -15,6 +16,9 @@ namespace leveldb
     class Env;
     class FilterPolicy;
     class Logger;
+    class PersistentCache;
+    class Slice;
+    class SliceTransform;
     class Snapshot;
     
     // DB contents are stored in a set of blocks, each of which holds a
@@ -26,7 +30,9 @@ namespace leveldb
         // NOTE: do not change the values of existing entries, as these are
         // part of the persistent format on disk.
         kNoCompression     = 0x0,
-        kSnappyCompression = 0x1
+        kSnappyCompression = 0x1,
+        kLZ4Compression    = 0x4,
+        kZstdCompression   = 0x7
     };
     
     // Options to control the behavior of a database (passed to DB::Open)
@@ -85,6 +91,23 @@ namespace leveldb
         // Default: 4MB
         size_t write_buffer_size;
         
+        // If true, the writers of a group commit insert their own batches
+        // into the memtable in parallel once the group's log record has been
+        // written, instead of the group leader inserting all of them.
+        // Helps when many threads write at the same time.
+        //
+        // Default: false
+        bool allow_concurrent_memtable_write;
+        
+        // If true, a write group leaves the writer queue as soon as its log
+        // record is written, so the next group's log write overlaps this
+        // group's memtable insert.  Groups are still applied and made
+        // visible in log order.  Takes precedence over
+        // allow_concurrent_memtable_write.
+        //
+        // Default: false
+        bool enable_pipelined_write;
+        
         // Number of open files that can be used by the DB.  You may need to
         // increase this if your database has a large working set (budget
         // one open file per 2MB of working set).
@@ -92,6 +115,45 @@ namespace leveldb
         // Default: 1000
         int max_open_files;
         
+        // Maximum number of compactions that may run concurrently.  Compactions
+        // run in the Env's LOW priority thread pool, so raising this only helps
+        // if that pool has at least as many threads, e.g.
+        //    env->SetBackgroundThreads(4, Env::LOW);
+        // Memtable flushes are scheduled separately in the HIGH priority pool
+        // and never wait behind compactions.
+        //
+        // Default: 1
+        int max_background_compactions;
+        
+        // Maximum number of threads a single compaction may be split across.
+        // When greater than 1, the key range of a compaction is cut at input
+        // file boundaries into up to this many pieces of similar size, which
+        // are merged in parallel and installed together.  The extra pieces
+        // are scheduled in the Env's LOW priority thread pool; those that no
+        // pool thread has started by the time the compaction's own thread is
+        // free are run by that thread.
+        //
+        // Default: 1
+        int max_subcompactions;
+        
+        // If non-zero, compactions read their input tables this many bytes
+        // at a time (see ReadOptions::readahead_size).  If zero, they read
+        // ahead automatically like any other scan.
+        //
+        // Default: 0
+        size_t compaction_readahead_size;
+        
+        // A table in which deletions (deletion markers and range tombstones)
+        // make up at least this fraction of the entries is compacted into the
+        // next level even if its own level is not too large, so that the
+        // deleted data stops slowing down reads.  Tables with few entries are
+        // left alone.  Zero disables these compactions.  When enabled, the
+        // entry counts of tables are kept in the MANIFEST, which builds
+        // that do not know them cannot read.
+        //
+        // Default: 0 (a good value is 0.5)
+        double deletion_compaction_ratio;
+        
         // Control over blocks (user data is stored in a set of blocks, and
         // a block is the unit of reading from disk).
         
@@ -100,6 +162,36 @@ namespace leveldb
         // Default: NULL
         Cache* block_cache;
         
+        // If non-NULL, use the specified cache as a second tier behind
+        // block_cache for blocks that are stored compressed.  It keeps
+        // their compressed contents, so a block_cache miss found there
+        // costs a decompression but no read.  Since compressed blocks are
+        // smaller, it holds more of the data than block_cache could in the
+        // same memory.  Entries are added when such blocks are read from a
+        // table, under the same rules as block_cache entries.
+        // Default: NULL
+        Cache* compressed_block_cache;
+        
+        // If non-NULL, use the specified cache (see NewPersistentCache()) as
+        // a tier behind block_cache and compressed_block_cache, typically on
+        // a local disk that is faster than the one holding the database.
+        // Blocks missing from the caches in front of it are looked up there
+        // before they are read from their table, and added when they are
+        // read, under the same rules as block_cache entries.  Its entries
+        // are keyed by table contents, so they still serve the tables of
+        // the database after it is reopened.
+        // Default: NULL
+        PersistentCache* persistent_cache;
+        
+        // If non-NULL, use the specified cache for the results of point
+        // lookups in tables, keyed by table and user key.  A Get() of a key
+        // found there skips the table and block caches altogether.  Entries
+        // are added by Get()s that do not use a snapshot, and serve Get()s
+        // whose snapshot sees them.  Each entry is charged the size of the
+        // key and value it holds.
+        // Default: NULL
+        Cache* row_cache;
+        
         // Approximate size of user data packed per block.  Note that the
         // block size specified here corresponds to uncompressed data.  The
         // actual size of the unit read from disk may be smaller if
@@ -129,8 +221,23 @@ namespace leveldb
         // worth switching to kNoCompression.  Even if the input data is
         // incompressible, the kSnappyCompression implementation will
         // efficiently detect that and will switch to uncompressed mode.
+        //
+        // kLZ4Compression decompresses faster than Snappy; kZstdCompression
+        // compresses much better at a higher CPU cost.  A block is stored
+        // uncompressed if the chosen library was not available at build
+        // time or saves less than 12.5%.
         CompressionType compression;
         
+        // If non-empty, tables written to level L use
+        // compression_per_level[L] instead of "compression", and levels past
+        // the end of the vector use its last entry.  Memtable flushes use
+        // entry 0 even when the output is placed deeper.  A typical setup is
+        // LZ4 for the upper levels and Zstd for the last one, which holds
+        // most of the data.
+        //
+        // Default: empty
+        std::vector<CompressionType> compression_per_level;
+        
         // If non-NULL, use the specified filter policy to reduce disk reads.
         // Many applications will benefit from passing the result of
         // NewBloomFilterPolicy() here.
@@ -138,6 +245,47 @@ namespace leveldb
         // Default: NULL
         const FilterPolicy* filter_policy;
         
+        // If true (and filter_policy is non-NULL), build one filter over all
+        // the keys of a table instead of one filter per 2KB of data.  A Get()
+        // that misses the filter then returns without touching the index
+        // block.  Tables are readable whatever this is set to.
+        //
+        // Default: false
+        bool whole_table_filter;
+        
+        // If non-NULL (and filter_policy is non-NULL), the filters of the
+        // tables also hold the prefix of every key in the domain of
+        // prefix_extractor, so that iterators with ReadOptions::prefix_seek
+        // can skip tables and blocks that hold no key with the prefix they
+        // look for.  Tables keep working, without the skipping, when this
+        // is changed or unset.
+        //
+        // Default: NULL
+        const SliceTransform* prefix_extractor;
+        
+        // If true, split each table's index into partitions of about
+        // block_size bytes, and keep only a small top-level index over the
+        // partitions in memory while the table is open.  The partitions are
+        // read on demand through block_cache like data blocks.  If
+        // whole_table_filter is also set, the filter is partitioned the
+        // same way, one partition per index partition.
+        //
+        // Tables written with this option cannot be read by versions of
+        // leveldb that predate it.
+        //
+        // Default: false
+        bool partition_index;
+        
+        // If true, a table's index and filter blocks are kept in block_cache
+        // (at high priority, see NewLRUCache()) instead of being held in
+        // memory for as long as the table is open, so that their memory is
+        // bounded by the cache capacity.  With partition_index, only the
+        // top-level index is affected; partitions always go through the
+        // cache.
+        //
+        // Default: false
+        bool cache_index_and_filter_blocks;
+        
         // Create an Options object with default values for all fields.
         Options();
     };
@@ -162,7 +310,48 @@ namespace leveldb
         // Default: NULL
         const Snapshot* snapshot;
         
-        ReadOptions(): verify_checksums(false),fill_cache(true),snapshot(NULL)
+        // If non-zero, iterators read table files this many bytes at a
+        // time, and serve the following blocks from what was read, instead
+        // of issuing one read per block.  If zero, an iterator starts
+        // reading ahead by itself once it has read a few blocks in a row,
+        // 8KB at first and twice as much each time up to 2MB.  Files that
+        // the Env serves from memory (e.g. mmap'ed files) are never read
+        // ahead.
+        // Default: 0
+        size_t readahead_size;
+        
+        // If true and Options::prefix_extractor is non-NULL, an iterator
+        // only yields the keys with the same prefix as the target of the
+        // last Seek(), and becomes invalid when it moves past them.  It
+        // skips the table files and blocks whose filters show that they
+        // hold no such key.  Such an iterator must be positioned with
+        // Seek(): SeekToFirst() and SeekToLast() leave it invalid with a
+        // NotSupported status, and so does Seek() of a key outside of the
+        // domain of the prefix extractor.
+        // Default: false
+        bool prefix_seek;
+        
+        // If non-NULL, an iterator behaves as if the database held no keys
+        // before "*iterate_lower_bound": SeekToFirst() and Seek() of smaller
+        // keys position it at the first key >= the bound, and Prev() ends
+        // there.  Table files and blocks that hold only smaller keys are not
+        // read.  The bound must remain live while the iterator is in use.
+        // Get() ignores it.
+        // Default: NULL
+        const Slice* iterate_lower_bound;
+        
+        // If non-NULL, an iterator behaves as if the database held no keys
+        // at or after "*iterate_upper_bound" (which is exclusive): Next()
+        // ends at the first key >= the bound instead of skipping deleted
+        // entries beyond it, and SeekToLast() positions the iterator at the
+        // last key before the bound.  Table files and blocks that hold only
+        // larger keys are not read.  The bound must remain live while the
+        // iterator is in use.  Get() ignores it.
+        // Default: NULL
+        const Slice* iterate_upper_bound;
+        
+        ReadOptions(): verify_checksums(false),fill_cache(true),snapshot(NULL),readahead_size(0),
+        prefix_seek(false),iterate_lower_bound(NULL),iterate_upper_bound(NULL)
         {
         }
     };
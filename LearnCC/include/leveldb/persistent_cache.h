@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache maps keys to byte strings that it keeps in files,
+// typically on a local disk that is faster than the one holding the
+// database.  Unlike a Cache, its contents outlive the process: a new
+// PersistentCache on the same directory serves what an earlier one
+// stored.  It has internal synchronization and may be safely accessed
+// concurrently from multiple threads.  It evicts entries on its own to
+// stay within its capacity.
+//
+// A builtin implementation that appends entries to a series of files and
+// evicts the oldest file first is provided by NewPersistentCache().
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb
+{
+    
+    class Env;
+    class PersistentCache;
+    
+    // Create a persistent cache that keeps at most about "capacity" bytes
+    // in files under "dir" of "env", creating "dir" if it is missing.  The
+    // entries left in "dir" by an earlier cache are indexed before this
+    // returns, so a database opened with the result after a restart finds
+    // the blocks it cached before.  Entries are appended to files of
+    // capacity/16 bytes, the latest of which is also kept in memory, and
+    // the oldest file is deleted when the cache is full.
+    //
+    // On success, stores a pointer to the new cache in *result and returns
+    // OK.  On failure stores NULL in *result and returns non-OK.
+    // The caller should delete *result when it is no longer needed, after
+    // any database that is using it has been closed.
+    extern Status NewPersistentCache(Env* env, const std::string& dir, uint64_t capacity, PersistentCache** result);
+    
+    class PersistentCache
+    {
+    public:
+        PersistentCache() { }
+        
+        virtual ~PersistentCache();
+        
+        // Store "data" under "key", replacing any data stored under it
+        // before.  Other entries may be evicted to make room.
+        virtual Status Insert(const Slice& key, const Slice& data) = 0;
+        
+        // If the cache holds data for "key", store it in *data and return
+        // OK.  Else return a NotFound status.
+        virtual Status Lookup(const Slice& key, std::string* data) = 0;
+        
+        // Returns the number of bytes the cache keeps on disk.
+        virtual uint64_t GetUsage() const = 0;
+        
+    private:
+        // No copying allowed
+        PersistentCache(const PersistentCache&);
+        void operator=(const PersistentCache&);
+    };
+    
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
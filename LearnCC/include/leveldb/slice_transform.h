@@ -0,0 +1,73 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to a part of it, typically a prefix that
+// groups related keys.  A database configured with one (see
+// Options::prefix_extractor) adds the prefixes of the keys to the
+// filters of its tables, so that iterators that only look at the keys
+// of one prefix can skip the tables and blocks that hold none of them.
+//
+// Most people will want to use one of the builtin transforms (see
+// NewFixedPrefixTransform() and NewDelimitedPrefixTransform() below).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+namespace leveldb
+{
+    
+    class Slice;
+    
+    // A SliceTransform implementation must be thread-safe since leveldb
+    // may invoke its methods concurrently from multiple threads.
+    //
+    // The keys of the domain that have the same prefix must be contiguous
+    // in the order of the comparator, as they are for any transform that
+    // returns a leading part of the key with the bytewise comparator.
+    class SliceTransform
+    {
+    public:
+        virtual ~SliceTransform();
+        
+        // The name of the transform.  The tables record the name of the
+        // transform whose prefixes their filters hold, and those prefixes
+        // are only used while a transform of the same name is configured.
+        // So if the mapping changes in an incompatible way, the name
+        // returned by this method must be changed.
+        virtual const char* Name() const = 0;
+        
+        // Return the prefix of "key", which must be a part of "key".
+        // REQUIRES: InDomain(key)
+        virtual Slice Transform(const Slice& key) const = 0;
+        
+        // Returns true iff "key" has a prefix.  Keys outside of the domain
+        // are only added to filters as whole keys.
+        virtual bool InDomain(const Slice& key) const = 0;
+        
+        // Returns true iff "a" and "b", two results of Transform(), are the
+        // same prefix.  Filters add a run of keys with the same prefix once.
+        // The default implementation compares their bytes.
+        virtual bool SamePrefix(const Slice& a, const Slice& b) const;
+    };
+    
+    // Return a new transform whose prefix is the first "prefix_len" bytes
+    // of a key.  Shorter keys are outside of its domain.
+    //
+    // Callers must delete the result after any database that is using the
+    // result has been closed.
+    extern const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+    
+    // Return a new transform whose prefix is a key up to and including the
+    // first occurrence of "delimiter", e.g. "tenant:" for "tenant:id:field"
+    // with ':'.  Keys without the delimiter are outside of its domain.
+    //
+    // Callers must delete the result after any database that is using the
+    // result has been closed.
+    extern const SliceTransform* NewDelimitedPrefixTransform(char delimiter);
+    
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
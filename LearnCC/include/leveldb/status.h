@@ -67,6 +67,9 @@ namespace leveldb
         // Returns true iff the status indicates an IOError.
         bool IsIOError() const { return code() == kIOError; }
         
+        // Returns true iff the status indicates a NotSupported error.
+        bool IsNotSupportedError() const { return code() == kNotSupported; }
+        
         // Return a string representation of this status suitable for printing.
         // Returns the string "OK" for success.
         std::string ToString() const;
@@ -11,7 +11,9 @@
 namespace leveldb
 {
     class Block;
+    struct BlockContents;
     class BlockHandle;
+    struct BlockCacheStats;
     class Footer;
     struct Options;
     class RandomAccessFile;
@@ -43,6 +45,20 @@ namespace leveldb
         // Returns a new iterator over the table contents.
         // The result of NewIterator() is initially invalid (caller must
         // call one of the Seek methods on the iterator before using it).
+        //
+        // The iterate bounds of the ReadOptions, if any, are keys ordered
+        // by the comparator of the table's Options.  Next() may then end
+        // once the remaining data blocks hold only keys >= the upper
+        // bound, and Prev() once they hold only keys < the lower bound,
+        // without reading those blocks.  Keys out of bounds in the blocks
+        // that are read are still returned.
+        //
+        // With ReadOptions::prefix_seek, if the filters of the table hold
+        // the prefixes of Options::prefix_extractor, the iterator also
+        // skips the blocks (or after Seek(), the whole table) that the
+        // filters show hold no key with the prefix of the last Seek()
+        // target.  The keys with that prefix are all returned, along with
+        // some others.
         Iterator* NewIterator(const ReadOptions&) const;
         
         // Given a key, return an approximate byte offset in the file where
@@ -53,24 +69,60 @@ namespace leveldb
         // be close to the file length.
         uint64_t ApproximateOffsetOf(const Slice& key) const;
         
+        // Returns a new iterator over the range tombstones that the table
+        // was built with (see TableBuilder::AddRangeTombstone()), in key
+        // order, or NULL if it has none.
+        Iterator* NewRangeTombstoneIterator() const;
+        
     private:
         struct Rep;
         Rep* rep_;
         
+        class PrefixIndexIterator;
+        
         explicit Table(Rep* rep) { rep_ = rep; }
         static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+        static Iterator* ScanBlockReader(void*, const ReadOptions&, const Slice&);
+        static Iterator* IndexPartitionReader(void*, const ReadOptions&, const Slice&);
+        
+        friend class TableCache;
+        
+        // Open() that counts the block cache hits and misses of the table
+        // in *stats, which must outlive it.
+        static Status Open(const Options& options, RandomAccessFile* file, uint64_t file_size, BlockCacheStats* stats, Table** table);
         
         // Calls (*handle_result)(arg, ...) with the entry found after a call
         // to Seek(key).  May not make such a call if filter policy says
         // that key is not present.
-        friend class TableCache;
         Status InternalGet(const ReadOptions&, const Slice& key,
                            void* arg,
                            void (*handle_result)(void* arg, const Slice& k, const Slice& v));
         
+        // InternalGet() for keys[0..n-1], which must be sorted.  Calls
+        // (*handle_result)(args[i], ...) for keys[i].  Consecutive keys that
+        // fall in the same block share the index lookup and the block read.
+        Status InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                                void* const* args,
+                                void (*handle_result)(void* arg, const Slice& k, const Slice& v));
+        
+        
+        Status ReadMeta(const Footer& footer);
+        // How the filter of the table is stored
+        enum FilterType
+        {
+            kNoFilter,
+            kBlockFilter,        // One filter per 2KB of data
+            kFullFilter,         // One filter for the whole table
+            kPartitionedFilter   // One filter per index partition
+        };
         
-        void ReadMeta(const Footer& footer);
-        void ReadFilter(const Slice& filter_handle_value);
+        void ReadFilter(const Slice& filter_handle_value, FilterType type);
+        Status ReadUncachedBlock(const ReadOptions&, RandomAccessFile* file, const BlockHandle& handle, bool fill, BlockContents* contents) const;
+        Iterator* ReadBlockIterator(const ReadOptions&, RandomAccessFile* file, const BlockHandle& handle, bool index) const;
+        Iterator* NewTopIndexIterator(const ReadOptions&) const;
+        Iterator* NewIndexIterator(const ReadOptions&) const;
+        bool FilterMayMatch(const ReadOptions&, const BlockHandle& filter_handle, bool full, uint64_t block_offset, const Slice& key) const;
+        bool PartitionMayMatch(const ReadOptions&, const Slice& top_index_value, const Slice& key) const;
         
         // No copying allowed
         Table(const Table&);
@@ -47,6 +47,15 @@ namespace leveldb
         // REQUIRES: Finish(), Abandon() have not been called
         void Add(const Slice& key, const Slice& value);
         
+        // Add a range tombstone that deletes from "key" up to the key
+        // "end" (see db/range_del.h), to be stored in a block of its own.
+        // Unlike Add(), tombstones may be added in any order.
+        // REQUIRES: Finish(), Abandon() have not been called
+        void AddRangeTombstone(const Slice& key, const Slice& end);
+        
+        // Number of calls to AddRangeTombstone() so far.
+        uint64_t NumRangeTombstones() const;
+        
         // Advanced operation: flush any buffered key/value pairs to file.
         // Can be used to ensure that two adjacent entries never live in
         // the same data block.  Most clients should not need to use this method.
@@ -79,6 +88,8 @@ namespace leveldb
         bool ok() const { return status().ok(); }
         void WriteBlock(BlockBuilder* block, BlockHandle* handle);
         void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+        void AddIndexEntry();
+        void FlushIndexPartition();
         
         struct Rep;
         Rep* rep_;
@@ -41,6 +41,11 @@ namespace leveldb
         // If the database contains a mapping for "key", erase it.  Else do nothing.
         void Delete(const Slice& key);
         
+        // Erase the mappings of all keys in ["begin", "end"), as ordered by
+        // the comparator of the database.  Nothing is erased if "begin" is
+        // not before "end".
+        void DeleteRange(const Slice& begin, const Slice& end);
+        
         // Clear all updates buffered in this batch.
         void Clear();
         
@@ -51,6 +56,8 @@ namespace leveldb
             virtual ~Handler();
             virtual void Put(const Slice& key, const Slice& value) = 0;
             virtual void Delete(const Slice& key) = 0;
+            // The default implementation ignores range deletions.
+            virtual void DeleteRange(const Slice& begin, const Slice& end);
         };
         Status Iterate(Handler* handler) const;
         
@@ -146,6 +146,16 @@ namespace leveldb
                 MemoryBarrier();
                 rep_ = v;
             }
+            // Atomically replace the value with "v" iff it is "expected".
+            // Acts as a full memory barrier.  Returns true on success.
+            inline bool CompareAndSwap(void* expected, void* v)
+            {
+#if defined(OS_WIN)
+                return InterlockedCompareExchangePointer(&rep_, v, expected) == expected;
+#else
+                return __sync_bool_compare_and_swap(&rep_, expected, v);
+#endif
+            }
         };
         
         // AtomicPointer based on <cstdatomic>
@@ -173,6 +183,10 @@ namespace leveldb
             {
                 rep_.store(v, std::memory_order_relaxed);
             }
+            inline bool CompareAndSwap(void* expected, void* v)
+            {
+                return rep_.compare_exchange_strong(expected, v);
+            }
         };
         
         // Atomic pointer based on sparc memory barriers
@@ -206,6 +220,10 @@ namespace leveldb
             }
             inline void* NoBarrier_Load() const { return rep_; }
             inline void NoBarrier_Store(void* v) { rep_ = v; }
+            inline bool CompareAndSwap(void* expected, void* v)
+            {
+                return __sync_bool_compare_and_swap(&rep_, expected, v);
+            }
         };
         
         // Atomic pointer based on ia64 acq/rel
@@ -239,12 +257,107 @@ namespace leveldb
             }
             inline void* NoBarrier_Load() const { return rep_; }
             inline void NoBarrier_Store(void* v) { rep_ = v; }
+            inline bool CompareAndSwap(void* expected, void* v)
+            {
+                return __sync_bool_compare_and_swap(&rep_, expected, v);
+            }
         };
         
         // We have neither MemoryBarrier(), nor <atomic>
 #else
 #error Please implement AtomicPointer for this platform.
         
+#endif
+        
+        // A 64-bit counter with the same accessors as AtomicPointer plus an
+        // atomic add.  Used for values such as sequence numbers that are
+        // read without holding a lock, which AtomicPointer cannot carry on
+        // 32-bit platforms.
+#if defined(LEVELDB_ATOMIC_PRESENT)
+        class AtomicUint64
+        {
+        private:
+            std::atomic<uint64_t> rep_;
+        public:
+            AtomicUint64() : rep_(0) { }
+            explicit AtomicUint64(uint64_t v) : rep_(v) { }
+            inline uint64_t Acquire_Load() const
+            {
+                return rep_.load(std::memory_order_acquire);
+            }
+            inline void Release_Store(uint64_t v)
+            {
+                rep_.store(v, std::memory_order_release);
+            }
+            inline uint64_t NoBarrier_Load() const
+            {
+                return rep_.load(std::memory_order_relaxed);
+            }
+            inline void NoBarrier_Store(uint64_t v)
+            {
+                rep_.store(v, std::memory_order_relaxed);
+            }
+            // Atomically add "delta" and return the previous value.
+            // Acts as a full memory barrier.
+            inline uint64_t FetchAdd(uint64_t delta)
+            {
+                return rep_.fetch_add(delta);
+            }
+            // Atomically subtract "delta" and return the previous value.
+            inline uint64_t FetchSub(uint64_t delta)
+            {
+                return rep_.fetch_sub(delta);
+            }
+            // Atomically replace the value with "v" iff it is "expected".
+            // Acts as a full memory barrier.  Returns true on success.
+            inline bool CompareAndSwap(uint64_t expected, uint64_t v)
+            {
+                return rep_.compare_exchange_strong(expected, v);
+            }
+        };
+        
+#elif defined(__GNUC__)
+        class AtomicUint64
+        {
+        private:
+            uint64_t rep_;
+        public:
+            AtomicUint64() : rep_(0) { }
+            explicit AtomicUint64(uint64_t v) : rep_(v) { }
+            inline uint64_t Acquire_Load() const
+            {
+                return __atomic_load_n(&rep_, __ATOMIC_ACQUIRE);
+            }
+            inline void Release_Store(uint64_t v)
+            {
+                __atomic_store_n(&rep_, v, __ATOMIC_RELEASE);
+            }
+            inline uint64_t NoBarrier_Load() const
+            {
+                return __atomic_load_n(&rep_, __ATOMIC_RELAXED);
+            }
+            inline void NoBarrier_Store(uint64_t v)
+            {
+                __atomic_store_n(&rep_, v, __ATOMIC_RELAXED);
+            }
+            inline uint64_t FetchAdd(uint64_t delta)
+            {
+                return __atomic_fetch_add(&rep_, delta, __ATOMIC_SEQ_CST);
+            }
+            inline uint64_t FetchSub(uint64_t delta)
+            {
+                return __atomic_fetch_sub(&rep_, delta, __ATOMIC_SEQ_CST);
+            }
+            inline bool CompareAndSwap(uint64_t expected, uint64_t v)
+            {
+                return __atomic_compare_exchange_n(&rep_, &expected, v, false,
+                                                   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            }
+        };
+        
+#else
+#error Please implement AtomicUint64 for this platform.
+        
 #endif
         
 #undef LEVELDB_HAVE_MEMORY_BARRIER
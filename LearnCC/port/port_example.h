@@ -97,6 +97,38 @@ class AtomicPointer {
 
   // Set va as the stored pointer with no ordering guarantees.
   void NoBarrier_Store(void* v);
+
+  // If the stored pointer equals "expected", replace it with "v" and
+  // return true; otherwise return false.  Acts as a full memory barrier.
+  bool CompareAndSwap(void* expected, void* v);
+};
+
+// A 64-bit integer with the same accessors as AtomicPointer.  Unlike
+// AtomicPointer it must not tear on 32-bit platforms.
+class AtomicUint64 {
+ public:
+  // Initialize to zero
+  AtomicUint64();
+
+  // Initialize to hold v
+  explicit AtomicUint64(uint64_t v);
+
+  uint64_t Acquire_Load() const;
+  void Release_Store(uint64_t v);
+  uint64_t NoBarrier_Load() const;
+  void NoBarrier_Store(uint64_t v);
+
+  // Atomically add "delta" and return the previous value.  Acts as a
+  // full memory barrier.
+  uint64_t FetchAdd(uint64_t delta);
+
+  // Atomically subtract "delta" and return the previous value.  Acts as
+  // a full memory barrier.
+  uint64_t FetchSub(uint64_t delta);
+
+  // If the stored value equals "expected", replace it with "v" and
+  // return true; otherwise return false.  Acts as a full memory barrier.
+  bool CompareAndSwap(uint64_t expected, uint64_t v);
 };
 
 // ------------------ Compression -------------------
@@ -122,6 +154,21 @@ extern bool Snappy_GetUncompressedLength(const char* input, size_t length,
 extern bool Snappy_Uncompress(const char* input_data, size_t input_length,
                               char* output);
 
+// Same as the Snappy functions above, for LZ4 and Zstd.  Each returns
+// false if the library is not supported by this port.
+extern bool LZ4_Compress(const char* input, size_t input_length,
+                         std::string* output);
+extern bool LZ4_GetUncompressedLength(const char* input, size_t length,
+                                      size_t* result);
+extern bool LZ4_Uncompress(const char* input_data, size_t input_length,
+                           char* output);
+extern bool Zstd_Compress(const char* input, size_t input_length,
+                          std::string* output);
+extern bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result);
+extern bool Zstd_Uncompress(const char* input_data, size_t input_length,
+                            char* output);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
@@ -129,6 +176,11 @@ extern bool Snappy_Uncompress(const char* input_data, size_t input_length,
 // The concatenation of all "data[0,n-1]" fragments is the heap profile.
 extern bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg);
 
+// If an accelerated CRC32C implementation is available on this CPU,
+// return the crc32c of concat(A, buf[0,size-1]) where crc is the crc32c
+// of some string A.  Otherwise return 0.
+extern uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size);
+
 }  // namespace port
 }  // namespace leveldb
 
@@ -7,6 +7,13 @@
 #include <cstdlib>
 #include <stdio.h>
 #include <string.h>
+#ifdef LZ4
+#include <lz4.h>
+#endif
+#ifdef ZSTD
+#include <zstd.h>
+#endif
+#include "util/coding.h"
 #include "util/logging.h"
 
 namespace leveldb
@@ -58,5 +65,111 @@ namespace leveldb
             PthreadCall("once", pthread_once(once, initializer));
         }
         
+        // The LZ4 block format does not record the uncompressed length, so
+        // compressed blocks start with it as a varint32.
+        bool LZ4_Compress(const char* input, size_t length, std::string* output)
+        {
+#ifdef LZ4
+            if (length > static_cast<size_t>(LZ4_MAX_INPUT_SIZE))
+            {
+                return false;
+            }
+            output->clear();
+            PutVarint32(output, static_cast<uint32_t>(length));
+            const size_t header = output->size();
+            const int bound = LZ4_compressBound(static_cast<int>(length));
+            output->resize(header + bound);
+            int outlen = LZ4_compress_default(input, &(*output)[header], static_cast<int>(length), bound);
+            if (outlen <= 0)
+            {
+                return false;
+            }
+            output->resize(header + outlen);
+            return true;
+#else
+            return false;
+#endif
+        }
+        
+        bool LZ4_GetUncompressedLength(const char* input, size_t length, size_t* result)
+        {
+#ifdef LZ4
+            uint32_t ulength;
+            if (GetVarint32Ptr(input, input + length, &ulength) == NULL)
+            {
+                return false;
+            }
+            *result = ulength;
+            return true;
+#else
+            return false;
+#endif
+        }
+        
+        bool LZ4_Uncompress(const char* input, size_t length, char* output)
+        {
+#ifdef LZ4
+            uint32_t ulength;
+            const char* p = GetVarint32Ptr(input, input + length, &ulength);
+            if (p == NULL)
+            {
+                return false;
+            }
+            const int n = static_cast<int>(input + length - p);
+            return LZ4_decompress_safe(p, output, n, static_cast<int>(ulength)) == static_cast<int>(ulength);
+#else
+            return false;
+#endif
+        }
+        
+        bool Zstd_Compress(const char* input, size_t length, std::string* output)
+        {
+#ifdef ZSTD
+            // Level 3 is zstd's own default: much better ratios than LZ4 or
+            // Snappy at a compression speed that still keeps up with disks.
+            static const int kZstdLevel = 3;
+            output->resize(ZSTD_compressBound(length));
+            size_t outlen = ZSTD_compress(&(*output)[0], output->size(), input, length, kZstdLevel);
+            if (ZSTD_isError(outlen))
+            {
+                return false;
+            }
+            output->resize(outlen);
+            return true;
+#else
+            return false;
+#endif
+        }
+        
+        bool Zstd_GetUncompressedLength(const char* input, size_t length, size_t* result)
+        {
+#ifdef ZSTD
+            unsigned long long ulength = ZSTD_getFrameContentSize(input, length);
+            if (ulength == ZSTD_CONTENTSIZE_ERROR || ulength == ZSTD_CONTENTSIZE_UNKNOWN)
+            {
+                return false;
+            }
+            *result = static_cast<size_t>(ulength);
+            return true;
+#else
+            return false;
+#endif
+        }
+        
+        bool Zstd_Uncompress(const char* input, size_t length, char* output)
+        {
+#ifdef ZSTD
+            size_t ulength;
+            if (!Zstd_GetUncompressedLength(input, length, &ulength))
+            {
+                return false;
+            }
+            size_t n = ZSTD_decompress(output, ulength, input, length);
+            return !ZSTD_isError(n) && n == ulength;
+#else
+            return false;
+#endif
+        }
+        
     }  // namespace port
 }  // namespace leveldb
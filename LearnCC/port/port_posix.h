@@ -148,11 +148,25 @@ namespace leveldb
 #endif
         }
         
+        // LZ4 and Zstd block compression, defined in port_posix.cc.  Like the
+        // Snappy functions above they return false when the library was not
+        // available at build time.
+        bool LZ4_Compress(const char* input, size_t length, ::std::string* output);
+        bool LZ4_GetUncompressedLength(const char* input, size_t length, size_t* result);
+        bool LZ4_Uncompress(const char* input, size_t length, char* output);
+        
+        bool Zstd_Compress(const char* input, size_t length, ::std::string* output);
+        bool Zstd_GetUncompressedLength(const char* input, size_t length, size_t* result);
+        bool Zstd_Uncompress(const char* input, size_t length, char* output);
+        
         inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg)
         {
             return false;
         }
         
+        // Defined in port_posix_sse.cc.
+        uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size);
+        
     } // namespace port
 } // namespace leveldb
 
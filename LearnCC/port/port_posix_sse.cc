@@ -0,0 +1,149 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// CRC32C using the SSE4.2 crc32 instruction.  The functions that issue
+// the instruction are compiled for SSE4.2 through a target attribute, so
+// this file needs no special compiler flags; whether the CPU actually
+// supports the instruction is checked at run time.
+
+#include "port/port.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define LEVELDB_CRC32C_SSE42 1
+#endif
+
+namespace leveldb
+{
+    namespace port
+    {
+#if defined(LEVELDB_CRC32C_SSE42)
+
+        // Large buffers are processed as three interleaved streams of
+        // kStride bytes each so that three crc32 instructions are in flight
+        // at once; the instruction has a latency of three cycles but can
+        // issue every cycle.
+        static const size_t kStride = 256;
+
+        // shift_table_[i][b] is the crc32c register that results from
+        // feeding kStride zero bytes into a register holding b << (8 * i).
+        // The crc register update is linear, so this lets a stream's crc be
+        // moved past the kStride bytes that follow it with four lookups.
+        static uint32_t shift_table_[4][256];
+        static OnceType shift_table_once_ = LEVELDB_ONCE_INIT;
+
+        static bool HaveSSE42()
+        {
+            unsigned int eax, ebx, ecx, edx;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            {
+                return false;
+            }
+            return (ecx & bit_SSE4_2) != 0;
+        }
+
+        static inline uint64_t LoadUnaligned64(const uint8_t* p)
+        {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            return word;
+        }
+
+        __attribute__((target("sse4.2")))
+        static void InitShiftTable()
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                for (uint32_t b = 0; b < 256; b++)
+                {
+                    uint64_t l = b << (8 * i);
+                    for (size_t n = 0; n < kStride; n += 8)
+                    {
+                        l = _mm_crc32_u64(l, 0);
+                    }
+                    shift_table_[i][b] = static_cast<uint32_t>(l);
+                }
+            }
+        }
+
+        static inline uint32_t Shift(uint32_t l)
+        {
+            return shift_table_[0][l & 0xff] ^
+                   shift_table_[1][(l >> 8) & 0xff] ^
+                   shift_table_[2][(l >> 16) & 0xff] ^
+                   shift_table_[3][l >> 24];
+        }
+
+        __attribute__((target("sse4.2")))
+        static uint32_t ExtendSSE42(uint32_t crc, const char* buf, size_t size)
+        {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+            const uint8_t* e = p + size;
+            uint64_t l = crc ^ 0xffffffffu;
+
+            // Process bytes until p is 8-byte aligned
+            while (p != e && (reinterpret_cast<uintptr_t>(p) & 7) != 0)
+            {
+                l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+            }
+
+            // Process three interleaved streams at a time
+            if (static_cast<size_t>(e - p) >= 3 * kStride)
+            {
+                InitOnce(&shift_table_once_, InitShiftTable);
+                do
+                {
+                    uint64_t l1 = 0;
+                    uint64_t l2 = 0;
+                    for (size_t i = 0; i < kStride; i += 8)
+                    {
+                        l = _mm_crc32_u64(l, LoadUnaligned64(p + i));
+                        l1 = _mm_crc32_u64(l1, LoadUnaligned64(p + kStride + i));
+                        l2 = _mm_crc32_u64(l2, LoadUnaligned64(p + 2 * kStride + i));
+                    }
+                    l = Shift(Shift(static_cast<uint32_t>(l)) ^ static_cast<uint32_t>(l1)) ^
+                        static_cast<uint32_t>(l2);
+                    p += 3 * kStride;
+                } while (static_cast<size_t>(e - p) >= 3 * kStride);
+            }
+
+            // Process bytes 8 at a time
+            while ((e - p) >= 8)
+            {
+                l = _mm_crc32_u64(l, LoadUnaligned64(p));
+                p += 8;
+            }
+
+            // Process the last few bytes
+            while (p != e)
+            {
+                l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+            }
+            return static_cast<uint32_t>(l) ^ 0xffffffffu;
+        }
+
+        uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size)
+        {
+            static const bool have_sse42 = HaveSSE42();
+            if (!have_sse42)
+            {
+                return 0;
+            }
+            return ExtendSSE42(crc, buf, size);
+        }
+
+#else  // LEVELDB_CRC32C_SSE42
+
+        uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size)
+        {
+            return 0;
+        }
+
+#endif  // LEVELDB_CRC32C_SSE42
+    } // namespace port
+} // namespace leveldb
@@ -5,6 +5,7 @@
 #include "table/filter_block.h"
 
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -46,11 +47,43 @@ namespace leveldb {
     static const size_t kFilterBaseLg = 11;
     static const size_t kFilterBase = 1 << kFilterBaseLg; // 2的11方=2048
     
+    // Appends the prefix of "key" to the flattened "prefixes", unless it
+    // is the same as the last one there: the keys come in order, so the
+    // keys of a prefix follow each other.
+    static void AddPrefix(const SliceTransform* prefix_extractor, const Slice& key,
+                          std::string* prefixes, std::vector<size_t>* start)
+    {
+        if (prefix_extractor == NULL || !prefix_extractor->InDomain(key))
+        {
+            return;
+        }
+        Slice prefix = prefix_extractor->Transform(key);
+        if (!start->empty() &&
+            prefix_extractor->SamePrefix(Slice(prefixes->data() + start->back(), prefixes->size() - start->back()), prefix))
+        {
+            return;
+        }
+        start->push_back(prefixes->size());
+        prefixes->append(prefix.data(), prefix.size());
+    }
+    
+    // Appends to *tmp_keys the entries of the flattened "contents" and
+    // "start".
+    static void AppendSlices(const std::string& contents, const std::vector<size_t>& start, std::vector<Slice>* tmp_keys)
+    {
+        for (size_t i = 0; i < start.size(); i++)
+        {
+            size_t limit = (i + 1 < start.size()) ? start[i+1] : contents.size();
+            tmp_keys->push_back(Slice(contents.data() + start[i], limit - start[i]));
+        }
+    }
+    
     /*
      FilterBlockBuilder的实现
      */
     
-    FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy) : policy_(policy)
+    FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy, const SliceTransform* prefix_extractor)
+    : policy_(policy), prefix_extractor_(prefix_extractor)
     {
     }
     
@@ -69,6 +102,7 @@ namespace leveldb {
         Slice k = key;
         start_.push_back(keys_.size());
         keys_.append(k.data(), k.size());
+        AddPrefix(prefix_extractor_, k, &prefixes_, &prefix_start_);
     }
     
     Slice FilterBlockBuilder::Finish()
@@ -100,23 +134,19 @@ namespace leveldb {
             return;
         }
         
-        // Make list of keys from flattened key structure
-        start_.push_back(keys_.size());  // Simplify length computation
-        tmp_keys_.resize(num_keys);
-        for (size_t i = 0; i < num_keys; i++)
-        {
-            const char* base = keys_.data() + start_[i];
-            size_t length = start_[i+1] - start_[i];
-            tmp_keys_[i] = Slice(base, length);
-        }
+        // Make list of keys (and then prefixes) from flattened key structure
+        AppendSlices(keys_, start_, &tmp_keys_);
+        AppendSlices(prefixes_, prefix_start_, &tmp_keys_);
         
         // Generate filter for current set of keys and append to result_.
         filter_offsets_.push_back(result_.size());
-        policy_->CreateFilter(&tmp_keys_[0], num_keys, &result_);
+        policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(tmp_keys_.size()), &result_);
         
         tmp_keys_.clear();
         keys_.clear();
         start_.clear();
+        prefixes_.clear();
+        prefix_start_.clear();
     }
     
     /*
@@ -155,4 +185,86 @@ namespace leveldb {
         return true;  // Errors are treated as potential matches
     }
     
+    /*
+     FullFilterBlockBuilder的实现
+     */
+    
+    FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy, const SliceTransform* prefix_extractor)
+    : policy_(policy), prefix_extractor_(prefix_extractor), builder_(policy->NewBuilder()), num_keys_(0), has_last_prefix_(false)
+    {
+    }
+    
+    FullFilterBlockBuilder::~FullFilterBlockBuilder()
+    {
+        delete builder_;
+    }
+    
+    void FullFilterBlockBuilder::AddKey(const Slice& key)
+    {
+        num_keys_++;
+        if (builder_ == NULL)
+        {
+            start_.push_back(keys_.size());
+            keys_.append(key.data(), key.size());
+            AddPrefix(prefix_extractor_, key, &prefixes_, &prefix_start_);
+            return;
+        }
+        
+        builder_->AddKey(key);
+        if (prefix_extractor_ != NULL && prefix_extractor_->InDomain(key))
+        {
+            Slice prefix = prefix_extractor_->Transform(key);
+            if (!has_last_prefix_ || !prefix_extractor_->SamePrefix(last_prefix_, prefix))
+            {
+                builder_->AddKey(prefix);
+                last_prefix_.assign(prefix.data(), prefix.size());
+                has_last_prefix_ = true;
+            }
+        }
+    }
+    
+    Slice FullFilterBlockBuilder::Finish()
+    {
+        result_.clear();
+        if (num_keys_ > 0)
+        {
+            if (builder_ != NULL)
+            {
+                builder_->Finish(&result_);
+            } else
+            {
+                std::vector<Slice> tmp_keys;
+                AppendSlices(keys_, start_, &tmp_keys);
+                AppendSlices(prefixes_, prefix_start_, &tmp_keys);
+                policy_->CreateFilter(&tmp_keys[0], static_cast<int>(tmp_keys.size()), &result_);
+            }
+        }
+        // An empty result_ means the table has no keys
+        num_keys_ = 0;
+        keys_.clear();
+        start_.clear();
+        prefixes_.clear();
+        prefix_start_.clear();
+        has_last_prefix_ = false;
+        return Slice(result_);
+    }
+    
+    /*
+     FullFilterBlockReader的实现
+     */
+    
+    FullFilterBlockReader::FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents): policy_(policy), contents_(contents)
+    {
+    }
+    
+    bool FullFilterBlockReader::KeyMayMatch(const Slice& key)
+    {
+        if (contents_.empty())
+        {
+            // Empty filters do not match any keys
+            return false;
+        }
+        return policy_->KeyMayMatch(key, contents_);
+    }
+    
 }
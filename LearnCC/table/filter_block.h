@@ -13,24 +13,28 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 #include "util/hash.h"
 
 namespace leveldb
 {
     
-    class FilterPolicy;
+    class SliceTransform;
     
     // A FilterBlockBuilder is used to construct all of the filters for a
     // particular Table.  It generates a single string which is stored as
-    // a special block in the Table.
+    // a special block in the Table.  If it is given a prefix extractor,
+    // each filter also holds the prefixes of its keys that are in the
+    // extractor's domain.
     //
     // The sequence of calls to FilterBlockBuilder must match the regexp:
     //      (StartBlock AddKey*)* Finish
     class FilterBlockBuilder
     {
     public:
-        explicit FilterBlockBuilder(const FilterPolicy*);
+        // "prefix_extractor" may be NULL.
+        FilterBlockBuilder(const FilterPolicy*, const SliceTransform* prefix_extractor);
         
         void StartBlock(uint64_t block_offset);
         void AddKey(const Slice& key);
@@ -40,8 +44,11 @@ namespace leveldb
         void GenerateFilter();
         
         const FilterPolicy* policy_;
+        const SliceTransform* prefix_extractor_;
         std::string keys_;              // Flattened key contents
         std::vector<size_t> start_;     // Starting index in keys_ of each key
+        std::string prefixes_;          // Flattened prefix contents
+        std::vector<size_t> prefix_start_;  // Starting index in prefixes_ of each prefix
         std::string result_;            // Filter data computed so far
         std::vector<Slice> tmp_keys_;   // policy_->CreateFilter() argument
         std::vector<uint32_t> filter_offsets_;
@@ -66,6 +73,60 @@ namespace leveldb
         size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
     };
     
+    // A FullFilterBlockBuilder builds one filter over every key in a
+    // Table, so that a lookup can consult it before seeking the index
+    // block.  Its output is the policy's filter with no framing.
+    //
+    // The sequence of calls to FullFilterBlockBuilder must match the
+    // regexp:
+    //      (AddKey* Finish)*
+    // Each Finish() returns a filter over the keys added since the
+    // previous one, which is how partitioned filters are built.  The
+    // result is valid until the next call to Finish().
+    //
+    // If the policy has a FilterPolicy::Builder, the keys go straight to
+    // it instead of being kept until Finish().
+    class FullFilterBlockBuilder
+    {
+    public:
+        // Like FilterBlockBuilder, also adds the prefixes of the keys if
+        // "prefix_extractor" is non-NULL.
+        FullFilterBlockBuilder(const FilterPolicy*, const SliceTransform* prefix_extractor);
+        ~FullFilterBlockBuilder();
+        
+        void AddKey(const Slice& key);
+        Slice Finish();
+        
+    private:
+        const FilterPolicy* policy_;
+        const SliceTransform* prefix_extractor_;
+        FilterPolicy::Builder* builder_;    // NULL if the policy has none
+        size_t num_keys_;               // Keys added since the last Finish()
+        std::string keys_;              // Flattened key contents, if !builder_
+        std::vector<size_t> start_;     // Starting index in keys_ of each key
+        std::string prefixes_;          // Flattened prefix contents, if !builder_
+        std::vector<size_t> prefix_start_;  // Starting index in prefixes_ of each prefix
+        std::string last_prefix_;       // Last prefix added, if builder_
+        bool has_last_prefix_;
+        std::string result_;            // Filter data
+        
+        // No copying allowed
+        FullFilterBlockBuilder(const FullFilterBlockBuilder&);
+        void operator=(const FullFilterBlockBuilder&);
+    };
+    
+    class FullFilterBlockReader
+    {
+    public:
+        // REQUIRES: "contents" and *policy must stay live while *this is live.
+        FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+        bool KeyMayMatch(const Slice& key);
+        
+    private:
+        const FilterPolicy* policy_;
+        Slice contents_;
+    };
+    
 }
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
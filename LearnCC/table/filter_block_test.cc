@@ -4,7 +4,9 @@
 
 #include "table/filter_block.h"
 
+#include "db/dbformat.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -44,7 +46,7 @@ class FilterBlockTest {
 };
 
 TEST(FilterBlockTest, EmptyBuilder) {
-  FilterBlockBuilder builder(&policy_);
+  FilterBlockBuilder builder(&policy_, NULL);
   Slice block = builder.Finish();
   ASSERT_EQ("\\x00\\x00\\x00\\x00\\x0b", EscapeString(block));
   FilterBlockReader reader(&policy_, block);
@@ -53,7 +55,7 @@ TEST(FilterBlockTest, EmptyBuilder) {
 }
 
 TEST(FilterBlockTest, SingleChunk) {
-  FilterBlockBuilder builder(&policy_);
+  FilterBlockBuilder builder(&policy_, NULL);
   builder.StartBlock(100);
   builder.AddKey("foo");
   builder.AddKey("bar");
@@ -74,7 +76,7 @@ TEST(FilterBlockTest, SingleChunk) {
 }
 
 TEST(FilterBlockTest, MultiChunk) {
-  FilterBlockBuilder builder(&policy_);
+  FilterBlockBuilder builder(&policy_, NULL);
 
   // First filter
   builder.StartBlock(0);
@@ -121,6 +123,94 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(! reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, Prefixes) {
+  const SliceTransform* prefix = NewFixedPrefixTransform(2);
+  FilterBlockBuilder builder(&policy_, prefix);
+  builder.StartBlock(0);
+  builder.AddKey("aa1");
+  builder.AddKey("aa2");
+  builder.AddKey("ab1");
+  builder.AddKey("c");  // Outside of the domain
+  builder.StartBlock(3000);
+  builder.AddKey("ab2");
+  Slice block = builder.Finish();
+
+  // Four keys and two distinct prefixes in the first filter, one key
+  // and one prefix in the second, then the offsets
+  ASSERT_EQ(4 * 6 + 4 * 2 + 4 * 2 + 5, block.size());
+  FilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(reader.KeyMayMatch(0, "aa1"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "aa"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "ab"));
+  ASSERT_TRUE(! reader.KeyMayMatch(0, "cx"));
+  ASSERT_TRUE(! reader.KeyMayMatch(0, "ac"));
+  ASSERT_TRUE(reader.KeyMayMatch(3000, "ab"));
+  ASSERT_TRUE(! reader.KeyMayMatch(3000, "aa"));
+
+  FullFilterBlockBuilder full_builder(&policy_, prefix);
+  full_builder.AddKey("aa1");
+  full_builder.AddKey("aa2");
+  full_builder.AddKey("ab1");
+  FullFilterBlockReader full_reader(&policy_, full_builder.Finish());
+  ASSERT_TRUE(full_reader.KeyMayMatch("aa2"));
+  ASSERT_TRUE(full_reader.KeyMayMatch("aa"));
+  ASSERT_TRUE(full_reader.KeyMayMatch("ab"));
+  ASSERT_TRUE(! full_reader.KeyMayMatch("ac"));
+  delete prefix;
+}
+
+TEST(FilterBlockTest, InternalKeyPrefixes) {
+  // The versions of a key, and the keys of a prefix, differ in the bytes
+  // that InternalPrefixTransform appends to a prefix, but they still add
+  // the prefix once
+  const SliceTransform* user_prefix = NewFixedPrefixTransform(2);
+  InternalPrefixTransform prefix(user_prefix);
+  std::vector<std::string> keys;
+  keys.push_back(InternalKey("aa1", 9, kTypeValue).Encode().ToString());
+  keys.push_back(InternalKey("aa1", 5, kTypeDeletion).Encode().ToString());
+  keys.push_back(InternalKey("aa2", 7, kTypeValue).Encode().ToString());
+  keys.push_back(InternalKey("ab1", 3, kTypeValue).Encode().ToString());
+
+  FilterBlockBuilder builder(&policy_, &prefix);
+  builder.StartBlock(0);
+  FullFilterBlockBuilder full_builder(&policy_, &prefix);
+  for (size_t i = 0; i < keys.size(); i++) {
+    builder.AddKey(keys[i]);
+    full_builder.AddKey(keys[i]);
+  }
+  // Four keys and two distinct prefixes, plus the offsets of the block
+  ASSERT_EQ(4 * 4 + 4 * 2 + 4 + 5, builder.Finish().size());
+  ASSERT_EQ(4 * 4 + 4 * 2, full_builder.Finish().size());
+  delete user_prefix;
+}
+
+TEST(FilterBlockTest, FullFilterWithPolicyBuilder) {
+  // The keys go to the policy's builder; each Finish() starts over
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  const SliceTransform* prefix = NewFixedPrefixTransform(2);
+  FullFilterBlockBuilder builder(bloom, prefix);
+  builder.AddKey("aa1");
+  builder.AddKey("aa2");
+  builder.AddKey("ab1");
+  const std::string first = builder.Finish().ToString();
+  builder.AddKey("cd1");
+  const std::string second = builder.Finish().ToString();
+  ASSERT_TRUE(builder.Finish().empty());
+
+  FullFilterBlockReader first_reader(bloom, first);
+  ASSERT_TRUE(first_reader.KeyMayMatch("aa1"));
+  ASSERT_TRUE(first_reader.KeyMayMatch("ab1"));
+  ASSERT_TRUE(first_reader.KeyMayMatch("aa"));
+  ASSERT_TRUE(first_reader.KeyMayMatch("ab"));
+  ASSERT_TRUE(! first_reader.KeyMayMatch("cd1"));
+  FullFilterBlockReader second_reader(bloom, second);
+  ASSERT_TRUE(second_reader.KeyMayMatch("cd1"));
+  ASSERT_TRUE(second_reader.KeyMayMatch("cd"));
+  ASSERT_TRUE(! second_reader.KeyMayMatch("aa1"));
+  delete prefix;
+  delete bloom;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -139,8 +139,9 @@ namespace leveldb
         metaindex_handle_.EncodeTo(dst);
         index_handle_.EncodeTo(dst);
         dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding 将剩下的空间填充
-        PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu)); //添加低位：32位占4个字节
-        PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32)); //添加高位：4个字节
+        const uint64_t magic = partitioned_index_ ? kPartitionedTableMagicNumber : kTableMagicNumber;
+        PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu)); //添加低位：32位占4个字节
+        PutFixed32(dst, static_cast<uint32_t>(magic >> 32)); //添加高位：4个字节
         assert(dst->size() == original_size + kEncodedLength);
     }
     
@@ -151,10 +152,11 @@ namespace leveldb
         const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4); // 获取高位4个字节
         // 魔数占8个字节，所以需要使用uint64_t类型。 转换成8位字节的高位向右移动4个字节与转换成8位字节的低位进行或运算，得到8字节的魔数
         const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) | (static_cast<uint64_t>(magic_lo)));
-        if (magic != kTableMagicNumber)
+        if (magic != kTableMagicNumber && magic != kPartitionedTableMagicNumber)
         {
             return Status::Corruption("not an sstable (bad magic number)");
         }
+        partitioned_index_ = (magic == kPartitionedTableMagicNumber);
         
         Status result = metaindex_handle_.DecodeFrom(input);
         if (result.ok())
@@ -170,43 +172,41 @@ namespace leveldb
         return result;
     }
     
-    Status ReadBlock(RandomAccessFile* file, const ReadOptions& options, const BlockHandle& handle, BlockContents* result)
+    static bool GetUncompressedLength(CompressionType type, const char* data, size_t n, size_t* result)
     {
-        result->data = Slice();
-        result->cachable = false;
-        result->heap_allocated = false;
-        
-        // Read the block contents as well as the type/crc footer.
-        // See table_builder.cc for the code that built this structure.
-        size_t n = static_cast<size_t>(handle.size());
-        char* buf = new char[n + kBlockTrailerSize];
-        Slice contents;
-        Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-        if (!s.ok())
+        switch (type)
         {
-            delete[] buf;
-            return s;
-        }
-        if (contents.size() != n + kBlockTrailerSize)
-        {
-            delete[] buf;
-            return Status::Corruption("truncated block read");
+            case kSnappyCompression:
+                return port::Snappy_GetUncompressedLength(data, n, result);
+            case kLZ4Compression:
+                return port::LZ4_GetUncompressedLength(data, n, result);
+            case kZstdCompression:
+                return port::Zstd_GetUncompressedLength(data, n, result);
+            default:
+                return false;
         }
-        
-        // Check the crc of the type and the block contents
-        const char* data = contents.data();    // Pointer to where Read put the data
-        if (options.verify_checksums) // 是否需要验证校验
+    }
+    
+    static bool Uncompress(CompressionType type, const char* data, size_t n, char* output)
+    {
+        switch (type)
         {
-            const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));//记录结构是block+type+crc;所以首地址+block长度+type长度得到crc起始地址
-            const uint32_t actual = crc32c::Value(data, n + 1);
-            if (actual != crc)
-            {
-                delete[] buf;
-                s = Status::Corruption("block checksum mismatch");
-                return s;
-            }
+            case kSnappyCompression:
+                return port::Snappy_Uncompress(data, n, output);
+            case kLZ4Compression:
+                return port::LZ4_Uncompress(data, n, output);
+            case kZstdCompression:
+                return port::Zstd_Uncompress(data, n, output);
+            default:
+                return false;
         }
-        
+    }
+    
+    // Fills *result from the "n" bytes of block contents at "data" and the
+    // type byte that follows them.  "buf" is the buffer the contents were
+    // read into, if any; it is either kept by *result or deleted.
+    static Status DecodeBlockContents(const char* data, size_t n, char* buf, BlockContents* result)
+    {
         switch (data[n]) // type
         {
             case kNoCompression:
@@ -229,15 +229,18 @@ namespace leveldb
                 // Ok
                 break;
             case kSnappyCompression:
+            case kLZ4Compression:
+            case kZstdCompression:
             {
+                CompressionType type = static_cast<CompressionType>(data[n]);
                 size_t ulength = 0;
-                if (!port::Snappy_GetUncompressedLength(data, n, &ulength))
+                if (!GetUncompressedLength(type, data, n, &ulength))
                 {
                     delete[] buf;
                     return Status::Corruption("corrupted compressed block contents");
                 }
                 char* ubuf = new char[ulength];
-                if (!port::Snappy_Uncompress(data, n, ubuf))
+                if (!Uncompress(type, data, n, ubuf))
                 {
                     delete[] buf;
                     delete[] ubuf;
@@ -257,4 +260,73 @@ namespace leveldb
         return Status::OK();
     }
     
+    Status ReadBlock(RandomAccessFile* file, const ReadOptions& options, const BlockHandle& handle, BlockContents* result, std::string* stored)
+    {
+        result->data = Slice();
+        result->cachable = false;
+        result->heap_allocated = false;
+        
+        // Read the block contents as well as the type/crc footer.
+        // See table_builder.cc for the code that built this structure.
+        size_t n = static_cast<size_t>(handle.size());
+        char* buf = new char[n + kBlockTrailerSize];
+        Slice contents;
+        Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+        if (!s.ok())
+        {
+            delete[] buf;
+            return s;
+        }
+        if (contents.size() != n + kBlockTrailerSize)
+        {
+            delete[] buf;
+            return Status::Corruption("truncated block read");
+        }
+        
+        // Check the crc of the type and the block contents
+        const char* data = contents.data();    // Pointer to where Read put the data
+        if (options.verify_checksums) // 是否需要验证校验
+        {
+            const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));//记录结构是block+type+crc;所以首地址+block长度+type长度得到crc起始地址
+            const uint32_t actual = crc32c::Value(data, n + 1);
+            if (actual != crc)
+            {
+                delete[] buf;
+                s = Status::Corruption("block checksum mismatch");
+                return s;
+            }
+        }
+        
+        if (stored != NULL)
+        {
+            stored->assign(data, n + 1);
+        }
+        return DecodeBlockContents(data, n, buf, result);
+    }
+    
+    Status ReadBlock(RandomAccessFile* file, const ReadOptions& options, const BlockHandle& handle, BlockContents* result)
+    {
+        return ReadBlock(file, options, handle, result, NULL);
+    }
+    
+    Status DecodeBlock(const Slice& stored, BlockContents* result)
+    {
+        result->data = Slice();
+        result->cachable = false;
+        result->heap_allocated = false;
+        if (stored.empty())
+        {
+            return Status::Corruption("bad block type");
+        }
+        const size_t n = stored.size() - 1;
+        if (!IsCompressedBlock(stored))
+        {
+            // Copy the contents, which the result must own
+            char* buf = new char[stored.size()];
+            memcpy(buf, stored.data(), stored.size());
+            return DecodeBlockContents(buf, n, buf, result);
+        }
+        return DecodeBlockContents(stored.data(), n, NULL, result);
+    }
+    
 }  // namespace leveldb
@@ -10,6 +10,7 @@
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 #include "leveldb/table_builder.h"
+#include "port/port.h"
 
 namespace leveldb
 {
@@ -50,7 +51,7 @@ namespace leveldb
     class Footer
     {
     public:
-        Footer() { }
+        Footer() : partitioned_index_(false) { }
         
         // The block handle for the metaindex block of the table
         const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -66,6 +67,13 @@ namespace leveldb
             index_handle_ = h;
         }
         
+        // True if index_handle() is the top level of a partitioned index,
+        // whose values point at index partitions instead of data blocks.
+        // Recorded through the magic number so that readers which do not
+        // know about partitioning reject the table.
+        bool partitioned_index() const { return partitioned_index_; }
+        void set_partitioned_index(bool p) { partitioned_index_ = p; }
+        
         void EncodeTo(std::string* dst) const;
         Status DecodeFrom(Slice* input);
         
@@ -80,6 +88,7 @@ namespace leveldb
     private:
         BlockHandle metaindex_handle_;
         BlockHandle index_handle_;
+        bool partitioned_index_;
     };
     
     // kTableMagicNumber was picked by running
@@ -87,6 +96,10 @@ namespace leveldb
     // and taking the leading 64 bits.
     static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
     
+    // Magic number of tables with a partitioned index; picked by running
+    //    echo http://code.google.com/p/leveldb/partitioned | sha1sum
+    static const uint64_t kPartitionedTableMagicNumber = 0xf2acd95ef85ce379ull;
+    
     // 1-byte type + 32-bit crc  （crc是数据校验码）
     static const size_t kBlockTrailerSize = 5;
     
@@ -97,10 +110,55 @@ namespace leveldb
         bool heap_allocated;  // True iff caller should delete[] data.data()
     };
     
+    // Block cache hits and misses of the tables opened by one TableCache,
+    // by kind of block, and the hits and misses of its row cache and of
+    // the compressed block cache and persistent cache.  Blocks that are
+    // not looked up in the cache count as a miss when they are read: the
+    // index and filter blocks that a table keeps in memory are counted
+    // once, when the table is opened.
+    struct BlockCacheStats
+    {
+        enum Kind
+        {
+            kData,
+            kIndex,
+            kFilter,
+            kRow,
+            kCompressed,
+            kPersistent,
+            kNumKinds
+        };
+        
+        port::AtomicUint64 hits[kNumKinds];
+        port::AtomicUint64 misses[kNumKinds];
+        
+        void Record(Kind kind, bool hit)
+        {
+            (hit ? hits : misses)[kind].FetchAdd(1);
+        }
+    };
+    
     // Read the block identified by "handle" from "file".  On failure
     // return non-OK.  On success fill *result and return OK.
     extern Status ReadBlock(RandomAccessFile* file, const ReadOptions& options, const BlockHandle& handle, BlockContents* result);
     
+    // Like ReadBlock(), but also stores in *stored the block as it is
+    // stored in "file": its possibly compressed contents followed by their
+    // type byte.  Callers keep this form in the compressed block cache and
+    // the persistent cache.
+    extern Status ReadBlock(RandomAccessFile* file, const ReadOptions& options, const BlockHandle& handle, BlockContents* result, std::string* stored);
+    
+    // Fill *result from "stored", a block in the form ReadBlock() stores.
+    // The result never points into "stored".
+    extern Status DecodeBlock(const Slice& stored, BlockContents* result);
+    
+    // Returns true if "stored", a block in the form ReadBlock() stores, is
+    // compressed.
+    inline bool IsCompressedBlock(const Slice& stored)
+    {
+        return stored.size() > 0 && stored[stored.size() - 1] != kNoCompression;
+    }
+    
     // Implementation details follow.  Clients should ignore,
     
     inline BlockHandle::BlockHandle(): offset_(~static_cast<uint64_t>(0)), size_(~static_cast<uint64_t>(0))
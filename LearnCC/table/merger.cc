@@ -4,6 +4,7 @@
 
 #include "table/merger.h"
 
+#include <vector>
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -36,24 +37,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   virtual void SeekToLast() {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildHeap();
   }
 
   virtual void Seek(const Slice& target) {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   virtual void Next() {
@@ -76,10 +77,11 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      BuildHeap();
     }
 
     current_->Next();
-    FindSmallest();
+    ReplaceTop();
   }
 
   virtual void Prev() {
@@ -105,10 +107,11 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      BuildHeap();
     }
 
     current_->Prev();
-    FindLargest();
+    ReplaceTop();
   }
 
   virtual Slice key() const {
@@ -133,53 +136,84 @@ class MergingIterator : public Iterator {
   }
 
  private:
-  void FindSmallest();
-  void FindLargest();
+  // Which direction is the iterator moving?
+  enum Direction {
+    kForward,
+    kReverse
+  };
+
+  // Return true iff "a" belongs closer to the top of the heap than "b".
+  // Ties between equal keys go to the earlier child when moving forward
+  // and to the later one in reverse.
+  bool Before(IteratorWrapper* a, IteratorWrapper* b) const {
+    int r = comparator_->Compare(a->key(), b->key());
+    if (r == 0) {
+      r = (a < b) ? -1 : (a > b ? +1 : 0);
+    }
+    return (direction_ == kForward) ? (r < 0) : (r > 0);
+  }
+
+  void BuildHeap();
+  void ReplaceTop();
+  void SiftDown(size_t i);
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
   IteratorWrapper* current_;
 
-  // Which direction is the iterator moving?
-  enum Direction {
-    kForward,
-    kReverse
-  };
+  // The valid children, arranged as a binary heap ordered by Before():
+  // a min-heap while moving forward and a max-heap in reverse.
+  // heap_[0] is current_.
+  std::vector<IteratorWrapper*> heap_;
+
   Direction direction_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = NULL;
+void MergingIterator::BuildHeap() {
+  heap_.clear();
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == NULL) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_.push_back(&children_[i]);
     }
   }
-  current_ = smallest;
+  for (size_t i = heap_.size() / 2; i > 0; i--) {
+    SiftDown(i - 1);
+  }
+  current_ = heap_.empty() ? NULL : heap_[0];
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = NULL;
-  for (int i = n_-1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == NULL) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+// Restore the heap after the top child has been advanced.
+void MergingIterator::ReplaceTop() {
+  assert(!heap_.empty() && heap_[0] == current_);
+  if (!current_->Valid()) {
+    heap_[0] = heap_.back();
+    heap_.pop_back();
+  }
+  if (!heap_.empty()) {
+    SiftDown(0);
+  }
+  current_ = heap_.empty() ? NULL : heap_[0];
+}
+
+void MergingIterator::SiftDown(size_t i) {
+  const size_t n = heap_.size();
+  IteratorWrapper* item = heap_[i];
+  while (true) {
+    size_t child = 2 * i + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n && Before(heap_[child + 1], heap_[child])) {
+      child++;
+    }
+    if (!Before(heap_[child], item)) {
+      break;
     }
+    heap_[i] = heap_[child];
+    i = child;
   }
-  current_ = largest;
+  heap_[i] = item;
 }
 }  // namespace
 
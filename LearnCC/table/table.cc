@@ -4,16 +4,22 @@
 
 #include "leveldb/table.h"
 
+#include <string.h>
+#include <algorithm>
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
 
 namespace leveldb
 {
@@ -22,23 +28,102 @@ namespace leveldb
     {
         ~Rep()
         {
-            delete filter;
             delete [] filter_data;
             delete index_block;
+            delete range_del_block;
         }
         
         Options options;
         Status status;
         RandomAccessFile* file;
+        uint64_t file_size;
         uint64_t cache_id;
-        FilterBlockReader* filter;
-        const char* filter_data;
+        uint64_t compressed_cache_id;
+        uint64_t table_fingerprint;     // Persistent cache id
+        BlockCacheStats* cache_stats;   // May be NULL
+        
+        FilterType filter_type;
+        BlockHandle filter_handle;  // kBlockFilter and kFullFilter only
+        bool filter_pinned;         // filter holds the contents of filter_handle
+        Slice filter;
+        const char* filter_data;    // Heap allocated storage of filter, if any
+        bool prefix_filtered;       // The filters hold the prefixes of options.prefix_extractor
         
         BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-        Block* index_block;
+        BlockHandle index_handle;
+        Block* index_block;         // Top-level index if partitioned_index;
+                                    // NULL if it is kept in the block cache
+        bool partitioned_index;
+        Block* range_del_block;     // NULL if the table has no range tombstones
     };
     
+    static void DeleteBlock(void* arg, void* ignored)
+    {
+        delete reinterpret_cast<Block*>(arg);
+    }
+    
+    static void DeleteCachedBlock(const Slice& key, void* value)
+    {
+        Block* block = reinterpret_cast<Block*>(value);
+        delete block;
+    }
+    
+    static void DeleteFilterContents(BlockContents* contents)
+    {
+        if (contents->heap_allocated)
+        {
+            delete [] contents->data.data();
+        }
+        delete contents;
+    }
+    
+    static void DeleteCachedFilter(const Slice& key, void* value)
+    {
+        DeleteFilterContents(reinterpret_cast<BlockContents*>(value));
+    }
+    
+    static void ReleaseBlock(void* arg, void* h)
+    {
+        Cache* cache = reinterpret_cast<Cache*>(arg);
+        Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+        cache->Release(handle);
+    }
+    
+    // The block cache key of a block is the cache_id of its table followed
+    // by its offset.  "buf" must have room for 16 bytes.
+    static Slice BlockCacheKey(uint64_t cache_id, const BlockHandle& handle, char* buf)
+    {
+        EncodeFixed64(buf, cache_id);
+        EncodeFixed64(buf+8, handle.offset());
+        return Slice(buf, 16);
+    }
+    
+    static void RecordLookup(BlockCacheStats* stats, BlockCacheStats::Kind kind, bool hit)
+    {
+        if (stats != NULL)
+        {
+            stats->Record(kind, hit);
+        }
+    }
+    
     Status Table::Open(const Options& options, RandomAccessFile* file, uint64_t size, Table** table)
+    {
+        return Open(options, file, size, NULL, table);
+    }
+    
+    // Identifies a table by its contents rather than by its file number,
+    // which another table may reuse after the database is destroyed, so
+    // that its persistent cache entries stay valid across restarts.  The
+    // index block lists the last key and location of every data block,
+    // so two different tables almost never share it and their size.
+    static uint64_t TableFingerprint(const Slice& index_contents, uint64_t file_size)
+    {
+        const uint32_t crc = crc32c::Value(index_contents.data(), index_contents.size());
+        const uint32_t hash = Hash(index_contents.data(), index_contents.size(), static_cast<uint32_t>(file_size));
+        return (static_cast<uint64_t>(crc) << 32) | hash;
+    }
+    
+    Status Table::Open(const Options& options, RandomAccessFile* file, uint64_t size, BlockCacheStats* stats, Table** table)
     {
         *table = NULL;
         if (size < Footer::kEncodedLength)
@@ -58,6 +143,7 @@ namespace leveldb
         // Read the index block
         BlockContents contents;
         Block* index_block = NULL;
+        uint64_t fingerprint = 0;
         if (s.ok())
         {
             ReadOptions opt;
@@ -68,6 +154,10 @@ namespace leveldb
             s = ReadBlock(file, opt, footer.index_handle(), &contents);
             if (s.ok())
             {
+                if (options.persistent_cache != NULL)
+                {
+                    fingerprint = TableFingerprint(contents.data, size);
+                }
                 index_block = new Block(contents);
             }
         }
@@ -79,13 +169,43 @@ namespace leveldb
             Rep* rep = new Table::Rep;
             rep->options = options;
             rep->file = file;
+            rep->file_size = size;
             rep->metaindex_handle = footer.metaindex_handle();
+            rep->index_handle = footer.index_handle();
             rep->index_block = index_block;
+            rep->partitioned_index = footer.partitioned_index();
             rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+            rep->compressed_cache_id = (options.compressed_block_cache ? options.compressed_block_cache->NewId() : 0);
+            rep->table_fingerprint = fingerprint;
+            rep->cache_stats = stats;
+            rep->filter_type = kNoFilter;
+            rep->filter_pinned = false;
             rep->filter_data = NULL;
-            rep->filter = NULL;
+            rep->prefix_filtered = false;
+            rep->range_del_block = NULL;
+            RecordLookup(stats, BlockCacheStats::kIndex, false);
+            if (options.cache_index_and_filter_blocks && options.block_cache != NULL && contents.cachable)
+            {
+                // Hand the index block over to the block cache, from where
+                // it is looked up (and if evicted, read again) on use.  It
+                // stays pinned if a strict capacity limit rejects it.
+                char cache_key_buffer[16];
+                Cache* block_cache = options.block_cache;
+                Cache::Handle* h = block_cache->Insert(BlockCacheKey(rep->cache_id, rep->index_handle, cache_key_buffer),
+                                                       index_block, index_block->size(), &DeleteCachedBlock, Cache::HIGH);
+                if (h != NULL)
+                {
+                    block_cache->Release(h);
+                    rep->index_block = NULL;
+                }
+            }
             *table = new Table(rep);
-            (*table)->ReadMeta(footer);
+            s = (*table)->ReadMeta(footer);
+            if (!s.ok())
+            {
+                delete *table;
+                *table = NULL;
+            }
         } else
         {
             if (index_block) delete index_block;
@@ -94,13 +214,8 @@ namespace leveldb
         return s;
     }
     
-    void Table::ReadMeta(const Footer& footer)
+    Status Table::ReadMeta(const Footer& footer)
     {
-        if (rep_->options.filter_policy == NULL)
-        {
-            return;  // Do not need any metadata
-        }
-        
         // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
         // it is an empty block.
         ReadOptions opt;
@@ -109,26 +224,79 @@ namespace leveldb
             opt.verify_checksums = true;
         }
         BlockContents contents;
-        if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok())
+        Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+        if (!s.ok())
         {
-            // Do not propagate errors since meta info is not needed for operation
-            return;
+            // The metaindex locates the range tombstones, which reads
+            // cannot do without (unlike the filters)
+            return s;
         }
         Block* meta = new Block(contents);
         
         Iterator* iter = meta->NewIterator(BytewiseComparator());
-        std::string key = "filter.";
+        iter->Seek("rangedel");
+        if (iter->Valid() && iter->key() == Slice("rangedel"))
+        {
+            Slice v = iter->value();
+            BlockHandle handle;
+            BlockContents block;
+            s = handle.DecodeFrom(&v);
+            if (s.ok())
+            {
+                s = ReadBlock(rep_->file, opt, handle, &block);
+            }
+            if (s.ok())
+            {
+                rep_->range_del_block = new Block(block);
+            }
+        }
+        if (!s.ok() || rep_->options.filter_policy == NULL)
+        {
+            // Do not need any filter metadata
+            delete iter;
+            delete meta;
+            return s;
+        }
+        
+        std::string key = "fullfilter.";
         key.append(rep_->options.filter_policy->Name());
         iter->Seek(key);
         if (iter->Valid() && iter->key() == Slice(key))
         {
-            ReadFilter(iter->value());
+            ReadFilter(iter->value(), kFullFilter);
+        } else if (rep_->partitioned_index)
+        {
+            key = "partitionedfilter.";
+            key.append(rep_->options.filter_policy->Name());
+            iter->Seek(key);
+            if (iter->Valid() && iter->key() == Slice(key))
+            {
+                rep_->filter_type = kPartitionedFilter;
+            }
+        }
+        if (rep_->filter_type == kNoFilter)
+        {
+            key = "filter.";
+            key.append(rep_->options.filter_policy->Name());
+            iter->Seek(key);
+            if (iter->Valid() && iter->key() == Slice(key))
+            {
+                ReadFilter(iter->value(), kBlockFilter);
+            }
+        }
+        if (rep_->filter_type != kNoFilter && rep_->options.prefix_extractor != NULL)
+        {
+            key = "prefixfilter.";
+            key.append(rep_->options.prefix_extractor->Name());
+            iter->Seek(key);
+            rep_->prefix_filtered = (iter->Valid() && iter->key() == Slice(key));
         }
         delete iter;
         delete meta;
+        return s;
     }
     
-    void Table::ReadFilter(const Slice& filter_handle_value)
+    void Table::ReadFilter(const Slice& filter_handle_value, FilterType type)
     {
         Slice v = filter_handle_value;
         BlockHandle filter_handle;
@@ -149,11 +317,29 @@ namespace leveldb
         {
             return;
         }
+        rep_->filter_type = type;
+        rep_->filter_handle = filter_handle;
+        RecordLookup(rep_->cache_stats, BlockCacheStats::kFilter, false);
+        Cache* block_cache = rep_->options.block_cache;
+        if (rep_->options.cache_index_and_filter_blocks && block_cache != NULL && block.cachable)
+        {
+            char cache_key_buffer[16];
+            BlockContents* contents = new BlockContents(block);
+            Cache::Handle* h = block_cache->Insert(BlockCacheKey(rep_->cache_id, filter_handle, cache_key_buffer),
+                                                   contents, block.data.size(), &DeleteCachedFilter, Cache::HIGH);
+            if (h != NULL)
+            {
+                block_cache->Release(h);
+                return;
+            }
+            delete contents;
+        }
         if (block.heap_allocated)
         {
             rep_->filter_data = block.data.data();     // Will need to delete later
         }
-        rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+        rep_->filter = block.data;
+        rep_->filter_pinned = true;
     }
     
     Table::~Table()
@@ -161,22 +347,137 @@ namespace leveldb
         delete rep_;
     }
     
-    static void DeleteBlock(void* arg, void* ignored)
+    static void DeleteStoredBlock(const Slice& key, void* value)
     {
-        delete reinterpret_cast<Block*>(arg);
+        delete reinterpret_cast<std::string*>(value);
     }
     
-    static void DeleteCachedBlock(const Slice& key, void* value)
+    // Reads the block at "handle" after a block cache miss.  The block is
+    // taken from the first of the compressed block cache, the persistent
+    // cache and the file that has it.  If "fill" is set, the block is then
+    // added to the tiers that missed: the persistent cache keeps every
+    // block, the compressed block cache only compressed ones.
+    Status Table::ReadUncachedBlock(const ReadOptions& options, RandomAccessFile* file, const BlockHandle& handle, bool fill, BlockContents* contents) const
     {
-        Block* block = reinterpret_cast<Block*>(value);
-        delete block;
+        Cache* compressed_cache = rep_->options.compressed_block_cache;
+        PersistentCache* persistent_cache = rep_->options.persistent_cache;
+        if (compressed_cache == NULL && persistent_cache == NULL)
+        {
+            return ReadBlock(file, options, handle, contents);
+        }
+        
+        char compressed_key_buffer[16];
+        Slice compressed_key;
+        if (compressed_cache != NULL)
+        {
+            compressed_key = BlockCacheKey(rep_->compressed_cache_id, handle, compressed_key_buffer);
+            Cache::Handle* h = compressed_cache->Lookup(compressed_key);
+            RecordLookup(rep_->cache_stats, BlockCacheStats::kCompressed, h != NULL);
+            if (h != NULL)
+            {
+                Status s = DecodeBlock(*reinterpret_cast<std::string*>(compressed_cache->Value(h)), contents);
+                compressed_cache->Release(h);
+                return s;
+            }
+        }
+        
+        std::string stored;
+        Status s;
+        bool found = false;
+        char persistent_key_buffer[16];
+        Slice persistent_key;
+        if (persistent_cache != NULL)
+        {
+            persistent_key = BlockCacheKey(rep_->table_fingerprint, handle, persistent_key_buffer);
+            found = persistent_cache->Lookup(persistent_key, &stored).ok();
+            RecordLookup(rep_->cache_stats, BlockCacheStats::kPersistent, found);
+        }
+        if (found)
+        {
+            s = DecodeBlock(stored, contents);
+        } else
+        {
+            s = ReadBlock(file, options, handle, contents, fill ? &stored : NULL);
+            if (s.ok() && fill && persistent_cache != NULL)
+            {
+                // A failed insert only costs a read of the file next time
+                persistent_cache->Insert(persistent_key, stored);
+            }
+        }
+        if (s.ok() && fill && compressed_cache != NULL && IsCompressedBlock(stored))
+        {
+            std::string* value = new std::string;
+            value->swap(stored);
+            Cache::Handle* h = compressed_cache->Insert(compressed_key, value, value->size(), &DeleteStoredBlock);
+            if (h != NULL)
+            {
+                compressed_cache->Release(h);
+            } else
+            {
+                delete value;
+            }
+        }
+        return s;
     }
     
-    static void ReleaseBlock(void* arg, void* h)
+    // Returns an iterator over the block at "handle", which is looked up in
+    // the block cache if there is one.  Data blocks are added to the cache
+    // with low priority if options.fill_cache is set; index blocks always
+    // are, with high priority.
+    Iterator* Table::ReadBlockIterator(const ReadOptions& options, RandomAccessFile* file, const BlockHandle& handle, bool index) const
     {
-        Cache* cache = reinterpret_cast<Cache*>(arg);
-        Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
-        cache->Release(handle);
+        Cache* block_cache = rep_->options.block_cache;
+        Block* block = NULL;
+        Cache::Handle* cache_handle = NULL;
+        Status s;
+        BlockContents contents;
+        if (block_cache != NULL)
+        {
+            char cache_key_buffer[16];
+            Slice key = BlockCacheKey(rep_->cache_id, handle, cache_key_buffer);
+            cache_handle = block_cache->Lookup(key);
+            RecordLookup(rep_->cache_stats, index ? BlockCacheStats::kIndex : BlockCacheStats::kData, cache_handle != NULL);
+            if (cache_handle != NULL)
+            {
+                block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+            } else
+            {
+                s = ReadUncachedBlock(options, file, handle, index || options.fill_cache, &contents);
+                if (s.ok())
+                {
+                    block = new Block(contents);
+                    if (contents.cachable && (index || options.fill_cache))
+                    {
+                        cache_handle = block_cache->Insert(key, block, block->size(), &DeleteCachedBlock,
+                                                           index ? Cache::HIGH : Cache::LOW);
+                    }
+                }
+            }
+        } else
+        {
+            s = ReadUncachedBlock(options, file, handle, index || options.fill_cache, &contents);
+            if (s.ok())
+            {
+                block = new Block(contents);
+            }
+        }
+        
+        Iterator* iter;
+        if (block != NULL)
+        {
+            iter = block->NewIterator(rep_->options.comparator);
+            if (cache_handle == NULL)
+            {
+                iter->RegisterCleanup(&DeleteBlock, block, NULL);
+            } else
+            {
+                iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+            }
+        } else
+        {
+            iter = NewErrorIterator(s);
+        }
+        return iter;
     }
     
     // Convert an index iterator value (i.e., an encoded BlockHandle)
@@ -184,85 +485,535 @@ namespace leveldb
     Iterator* Table::BlockReader(void* arg, const ReadOptions& options, const Slice& index_value)
     {
         Table* table = reinterpret_cast<Table*>(arg);
-        Cache* block_cache = table->rep_->options.block_cache;
-        Block* block = NULL;
-        Cache::Handle* cache_handle = NULL;
-        
         BlockHandle handle;
         Slice input = index_value;
         Status s = handle.DecodeFrom(&input);
         // We intentionally allow extra stuff in index_value so that we
         // can add more features in the future.
+        if (!s.ok())
+        {
+            return NewErrorIterator(s);
+        }
+        return table->ReadBlockIterator(options, table->rep_->file, handle, false);
+    }
+    
+    namespace
+    {
+        // Automatic readahead starts after this many reads in a row, with
+        // a window of kInitialWindow bytes that doubles up to kMaxWindow.
+        static const int kSequentialReads = 2;
+        static const size_t kInitialWindow = 8 << 10;
+        static const size_t kMaxWindow = 2 << 20;
         
-        if (s.ok())
+        // Largest gap between two reads that still counts as in order
+        static const uint64_t kMaxSkip = 8 << 10;
+        
+        // The file that one table iterator reads its data blocks through.
+        // Once the blocks are read in order, it reads ahead of them in
+        // windows that double in size, and serves the following blocks
+        // from its buffer.  Used by one iterator at a time, so it needs no
+        // locking.
+        class ReadaheadFile : public RandomAccessFile
         {
-            BlockContents contents;
-            if (block_cache != NULL)
+        public:
+            // Reads ahead "readahead_size" bytes from the start if non-zero,
+            // else automatically.
+            ReadaheadFile(RandomAccessFile* file, uint64_t file_size, size_t readahead_size)
+            : file_(file),
+            file_size_(file_size),
+            readahead_size_(readahead_size),
+            window_(0),
+            sequential_reads_(0),
+            next_offset_(0),
+            buffer_offset_(0),
+            buffer_size_(0),
+            in_memory_(false)
             {
-                char cache_key_buffer[16];
-                EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-                EncodeFixed64(cache_key_buffer+8, handle.offset());
-                Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-                cache_handle = block_cache->Lookup(key);
-                if (cache_handle != NULL)
+            }
+            
+            virtual Status Read(uint64_t offset, size_t n, Slice* result, char* scratch) const
+            {
+                if (offset >= buffer_offset_ && offset + n <= buffer_offset_ + buffer_size_)
+                {
+                    // Copied out since the buffer is reused by later reads
+                    memcpy(scratch, buffer_.data() + (offset - buffer_offset_), n);
+                    *result = Slice(scratch, n);
+                    next_offset_ = offset + n;
+                    return Status::OK();
+                }
+                
+                // Blocks read in order may skip the index and filter
+                // partitions of a partitioned table, or blocks found in the
+                // block cache.
+                if (offset >= next_offset_ && offset - next_offset_ <= kMaxSkip)
                 {
-                    block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+                    sequential_reads_++;
                 } else
                 {
-                    s = ReadBlock(table->rep_->file, options, handle, &contents);
-                    if (s.ok())
+                    sequential_reads_ = 0;
+                    window_ = 0;
+                }
+                next_offset_ = offset + n;
+                
+                size_t size = n;
+                if (!in_memory_)
+                {
+                    if (readahead_size_ > 0)
                     {
-                        block = new Block(contents);
-                        if (contents.cachable && options.fill_cache)
-                        {
-                            cache_handle = block_cache->Insert(key, block, block->size(), &DeleteCachedBlock);
-                        }
+                        size = readahead_size_;
+                    } else if (sequential_reads_ >= kSequentialReads)
+                    {
+                        window_ = (window_ == 0 ? kInitialWindow : std::min(2 * window_, kMaxWindow));
+                        size = window_;
+                    }
+                    if (offset < file_size_)
+                    {
+                        size = static_cast<size_t>(std::min<uint64_t>(size, file_size_ - offset));
                     }
                 }
-            } else
+                if (size <= n)
+                {
+                    Status s = file_->Read(offset, n, result, scratch);
+                    if (s.ok() && result->data() != scratch)
+                    {
+                        in_memory_ = true;
+                    }
+                    return s;
+                }
+                
+                buffer_.resize(size);
+                buffer_size_ = 0;
+                Slice data;
+                Status s = file_->Read(offset, size, &data, &buffer_[0]);
+                if (!s.ok())
+                {
+                    return s;
+                }
+                if (data.data() != buffer_.data())
+                {
+                    // The file is in memory already: nothing to gain
+                    in_memory_ = true;
+                    *result = Slice(data.data(), std::min(n, data.size()));
+                    return s;
+                }
+                buffer_offset_ = offset;
+                buffer_size_ = data.size();
+                n = std::min(n, data.size());
+                memcpy(scratch, buffer_.data(), n);
+                *result = Slice(scratch, n);
+                return s;
+            }
+            
+        private:
+            RandomAccessFile* const file_;
+            const uint64_t file_size_;
+            const size_t readahead_size_;
+            
+            mutable size_t window_;             // Last automatic readahead size
+            mutable int sequential_reads_;
+            mutable uint64_t next_offset_;      // End of the last read
+            mutable std::string buffer_;
+            mutable uint64_t buffer_offset_;
+            mutable size_t buffer_size_;        // Valid bytes in buffer_
+            mutable bool in_memory_;            // file_ returns its own memory
+        };
+        
+        // The argument of Table::ScanBlockReader()
+        struct TableScan
+        {
+            TableScan(const Table* t, RandomAccessFile* file, uint64_t file_size, size_t readahead_size)
+            : table(t), readahead_file(file, file_size, readahead_size)
             {
-                s = ReadBlock(table->rep_->file, options, handle, &contents);
-                if (s.ok())
+            }
+            
+            const Table* table;
+            ReadaheadFile readahead_file;
+        };
+        
+        static void DeleteTableScan(void* arg, void* ignored)
+        {
+            delete reinterpret_cast<TableScan*>(arg);
+        }
+        
+        // Wraps an index iterator so that a scan does not go on to data
+        // blocks outside [lower, upper).  The key of an index entry is >=
+        // the keys of its block and < the keys of the next one, so Next()
+        // from an entry >= upper and Prev() onto an entry < lower can only
+        // reach blocks out of range, and end the iteration instead.
+        // SeekToLast() starts from the first entry >= upper, the last one
+        // whose block may be in range.  Other seeks are passed through
+        // untouched.  An empty bound is open.
+        class BoundedIndexIterator : public Iterator
+        {
+        public:
+            BoundedIndexIterator(Iterator* iter, const Comparator* cmp, const Slice* lower, const Slice* upper)
+            : iter_(iter), cmp_(cmp), valid_(false)
+            {
+                if (lower != NULL)
                 {
-                    block = new Block(contents);
+                    lower_.assign(lower->data(), lower->size());
+                }
+                if (upper != NULL)
+                {
+                    upper_.assign(upper->data(), upper->size());
+                }
+            }
+            virtual ~BoundedIndexIterator() { delete iter_; }
+            virtual bool Valid() const { return valid_; }
+            virtual void Seek(const Slice& target)
+            {
+                iter_->Seek(target);
+                valid_ = iter_->Valid();
+            }
+            virtual void SeekToFirst()
+            {
+                iter_->SeekToFirst();
+                valid_ = iter_->Valid();
+            }
+            virtual void SeekToLast()
+            {
+                if (!upper_.empty())
+                {
+                    iter_->Seek(upper_);
+                }
+                if (upper_.empty() || !iter_->Valid())
+                {
+                    iter_->SeekToLast();
+                }
+                valid_ = iter_->Valid() && (lower_.empty() || cmp_->Compare(iter_->key(), lower_) >= 0);
+            }
+            virtual void Next()
+            {
+                assert(valid_);
+                if (!upper_.empty() && cmp_->Compare(iter_->key(), upper_) >= 0)
+                {
+                    valid_ = false;
+                    return;
                 }
+                iter_->Next();
+                valid_ = iter_->Valid();
+            }
+            virtual void Prev()
+            {
+                assert(valid_);
+                iter_->Prev();
+                valid_ = iter_->Valid() && (lower_.empty() || cmp_->Compare(iter_->key(), lower_) >= 0);
+            }
+            virtual Slice key() const
+            {
+                assert(valid_);
+                return iter_->key();
+            }
+            virtual Slice value() const
+            {
+                assert(valid_);
+                return iter_->value();
+            }
+            virtual Status status() const { return iter_->status(); }
+            
+        private:
+            Iterator* const iter_;
+            const Comparator* const cmp_;
+            std::string lower_;
+            std::string upper_;
+            bool valid_;
+        };
+    }  // namespace
+    
+    // Wraps the index iterator of a table whose filters hold prefixes, so
+    // that a scan skips the data blocks whose filter shows that they hold
+    // no key with the prefix of the last Seek() target, or all of them if
+    // the whole-table filter does.  After SeekToFirst() and SeekToLast(),
+    // or a Seek() outside of the domain of the prefix extractor, every
+    // block is visited.
+    class Table::PrefixIndexIterator : public Iterator
+    {
+    public:
+        PrefixIndexIterator(const Table* table, const ReadOptions& options, Iterator* iter)
+        : table_(table), options_(options), iter_(iter), has_prefix_(false), excluded_(false)
+        {
+        }
+        virtual ~PrefixIndexIterator() { delete iter_; }
+        virtual bool Valid() const { return !excluded_ && iter_->Valid(); }
+        virtual void Seek(const Slice& target)
+        {
+            const Rep* r = table_->rep_;
+            has_prefix_ = r->options.prefix_extractor->InDomain(target);
+            if (has_prefix_)
+            {
+                Slice prefix = r->options.prefix_extractor->Transform(target);
+                prefix_.assign(prefix.data(), prefix.size());
+            }
+            excluded_ = (has_prefix_ && r->filter_type == kFullFilter &&
+                         !table_->FilterMayMatch(options_, r->filter_handle, true, 0, prefix_));
+            if (!excluded_)
+            {
+                iter_->Seek(target);
+                SkipForward();
+            }
+        }
+        virtual void SeekToFirst()
+        {
+            has_prefix_ = excluded_ = false;
+            iter_->SeekToFirst();
+        }
+        virtual void SeekToLast()
+        {
+            has_prefix_ = excluded_ = false;
+            iter_->SeekToLast();
+        }
+        virtual void Next()
+        {
+            assert(Valid());
+            iter_->Next();
+            SkipForward();
+        }
+        virtual void Prev()
+        {
+            assert(Valid());
+            iter_->Prev();
+            while (iter_->Valid() && !BlockMayMatch())
+            {
+                iter_->Prev();
             }
         }
+        virtual Slice key() const
+        {
+            assert(Valid());
+            return iter_->key();
+        }
+        virtual Slice value() const
+        {
+            assert(Valid());
+            return iter_->value();
+        }
+        virtual Status status() const { return iter_->status(); }
         
-        Iterator* iter;
-        if (block != NULL)
+    private:
+        // Returns false if the filter of the current block rules out the
+        // prefix.
+        bool BlockMayMatch() const
         {
-            iter = block->NewIterator(table->rep_->options.comparator);
-            if (cache_handle == NULL)
+            const Rep* r = table_->rep_;
+            if (!has_prefix_ || r->filter_type != kBlockFilter)
             {
-                iter->RegisterCleanup(&DeleteBlock, block, NULL);
+                return true;
+            }
+            Slice input = iter_->value();
+            BlockHandle handle;
+            return (!handle.DecodeFrom(&input).ok() ||
+                    table_->FilterMayMatch(options_, r->filter_handle, false, handle.offset(), prefix_));
+        }
+        
+        void SkipForward()
+        {
+            while (iter_->Valid() && !BlockMayMatch())
+            {
+                iter_->Next();
+            }
+        }
+        
+        const Table* const table_;
+        const ReadOptions options_;
+        Iterator* const iter_;
+        std::string prefix_;        // Of the last Seek() target, if has_prefix_
+        bool has_prefix_;
+        bool excluded_;             // The table holds no key with the prefix
+    };
+    
+    // Like BlockReader, for the iterators of NewIterator(), which read data
+    // blocks through the ReadaheadFile of their TableScan.
+    Iterator* Table::ScanBlockReader(void* arg, const ReadOptions& options, const Slice& index_value)
+    {
+        TableScan* scan = reinterpret_cast<TableScan*>(arg);
+        BlockHandle handle;
+        Slice input = index_value;
+        Status s = handle.DecodeFrom(&input);
+        if (!s.ok())
+        {
+            return NewErrorIterator(s);
+        }
+        return scan->table->ReadBlockIterator(options, &scan->readahead_file, handle, false);
+    }
+    
+    // Like BlockReader, for a top-level index value (whose handle may be
+    // followed by the handle of a filter partition).
+    Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options, const Slice& index_value)
+    {
+        Table* table = reinterpret_cast<Table*>(arg);
+        BlockHandle handle;
+        Slice input = index_value;
+        Status s = handle.DecodeFrom(&input);
+        if (!s.ok())
+        {
+            return NewErrorIterator(s);
+        }
+        return table->ReadBlockIterator(options, table->rep_->file, handle, true);
+    }
+    
+    // Returns an iterator over the index block (the top level of a
+    // partitioned index), pinned or from the block cache.
+    Iterator* Table::NewTopIndexIterator(const ReadOptions& options) const
+    {
+        if (rep_->index_block != NULL)
+        {
+            return rep_->index_block->NewIterator(rep_->options.comparator);
+        }
+        return ReadBlockIterator(options, rep_->file, rep_->index_handle, true);
+    }
+    
+    // Returns an iterator over the index entries of the table, whose values
+    // are data block handles.  A partitioned index is walked through its
+    // top level.
+    Iterator* Table::NewIndexIterator(const ReadOptions& options) const
+    {
+        Iterator* iiter = NewTopIndexIterator(options);
+        if (rep_->partitioned_index)
+        {
+            iiter = NewTwoLevelIterator(iiter, &Table::IndexPartitionReader, const_cast<Table*>(this), options);
+        }
+        return iiter;
+    }
+    
+    // Returns false if the filter block at "filter_handle" shows that "key"
+    // is absent.  For a per-block filter, "block_offset" is the offset of
+    // the data block that would hold the key.  Filters that are not pinned
+    // in the table are read through the block cache, and always added to
+    // it with high priority.
+    bool Table::FilterMayMatch(const ReadOptions& options, const BlockHandle& filter_handle, bool full, uint64_t block_offset, const Slice& key) const
+    {
+        Cache* block_cache = rep_->options.block_cache;
+        Cache::Handle* cache_handle = NULL;
+        BlockContents* contents = NULL;     // Owned if cache_handle is NULL
+        Slice filter;
+        if (rep_->filter_pinned && filter_handle.offset() == rep_->filter_handle.offset())
+        {
+            filter = rep_->filter;
+        } else
+        {
+            char cache_key_buffer[16];
+            Slice cache_key = BlockCacheKey(rep_->cache_id, filter_handle, cache_key_buffer);
+            if (block_cache != NULL)
+            {
+                cache_handle = block_cache->Lookup(cache_key);
+                RecordLookup(rep_->cache_stats, BlockCacheStats::kFilter, cache_handle != NULL);
+            }
+            if (cache_handle != NULL)
+            {
+                filter = reinterpret_cast<BlockContents*>(block_cache->Value(cache_handle))->data;
             } else
             {
-                iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+                contents = new BlockContents;
+                if (!ReadBlock(rep_->file, options, filter_handle, contents).ok())
+                {
+                    delete contents;
+                    return true;  // Errors are treated as potential matches
+                }
+                filter = contents->data;
+                if (block_cache != NULL && contents->cachable)
+                {
+                    cache_handle = block_cache->Insert(cache_key, contents, contents->data.size(), &DeleteCachedFilter, Cache::HIGH);
+                    if (cache_handle != NULL)
+                    {
+                        contents = NULL;
+                    }
+                }
             }
+        }
+        
+        bool result;
+        if (full)
+        {
+            result = FullFilterBlockReader(rep_->options.filter_policy, filter).KeyMayMatch(key);
         } else
         {
-            iter = NewErrorIterator(s);
+            result = FilterBlockReader(rep_->options.filter_policy, filter).KeyMayMatch(block_offset, key);
         }
-        return iter;
+        if (cache_handle != NULL)
+        {
+            block_cache->Release(cache_handle);
+        }
+        if (contents != NULL)
+        {
+            DeleteFilterContents(contents);
+        }
+        return result;
+    }
+    
+    // Returns false if the filter partition named by a top-level index
+    // value shows that "key" is not in that partition.
+    bool Table::PartitionMayMatch(const ReadOptions& options, const Slice& top_index_value, const Slice& key) const
+    {
+        if (rep_->filter_type != kPartitionedFilter)
+        {
+            return true;
+        }
+        Slice input = top_index_value;
+        BlockHandle partition_handle, filter_handle;
+        if (!partition_handle.DecodeFrom(&input).ok() || !filter_handle.DecodeFrom(&input).ok())
+        {
+            return true;  // Errors are treated as potential matches
+        }
+        return FilterMayMatch(options, filter_handle, true, 0, key);
     }
     
     Iterator* Table::NewIterator(const ReadOptions& options) const
     {
-        return NewTwoLevelIterator(rep_->index_block->NewIterator(rep_->options.comparator), &Table::BlockReader, const_cast<Table*>(this), options);
+        // The bounds are copied by the index iterator, so the iterators
+        // below must not keep pointers to them.
+        ReadOptions scan_options = options;
+        scan_options.iterate_lower_bound = NULL;
+        scan_options.iterate_upper_bound = NULL;
+        Iterator* index_iter = NewIndexIterator(scan_options);
+        if (options.prefix_seek && rep_->prefix_filtered &&
+            (rep_->filter_type == kBlockFilter || rep_->filter_type == kFullFilter))
+        {
+            index_iter = new PrefixIndexIterator(this, scan_options, index_iter);
+        }
+        if (options.iterate_lower_bound != NULL || options.iterate_upper_bound != NULL)
+        {
+            index_iter = new BoundedIndexIterator(index_iter, rep_->options.comparator,
+                                                  options.iterate_lower_bound, options.iterate_upper_bound);
+        }
+        TableScan* scan = new TableScan(this, rep_->file, rep_->file_size, options.readahead_size);
+        Iterator* iter = NewTwoLevelIterator(index_iter, &Table::ScanBlockReader, scan, scan_options);
+        iter->RegisterCleanup(&DeleteTableScan, scan, NULL);
+        return iter;
     }
     
     Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg, void (*saver)(void*, const Slice&, const Slice&))
     {
         Status s;
-        Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+        if (rep_->filter_type == kFullFilter && !FilterMayMatch(options, rep_->filter_handle, true, 0, k))
+        {
+            // Not found, and no need to consult the index
+            return s;
+        }
+        Iterator* iiter;
+        if (rep_->partitioned_index)
+        {
+            // Find the partition, and check its filter before reading it
+            Iterator* top = NewTopIndexIterator(options);
+            top->Seek(k);
+            if (!top->Valid() || !PartitionMayMatch(options, top->value(), k))
+            {
+                s = top->status();
+                delete top;
+                return s;
+            }
+            iiter = IndexPartitionReader(this, options, top->value());
+            delete top;
+        } else
+        {
+            iiter = NewTopIndexIterator(options);
+        }
         iiter->Seek(k);
         if (iiter->Valid())
         {
             Slice handle_value = iiter->value();
-            FilterBlockReader* filter = rep_->filter;
             BlockHandle handle;
-            if (filter != NULL && handle.DecodeFrom(&handle_value).ok() && !filter->KeyMayMatch(handle.offset(), k))
+            if (rep_->filter_type == kBlockFilter && handle.DecodeFrom(&handle_value).ok() &&
+                !FilterMayMatch(options, rep_->filter_handle, false, handle.offset(), k))
             {
                 // Not found
             } else
@@ -286,9 +1037,88 @@ namespace leveldb
     }
     
     
+    Status Table::InternalMultiGet(const ReadOptions& options, int n, const Slice* keys, void* const* args, void (*saver)(void*, const Slice&, const Slice&))
+    {
+        Status s;
+        const Comparator* cmp = rep_->options.comparator;
+        Iterator* iiter = NewIndexIterator(options);
+        Iterator* top = (rep_->filter_type == kPartitionedFilter) ? NewTopIndexIterator(options) : NULL;
+        Iterator* block_iter = NULL;
+        std::string block_handle;   // Handle of the block under block_iter
+        for (int i = 0; i < n && s.ok(); i++)
+        {
+            const Slice& k = keys[i];
+            if (rep_->filter_type == kFullFilter && !FilterMayMatch(options, rep_->filter_handle, true, 0, k))
+            {
+                // Not found
+                continue;
+            }
+            if (top != NULL)
+            {
+                if (!top->Valid() || cmp->Compare(top->key(), k) < 0)
+                {
+                    top->Seek(k);
+                    if (!top->Valid())
+                    {
+                        break;
+                    }
+                }
+                if (!PartitionMayMatch(options, top->value(), k))
+                {
+                    // Not found
+                    continue;
+                }
+            }
+            // The keys are sorted, so the current index entry is still the
+            // right one as long as it is >= k.
+            if (!iiter->Valid() || cmp->Compare(iiter->key(), k) < 0)
+            {
+                iiter->Seek(k);
+                if (!iiter->Valid())
+                {
+                    // k and all keys after it are past the end of the table
+                    break;
+                }
+            }
+            Slice handle_value = iiter->value();
+            BlockHandle handle;
+            Slice input = handle_value;
+            if (rep_->filter_type == kBlockFilter && handle.DecodeFrom(&input).ok() &&
+                !FilterMayMatch(options, rep_->filter_handle, false, handle.offset(), k))
+            {
+                // Not found
+                continue;
+            }
+            if (block_iter == NULL || handle_value != Slice(block_handle))
+            {
+                delete block_iter;
+                block_iter = BlockReader(this, options, handle_value);
+                block_handle.assign(handle_value.data(), handle_value.size());
+            }
+            block_iter->Seek(k);
+            if (block_iter->Valid())
+            {
+                (*saver)(args[i], block_iter->key(), block_iter->value());
+            }
+            s = block_iter->status();
+        }
+        delete block_iter;
+        if (s.ok())
+        {
+            s = iiter->status();
+        }
+        if (s.ok() && top != NULL)
+        {
+            s = top->status();
+        }
+        delete top;
+        delete iiter;
+        return s;
+    }
+    
     uint64_t Table::ApproximateOffsetOf(const Slice& key) const
     {
-        Iterator* index_iter = rep_->index_block->NewIterator(rep_->options.comparator);
+        Iterator* index_iter = NewIndexIterator(ReadOptions());
         index_iter->Seek(key);
         uint64_t result;
         if (index_iter->Valid())
@@ -317,4 +1147,13 @@ namespace leveldb
         return result;
     }
     
+    Iterator* Table::NewRangeTombstoneIterator() const
+    {
+        if (rep_->range_del_block == NULL)
+        {
+            return NULL;
+        }
+        return rep_->range_del_block->NewIterator(rep_->options.comparator);
+    }
+    
 }  // namespace leveldb
@@ -5,10 +5,12 @@
 #include "leveldb/table_builder.h"
 
 #include <assert.h>
+#include <algorithm>
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -25,11 +27,14 @@ namespace leveldb
         uint64_t offset;
         Status status;
         BlockBuilder data_block;
-        BlockBuilder index_block;
+        BlockBuilder index_block;       // Current partition if options.partition_index
+        BlockBuilder top_index_block;   // Index over the partitions
         std::string last_key;
         int64_t num_entries;
         bool closed;          // Either Finish() or Abandon() has been called.
         FilterBlockBuilder* filter_block;
+        FullFilterBlockBuilder* full_filter_block;
+        std::vector<std::pair<std::string, std::string> > range_tombstones;
         
         // We do not emit the index entry for a block until we have seen the
         // first key for the next data block.  This allows us to use shorter
@@ -51,9 +56,11 @@ namespace leveldb
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        top_index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == NULL ? NULL : new FilterBlockBuilder(opt.filter_policy)),
+        filter_block(opt.filter_policy == NULL || opt.whole_table_filter ? NULL : new FilterBlockBuilder(opt.filter_policy, opt.prefix_extractor)),
+        full_filter_block(opt.filter_policy == NULL || !opt.whole_table_filter ? NULL : new FullFilterBlockBuilder(opt.filter_policy, opt.prefix_extractor)),
         pending_index_entry(false)
         {
             index_block_options.block_restart_interval = 1;
@@ -72,6 +79,7 @@ namespace leveldb
     {
         assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
         delete rep_->filter_block;
+        delete rep_->full_filter_block;
         delete rep_;
     }
     
@@ -84,6 +92,12 @@ namespace leveldb
         {
             return Status::InvalidArgument("changing comparator while building table");
         }
+        if (options.partition_index != rep_->options.partition_index ||
+            options.whole_table_filter != rep_->options.whole_table_filter ||
+            options.prefix_extractor != rep_->options.prefix_extractor)
+        {
+            return Status::InvalidArgument("changing index or filter layout while building table");
+        }
         
         // Note that any live BlockBuilders point to rep_->options and therefore
         // will automatically pick up the updated options.
@@ -93,6 +107,32 @@ namespace leveldb
         return Status::OK();
     }
     
+    namespace
+    {
+        struct TombstoneLess
+        {
+            const Comparator* cmp;
+            bool operator()(const std::pair<std::string, std::string>& a,
+                            const std::pair<std::string, std::string>& b) const
+            {
+                return cmp->Compare(a.first, b.first) < 0;
+            }
+        };
+    }  // namespace
+    
+    void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& end)
+    {
+        Rep* r = rep_;
+        assert(!r->closed);
+        if (!ok()) return;
+        r->range_tombstones.push_back(std::make_pair(key.ToString(), end.ToString()));
+    }
+    
+    uint64_t TableBuilder::NumRangeTombstones() const
+    {
+        return rep_->range_tombstones.size();
+    }
+    
     void TableBuilder::Add(const Slice& key, const Slice& value)
     {
         Rep* r = rep_;
@@ -107,16 +147,17 @@ namespace leveldb
         {
             assert(r->data_block.empty());
             r->options.comparator->FindShortestSeparator(&r->last_key, key);
-            std::string handle_encoding;
-            r->pending_handle.EncodeTo(&handle_encoding);
-            r->index_block.Add(r->last_key, Slice(handle_encoding));
-            r->pending_index_entry = false;
+            AddIndexEntry();
         }
         
         if (r->filter_block != NULL)
         {
             r->filter_block->AddKey(key);
         }
+        if (r->full_filter_block != NULL)
+        {
+            r->full_filter_block->AddKey(key);
+        }
         
         r->last_key.assign(key.data(), key.size());
         r->num_entries++;
@@ -148,6 +189,53 @@ namespace leveldb
         }
     }
     
+    // Adds the index entry for the block at r->pending_handle, keyed by
+    // r->last_key, and starts a new index partition once the current one
+    // is large enough.
+    void TableBuilder::AddIndexEntry()
+    {
+        Rep* r = rep_;
+        std::string handle_encoding;
+        r->pending_handle.EncodeTo(&handle_encoding);
+        r->index_block.Add(r->last_key, Slice(handle_encoding));
+        r->pending_index_entry = false;
+        if (r->options.partition_index &&
+            r->index_block.CurrentSizeEstimate() >= r->options.block_size)
+        {
+            FlushIndexPartition();
+        }
+    }
+    
+    // Writes out the current index partition, along with the filter for
+    // its keys if filters are partitioned, and adds it to the top-level
+    // index under r->last_key.  A top-level value is the partition's
+    // handle, followed by the filter partition's handle if there is one.
+    void TableBuilder::FlushIndexPartition()
+    {
+        Rep* r = rep_;
+        if (!ok()) return;
+        BlockHandle partition_handle;
+        WriteBlock(&r->index_block, &partition_handle);
+        std::string handle_encoding;
+        partition_handle.EncodeTo(&handle_encoding);
+        if (ok() && r->full_filter_block != NULL)
+        {
+            BlockHandle filter_handle;
+            WriteRawBlock(r->full_filter_block->Finish(), kNoCompression, &filter_handle);
+            filter_handle.EncodeTo(&handle_encoding);
+        }
+        if (ok())
+        {
+            r->top_index_block.Add(r->last_key, Slice(handle_encoding));
+        }
+        if (r->filter_block != NULL)
+        {
+            // The partition now sits where Flush() expected the next data
+            // block, so move the per-block filter on to the real offset.
+            r->filter_block->StartBlock(r->offset);
+        }
+    }
+    
     void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle)
     {
         // File format contains a sequence of blocks where each block has:
@@ -160,28 +248,32 @@ namespace leveldb
         
         Slice block_contents;
         CompressionType type = r->options.compression;
-        // TODO(postrelease): Support more compression options: zlib?
+        std::string* compressed = &r->compressed_output;
+        bool ok;
         switch (type)
         {
-            case kNoCompression:
-                block_contents = raw;
-                break;
-                
             case kSnappyCompression:
-            {
-                std::string* compressed = &r->compressed_output;
-                if (port::Snappy_Compress(raw.data(), raw.size(), compressed) && compressed->size() < raw.size() - (raw.size() / 8u))
-                {
-                    block_contents = *compressed;
-                } else
-                {
-                    // Snappy not supported, or compressed less than 12.5%, so just
-                    // store uncompressed form
-                    block_contents = raw;
-                    type = kNoCompression;
-                }
+                ok = port::Snappy_Compress(raw.data(), raw.size(), compressed);
+                break;
+            case kLZ4Compression:
+                ok = port::LZ4_Compress(raw.data(), raw.size(), compressed);
+                break;
+            case kZstdCompression:
+                ok = port::Zstd_Compress(raw.data(), raw.size(), compressed);
+                break;
+            default:
+                ok = false;
                 break;
-            }
+        }
+        if (ok && compressed->size() < raw.size() - (raw.size() / 8u))
+        {
+            block_contents = *compressed;
+        } else
+        {
+            // No compression requested, compression not supported, or
+            // compressed less than 12.5%, so just store uncompressed form
+            block_contents = raw;
+            type = kNoCompression;
         }
         WriteRawBlock(block_contents, type, handle);
         r->compressed_output.clear();
@@ -221,13 +313,45 @@ namespace leveldb
         assert(!r->closed);
         r->closed = true;
         
-        BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+        BlockHandle filter_block_handle, range_del_block_handle, metaindex_block_handle, index_block_handle;
+        
+        // Write the last index partition (and filter partition)
+        if (ok() && r->options.partition_index)
+        {
+            if (r->pending_index_entry)
+            {
+                r->options.comparator->FindShortSuccessor(&r->last_key);
+                AddIndexEntry();
+            }
+            if (!r->index_block.empty())
+            {
+                FlushIndexPartition();
+            }
+        }
         
         // Write filter block
         if (ok() && r->filter_block != NULL)
         {
             WriteRawBlock(r->filter_block->Finish(), kNoCompression, &filter_block_handle);
         }
+        if (ok() && r->full_filter_block != NULL && !r->options.partition_index)
+        {
+            WriteRawBlock(r->full_filter_block->Finish(), kNoCompression, &filter_block_handle);
+        }
+        
+        // Write range tombstone block
+        if (ok() && !r->range_tombstones.empty())
+        {
+            TombstoneLess less;
+            less.cmp = r->options.comparator;
+            std::sort(r->range_tombstones.begin(), r->range_tombstones.end(), less);
+            BlockBuilder range_del_block(&r->options);
+            for (size_t i = 0; i < r->range_tombstones.size(); i++)
+            {
+                range_del_block.Add(r->range_tombstones[i].first, r->range_tombstones[i].second);
+            }
+            WriteBlock(&range_del_block, &range_del_block_handle);
+        }
         
         // Write metaindex block
         if (ok())
@@ -242,6 +366,37 @@ namespace leveldb
                 filter_block_handle.EncodeTo(&handle_encoding);
                 meta_index_block.Add(key, handle_encoding);
             }
+            if (r->full_filter_block != NULL && !r->options.partition_index)
+            {
+                // Add mapping from "fullfilter.Name" to location of filter data
+                std::string key = "fullfilter.";
+                key.append(r->options.filter_policy->Name());
+                std::string handle_encoding;
+                filter_block_handle.EncodeTo(&handle_encoding);
+                meta_index_block.Add(key, handle_encoding);
+            }
+            if (r->full_filter_block != NULL && r->options.partition_index)
+            {
+                // The filter partitions are located through the top-level
+                // index; record which policy built them.
+                std::string key = "partitionedfilter.";
+                key.append(r->options.filter_policy->Name());
+                meta_index_block.Add(key, Slice());
+            }
+            if ((r->filter_block != NULL || r->full_filter_block != NULL) && r->options.prefix_extractor != NULL)
+            {
+                // Record which prefixes the filters hold, if any
+                std::string key = "prefixfilter.";
+                key.append(r->options.prefix_extractor->Name());
+                meta_index_block.Add(key, Slice());
+            }
+            if (!r->range_tombstones.empty())
+            {
+                // Add mapping from "rangedel" to location of the tombstones
+                std::string handle_encoding;
+                range_del_block_handle.EncodeTo(&handle_encoding);
+                meta_index_block.Add("rangedel", handle_encoding);
+            }
             
             // TODO(postrelease): Add stats and other meta blocks
             WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -250,15 +405,18 @@ namespace leveldb
         // Write index block
         if (ok())
         {
-            if (r->pending_index_entry)
+            if (r->options.partition_index)
             {
-                r->options.comparator->FindShortSuccessor(&r->last_key);
-                std::string handle_encoding;
-                r->pending_handle.EncodeTo(&handle_encoding);
-                r->index_block.Add(r->last_key, Slice(handle_encoding));
-                r->pending_index_entry = false;
+                WriteBlock(&r->top_index_block, &index_block_handle);
+            } else
+            {
+                if (r->pending_index_entry)
+                {
+                    r->options.comparator->FindShortSuccessor(&r->last_key);
+                    AddIndexEntry();
+                }
+                WriteBlock(&r->index_block, &index_block_handle);
             }
-            WriteBlock(&r->index_block, &index_block_handle);
         }
         
         // Write footer
@@ -267,6 +425,7 @@ namespace leveldb
             Footer footer;
             footer.set_metaindex_handle(metaindex_block_handle);
             footer.set_index_handle(index_block_handle);
+            footer.set_partitioned_index(r->options.partition_index);
             std::string footer_encoding;
             footer.EncodeTo(&footer_encoding);
             r->status = r->file->Append(footer_encoding);
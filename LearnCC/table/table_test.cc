@@ -7,15 +7,20 @@
 #include <map>
 #include <string>
 #include "db/dbformat.h"
+#include "db/filename.h"
 #include "db/memtable.h"
+#include "db/table_cache.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -218,6 +223,51 @@ class BlockConstructor: public Constructor {
   BlockConstructor();
 };
 
+// Deals the data round-robin across several blocks and reads them back
+// through a merging iterator.
+class MergingConstructor: public Constructor {
+ public:
+  MergingConstructor(const Comparator* cmp, int num_children)
+      : Constructor(cmp),
+        comparator_(cmp) {
+    for (int i = 0; i < num_children; i++) {
+      children_.push_back(new BlockConstructor(cmp));
+    }
+  }
+  ~MergingConstructor() {
+    for (size_t i = 0; i < children_.size(); i++) {
+      delete children_[i];
+    }
+  }
+  virtual Status FinishImpl(const Options& options, const KVMap& data) {
+    std::vector<KVMap> parts(children_.size(), KVMap(STLLessThan(comparator_)));
+    size_t n = 0;
+    for (KVMap::const_iterator it = data.begin();
+         it != data.end();
+         ++it, ++n) {
+      parts[n % parts.size()][it->first] = it->second;
+    }
+    for (size_t i = 0; i < children_.size(); i++) {
+      Status s = children_[i]->FinishImpl(options, parts[i]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+  virtual Iterator* NewIterator() const {
+    std::vector<Iterator*> list;
+    for (size_t i = 0; i < children_.size(); i++) {
+      list.push_back(children_[i]->NewIterator());
+    }
+    return NewMergingIterator(comparator_, &list[0], list.size());
+  }
+
+ private:
+  const Comparator* comparator_;
+  std::vector<BlockConstructor*> children_;
+};
+
 class TableConstructor: public Constructor {
  public:
   TableConstructor(const Comparator* cmp)
@@ -247,6 +297,7 @@ class TableConstructor: public Constructor {
     source_ = new StringSource(sink.contents());
     Options table_options;
     table_options.comparator = options.comparator;
+    table_options.filter_policy = options.filter_policy;
     return Table::Open(table_options, source_, sink.contents().size(), &table_);
   }
 
@@ -398,8 +449,10 @@ class DBConstructor: public Constructor {
 
 enum TestType {
   TABLE_TEST,
+  PARTITIONED_TABLE_TEST,
   BLOCK_TEST,
   MEMTABLE_TEST,
+  MERGER_TEST,
   DB_TEST
 };
 
@@ -417,6 +470,10 @@ static const TestArgs kTestArgList[] = {
   { TABLE_TEST, true, 1 },
   { TABLE_TEST, true, 1024 },
 
+  { PARTITIONED_TABLE_TEST, false, 16 },
+  { PARTITIONED_TABLE_TEST, true, 16 },
+  { PARTITIONED_TABLE_TEST, false, 1 },
+
   { BLOCK_TEST, false, 16 },
   { BLOCK_TEST, false, 1 },
   { BLOCK_TEST, false, 1024 },
@@ -428,6 +485,12 @@ static const TestArgs kTestArgList[] = {
   { MEMTABLE_TEST, false, 16 },
   { MEMTABLE_TEST, true, 16 },
 
+  // For merging iterators the restart interval is the number of children
+  { MERGER_TEST, false, 1 },
+  { MERGER_TEST, false, 4 },
+  { MERGER_TEST, false, 50 },
+  { MERGER_TEST, true, 4 },
+
   // Do not bother with restart interval variations for DB
   { DB_TEST, false, 16 },
   { DB_TEST, true, 16 },
@@ -454,12 +517,21 @@ class Harness {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PARTITIONED_TABLE_TEST:
+        constructor_ = new TableConstructor(options_.comparator);
+        options_.partition_index = true;
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
       case MEMTABLE_TEST:
         constructor_ = new MemTableConstructor(options_.comparator);
         break;
+      case MERGER_TEST:
+        constructor_ = new MergingConstructor(options_.comparator,
+                                              args.restart_interval);
+        options_.block_restart_interval = 16;
+        break;
       case DB_TEST:
         constructor_ = new DBConstructor(options_.comparator);
         break;
@@ -861,6 +933,636 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),    4000,   6000));
 }
 
+static bool CompressionSupported(CompressionType type) {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  switch (type) {
+    case kSnappyCompression:
+      return port::Snappy_Compress(in.data(), in.size(), &out);
+    case kLZ4Compression:
+      return port::LZ4_Compress(in.data(), in.size(), &out);
+    case kZstdCompression:
+      return port::Zstd_Compress(in.data(), in.size(), &out);
+    default:
+      return true;
+  }
+}
+
+TEST(TableTest, CompressionTypes) {
+  const CompressionType kTypes[] = {
+    kNoCompression, kSnappyCompression, kLZ4Compression, kZstdCompression
+  };
+  for (size_t i = 0; i < sizeof(kTypes) / sizeof(kTypes[0]); i++) {
+    // Unsupported types fall back to storing blocks uncompressed
+    const bool compressed = (kTypes[i] != kNoCompression) &&
+                            CompressionSupported(kTypes[i]);
+    Random rnd(301);
+    TableConstructor c(BytewiseComparator());
+    std::string tmp;
+    for (int k = 0; k < 10; k++) {
+      char key[10];
+      snprintf(key, sizeof(key), "k%02d", k);
+      c.Add(key, test::CompressibleString(&rnd, 0.25, 10000, &tmp));
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 1024;
+    options.compression = kTypes[i];
+    c.Finish(options, &keys, &kvmap);
+
+    Iterator* iter = c.NewIterator();
+    KVMap::const_iterator model = kvmap.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+      ASSERT_TRUE(model != kvmap.end());
+      ASSERT_EQ(model->first, iter->key().ToString());
+      ASSERT_EQ(model->second, iter->value().ToString());
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_TRUE(model == kvmap.end());
+    delete iter;
+
+    const uint64_t size = c.ApproximateOffsetOf("xyz");
+    if (compressed) {
+      ASSERT_LT(size, 50000u);
+    } else {
+      ASSERT_GE(size, 100000u);
+    }
+  }
+}
+
+namespace {
+// Counts the comparisons made through it.  A lookup that a whole-table
+// filter rejects makes none, since it never seeks the index block.
+class CountingComparator : public Comparator {
+ public:
+  CountingComparator() : count_(0) { }
+  virtual const char* Name() const { return BytewiseComparator()->Name(); }
+  virtual int Compare(const Slice& a, const Slice& b) const {
+    count_++;
+    return BytewiseComparator()->Compare(a, b);
+  }
+  virtual void FindShortestSeparator(std::string* start,
+                                     const Slice& limit) const {
+    BytewiseComparator()->FindShortestSeparator(start, limit);
+  }
+  virtual void FindShortSuccessor(std::string* key) const {
+    BytewiseComparator()->FindShortSuccessor(key);
+  }
+
+  mutable int count_;
+};
+
+void SaveValue(void* arg, const Slice& k, const Slice& v) {
+  std::pair<std::string, std::string>* result =
+      reinterpret_cast<std::pair<std::string, std::string>*>(arg);
+  result->first = k.ToString();
+  result->second = v.ToString();
+}
+}  // namespace
+
+static std::string FilterKey(int i) {
+  char buf[20];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
+// An Env that serves one table file from memory through StringSource.
+// Blocks read from it are copies, and so can be cached (blocks of the
+// mmap'ed files of the default Env are not).
+class StringSourceEnv : public EnvWrapper {
+ public:
+  StringSourceEnv(const std::string& fname, const std::string& contents)
+      : EnvWrapper(Env::Default()), fname_(fname), contents_(contents) { }
+
+  virtual Status NewRandomAccessFile(const std::string& fname,
+                                     RandomAccessFile** result) {
+    if (fname != fname_) {
+      return target()->NewRandomAccessFile(fname, result);
+    }
+    *result = new StringSource(contents_);
+    return Status::OK();
+  }
+
+ private:
+  std::string fname_;
+  std::string contents_;
+};
+
+// Builds a table holding the even keys in [0, 2*kKeys) and reads it back
+// through a TableCache, which (unlike TableConstructor) goes through
+// Table::InternalGet().
+class CachedTable {
+ public:
+  static const int kKeys = 5000;
+
+  explicit CachedTable(const Options& options)
+      : options_(options), env_(NULL), cache_(NULL) {
+    StringSink sink;
+    TableBuilder builder(options_, &sink);
+    for (int i = 0; i < 2 * kKeys; i += 2) {
+      builder.Add(FilterKey(i), "value");
+    }
+    ASSERT_OK(builder.Finish());
+    size_ = sink.contents().size();
+
+    const std::string dbname = "/cachedtable";
+    env_ = new StringSourceEnv(TableFileName(dbname, 1), sink.contents());
+    options_.env = env_;
+    cache_ = new TableCache(dbname, &options_, 10);
+  }
+
+  ~CachedTable() {
+    delete cache_;
+    delete env_;
+  }
+
+  // Returns the key the lookup of FilterKey(i) landed on, or "" if none
+  std::string Get(int i) {
+    std::pair<std::string, std::string> found;
+    SequenceNumber covering;
+    ASSERT_OK(cache_->Get(ReadOptions(), 1, size_, FilterKey(i), &found,
+                          SaveValue, &covering));
+    ASSERT_EQ(0, covering);
+    return found.first;
+  }
+
+  TableCache* cache() { return cache_; }
+  uint64_t size() const { return size_; }
+
+ private:
+  Options options_;
+  StringSourceEnv* env_;
+  uint64_t size_;
+  TableCache* cache_;
+};
+
+// Looks up each odd (absent) key and returns the comparisons made.
+static int MissComparisons(bool whole_table_filter) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  CountingComparator cmp;
+  Options options;
+  options.comparator = &cmp;
+  options.filter_policy = policy;
+  options.whole_table_filter = whole_table_filter;
+  options.compression = kNoCompression;
+  options.block_size = 256;
+  int result;
+  {
+    CachedTable table(options);
+    for (int i = 0; i < 2 * CachedTable::kKeys; i += 2) {
+      ASSERT_EQ(FilterKey(i), table.Get(i));
+    }
+    cmp.count_ = 0;
+    for (int i = 1; i < 2 * CachedTable::kKeys; i += 2) {
+      ASSERT_NE(FilterKey(i), table.Get(i));
+    }
+    result = cmp.count_;
+  }
+  delete policy;
+  return result;
+}
+
+TEST(TableTest, WholeTableFilterSkipsIndex) {
+  const int per_block = MissComparisons(false);
+  const int whole_table = MissComparisons(true);
+  fprintf(stderr, "Comparisons for 5000 misses: per-block filter %d, "
+          "whole-table filter %d\n", per_block, whole_table);
+  // Only the ~1% false positives seek the index with a whole-table filter
+  ASSERT_LT(whole_table * 20, per_block);
+}
+
+// Index partitions are written between data blocks; the per-block
+// filter must still find every key of the blocks that follow them.
+TEST(TableTest, PartitionedIndexWithPerBlockFilter) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Options options;
+  options.filter_policy = policy;
+  options.partition_index = true;
+  options.compression = kNoCompression;
+  // Vary the block size so that some partitions cross a filter boundary
+  for (int block_size = 256; block_size <= 1024; block_size += 64) {
+    options.block_size = block_size;
+    CachedTable table(options);
+    for (int i = 0; i < 2 * CachedTable::kKeys; i += 2) {
+      ASSERT_EQ(FilterKey(i), table.Get(i));
+    }
+  }
+  delete policy;
+}
+
+namespace {
+// A Cache that counts the blocks inserted into it.
+class CountingCache : public Cache {
+ public:
+  CountingCache() : rep_(NewLRUCache(1 << 20)), inserts_(0) { }
+  ~CountingCache() { delete rep_; }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    inserts_++;
+    return rep_->Insert(key, value, charge, deleter);
+  }
+  virtual Handle* Lookup(const Slice& key) { return rep_->Lookup(key); }
+  virtual void Release(Handle* handle) { rep_->Release(handle); }
+  virtual void* Value(Handle* handle) { return rep_->Value(handle); }
+  virtual void Erase(const Slice& key) { rep_->Erase(key); }
+  virtual uint64_t NewId() { return rep_->NewId(); }
+
+  Cache* rep_;
+  int inserts_;
+};
+}  // namespace
+
+// Reads every key of a table through "cache" twice and returns the
+// number of blocks the first pass put in the cache.
+static int CachedBlocksForReads(bool partition_index) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  CountingCache cache;
+  Options options;
+  options.filter_policy = policy;
+  options.whole_table_filter = true;
+  options.partition_index = partition_index;
+  options.block_cache = &cache;
+  options.block_size = 256;
+  int result;
+  {
+    CachedTable table(options);
+    for (int i = 0; i < 2 * CachedTable::kKeys; i++) {
+      if (i % 2 == 0) {
+        ASSERT_EQ(FilterKey(i), table.Get(i));
+      } else {
+        ASSERT_NE(FilterKey(i), table.Get(i));
+      }
+    }
+    result = cache.inserts_;
+
+    // Everything needed is now cached
+    for (int i = 0; i < 2 * CachedTable::kKeys; i++) {
+      table.Get(i);
+    }
+    ASSERT_EQ(result, cache.inserts_);
+
+    // Scans and batched lookups see every key
+    Iterator* iter = table.cache()->NewIterator(ReadOptions(), 1, table.size());
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i += 2) {
+      ASSERT_EQ(FilterKey(i), iter->key().ToString());
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_EQ(2 * CachedTable::kKeys, i);
+    iter->Seek(FilterKey(777));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(FilterKey(778), iter->key().ToString());
+    delete iter;
+
+    std::vector<std::string> keys;
+    std::vector<std::pair<std::string, std::string> > found(1000);
+    std::vector<void*> args;
+    for (int k = 3000; k < 4000; k++) {
+      keys.push_back(FilterKey(k));
+      args.push_back(&found[k - 3000]);
+    }
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<SequenceNumber> covering(key_slices.size());
+    ASSERT_OK(table.cache()->MultiGet(ReadOptions(), 1, table.size(),
+                                      key_slices.size(), &key_slices[0],
+                                      &args[0], SaveValue, &covering[0]));
+    for (int k = 3000; k < 4000; k++) {
+      ASSERT_EQ(k % 2 == 0, found[k - 3000].first == FilterKey(k)) << k;
+    }
+  }
+  delete policy;
+  return result;
+}
+
+TEST(TableTest, PartitionedIndexAndFilter) {
+  const int plain = CachedBlocksForReads(false);
+  const int partitioned = CachedBlocksForReads(true);
+  fprintf(stderr, "Blocks cached by reading every key: %d with a pinned "
+          "index and filter, %d with partitions\n", plain, partitioned);
+  // The index and filter partitions go through the block cache as well
+  ASSERT_GT(partitioned, plain);
+}
+
+// Reads every key of a table twice with cache_index_and_filter_blocks
+// set, through a block cache of "capacity" bytes, and stores the block
+// cache misses by kind of block in misses[].
+static void CacheMissesForReads(size_t capacity,
+                                uint64_t misses[BlockCacheStats::kNumKinds]) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Cache* cache = NewLRUCache(capacity);
+  Options options;
+  options.filter_policy = policy;
+  options.whole_table_filter = true;
+  options.cache_index_and_filter_blocks = true;
+  options.block_cache = cache;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  {
+    CachedTable table(options);
+    for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < 2 * CachedTable::kKeys; i++) {
+        if (i % 2 == 0) {
+          ASSERT_EQ(FilterKey(i), table.Get(i));
+        } else {
+          ASSERT_NE(FilterKey(i), table.Get(i));
+        }
+      }
+    }
+    const BlockCacheStats& stats = table.cache()->block_cache_stats();
+    for (int kind = 0; kind < BlockCacheStats::kNumKinds; kind++) {
+      misses[kind] = stats.misses[kind].NoBarrier_Load();
+    }
+    ASSERT_EQ(4 * CachedTable::kKeys,
+              stats.hits[BlockCacheStats::kFilter].NoBarrier_Load() +
+              stats.misses[BlockCacheStats::kFilter].NoBarrier_Load() - 1);
+  }
+  delete cache;
+  delete policy;
+}
+
+TEST(TableTest, CacheIndexAndFilterBlocks) {
+  uint64_t misses[BlockCacheStats::kNumKinds];
+
+  // With room for everything, each block is read once
+  CacheMissesForReads(1 << 20, misses);
+  ASSERT_EQ(1, misses[BlockCacheStats::kIndex]);
+  ASSERT_EQ(1, misses[BlockCacheStats::kFilter]);
+  ASSERT_GT(misses[BlockCacheStats::kData], 0);
+
+  // A cache too small to keep anything reads the index and filter again
+  // on every lookup, and still finds every key
+  CacheMissesForReads(0, misses);
+  ASSERT_EQ(4 * CachedTable::kKeys + 1, misses[BlockCacheStats::kFilter]);
+  ASSERT_GT(misses[BlockCacheStats::kIndex], 2 * CachedTable::kKeys);
+}
+
+// Reads every key of a table compressed with "type" twice, through a
+// block cache that keeps nothing and a compressed block cache that can
+// hold the whole table.  Stores the compressed block cache hits and
+// misses of each pass in hits[] and misses[], and returns its usage.
+static size_t CompressedCacheReads(CompressionType type, uint64_t hits[2],
+                                   uint64_t misses[2]) {
+  Cache* cache = NewLRUCache(0);
+  Cache* compressed_cache = NewLRUCache(1 << 20);
+  Options options;
+  options.block_cache = cache;
+  options.compressed_block_cache = compressed_cache;
+  options.block_size = 1024;
+  options.compression = type;
+  size_t usage;
+  {
+    CachedTable table(options);
+    const BlockCacheStats& stats = table.cache()->block_cache_stats();
+    for (int pass = 0; pass < 2; pass++) {
+      const uint64_t hits_before =
+          stats.hits[BlockCacheStats::kCompressed].NoBarrier_Load();
+      const uint64_t misses_before =
+          stats.misses[BlockCacheStats::kCompressed].NoBarrier_Load();
+      for (int i = 0; i < 2 * CachedTable::kKeys; i += 2) {
+        ASSERT_EQ(FilterKey(i), table.Get(i));
+      }
+      hits[pass] = stats.hits[BlockCacheStats::kCompressed].NoBarrier_Load() -
+                   hits_before;
+      misses[pass] =
+          stats.misses[BlockCacheStats::kCompressed].NoBarrier_Load() -
+          misses_before;
+    }
+    usage = compressed_cache->GetUsage();
+    ASSERT_LT(usage, table.size());
+  }
+  delete compressed_cache;
+  delete cache;
+  return usage;
+}
+
+TEST(TableTest, CompressedBlockCache) {
+  uint64_t hits[2], misses[2];
+
+  // Uncompressed blocks are not kept, so every lookup reads the file
+  ASSERT_EQ(0, CompressedCacheReads(kNoCompression, hits, misses));
+  ASSERT_EQ(0, hits[0] + hits[1]);
+  ASSERT_EQ(2 * CachedTable::kKeys, misses[0] + misses[1]);
+
+  const CompressionType kTypes[] = {
+    kSnappyCompression, kLZ4Compression, kZstdCompression
+  };
+  bool tested = false;
+  for (size_t i = 0; i < sizeof(kTypes) / sizeof(kTypes[0]); i++) {
+    if (!CompressionSupported(kTypes[i])) {
+      continue;
+    }
+    tested = true;
+
+    // Each block is read from the file once; every other lookup
+    // decompresses it from the compressed block cache
+    ASSERT_GT(CompressedCacheReads(kTypes[i], hits, misses), 0);
+    ASSERT_EQ(static_cast<uint64_t>(CachedTable::kKeys), hits[0] + misses[0]);
+    ASSERT_LT(misses[0], CachedTable::kKeys / 10);
+    ASSERT_EQ(static_cast<uint64_t>(CachedTable::kKeys), hits[1]);
+    ASSERT_EQ(0, misses[1]);
+  }
+  if (!tested) {
+    fprintf(stderr, "skipping compressed block cache tests\n");
+  }
+}
+
+static void DeleteDirectory(const std::string& dir) {
+  std::vector<std::string> files;
+  Env::Default()->GetChildren(dir, &files);
+  for (size_t i = 0; i < files.size(); i++) {
+    Env::Default()->DeleteFile(dir + "/" + files[i]);
+  }
+  Env::Default()->DeleteDir(dir);
+}
+
+// Reads every key of a table once, through a block cache that keeps
+// nothing and a persistent cache on "dir", and returns the persistent
+// cache hits.
+static uint64_t PersistentCacheHits(const std::string& dir) {
+  PersistentCache* persistent_cache;
+  ASSERT_OK(NewPersistentCache(Env::Default(), dir, 1 << 20,
+                               &persistent_cache));
+  Cache* cache = NewLRUCache(0);
+  Options options;
+  options.block_cache = cache;
+  options.persistent_cache = persistent_cache;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  uint64_t hits;
+  {
+    CachedTable table(options);
+    for (int i = 0; i < 2 * CachedTable::kKeys; i += 2) {
+      ASSERT_EQ(FilterKey(i), table.Get(i));
+    }
+    const BlockCacheStats& stats = table.cache()->block_cache_stats();
+    hits = stats.hits[BlockCacheStats::kPersistent].NoBarrier_Load();
+    ASSERT_EQ(static_cast<uint64_t>(CachedTable::kKeys),
+              hits + stats.misses[BlockCacheStats::kPersistent].NoBarrier_Load());
+  }
+  delete cache;
+  delete persistent_cache;
+  return hits;
+}
+
+TEST(TableTest, PersistentCache) {
+  const std::string dir = test::TmpDir() + "/table_test_persistent_cache";
+  DeleteDirectory(dir);
+
+  // Each block is read from the table once
+  const uint64_t hits = PersistentCacheHits(dir);
+  ASSERT_LT(CachedTable::kKeys - hits, CachedTable::kKeys / 10);
+
+  // After a restart, with new caches and a new table cache, every block
+  // is still found
+  ASSERT_EQ(static_cast<uint64_t>(CachedTable::kKeys),
+            PersistentCacheHits(dir));
+  DeleteDirectory(dir);
+}
+
+namespace {
+// A table file that counts its reads.  If "in_memory", it returns
+// pointers into its contents, as the mmap'ed files of the default Env do.
+class CountingSource : public RandomAccessFile {
+ public:
+  CountingSource(const std::string& contents, bool in_memory)
+      : contents_(contents), in_memory_(in_memory), reads_(0) { }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    reads_++;
+    if (offset > contents_.size() ||
+        (in_memory_ && offset + n > contents_.size())) {
+      return Status::InvalidArgument("invalid Read offset");
+    }
+    n = std::min(n, static_cast<size_t>(contents_.size() - offset));
+    if (in_memory_) {
+      *result = Slice(contents_.data() + offset, n);
+    } else {
+      memcpy(scratch, contents_.data() + offset, n);
+      *result = Slice(scratch, n);
+    }
+    return Status::OK();
+  }
+
+  std::string contents_;
+  bool in_memory_;
+  mutable int reads_;
+};
+}  // namespace
+
+// Scans a table of 1KB blocks forward, or backward if "reverse", with
+// ReadOptions::readahead_size set to "readahead_size", and returns the
+// number of reads of its file.
+static int ScanReads(size_t readahead_size, bool in_memory, bool reverse) {
+  const int kNumKeys = 20000;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (int i = 0; i < kNumKeys; i++) {
+    builder.Add(FilterKey(i), "value");
+  }
+  ASSERT_OK(builder.Finish());
+
+  CountingSource source(sink.contents(), in_memory);
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+  source.reads_ = 0;
+  ReadOptions read_options;
+  read_options.readahead_size = readahead_size;
+  Iterator* iter = table->NewIterator(read_options);
+  int count = 0;
+  if (reverse) {
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev(), count++) {
+      ASSERT_EQ(FilterKey(kNumKeys - 1 - count), iter->key().ToString());
+    }
+  } else {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), count++) {
+      ASSERT_EQ(FilterKey(count), iter->key().ToString());
+    }
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(kNumKeys, count);
+  delete iter;
+  delete table;
+  return source.reads_;
+}
+
+TEST(TableTest, ReadaheadForScans) {
+  // Files in memory are never read ahead, so they are read once per block
+  const int blocks = ScanReads(0, true, false);
+  ASSERT_GT(blocks, 150);
+  ASSERT_EQ(blocks, ScanReads(1 << 20, true, false));
+
+  // Automatic readahead grows from 8KB, so a few reads cover the table
+  const int automatic = ScanReads(0, false, false);
+  fprintf(stderr, "Reads to scan %d blocks: %d with automatic readahead\n",
+          blocks, automatic);
+  ASSERT_LT(automatic, 20);
+
+  // A fixed readahead reads 64 blocks at a time from the start
+  ASSERT_LE(ScanReads(64 << 10, false, false), blocks / 64 + 2);
+
+  // Blocks read backward are not in order, so each is read on its own
+  ASSERT_EQ(blocks, ScanReads(0, false, true));
+}
+
+TEST(TableTest, RangeTombstones) {
+  Options options;
+  for (int with_entries = 0; with_entries < 2; with_entries++) {
+    StringSink sink;
+    TableBuilder builder(options, &sink);
+    if (with_entries) {
+      builder.Add("k1", "v1");
+      builder.Add("k2", "v2");
+    }
+    // Added out of order: the table keeps them sorted
+    builder.AddRangeTombstone("m", "p");
+    builder.AddRangeTombstone("c", "f");
+    ASSERT_EQ(2, builder.NumRangeTombstones());
+    ASSERT_OK(builder.Finish());
+
+    StringSource* source = new StringSource(sink.contents());
+    Table* table;
+    ASSERT_OK(Table::Open(options, source, sink.contents().size(), &table));
+    Iterator* iter = table->NewRangeTombstoneIterator();
+    ASSERT_TRUE(iter != NULL);
+    std::string result;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += "[" + iter->key().ToString() + "," +
+                iter->value().ToString() + ")";
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_EQ("[c,f)[m,p)", result);
+    delete iter;
+
+    // The tombstones are not among the entries of the table
+    int entries = 0;
+    iter = table->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      entries++;
+    }
+    ASSERT_EQ(with_entries ? 2 : 0, entries);
+    delete iter;
+    delete table;
+    delete source;
+  }
+
+  // A table without tombstones has no iterator for them
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  builder.Add("k1", "v1");
+  ASSERT_OK(builder.Finish());
+  StringSource* source = new StringSource(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, source, sink.contents().size(), &table));
+  ASSERT_TRUE(table->NewRangeTombstoneIterator() == NULL);
+  delete table;
+  delete source;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
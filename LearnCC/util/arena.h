@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "port/port.h"
 
 namespace leveldb
 {
@@ -25,12 +26,18 @@ namespace leveldb
         // Allocate memory with the normal alignment guarantees provided by malloc
         char* AllocateAligned(size_t bytes);
         
+        // Thread-safe variants of Allocate() and AllocateAligned() for arenas
+        // shared by several writers.  They must not race with the plain
+        // variants above.
+        char* AllocateConcurrently(size_t bytes);
+        char* AllocateAlignedConcurrently(size_t bytes);
+        
         // Returns an estimate of the total memory usage of data allocated
         // by the arena (including space allocated but not yet used for user
-        // allocations).
+        // allocations).  Safe to call while other threads allocate.
         size_t MemoryUsage() const
         {
-            return blocks_memory_ + blocks_.capacity() * sizeof(char*);
+            return reinterpret_cast<uintptr_t>(memory_usage_.NoBarrier_Load());
         }
         
     private:
@@ -44,8 +51,11 @@ namespace leveldb
         // Array of new[] allocated memory blocks
         std::vector<char*> blocks_;
         
-        // Bytes of memory in blocks allocated so far
-        size_t blocks_memory_;
+        // Total memory usage of the arena.
+        port::AtomicPointer memory_usage_;
+        
+        // Serializes the *Concurrently() allocation paths
+        port::Mutex mu_;
         
         // No copying allowed
         Arena(const Arena&);
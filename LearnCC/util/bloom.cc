@@ -4,7 +4,15 @@
 
 #include "leveldb/filter_policy.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/slice.h"
+#include "util/coding.h"
 #include "util/hash.h"
 
 namespace leveldb
@@ -17,7 +25,58 @@ namespace leveldb
             return Hash(key.data(), key.size(), 0xbc9f1d34);
         }
         
-        class BloomFilterPolicy : public FilterPolicy
+        // A bloom filter policy that sets the bits of a key from its
+        // BloomHash() alone, so that a filter can be built from hashes.
+        class HashedFilterPolicy : public FilterPolicy
+        {
+        public:
+            // Appends a filter of the keys with hashes[0,n-1] to *dst.
+            virtual void CreateFilterFromHashes(const uint32_t* hashes, size_t n, std::string* dst) const = 0;
+            
+            virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const
+            {
+                std::vector<uint32_t> hashes(n);
+                for (int i = 0; i < n; i++)
+                {
+                    hashes[i] = BloomHash(keys[i]);
+                }
+                CreateFilterFromHashes(hashes.empty() ? NULL : &hashes[0], hashes.size(), dst);
+            }
+            
+            virtual Builder* NewBuilder() const;
+        };
+        
+        // Keeps four bytes per key.  Repeated keys (the versions of a key
+        // in a table) are counted once, as InternalFilterPolicy does.
+        class HashedFilterBuilder : public FilterPolicy::Builder
+        {
+        private:
+            const HashedFilterPolicy* const policy_;
+            std::vector<uint32_t> hashes_;
+            
+        public:
+            explicit HashedFilterBuilder(const HashedFilterPolicy* policy) : policy_(policy) { }
+            
+            virtual void AddKey(const Slice& key)
+            {
+                hashes_.push_back(BloomHash(key));
+            }
+            
+            virtual void Finish(std::string* dst)
+            {
+                std::sort(hashes_.begin(), hashes_.end());
+                hashes_.erase(std::unique(hashes_.begin(), hashes_.end()), hashes_.end());
+                policy_->CreateFilterFromHashes(hashes_.empty() ? NULL : &hashes_[0], hashes_.size(), dst);
+                hashes_.clear();
+            }
+        };
+        
+        FilterPolicy::Builder* HashedFilterPolicy::NewBuilder() const
+        {
+            return new HashedFilterBuilder(this);
+        }
+        
+        class BloomFilterPolicy : public HashedFilterPolicy
         {
         private:
             size_t bits_per_key_;
@@ -38,7 +97,7 @@ namespace leveldb
             }
             
             // n:key的个数
-            virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const
+            virtual void CreateFilterFromHashes(const uint32_t* hashes, size_t n, std::string* dst) const
             {
                 // Compute bloom filter size (in both bits and bytes)
                 size_t bits = n * bits_per_key_;
@@ -62,7 +121,7 @@ namespace leveldb
                 {
                     // Use double-hashing to generate a sequence of hash values.
                     // See analysis in [Kirsch,Mitzenmacher 2006].
-                    uint32_t h = BloomHash(keys[i]);
+                    uint32_t h = hashes[i];
                     const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
                     // 使用k个哈希函数，计算出k位，每位都赋值为1。
                     // 为了减少哈希冲突，减少误判。
@@ -115,6 +174,125 @@ namespace leveldb
                 return true;
             }
         };
+        
+        // Filter layout:
+        //    line[0] ... line[num_lines-1]  (64 bytes each)
+        //    num_probes                     (1 byte)
+        //    kBlockedBloomMarker            (1 byte)
+        // 一个key的所有探测位都落在同一个64字节的line内，查询只需访问一次cache line。
+        // The marker lies above the k <= 30 range of BloomFilterPolicy, so
+        // that policy treats a blocked filter as "may match" instead of
+        // misreading it.
+        static const size_t kCacheLineBytes = 64;
+        static const size_t kCacheLineBits = kCacheLineBytes * 8;
+        static const size_t kLineWords = kCacheLineBytes / sizeof(uint64_t);
+        static const unsigned char kBlockedBloomMarker = 0xff;
+        
+        class BlockedBloomFilterPolicy : public HashedFilterPolicy
+        {
+        private:
+            size_t bits_per_key_;
+            size_t k_;
+            
+            // Chooses the line from the high bits of h (multiply-shift instead
+            // of a modulus), then remixes h once per probe and takes the top 9
+            // bits as the bit offset within the line.
+            static size_t LineFor(uint32_t h, size_t num_lines)
+            {
+                return static_cast<size_t>((static_cast<uint64_t>(h) * num_lines) >> 32);
+            }
+            
+            static void ProbeMask(uint32_t h, size_t k, uint64_t* mask)
+            {
+                memset(mask, 0, kCacheLineBytes);
+                for (size_t j = 0; j < k; j++)
+                {
+                    h *= 0x9e3779b9;  // Golden ratio; odd, so a bijection on h
+                    const uint32_t bitpos = h >> 23;  // 0 <= bitpos < 512
+                    mask[bitpos >> 6] |= static_cast<uint64_t>(1) << (bitpos & 63);
+                }
+            }
+            
+            // Returns true iff every bit set in mask is also set in line.
+            static bool LineContains(const char* line, const uint64_t* mask)
+            {
+#if defined(__SSE2__)
+                __m128i missing = _mm_setzero_si128();
+                for (size_t i = 0; i < kLineWords; i += 2)
+                {
+                    const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i));
+                    const __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + i * 8));
+                    missing = _mm_or_si128(missing, _mm_andnot_si128(l, m));
+                }
+                return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xffff;
+#else
+                uint64_t missing = 0;
+                for (size_t i = 0; i < kLineWords; i++)
+                {
+                    missing |= mask[i] & ~DecodeFixed64(line + i * 8);
+                }
+                return missing == 0;
+#endif
+            }
+            
+        public:
+            explicit BlockedBloomFilterPolicy(int bits_per_key): bits_per_key_(bits_per_key)
+            {
+                k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+                if (k_ < 1) k_ = 1;
+                if (k_ > 30) k_ = 30;
+            }
+            
+            virtual const char* Name() const
+            {
+                return "leveldb.BlockedBloomFilter";
+            }
+            
+            virtual void CreateFilterFromHashes(const uint32_t* hashes, size_t n, std::string* dst) const
+            {
+                size_t bits = n * bits_per_key_;
+                size_t num_lines = (bits + kCacheLineBits - 1) / kCacheLineBits;
+                if (num_lines < 1) num_lines = 1;
+                
+                const size_t init_size = dst->size();
+                dst->resize(init_size + num_lines * kCacheLineBytes, 0);
+                dst->push_back(static_cast<char>(k_));
+                dst->push_back(static_cast<char>(kBlockedBloomMarker));
+                char* array = &(*dst)[init_size];
+                uint64_t mask[kLineWords];
+                for (size_t i = 0; i < n; i++)
+                {
+                    const uint32_t h = hashes[i];
+                    char* line = array + LineFor(h, num_lines) * kCacheLineBytes;
+                    ProbeMask(h, k_, mask);
+                    for (size_t w = 0; w < kLineWords; w++)
+                    {
+                        EncodeFixed64(line + w * 8, DecodeFixed64(line + w * 8) | mask[w]);
+                    }
+                }
+            }
+            
+            virtual bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const
+            {
+                const size_t len = bloom_filter.size();
+                if (len < 2 + kCacheLineBytes) return false;
+                
+                const char* array = bloom_filter.data();
+                const size_t k = static_cast<unsigned char>(array[len-2]);
+                if (static_cast<unsigned char>(array[len-1]) != kBlockedBloomMarker ||
+                    (len - 2) % kCacheLineBytes != 0 || k > 30)
+                {
+                    // Not an encoding we understand; consider it a match.
+                    return true;
+                }
+                
+                const size_t num_lines = (len - 2) / kCacheLineBytes;
+                const uint32_t h = BloomHash(key);
+                uint64_t mask[kLineWords];
+                ProbeMask(h, k, mask);
+                return LineContains(array + LineFor(h, num_lines) * kCacheLineBytes, mask);
+            }
+        };
     }
     
     const FilterPolicy* NewBloomFilterPolicy(int bits_per_key)
@@ -122,4 +300,9 @@ namespace leveldb
         return new BloomFilterPolicy(bits_per_key);
     }
     
+    const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key)
+    {
+        return new BlockedBloomFilterPolicy(bits_per_key);
+    }
+    
 }  // namespace leveldb
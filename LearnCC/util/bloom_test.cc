@@ -4,6 +4,7 @@
 
 #include "leveldb/filter_policy.h"
 
+#include "leveldb/env.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/testharness.h"
@@ -18,6 +19,19 @@ static Slice Key(int i, char* buffer) {
   return Slice(buffer, sizeof(uint32_t));
 }
 
+static int NextLength(int length) {
+  if (length < 10) {
+    length += 1;
+  } else if (length < 100) {
+    length += 10;
+  } else if (length < 1000) {
+    length += 100;
+  } else {
+    length += 1000;
+  }
+  return length;
+}
+
 class BloomTest {
  private:
   const FilterPolicy* policy_;
@@ -25,7 +39,8 @@ class BloomTest {
   std::vector<std::string> keys_;
 
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) { }
+  explicit BloomTest(const FilterPolicy* policy = NewBloomFilterPolicy(10))
+      : policy_(policy) { }
 
   ~BloomTest() {
     delete policy_;
@@ -83,6 +98,48 @@ class BloomTest {
     }
     return result / 10000.0;
   }
+
+  // Builds filters over 1..10000 keys and checks their size and false
+  // positive rate; each filter may exceed 10 bits/key by "slack" bytes.
+  void CheckVaryingLengths(int slack) {
+    char buffer[sizeof(int)];
+
+    // Count number of filters that significantly exceed the false positive rate
+    int mediocre_filters = 0;
+    int good_filters = 0;
+
+    for (int length = 1; length <= 10000; length = NextLength(length)) {
+      Reset();
+      for (int i = 0; i < length; i++) {
+        Add(Key(i, buffer));
+      }
+      Build();
+
+      ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + slack))
+          << length;
+
+      // All added keys must match
+      for (int i = 0; i < length; i++) {
+        ASSERT_TRUE(Matches(Key(i, buffer)))
+            << "Length " << length << "; key " << i;
+      }
+
+      // Check false positive rate
+      double rate = FalsePositiveRate();
+      if (kVerbose >= 1) {
+        fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                rate*100.0, length, static_cast<int>(FilterSize()));
+      }
+      ASSERT_LE(rate, 0.02);   // Must not be over 2%
+      if (rate > 0.0125) mediocre_filters++;  // Allowed, but not too often
+      else good_filters++;
+    }
+    if (kVerbose >= 1) {
+      fprintf(stderr, "Filters: %d good, %d mediocre\n",
+              good_filters, mediocre_filters);
+    }
+    ASSERT_LE(mediocre_filters, good_filters/5);
+  }
 };
 
 TEST(BloomTest, EmptyFilter) {
@@ -99,57 +156,103 @@ TEST(BloomTest, Small) {
   ASSERT_TRUE(! Matches("foo"));
 }
 
-static int NextLength(int length) {
-  if (length < 10) {
-    length += 1;
-  } else if (length < 100) {
-    length += 10;
-  } else if (length < 1000) {
-    length += 100;
-  } else {
-    length += 1000;
-  }
-  return length;
-}
 
 TEST(BloomTest, VaryingLengths) {
-  char buffer[sizeof(int)];
+  CheckVaryingLengths(40);
+}
 
-  // Count number of filters that significantly exceed the false positive rate
-  int mediocre_filters = 0;
-  int good_filters = 0;
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) { }
+};
 
-  for (int length = 1; length <= 10000; length = NextLength(length)) {
-    Reset();
-    for (int i = 0; i < length; i++) {
-      Add(Key(i, buffer));
-    }
-    Build();
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
-        << length;
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
 
-    // All added keys must match
-    for (int i = 0; i < length; i++) {
-      ASSERT_TRUE(Matches(Key(i, buffer)))
-          << "Length " << length << "; key " << i;
-    }
+TEST(BlockedBloomTest, BlockedVaryingLengths) {
+  // Filters are rounded up to whole 64-byte lines plus a 2-byte trailer
+  CheckVaryingLengths(64 + 2);
+}
 
-    // Check false positive rate
-    double rate = FalsePositiveRate();
+// Compares false positive rate and probe cost of the two policies on a
+// filter that is too large to stay in cache.
+TEST(BlockedBloomTest, CompareWithBloom) {
+  const int kKeys = 1000000;
+  const int kProbes = 1000000;
+  char buffer[sizeof(int)];
+  const FilterPolicy* policies[2] = {
+    NewBloomFilterPolicy(10), NewBlockedBloomFilterPolicy(10)
+  };
+  std::vector<std::string> keys;
+  for (int i = 0; i < kKeys; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  double rates[2];
+  for (int p = 0; p < 2; p++) {
+    std::string filter;
+    policies[p]->CreateFilter(&key_slices[0], kKeys, &filter);
+    Random rnd(301);
+    int matches = 0;
+    const uint64_t start = Env::Default()->NowMicros();
+    for (int i = 0; i < kProbes; i++) {
+      const int k = kKeys + rnd.Uniform(1 << 30);
+      if (policies[p]->KeyMayMatch(Key(k, buffer), filter)) {
+        matches++;
+      }
+    }
+    const uint64_t micros = Env::Default()->NowMicros() - start;
+    rates[p] = matches / static_cast<double>(kProbes);
     if (kVerbose >= 1) {
-      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
-              rate*100.0, length, static_cast<int>(FilterSize()));
+      fprintf(stderr, "%-28s false positives: %5.2f%% ; %6.1f ns/probe ; "
+              "bytes = %d\n", policies[p]->Name(), rates[p] * 100.0,
+              micros * 1000.0 / kProbes, static_cast<int>(filter.size()));
     }
-    ASSERT_LE(rate, 0.02);   // Must not be over 2%
-    if (rate > 0.0125) mediocre_filters++;  // Allowed, but not too often
-    else good_filters++;
+    delete policies[p];
   }
-  if (kVerbose >= 1) {
-    fprintf(stderr, "Filters: %d good, %d mediocre\n",
-            good_filters, mediocre_filters);
+  ASSERT_LE(rates[0], 0.02);
+  ASSERT_LE(rates[1], 0.02);
+}
+
+// A Builder fed the keys one at a time, some of them twice, makes the
+// filter that CreateFilter() makes of the distinct keys.
+TEST(BlockedBloomTest, Builder) {
+  char buffer[sizeof(int)];
+  const FilterPolicy* policies[2] = {
+    NewBloomFilterPolicy(10), NewBlockedBloomFilterPolicy(10)
+  };
+  for (int p = 0; p < 2; p++) {
+    FilterPolicy::Builder* builder = policies[p]->NewBuilder();
+    ASSERT_TRUE(builder != NULL);
+    for (int length = 1; length <= 10000; length = NextLength(length)) {
+      std::vector<std::string> keys;
+      for (int i = 0; i < length; i++) {
+        keys.push_back(Key(i, buffer).ToString());
+        builder->AddKey(keys.back());
+        if (i % 3 == 0) {
+          builder->AddKey(keys.back());
+        }
+      }
+      std::vector<Slice> key_slices(keys.begin(), keys.end());
+      std::string expected, filter("prefix");
+      policies[p]->CreateFilter(&key_slices[0], length, &expected);
+      builder->Finish(&filter);
+      ASSERT_EQ("prefix" + expected, filter) << length;
+    }
+    delete builder;
+    delete policies[p];
   }
-  ASSERT_LE(mediocre_filters, good_filters/5);
 }
 
 // Different bits-per-byte
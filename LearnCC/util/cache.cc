@@ -16,6 +16,21 @@ namespace leveldb
     
     Cache::~Cache() { }
     
+    Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge, void (*deleter)(const Slice& key, void* value), Priority priority)
+    {
+        return Insert(key, value, charge, deleter);
+    }
+    
+    size_t Cache::GetUsage() const
+    {
+        return 0;
+    }
+    
+    size_t Cache::GetPinnedUsage() const
+    {
+        return 0;
+    }
+    
     namespace {
         
         // LRU cache implementation
@@ -33,6 +48,10 @@ namespace leveldb
             size_t key_length;
             uint32_t refs;
             uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+            bool high_pri;          // Inserted with Cache::HIGH priority
+            bool hit;               // Found by Lookup() since it was inserted
+            bool in_cache;          // Reachable through the table; false once erased or evicted
+            bool in_high_pri_pool;  // Currently in the high priority part of the LRU list
             char key_data[1];   // Beginning of key key的首地址
             
             Slice key() const
@@ -198,33 +217,77 @@ namespace leveldb
             ~LRUCache();
             
             // Separate from constructor so caller can easily make an array of LRUCache
-            void SetCapacity(size_t capacity) { capacity_ = capacity; }
+            void SetCapacity(size_t capacity, double high_pri_pool_ratio, bool strict_capacity_limit)
+            {
+                capacity_ = capacity;
+                high_pri_pool_capacity_ = static_cast<size_t>(capacity * high_pri_pool_ratio);
+                strict_capacity_limit_ = strict_capacity_limit;
+            }
             
             // Like Cache methods, but with an extra "hash" parameter.
             Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
-                                  size_t charge, void (*deleter)(const Slice& key, void* value));
+                                  size_t charge, void (*deleter)(const Slice& key, void* value),
+                                  Cache::Priority priority);
             Cache::Handle* Lookup(const Slice& key, uint32_t hash);
             void Release(Cache::Handle* handle);
             void Erase(const Slice& key, uint32_t hash);
+            size_t GetUsage() const
+            {
+                MutexLock l(&mutex_);
+                return usage_;
+            }
+            size_t GetPinnedUsage() const
+            {
+                MutexLock l(&mutex_);
+                return pinned_usage_;
+            }
             
         private:
             void LRU_Remove(LRUHandle* e);
             void LRU_Append(LRUHandle* e);
+            void InUse_Append(LRUHandle* e);
+            void MaintainPoolSize();
+            void Ref(LRUHandle* e);
             void Unref(LRUHandle* e);
+            void FinishErase(LRUHandle* e);
+            void Free(LRUHandle* e);
+            void EvictToFit(size_t charge);
             
             // Initialized before use.
             // 缓存的总容量
             size_t capacity_;
+            size_t high_pri_pool_capacity_;
+            bool strict_capacity_limit_;
             
             // mutex_ protects the following state.
-            port::Mutex mutex_;
-            // 缓存数据的总大小
+            mutable port::Mutex mutex_;
+            // 缓存数据的总大小, including entries that were erased or evicted
+            // but are still referenced by clients
             size_t usage_;
+            // Charge of the entries referenced by clients
+            size_t pinned_usage_;
             
-            // Dummy head of LRU list.
+            // Dummy head of LRU list of the entries that only the cache
+            // references, which are the ones that can be evicted.
             // lru.prev is newest entry, lru.next is oldest entry.
             // 双向循环链表，有大小限制，保证数据的新旧，当缓存不够时，保证先清除旧的数据
+            //
+            // The list is split in two at lru_low_pri_: entries from lru_.next
+            // up to and including lru_low_pri_ are the low priority part (the
+            // "probation" segment), and the newer ones are the high priority
+            // pool (the "protected" segment).  Low priority entries are
+            // inserted at the split, so they are evicted before any entry of
+            // the pool, and enter the pool only when a Lookup() hits them.
+            // A scan that touches each block once thus churns the probation
+            // segment only.  When the pool outgrows high_pri_pool_capacity_,
+            // its oldest entries move back to the low priority part.
             LRUHandle lru_;
+            LRUHandle* lru_low_pri_;
+            size_t high_pri_pool_usage_;
+            
+            // Dummy head of in-use list: entries in the cache that clients
+            // also reference, in no particular order.
+            LRUHandle in_use_;
             /* 
              二级指针数组，链表没有大小限制，动态扩展大小，保证数据快速查找，
              hash定位一级指针，得到存放在一级指针上的二级指针链表，遍历查找数据
@@ -232,65 +295,166 @@ namespace leveldb
             HandleTable table_;
         };
         
-        LRUCache::LRUCache(): usage_(0)
+        LRUCache::LRUCache(): capacity_(0), high_pri_pool_capacity_(0), strict_capacity_limit_(false), usage_(0), pinned_usage_(0), lru_low_pri_(&lru_), high_pri_pool_usage_(0)
         {
-            // Make empty circular linked list
+            // Make empty circular linked lists
             lru_.next = &lru_;
             lru_.prev = &lru_;
+            in_use_.next = &in_use_;
+            in_use_.prev = &in_use_;
         }
         
         LRUCache::~LRUCache()
         {
+            assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
             for (LRUHandle* e = lru_.next; e != &lru_; )
             {
                 LRUHandle* next = e->next;
-                assert(e->refs == 1);  // Error if caller has an unreleased handle
-                Unref(e);
+                assert(e->in_cache);
+                assert(e->refs == 1);
+                Free(e);
                 e = next;
             }
         }
         
+        void LRUCache::Ref(LRUHandle* e)
+        {
+            if (e->refs == 1 && e->in_cache)
+            {
+                // First client reference: no longer evictable
+                LRU_Remove(e);
+                InUse_Append(e);
+                pinned_usage_ += e->charge;
+            }
+            e->refs++;
+        }
+        
         void LRUCache::Unref(LRUHandle* e)
         {
             assert(e->refs > 0);
             e->refs--;
             if (e->refs <= 0) // 引用计数小于等于0 释放
             {
-                usage_ -= e->charge;
-                (*e->deleter)(e->key(), e->value);
-                free(e);
+                // A client held the last reference to an erased entry
+                assert(!e->in_cache);
+                pinned_usage_ -= e->charge;
+                Free(e);
+            } else if (e->in_cache && e->refs == 1)
+            {
+                // Last client reference gone: evictable again, and evicted at
+                // once if the cache is over its capacity
+                LRU_Remove(e);
+                LRU_Append(e);
+                pinned_usage_ -= e->charge;
+                EvictToFit(0);
+            }
+        }
+        
+        // Removes "e", just taken out of table_, from its list and drops the
+        // cache's reference to it.
+        void LRUCache::FinishErase(LRUHandle* e)
+        {
+            assert(e->in_cache);
+            LRU_Remove(e);
+            e->in_cache = false;
+            e->refs--;
+            if (e->refs == 0)
+            {
+                Free(e);
+            }
+        }
+        
+        void LRUCache::Free(LRUHandle* e)
+        {
+            usage_ -= e->charge;
+            (*e->deleter)(e->key(), e->value);
+            free(e);
+        }
+        
+        // Evicts the oldest unreferenced entries until "charge" more fits in
+        // the capacity, or there is nothing left to evict.
+        void LRUCache::EvictToFit(size_t charge)
+        {
+            while (usage_ + charge > capacity_ && lru_.next != &lru_)
+            {
+                LRUHandle* old = lru_.next;
+                table_.Remove(old->key(), old->hash);
+                FinishErase(old);
             }
         }
         
         void LRUCache::LRU_Remove(LRUHandle* e)
         {
+            if (lru_low_pri_ == e)
+            {
+                lru_low_pri_ = e->prev;
+            }
             e->next->prev = e->prev;
             e->prev->next = e->next;
+            if (e->in_high_pri_pool)
+            {
+                assert(high_pri_pool_usage_ >= e->charge);
+                high_pri_pool_usage_ -= e->charge;
+            }
         }
         
         void LRUCache::LRU_Append(LRUHandle* e)
         {
-            // Make "e" newest entry by inserting just before lru_
-            // 新数据插到lru_的前面
-            e->next = &lru_;
-            e->prev = lru_.prev;
+            if (e->high_pri || e->hit)
+            {
+                // Make "e" newest entry by inserting just before lru_
+                // 新数据插到lru_的前面
+                e->next = &lru_;
+                e->prev = lru_.prev;
+                e->in_high_pri_pool = true;
+                high_pri_pool_usage_ += e->charge;
+            } else
+            {
+                // Make "e" the newest low priority entry
+                e->next = lru_low_pri_->next;
+                e->prev = lru_low_pri_;
+                e->in_high_pri_pool = false;
+                lru_low_pri_ = e;
+            }
+            e->prev->next = e;
+            e->next->prev = e;
+            MaintainPoolSize();
+        }
+        
+        void LRUCache::InUse_Append(LRUHandle* e)
+        {
+            e->next = &in_use_;
+            e->prev = in_use_.prev;
+            e->in_high_pri_pool = false;
             e->prev->next = e;
             e->next->prev = e;
         }
         
+        void LRUCache::MaintainPoolSize()
+        {
+            while (high_pri_pool_usage_ > high_pri_pool_capacity_)
+            {
+                // Demote the oldest entry of the pool
+                lru_low_pri_ = lru_low_pri_->next;
+                assert(lru_low_pri_ != &lru_);
+                lru_low_pri_->in_high_pri_pool = false;
+                high_pri_pool_usage_ -= lru_low_pri_->charge;
+            }
+        }
+        
         Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash)
         {
             MutexLock l(&mutex_);
             LRUHandle* e = table_.Lookup(key, hash);
             if (e != NULL)
             {
-                e->refs++;
                 /*
-                 为什么要先删除，再加入。
-                 由于当缓存不够时，会清除lru_的next处的数据，保证清除比较旧的数据。
+                 The entry moves to the in-use list, and back to the newest end
+                 of lru_ when it is released, 由于当缓存不够时，会清除lru_的next处的数据，保证清除比较旧的数据。
+                 A hit promotes a low priority entry to the high priority pool.
                  */
-                LRU_Remove(e);
-                LRU_Append(e);
+                e->hit = true;
+                Ref(e);
             }
             return reinterpret_cast<Cache::Handle*>(e);
         }
@@ -301,10 +465,18 @@ namespace leveldb
             Unref(reinterpret_cast<LRUHandle*>(handle));
         }
         
-        Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value, size_t charge, void (*deleter)(const Slice& key, void* value))
+        Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value, size_t charge, void (*deleter)(const Slice& key, void* value), Cache::Priority priority)
         {
             MutexLock l(&mutex_);
             
+            // 缓存不够，清除比较旧的数据
+            EvictToFit(charge);
+            if (strict_capacity_limit_ && usage_ + charge > capacity_)
+            {
+                // Everything left is pinned
+                return NULL;
+            }
+            
             // 减去记录key的首地址大小(一个字节)，加上key实际大小
             LRUHandle* e = reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle)-1 + key.size()));
             e->value = value;
@@ -313,26 +485,20 @@ namespace leveldb
             e->key_length = key.size();
             e->hash = hash;
             e->refs = 2;  // One from LRUCache, one for the returned handle
+            e->high_pri = (priority == Cache::HIGH);
+            e->hit = false;
+            e->in_cache = true;
             // 记录key的首地址
             memcpy(e->key_data, key.data(), key.size());
-            LRU_Append(e);
+            InUse_Append(e);
             // 缓存数据的大小
             usage_ += charge;
+            pinned_usage_ += charge;
             
             LRUHandle* old = table_.Insert(e);
             if (old != NULL)
             {
-                LRU_Remove(old);
-                Unref(old);
-            }
-            
-            // 缓存不够，清除比较旧的数据
-            while (usage_ > capacity_ && lru_.next != &lru_)
-            {
-                LRUHandle* old = lru_.next;
-                LRU_Remove(old);
-                table_.Remove(old->key(), old->hash);
-                Unref(old);
+                FinishErase(old);
             }
             
             return reinterpret_cast<Cache::Handle*>(e);
@@ -344,8 +510,7 @@ namespace leveldb
             LRUHandle* e = table_.Remove(key, hash);
             if (e != NULL)
             {
-                LRU_Remove(e);
-                Unref(e);
+                FinishErase(e);
             }
         }
         
@@ -353,13 +518,18 @@ namespace leveldb
          类：ShardedLRUCache
          *****************************************************************************/
         
+        // Default number of shards, 2^4==16
         static const int kNumShardBits = 4;
-        static const int kNumShards = 1 << kNumShardBits; // 2^4==16
+        
+        // With an automatic shard count, shards hold at least this much
+        static const size_t kMinShardCapacity = 512 << 10;
+        static const int kMaxAutoShardBits = 6;
         
         class ShardedLRUCache : public Cache
         {
         private:
-            LRUCache shard_[kNumShards];
+            LRUCache* shard_;
+            int num_shard_bits_;
             port::Mutex id_mutex_;
             uint64_t last_id_;
             
@@ -369,19 +539,31 @@ namespace leveldb
             }
             
             // 得到shard_数组的下标
-            static uint32_t Shard(uint32_t hash)
+            uint32_t Shard(uint32_t hash) const
             {
                 /*
                  hash是4个字节，32位，向右移动28位，则剩下高4位有效位，
                  即最小的是0000等于0，最大的是1111等于15 
-                 则得到的数字在[0,15]范围内。
+                 则得到的数字在[0,15]范围内。(for the default of 4 shard bits)
                  */
-                return hash >> (32 - kNumShardBits);
+                return num_shard_bits_ > 0 ? hash >> (32 - num_shard_bits_) : 0;
             }
             
         public:
-            explicit ShardedLRUCache(size_t capacity) : last_id_(0)
+            ShardedLRUCache(size_t capacity, int num_shard_bits, bool strict_capacity_limit, double high_pri_pool_ratio) : last_id_(0)
             {
+                if (num_shard_bits < 0)
+                {
+                    num_shard_bits = 0;
+                    while (num_shard_bits < kMaxAutoShardBits &&
+                           (capacity >> (num_shard_bits + 1)) >= kMinShardCapacity)
+                    {
+                        num_shard_bits++;
+                    }
+                }
+                num_shard_bits_ = num_shard_bits;
+                const int kNumShards = 1 << num_shard_bits;
+                shard_ = new LRUCache[kNumShards];
                 /*
                  将容量平均分成kNumShards份，如果有剩余，将剩余的补全。为什么要补全呢？
                  例如设置容量大小为10，则最多就能放下大小为10的数据，现在将容量分成3份，
@@ -398,16 +580,25 @@ namespace leveldb
                 const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
                 for (int s = 0; s < kNumShards; s++)
                 {
-                    shard_[s].SetCapacity(per_shard);
+                    shard_[s].SetCapacity(per_shard, high_pri_pool_ratio, strict_capacity_limit);
                 }
             }
-            virtual ~ShardedLRUCache() { }
+            virtual ~ShardedLRUCache()
+            {
+                delete [] shard_;
+            }
             // charge 数据大小
             virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                                    void (*deleter)(const Slice& key, void* value))
+            {
+                return Insert(key, value, charge, deleter, LOW);
+            }
+            virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                                   void (*deleter)(const Slice& key, void* value),
+                                   Priority priority)
             {
                 const uint32_t hash = HashSlice(key);
-                return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+                return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter, priority);
             }
             virtual Handle* Lookup(const Slice& key)
             {
@@ -433,6 +624,24 @@ namespace leveldb
                 MutexLock l(&id_mutex_);
                 return ++(last_id_);
             }
+            virtual size_t GetUsage() const
+            {
+                size_t usage = 0;
+                for (int s = 0; s < (1 << num_shard_bits_); s++)
+                {
+                    usage += shard_[s].GetUsage();
+                }
+                return usage;
+            }
+            virtual size_t GetPinnedUsage() const
+            {
+                size_t usage = 0;
+                for (int s = 0; s < (1 << num_shard_bits_); s++)
+                {
+                    usage += shard_[s].GetPinnedUsage();
+                }
+                return usage;
+            }
         };
         
     }  // end anonymous namespace
@@ -443,7 +652,22 @@ namespace leveldb
     
     Cache* NewLRUCache(size_t capacity)
     {
-        return new ShardedLRUCache(capacity);
+        return new ShardedLRUCache(capacity, kNumShardBits, false, 0.5);
+    }
+    
+    Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio)
+    {
+        return new ShardedLRUCache(capacity, kNumShardBits, false, high_pri_pool_ratio);
+    }
+    
+    Cache* NewLRUCache(size_t capacity, int num_shard_bits, bool strict_capacity_limit)
+    {
+        return new ShardedLRUCache(capacity, num_shard_bits, strict_capacity_limit, 0.5);
+    }
+    
+    Cache* NewLRUCache(size_t capacity, int num_shard_bits, bool strict_capacity_limit, double high_pri_pool_ratio)
+    {
+        return new ShardedLRUCache(capacity, num_shard_bits, strict_capacity_limit, high_pri_pool_ratio);
     }
     
 }  // namespace leveldb
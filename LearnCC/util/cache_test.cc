@@ -5,7 +5,11 @@
 #include "leveldb/cache.h"
 
 #include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -59,6 +63,11 @@ class CacheTest {
                                    &CacheTest::Deleter));
   }
 
+  void InsertHighPri(int key, int value, int charge = 1) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                                   &CacheTest::Deleter, Cache::HIGH));
+  }
+
   void Erase(int key) {
     cache_->Erase(EncodeKey(key));
   }
@@ -173,6 +182,338 @@ TEST(CacheTest, HeavyEntries) {
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
 }
 
+TEST(CacheTest, HighPriorityPool) {
+  // A scan of low priority entries twice the cache size does not evict
+  // high priority entries that fit in the pool
+  for (int i = 0; i < 100; i++) {
+    InsertHighPri(i, 1000+i);
+  }
+  for (int i = 0; i < 2*kCacheSize; i++) {
+    Insert(10000+i, 20000+i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000+i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(10000));
+
+  // Once the pool is full, its oldest entries become evictable
+  for (int i = 0; i < kCacheSize; i++) {
+    InsertHighPri(100+i, 1100+i);
+  }
+  for (int i = 0; i < 2*kCacheSize; i++) {
+    Insert(10000+i, 20000+i);
+  }
+  int kept = 0;
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    if (Lookup(i) >= 0) kept++;
+  }
+  ASSERT_GT(kept, kCacheSize/4);
+  ASSERT_LE(kept, kCacheSize/2 + kCacheSize/10);
+}
+
+TEST(CacheTest, NoHighPriorityPool) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.0);
+  for (int i = 0; i < 100; i++) {
+    InsertHighPri(i, 1000+i);
+  }
+  for (int i = 0; i < 2*kCacheSize; i++) {
+    Insert(10000+i, 20000+i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(-1, Lookup(i));
+  }
+}
+
+// Inserts a working set, hits each entry, then scans twice the cache
+// size of entries that are touched once, and returns how many entries
+// of the working set survived.
+static int WorkingSetAfterScan(CacheTest* t) {
+  const int kWorkingSet = CacheTest::kCacheSize / 4;
+  for (int i = 0; i < kWorkingSet; i++) {
+    t->Insert(i, 1000+i);
+  }
+  for (int i = 0; i < kWorkingSet; i++) {
+    ASSERT_EQ(1000+i, t->Lookup(i));
+  }
+  for (int i = 0; i < 2*CacheTest::kCacheSize; i++) {
+    t->Insert(10000+i, 20000+i);
+  }
+  int kept = 0;
+  for (int i = 0; i < kWorkingSet; i++) {
+    if (t->Lookup(i) >= 0) kept++;
+  }
+  return kept;
+}
+
+TEST(CacheTest, ScanResistance) {
+  // Entries hit a second time are protected from the scan...
+  ASSERT_EQ(kCacheSize/4, WorkingSetAfterScan(this));
+
+  // ...unless the cache is a plain LRU
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.0);
+  ASSERT_EQ(0, WorkingSetAfterScan(this));
+}
+
+TEST(CacheTest, NumShardBits) {
+  // With a single shard, the whole capacity is available to any keys
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, false);
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000+i);
+  }
+  for (int i = 0; i < kCacheSize; i++) {
+    ASSERT_EQ(1000+i, Lookup(i));
+  }
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  // Sharded caches work the same
+  for (int bits = 1; bits <= 8; bits++) {
+    delete cache_;
+    cache_ = NewLRUCache(kCacheSize, bits, false);
+    Insert(100, 101);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1, Lookup(200));
+  }
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, -1, false);
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+}
+
+TEST(CacheTest, Usage) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, false);
+  ASSERT_EQ(0, cache_->GetUsage());
+  ASSERT_EQ(0, cache_->GetPinnedUsage());
+
+  Insert(100, 101, 10);
+  Cache::Handle* h = cache_->Insert(EncodeKey(200), EncodeValue(201), 20,
+                                    &CacheTest::Deleter);
+  ASSERT_EQ(30, cache_->GetUsage());
+  ASSERT_EQ(20, cache_->GetPinnedUsage());
+
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(30, cache_->GetPinnedUsage());
+  cache_->Release(h2);
+  ASSERT_EQ(20, cache_->GetPinnedUsage());
+
+  // An erased entry counts until its last handle is released
+  Erase(200);
+  ASSERT_EQ(30, cache_->GetUsage());
+  ASSERT_EQ(20, cache_->GetPinnedUsage());
+  cache_->Release(h);
+  ASSERT_EQ(10, cache_->GetUsage());
+  ASSERT_EQ(0, cache_->GetPinnedUsage());
+}
+
+TEST(CacheTest, StrictCapacityLimit) {
+  std::vector<Cache::Handle*> handles;
+
+  // By default pinned entries let usage exceed the capacity
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, false);
+  for (int i = 0; i < kCacheSize + 10; i++) {
+    handles.push_back(cache_->Insert(EncodeKey(i), EncodeValue(1000+i), 1,
+                                     &CacheTest::Deleter));
+    ASSERT_TRUE(handles.back() != NULL);
+  }
+  ASSERT_EQ(kCacheSize + 10, cache_->GetUsage());
+  for (size_t i = 0; i < handles.size(); i++) {
+    cache_->Release(handles[i]);
+  }
+  // ...until they are released
+  ASSERT_EQ(static_cast<size_t>(kCacheSize), cache_->GetUsage());
+  handles.clear();
+
+  // A strict cache refuses entries that do not fit
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, true);
+  for (int i = 0; i < kCacheSize; i++) {
+    handles.push_back(cache_->Insert(EncodeKey(i), EncodeValue(1000+i), 1,
+                                     &CacheTest::Deleter));
+    ASSERT_TRUE(handles.back() != NULL);
+  }
+  ASSERT_TRUE(cache_->Insert(EncodeKey(kCacheSize), EncodeValue(0), 1,
+                             &CacheTest::Deleter) == NULL);
+  ASSERT_EQ(static_cast<size_t>(kCacheSize), cache_->GetUsage());
+  ASSERT_EQ(static_cast<size_t>(kCacheSize), cache_->GetPinnedUsage());
+
+  // Releasing handles makes room again, by evicting unpinned entries
+  cache_->Release(handles[0]);
+  Insert(kCacheSize, 1000+kCacheSize);
+  ASSERT_EQ(1000+kCacheSize, Lookup(kCacheSize));
+  ASSERT_EQ(-1, Lookup(0));
+  ASSERT_EQ(static_cast<size_t>(kCacheSize), cache_->GetUsage());
+  for (int i = 1; i < kCacheSize; i++) {
+    cache_->Release(handles[i]);
+  }
+  ASSERT_EQ(0, cache_->GetPinnedUsage());
+}
+
+TEST(CacheTest, ClockHitAndMiss) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 4, 1);
+  ASSERT_EQ(-1, Lookup(100));
+
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1,  Lookup(200));
+
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST(CacheTest, ClockEraseAndPin) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 4, 1);
+  Insert(100, 101);
+  Insert(200, 201);
+  Cache::Handle* h = cache_->Lookup(EncodeKey(100));
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(0, deleted_keys_.size());
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h)));
+  cache_->Release(h);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+}
+
+TEST(CacheTest, ClockEvictionPolicy) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 4, 1);
+  Insert(100, 101);
+  Insert(200, 201);
+
+  // Frequently used entry must be kept around
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+    ASSERT_EQ(2000+i, Lookup(1000+i));
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+
+  // Usage stays within the capacity
+  int cached = 0;
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    if (Lookup(1000+i) >= 0) cached++;
+  }
+  ASSERT_LE(cached, kCacheSize + 16);
+  ASSERT_GE(cached, kCacheSize / 2);
+}
+
+TEST(CacheTest, ClockFullTable) {
+  // A single shard with a 16 slot table
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 0, kCacheSize);
+  std::vector<Cache::Handle*> handles;
+  for (int i = 0; i < 40; i++) {
+    handles.push_back(cache_->Insert(EncodeKey(i), EncodeValue(1000+i), 1,
+                                     &CacheTest::Deleter));
+  }
+  for (int i = 0; i < 40; i++) {
+    ASSERT_EQ(1000+i, DecodeValue(cache_->Value(handles[i])));
+    cache_->Release(handles[i]);
+  }
+  // The entries that did not fit were freed on release
+  ASSERT_EQ(40 - 16, deleted_keys_.size());
+  int cached = 0;
+  for (int i = 0; i < 40; i++) {
+    int r = Lookup(i);
+    if (r >= 0) {
+      ASSERT_EQ(1000+i, r);
+      cached++;
+    }
+  }
+  ASSERT_EQ(16, cached);
+}
+
+namespace {
+struct CacheBenchState {
+  Cache* cache;
+  int keys;
+  int ops;
+  port::Mutex mu;
+  int num_running;
+  int errors;
+};
+
+static void NoopDeleter(const Slice& key, void* value) { }
+
+// Looks up random keys among state->keys, inserting the ones missing
+static void CacheBenchThread(void* arg) {
+  CacheBenchState* state = reinterpret_cast<CacheBenchState*>(arg);
+  Random rnd(301 + reinterpret_cast<uintptr_t>(&rnd));
+  int errors = 0;
+  for (int i = 0; i < state->ops; i++) {
+    const int k = rnd.Uniform(state->keys);
+    const std::string key = EncodeKey(k);
+    Cache::Handle* h = state->cache->Lookup(key);
+    if (h == NULL) {
+      h = state->cache->Insert(key, EncodeValue(k), 1, &NoopDeleter);
+    }
+    if (DecodeValue(state->cache->Value(h)) != k) errors++;
+    state->cache->Release(h);
+  }
+  MutexLock l(&state->mu);
+  state->errors += errors;
+  state->num_running--;
+}
+
+// Returns the lookups per second of "threads" threads sharing "cache"
+static double CacheBench(Cache* cache, int threads, int keys) {
+  CacheBenchState state;
+  state.cache = cache;
+  state.keys = keys;
+  state.ops = 200000;
+  state.num_running = threads;
+  state.errors = 0;
+  const uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0; i < threads; i++) {
+    Env::Default()->StartThread(&CacheBenchThread, &state);
+  }
+  while (true) {
+    state.mu.Lock();
+    int num = state.num_running;
+    state.mu.Unlock();
+    if (num == 0) {
+      break;
+    }
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  const uint64_t micros = Env::Default()->NowMicros() - start;
+  ASSERT_EQ(0, state.errors);
+  delete cache;
+  return threads * static_cast<double>(state.ops) * 1e6 / micros;
+}
+}  // namespace
+
+TEST(CacheTest, ClockVersusLRUBenchmark) {
+  // A few hot keys, all cached, and a key space twice the cache size
+  const int kKeys[] = { 64, 2 * kCacheSize };
+  for (int k = 0; k < 2; k++) {
+    for (int threads = 1; threads <= 8; threads *= 2) {
+      double lru = CacheBench(NewLRUCache(kCacheSize), threads, kKeys[k]);
+      double clock = CacheBench(NewClockCache(kCacheSize, 4, 1), threads,
+                                kKeys[k]);
+      fprintf(stderr, "%5d keys, %d threads: LRU %6.2f Mops/s, "
+              "CLOCK %6.2f Mops/s\n", kKeys[k], threads, lru / 1e6,
+              clock / 1e6);
+    }
+  }
+}
+
 TEST(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
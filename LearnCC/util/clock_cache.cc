@@ -0,0 +1,485 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <assert.h>
+#include <string.h>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "util/hash.h"
+
+namespace leveldb
+{
+
+    namespace {
+
+        // CLOCK cache implementation
+        //
+        // Each shard is an open addressing hash table of a fixed number of
+        // slots.  The state of a slot lives in a single 64-bit word, "meta",
+        // so that Lookup() and Release() are a compare-and-swap and an atomic
+        // decrement on it, with no lock:
+        //
+        //    bits  0..31: number of references held by clients
+        //    bits 32..33: CLOCK countdown; the sweep decrements it and evicts
+        //                 the entry when it reaches 0 with no references
+        //    bits 34..35: state (kEmpty, kConstruction, kVisible, kInvisible)
+        //    bits 36..63: tag, the high bits of the hash of the key
+        //
+        // Only a thread that moves a slot into kConstruction (an inserter
+        // claiming an empty slot, or the thread that drops the last reference
+        // to an entry that is no longer visible or that the sweep picked) may
+        // touch the other fields of the slot, until it publishes it again.
+        //
+        // Keys are probed with double hashing.  "displacements" counts the
+        // entries whose probe sequence passed over a slot, so that a lookup
+        // can stop at the first slot that no entry went past.
+
+        enum
+        {
+            kEmpty = 0,
+            kConstruction = 1,
+            kVisible = 2,
+            kInvisible = 3
+        };
+
+        static const int kCountdownShift = 32;
+        static const int kStateShift = 34;
+        static const int kTagShift = 36;
+        static const uint64_t kRefMask = 0xffffffffull;
+        static const uint64_t kCountdownMask = 3ull << kCountdownShift;
+        static const uint64_t kMaxCountdown = 3;
+
+        static inline uint64_t Refs(uint64_t meta) { return meta & kRefMask; }
+        static inline uint64_t Countdown(uint64_t meta) { return (meta & kCountdownMask) >> kCountdownShift; }
+        static inline int State(uint64_t meta) { return static_cast<int>((meta >> kStateShift) & 3); }
+        static inline uint64_t Tag(uint64_t meta) { return meta >> kTagShift; }
+        static inline uint64_t HashTag(uint32_t hash) { return hash >> 4; }
+
+        struct ClockHandle
+        {
+            port::AtomicUint64 meta;
+            port::AtomicUint64 displacements;
+
+            void* value;
+            void (*deleter)(const Slice&, void* value);
+            size_t charge;
+            char* key_data;
+            size_t key_length;
+            uint32_t hash;
+            bool detached;      // Allocated outside the table because it was full
+
+            Slice key() const { return Slice(key_data, key_length); }
+        };
+
+        // A single shard of sharded cache.
+        class ClockCacheShard
+        {
+        public:
+            ClockCacheShard();
+            ~ClockCacheShard();
+
+            // Separate from constructor so caller can easily make an array of shards
+            void Init(size_t capacity, int slot_bits);
+
+            // Like Cache methods, but with an extra "hash" parameter.
+            Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                                  size_t charge, void (*deleter)(const Slice& key, void* value),
+                                  Cache::Priority priority);
+            Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+            void Release(Cache::Handle* handle);
+            void Erase(const Slice& key, uint32_t hash);
+            size_t GetUsage() const { return usage_.NoBarrier_Load(); }
+            size_t GetPinnedUsage() const;
+
+        private:
+            size_t Slot(uint32_t hash, size_t probe) const
+            {
+                // An odd increment visits every slot of the power-of-2 table
+                const uint32_t increment = ((hash * 0x9e3779b9u) >> 7) | 1;
+                return (hash + probe * increment) & (num_slots_ - 1);
+            }
+
+            bool Acquire(ClockHandle* h);
+            void Unref(ClockHandle* h);
+            void Free(ClockHandle* h);
+            ClockHandle* Claim(uint32_t hash);
+            void Evict(size_t charge, bool force);
+
+            size_t capacity_;
+            size_t num_slots_;
+            ClockHandle* slots_;
+            port::AtomicUint64 usage_;
+            port::AtomicUint64 detached_usage_;
+            port::AtomicUint64 clock_hand_;
+        };
+
+        ClockCacheShard::ClockCacheShard() : capacity_(0), num_slots_(0), slots_(NULL)
+        {
+        }
+
+        ClockCacheShard::~ClockCacheShard()
+        {
+            for (size_t i = 0; i < num_slots_; i++)
+            {
+                ClockHandle* h = &slots_[i];
+                uint64_t meta = h->meta.NoBarrier_Load();
+                if (State(meta) == kVisible)
+                {
+                    assert(Refs(meta) == 0);  // Error if caller has an unreleased handle
+                    (*h->deleter)(h->key(), h->value);
+                    delete [] h->key_data;
+                }
+            }
+            delete [] slots_;
+        }
+
+        void ClockCacheShard::Init(size_t capacity, int slot_bits)
+        {
+            capacity_ = capacity;
+            num_slots_ = static_cast<size_t>(1) << slot_bits;
+            slots_ = new ClockHandle[num_slots_];
+        }
+
+        // Takes a reference to "h" if it holds a visible entry, and ages it
+        // back up in the CLOCK order.
+        bool ClockCacheShard::Acquire(ClockHandle* h)
+        {
+            while (true)
+            {
+                uint64_t meta = h->meta.Acquire_Load();
+                if (State(meta) != kVisible)
+                {
+                    return false;
+                }
+                uint64_t updated = meta + 1;
+                if (Countdown(meta) < kMaxCountdown)
+                {
+                    updated += 1ull << kCountdownShift;
+                }
+                if (h->meta.CompareAndSwap(meta, updated))
+                {
+                    return true;
+                }
+            }
+        }
+
+        void ClockCacheShard::Unref(ClockHandle* h)
+        {
+            uint64_t old = h->meta.FetchSub(1);
+            assert(Refs(old) > 0);
+            if (Refs(old) == 1 && State(old) == kInvisible)
+            {
+                // Nobody else can reach an invisible entry once its last
+                // reference is gone, so this cannot fail.
+                if (h->meta.CompareAndSwap(old - 1, static_cast<uint64_t>(kConstruction) << kStateShift))
+                {
+                    Free(h);
+                }
+            }
+        }
+
+        // REQUIRES: "h" is in kConstruction, owned by this thread.
+        void ClockCacheShard::Free(ClockHandle* h)
+        {
+            (*h->deleter)(h->key(), h->value);
+            delete [] h->key_data;
+            usage_.FetchSub(h->charge);
+            if (h->detached)
+            {
+                detached_usage_.FetchSub(h->charge);
+                delete h;
+                return;
+            }
+
+            // Undo the displacements recorded when the entry was inserted
+            const size_t index = h - slots_;
+            for (size_t probe = 0; Slot(h->hash, probe) != index; probe++)
+            {
+                slots_[Slot(h->hash, probe)].displacements.FetchSub(1);
+            }
+            h->meta.Release_Store(static_cast<uint64_t>(kEmpty) << kStateShift);
+        }
+
+        // Returns an empty slot on the probe sequence of "hash", moved to
+        // kConstruction, or NULL if there is none.
+        ClockHandle* ClockCacheShard::Claim(uint32_t hash)
+        {
+            const uint64_t construction = static_cast<uint64_t>(kConstruction) << kStateShift;
+            for (size_t probe = 0; probe < num_slots_; probe++)
+            {
+                ClockHandle* h = &slots_[Slot(hash, probe)];
+                uint64_t meta = h->meta.Acquire_Load();
+                if (State(meta) == kEmpty && h->meta.CompareAndSwap(meta, construction))
+                {
+                    return h;
+                }
+                h->displacements.FetchAdd(1);
+            }
+            for (size_t probe = 0; probe < num_slots_; probe++)
+            {
+                slots_[Slot(hash, probe)].displacements.FetchSub(1);
+            }
+            return NULL;
+        }
+
+        // Runs the CLOCK sweep until "charge" more fits in the capacity, or
+        // if "force", until at least one entry was evicted.  Gives up after
+        // enough steps to bring every countdown down to 0.
+        void ClockCacheShard::Evict(size_t charge, bool force)
+        {
+            const uint64_t construction = static_cast<uint64_t>(kConstruction) << kStateShift;
+            const size_t max_steps = num_slots_ * (kMaxCountdown + 1);
+            for (size_t step = 0; step < max_steps; step++)
+            {
+                if (!force && usage_.NoBarrier_Load() + charge <= capacity_)
+                {
+                    return;
+                }
+                ClockHandle* h = &slots_[clock_hand_.FetchAdd(1) & (num_slots_ - 1)];
+                uint64_t meta = h->meta.Acquire_Load();
+                if (State(meta) != kVisible || Refs(meta) != 0)
+                {
+                    continue;
+                }
+                if (Countdown(meta) > 0)
+                {
+                    h->meta.CompareAndSwap(meta, meta - (1ull << kCountdownShift));
+                } else if (h->meta.CompareAndSwap(meta, construction))
+                {
+                    Free(h);
+                    force = false;
+                }
+            }
+        }
+
+        // Only a snapshot: references come and go while the table is read.
+        size_t ClockCacheShard::GetPinnedUsage() const
+        {
+            size_t usage = detached_usage_.NoBarrier_Load();
+            for (size_t i = 0; i < num_slots_; i++)
+            {
+                const ClockHandle* h = &slots_[i];
+                uint64_t meta = h->meta.Acquire_Load();
+                if ((State(meta) == kVisible || State(meta) == kInvisible) && Refs(meta) > 0)
+                {
+                    usage += h->charge;
+                }
+            }
+            return usage;
+        }
+
+        Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash)
+        {
+            const uint64_t tag = HashTag(hash);
+            for (size_t probe = 0; probe < num_slots_; probe++)
+            {
+                ClockHandle* h = &slots_[Slot(hash, probe)];
+                uint64_t meta = h->meta.Acquire_Load();
+                if (State(meta) == kVisible && Tag(meta) == tag && Acquire(h))
+                {
+                    if (h->hash == hash && h->key() == key)
+                    {
+                        return reinterpret_cast<Cache::Handle*>(h);
+                    }
+                    Unref(h);
+                }
+                if (h->displacements.Acquire_Load() == 0)
+                {
+                    break;
+                }
+            }
+            return NULL;
+        }
+
+        void ClockCacheShard::Release(Cache::Handle* handle)
+        {
+            Unref(reinterpret_cast<ClockHandle*>(handle));
+        }
+
+        void ClockCacheShard::Erase(const Slice& key, uint32_t hash)
+        {
+            const uint64_t tag = HashTag(hash);
+            for (size_t probe = 0; probe < num_slots_; probe++)
+            {
+                ClockHandle* h = &slots_[Slot(hash, probe)];
+                uint64_t meta = h->meta.Acquire_Load();
+                if (State(meta) == kVisible && Tag(meta) == tag && Acquire(h))
+                {
+                    if (h->hash == hash && h->key() == key)
+                    {
+                        // Hide it; the entry is freed with its last reference
+                        while (State(meta = h->meta.Acquire_Load()) == kVisible &&
+                               !h->meta.CompareAndSwap(meta, meta | (static_cast<uint64_t>(kInvisible) << kStateShift)))
+                        {
+                        }
+                    }
+                    Unref(h);
+                }
+                if (h->displacements.Acquire_Load() == 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        Cache::Handle* ClockCacheShard::Insert(const Slice& key, uint32_t hash, void* value, size_t charge, void (*deleter)(const Slice& key, void* value), Cache::Priority priority)
+        {
+            // Replace any existing entry for the key
+            Erase(key, hash);
+
+            usage_.FetchAdd(charge);
+            Evict(0, false);
+            ClockHandle* h = Claim(hash);
+            if (h == NULL)
+            {
+                Evict(0, true);
+                h = Claim(hash);
+            }
+            uint64_t meta = 1;  // The reference for the returned handle
+            if (h == NULL)
+            {
+                // Every slot is pinned: hand out an entry that is not in
+                // the table and goes away when it is released.
+                h = new ClockHandle;
+                h->detached = true;
+                meta |= static_cast<uint64_t>(kInvisible) << kStateShift;
+                detached_usage_.FetchAdd(charge);
+            } else
+            {
+                h->detached = false;
+                meta |= static_cast<uint64_t>(kVisible) << kStateShift;
+                meta |= (priority == Cache::HIGH ? kMaxCountdown : 1) << kCountdownShift;
+                meta |= HashTag(hash) << kTagShift;
+            }
+            h->value = value;
+            h->deleter = deleter;
+            h->charge = charge;
+            h->key_data = new char[key.size()];
+            memcpy(h->key_data, key.data(), key.size());
+            h->key_length = key.size();
+            h->hash = hash;
+            h->meta.Release_Store(meta);
+            return reinterpret_cast<Cache::Handle*>(h);
+        }
+
+        class ShardedClockCache : public Cache
+        {
+        private:
+            ClockCacheShard* shards_;
+            int num_shard_bits_;
+            port::AtomicUint64 last_id_;
+
+            static inline uint32_t HashSlice(const Slice& s)
+            {
+                return Hash(s.data(), s.size(), 0);
+            }
+
+            uint32_t Shard(uint32_t hash) const
+            {
+                return num_shard_bits_ > 0 ? hash >> (32 - num_shard_bits_) : 0;
+            }
+
+        public:
+            ShardedClockCache(size_t capacity, int num_shard_bits, size_t estimated_entry_charge)
+            {
+                if (num_shard_bits < 0)
+                {
+                    // Same choice as NewLRUCache(): shards of at least 512KB
+                    num_shard_bits = 0;
+                    while (num_shard_bits < 6 && (capacity >> (num_shard_bits + 1)) >= (512 << 10))
+                    {
+                        num_shard_bits++;
+                    }
+                }
+                num_shard_bits_ = num_shard_bits;
+                const int num_shards = 1 << num_shard_bits;
+                const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+
+                // Keep the table at most half full when the cache is
+                size_t entries = per_shard / (estimated_entry_charge > 0 ? estimated_entry_charge : 1);
+                int slot_bits = 4;
+                while ((static_cast<size_t>(1) << slot_bits) < 2 * entries && slot_bits < 30)
+                {
+                    slot_bits++;
+                }
+
+                shards_ = new ClockCacheShard[num_shards];
+                for (int s = 0; s < num_shards; s++)
+                {
+                    shards_[s].Init(per_shard, slot_bits);
+                }
+            }
+            virtual ~ShardedClockCache()
+            {
+                delete [] shards_;
+            }
+            virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                                   void (*deleter)(const Slice& key, void* value))
+            {
+                return Insert(key, value, charge, deleter, LOW);
+            }
+            virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                                   void (*deleter)(const Slice& key, void* value),
+                                   Priority priority)
+            {
+                const uint32_t hash = HashSlice(key);
+                return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter, priority);
+            }
+            virtual Handle* Lookup(const Slice& key)
+            {
+                const uint32_t hash = HashSlice(key);
+                return shards_[Shard(hash)].Lookup(key, hash);
+            }
+            virtual void Release(Handle* handle)
+            {
+                ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+                shards_[Shard(h->hash)].Release(handle);
+            }
+            virtual void Erase(const Slice& key)
+            {
+                const uint32_t hash = HashSlice(key);
+                shards_[Shard(hash)].Erase(key, hash);
+            }
+            virtual void* Value(Handle* handle)
+            {
+                return reinterpret_cast<ClockHandle*>(handle)->value;
+            }
+            virtual uint64_t NewId()
+            {
+                return last_id_.FetchAdd(1) + 1;
+            }
+            virtual size_t GetUsage() const
+            {
+                size_t usage = 0;
+                for (int s = 0; s < (1 << num_shard_bits_); s++)
+                {
+                    usage += shards_[s].GetUsage();
+                }
+                return usage;
+            }
+            virtual size_t GetPinnedUsage() const
+            {
+                size_t usage = 0;
+                for (int s = 0; s < (1 << num_shard_bits_); s++)
+                {
+                    usage += shards_[s].GetPinnedUsage();
+                }
+                return usage;
+            }
+        };
+
+    }  // end anonymous namespace
+
+    Cache* NewClockCache(size_t capacity, int num_shard_bits)
+    {
+        return new ShardedClockCache(capacity, num_shard_bits, 4096);
+    }
+
+    Cache* NewClockCache(size_t capacity, int num_shard_bits, size_t estimated_entry_charge)
+    {
+        return new ShardedClockCache(capacity, num_shard_bits, estimated_entry_charge);
+    }
+
+}  // namespace leveldb
@@ -8,6 +8,7 @@
 #include "util/crc32c.h"
 
 #include <stdint.h>
+#include "port/port.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -283,7 +284,7 @@ static inline uint32_t LE_LOAD32(const uint8_t *p) {
   return DecodeFixed32(reinterpret_cast<const char*>(p));
 }
 
-uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+uint32_t ExtendPortable(uint32_t crc, const char* buf, size_t size) {
   const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
   const uint8_t *e = p + size;
   uint32_t l = crc ^ 0xffffffffu;
@@ -328,5 +329,26 @@ uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
   return l ^ 0xffffffffu;
 }
 
+// port::AcceleratedCRC32C returns zero when it cannot accelerate, so
+// check it against a known value before trusting it.
+static bool CanAccelerateCRC32C() {
+  static const char kTestCRCBuffer[] = "TestCRCBuffer";
+  static const size_t kBufSize = sizeof(kTestCRCBuffer) - 1;
+  return port::AcceleratedCRC32C(0, kTestCRCBuffer, kBufSize) ==
+         ExtendPortable(0, kTestCRCBuffer, kBufSize);
+}
+
+bool IsHardwareAccelerated() {
+  static const bool accelerate = CanAccelerateCRC32C();
+  return accelerate;
+}
+
+uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+  if (IsHardwareAccelerated()) {
+    return port::AcceleratedCRC32C(crc, buf, size);
+  }
+  return ExtendPortable(crc, buf, size);
+}
+
 }  // namespace crc32c
 }  // namespace leveldb
@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "util/crc32c.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -56,6 +57,26 @@ TEST(CRC, Extend) {
             Extend(Value("hello ", 6), "world", 5));
 }
 
+TEST(CRC, MatchesPortable) {
+  // Cover the unaligned head, the interleaved body and the tail of the
+  // accelerated code for a range of lengths and alignments.
+  Random rnd(301);
+  std::string data;
+  for (int i = 0; i < 4096 + 64; i++) {
+    data.push_back(static_cast<char>(rnd.Uniform(256)));
+  }
+  const int kLengths[] = { 0, 1, 7, 8, 9, 63, 767, 768, 769, 1536, 2311,
+                           4096 };
+  for (size_t i = 0; i < sizeof(kLengths) / sizeof(kLengths[0]); i++) {
+    for (int offset = 0; offset < 16; offset++) {
+      const char* p = data.data() + offset;
+      ASSERT_EQ(ExtendPortable(0, p, kLengths[i]), Value(p, kLengths[i]));
+      ASSERT_EQ(ExtendPortable(0x12345678, p, kLengths[i]),
+                Extend(0x12345678, p, kLengths[i]));
+    }
+  }
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
@@ -17,6 +17,7 @@
 #include <unistd.h>
 #include <deque>
 #include <set>
+#include <vector>
 #include "leveldb/env.h"
 #include "leveldb/slice.h"
 #include "port/port.h"
@@ -440,6 +441,176 @@ namespace leveldb
             }
         };
         
+        /*****************************************************************
+         类：PosixThreadPool
+         *****************************************************************/
+        static void PthreadCall(const char* label, int result)
+        {
+            if (result != 0) // 线程调用失败时，关闭进程
+            {
+                fprintf(stderr, "pthread %s: %s\n", label, strerror(result));
+                abort();
+            }
+        }
+        
+        // A pool of background threads draining one FIFO queue of work items.
+        // Threads are started lazily by Schedule().  The pool size may be
+        // changed at any time: when it shrinks, surplus threads exit (newest
+        // first) as soon as they are idle.
+        class PosixThreadPool
+        {
+        public:
+            PosixThreadPool() : total_threads_limit_(1)
+            {
+                PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
+                PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
+            }
+            
+            void Schedule(void (*function)(void*), void* arg)
+            {
+                PthreadCall("lock", pthread_mutex_lock(&mu_));
+                
+                // Start background threads if necessary
+                StartBGThreads();
+                
+                // Add to priority queue
+                queue_.push_back(BGItem());
+                queue_.back().function = function;
+                queue_.back().arg = arg;
+                
+                // Wake up one idle thread.  Excessive threads may be waiting too,
+                // so wake everybody if some of them are going away.
+                if (!HasExcessiveThread())
+                {
+                    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
+                } else
+                {
+                    PthreadCall("broadcast", pthread_cond_broadcast(&bgsignal_));
+                }
+                
+                PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+            }
+            
+            void SetBackgroundThreads(int num)
+            {
+                if (num < 1) num = 1;
+                PthreadCall("lock", pthread_mutex_lock(&mu_));
+                const size_t limit = static_cast<size_t>(num);
+                if (limit != total_threads_limit_)
+                {
+                    total_threads_limit_ = limit;
+                    if (queue_.empty())
+                    {
+                        // Nothing to do yet; threads will be started by Schedule().
+                    } else
+                    {
+                        StartBGThreads();
+                    }
+                    // Wake up idle threads so surplus ones can exit.
+                    PthreadCall("broadcast", pthread_cond_broadcast(&bgsignal_));
+                }
+                PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+            }
+            
+            int GetQueueLen() const
+            {
+                PthreadCall("lock", pthread_mutex_lock(&mu_));
+                const int len = static_cast<int>(queue_.size());
+                PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+                return len;
+            }
+            
+        private:
+            // REQUIRES: mu_ is held
+            void StartBGThreads()
+            {
+                while (bgthreads_.size() < total_threads_limit_)
+                {
+                    BGThreadArg* thread_arg = new BGThreadArg;
+                    thread_arg->pool = this;
+                    thread_arg->thread_id = bgthreads_.size();
+                    pthread_t t;
+                    PthreadCall("create thread", pthread_create(&t, NULL, &PosixThreadPool::BGThreadWrapper, thread_arg));
+                    bgthreads_.push_back(t);
+                }
+            }
+            
+            // REQUIRES: mu_ is held
+            bool HasExcessiveThread() const { return bgthreads_.size() > total_threads_limit_; }
+            
+            // Is thread_id one of the threads that must go away?
+            // REQUIRES: mu_ is held
+            bool IsExcessiveThread(size_t thread_id) const { return thread_id >= total_threads_limit_; }
+            
+            // Only the newest thread may exit, so that thread ids stay dense.
+            // REQUIRES: mu_ is held
+            bool IsLastExcessiveThread(size_t thread_id) const
+            {
+                return HasExcessiveThread() && thread_id == bgthreads_.size() - 1;
+            }
+            
+            // BGThread() is the body of each background thread
+            void BGThread(size_t thread_id)
+            {
+                while (true)
+                {
+                    // Wait until there is an item that is ready to run
+                    PthreadCall("lock", pthread_mutex_lock(&mu_));
+                    while (!IsLastExcessiveThread(thread_id) && (queue_.empty() || IsExcessiveThread(thread_id)))
+                    {
+                        PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
+                    }
+                    
+                    if (IsLastExcessiveThread(thread_id))
+                    {
+                        // This thread is surplus after the pool shrank: terminate it.
+                        pthread_t self = bgthreads_.back();
+                        bgthreads_.pop_back();
+                        if (HasExcessiveThread())
+                        {
+                            // Let the next surplus thread see it is now the last one.
+                            PthreadCall("broadcast", pthread_cond_broadcast(&bgsignal_));
+                        }
+                        PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+                        PthreadCall("detach", pthread_detach(self));
+                        return;
+                    }
+                    
+                    void (*function)(void*) = queue_.front().function;
+                    void* arg = queue_.front().arg;
+                    queue_.pop_front();
+                    
+                    PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+                    (*function)(arg);
+                }
+            }
+            
+            struct BGThreadArg
+            {
+                PosixThreadPool* pool;
+                size_t thread_id;
+            };
+            static void* BGThreadWrapper(void* arg)
+            {
+                BGThreadArg* thread_arg = reinterpret_cast<BGThreadArg*>(arg);
+                PosixThreadPool* pool = thread_arg->pool;
+                size_t thread_id = thread_arg->thread_id;
+                delete thread_arg;
+                pool->BGThread(thread_id);
+                return NULL;
+            }
+            
+            mutable pthread_mutex_t mu_;
+            pthread_cond_t bgsignal_;
+            std::vector<pthread_t> bgthreads_;
+            size_t total_threads_limit_;
+            
+            // Entry per Schedule() call
+            struct BGItem { void* arg; void (*function)(void*); };
+            typedef std::deque<BGItem> BGQueue;
+            BGQueue queue_;
+        };
+        
         /*****************************************************************
          类：PosixEnv
          *****************************************************************/
@@ -705,7 +876,19 @@ namespace leveldb
                 return result;
             }
             
-            virtual void Schedule(void (*function)(void*), void* arg);
+            virtual void Schedule(void (*function)(void*), void* arg, Priority pri);
+            
+            virtual void SetBackgroundThreads(int number, Priority pri)
+            {
+                assert(pri >= LOW && pri < TOTAL);
+                thread_pools_[pri].SetBackgroundThreads(number);
+            }
+            
+            virtual int GetThreadPoolQueueLen(Priority pri) const
+            {
+                assert(pri >= LOW && pri < TOTAL);
+                return thread_pools_[pri].GetQueueLen();
+            }
             
             virtual void StartThread(void (*function)(void* arg), void* arg);
             // 得到测试目录
@@ -761,32 +944,8 @@ namespace leveldb
             }
             
         private:
-            void PthreadCall(const char* label, int result)
-            {
-                if (result != 0) // 线程调用失败时，关闭进程
-                {
-                    fprintf(stderr, "pthread %s: %s\n", label, strerror(result));
-                    abort();
-                }
-            }
-            
-            // BGThread() is the body of the background thread
-            void BGThread();
-            static void* BGThreadWrapper(void* arg)
-            {
-                reinterpret_cast<PosixEnv*>(arg)->BGThread();
-                return NULL;
-            }
-            
-            pthread_mutex_t mu_;
-            pthread_cond_t bgsignal_;
-            pthread_t bgthread_;
-            bool started_bgthread_;
-            
-            // Entry per Schedule() call
-            struct BGItem { void* arg; void (*function)(void*); };
-            typedef std::deque<BGItem> BGQueue;
-            BGQueue queue_;
+            // One pool per Env::Priority
+            PosixThreadPool thread_pools_[TOTAL];
             
             PosixLockTable locks_;
             MmapLimiter mmap_limit_;
@@ -796,70 +955,14 @@ namespace leveldb
          类：PosixEnv 一些方法的实现
          *****************************************************************/
         // PosixEnv的构造方法
-        PosixEnv::PosixEnv() : started_bgthread_(false)
+        PosixEnv::PosixEnv()
         {
-            PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
-            PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
-        }
-        // PosixEnv的虚构方法
-        void PosixEnv::Schedule(void (*function)(void*), void* arg)
-        {
-            PthreadCall("lock", pthread_mutex_lock(&mu_));
-            
-            // Start background thread if necessary
-            if (!started_bgthread_)
-            {
-                started_bgthread_ = true;
-                /**
-                 int pthread_create(pthread_t *tidp,const pthread_attr_t *attr,(void*)(*start_rtn)(void*),void *arg);
-                 参数说明：
-                 第一个参数为指向线程标识符的指针。
-                 第二个参数用来设置线程属性。
-                 第三个参数是线程运行函数的起始地址。
-                 最后一个参数是运行函数的参数。
-                 返回值：
-                 若线程创建成功，则返回0。若线程创建失败，则返回出错编号
-                 */
-                PthreadCall("create thread", pthread_create(&bgthread_, NULL,  &PosixEnv::BGThreadWrapper, this));
-            }
-            
-            // If the queue is currently empty, the background thread may currently be
-            // waiting.
-            if (queue_.empty())
-            {
-                /**
-                 pthread_cond_signal函数的作用是发送一个信号给另外一个正在处于阻塞等待状态的线程,使其脱离阻塞状态,继续执行.
-                 如果没有线程处在阻塞等待状态,pthread_cond_signal也会成功返回。
-                 */
-                PthreadCall("signal", pthread_cond_signal(&bgsignal_));
-            }
-            
-            // Add to priority queue
-            queue_.push_back(BGItem());
-            queue_.back().function = function;
-            queue_.back().arg = arg;
-            
-            PthreadCall("unlock", pthread_mutex_unlock(&mu_));
         }
         
-        void PosixEnv::BGThread()
+        void PosixEnv::Schedule(void (*function)(void*), void* arg, Priority pri)
         {
-            while (true)
-            {
-                // Wait until there is an item that is ready to run
-                PthreadCall("lock", pthread_mutex_lock(&mu_));
-                while (queue_.empty())
-                {
-                    PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
-                }
-                
-                void (*function)(void*) = queue_.front().function;
-                void* arg = queue_.front().arg;
-                queue_.pop_front();
-                
-                PthreadCall("unlock", pthread_mutex_unlock(&mu_));
-                (*function)(arg);
-            }
+            assert(pri >= LOW && pri < TOTAL);
+            thread_pools_[pri].Schedule(function, arg);
         }
         
         namespace
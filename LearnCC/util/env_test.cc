@@ -64,6 +64,88 @@ TEST(EnvPosixTest, RunMany) {
   ASSERT_EQ(4, reinterpret_cast<uintptr_t>(cur));
 }
 
+// Shared state for jobs that wait for each other to be running.
+struct PoolState {
+  port::Mutex mu;
+  int running;          // Jobs currently inside Run()
+  int max_running;      // Largest value seen for "running"
+  int target;           // Jobs return once this many are running at once
+  port::AtomicPointer high_ran;
+};
+
+static void WaitForTarget(void* arg) {
+  PoolState* s = reinterpret_cast<PoolState*>(arg);
+  s->mu.Lock();
+  s->running++;
+  if (s->running > s->max_running) s->max_running = s->running;
+  s->mu.Unlock();
+  // Give up after a while so a broken pool fails the test instead of hanging
+  for (int i = 0; i < 100; i++) {
+    s->mu.Lock();
+    bool done = (s->max_running >= s->target);
+    s->mu.Unlock();
+    if (done) break;
+    Env::Default()->SleepForMicroseconds(kDelayMicros / 10);
+  }
+  s->mu.Lock();
+  s->running--;
+  s->mu.Unlock();
+}
+
+static void WaitForHigh(void* arg) {
+  PoolState* s = reinterpret_cast<PoolState*>(arg);
+  for (int i = 0; i < 100 && s->high_ran.Acquire_Load() == NULL; i++) {
+    Env::Default()->SleepForMicroseconds(kDelayMicros / 10);
+  }
+  s->mu.Lock();
+  s->running--;
+  s->mu.Unlock();
+}
+
+TEST(EnvPosixTest, HighPriorityDoesNotWaitForLow) {
+  PoolState state;
+  state.running = 1;
+  state.high_ran.Release_Store(NULL);
+  // Occupies the single LOW thread until the HIGH job has run
+  env_->Schedule(&WaitForHigh, &state, Env::LOW);
+  env_->Schedule(&SetBool, &state.high_ran, Env::HIGH);
+  while (true) {
+    state.mu.Lock();
+    int running = state.running;
+    state.mu.Unlock();
+    if (running == 0) break;
+    Env::Default()->SleepForMicroseconds(kDelayMicros / 10);
+  }
+  ASSERT_TRUE(state.high_ran.Acquire_Load() != NULL);
+}
+
+TEST(EnvPosixTest, SetBackgroundThreads) {
+  env_->SetBackgroundThreads(3, Env::LOW);
+  PoolState state;
+  state.running = 0;
+  state.max_running = 0;
+  state.target = 3;
+  for (int i = 0; i < 3; i++) {
+    env_->Schedule(&WaitForTarget, &state, Env::LOW);
+  }
+  for (int i = 0; i < 200; i++) {
+    state.mu.Lock();
+    bool done = (state.max_running == state.target && state.running == 0);
+    state.mu.Unlock();
+    if (done) break;
+    Env::Default()->SleepForMicroseconds(kDelayMicros / 10);
+  }
+  ASSERT_EQ(3, state.max_running);
+  ASSERT_EQ(0, env_->GetThreadPoolQueueLen(Env::LOW));
+
+  // Shrinking the pool back must leave it usable
+  env_->SetBackgroundThreads(1, Env::LOW);
+  port::AtomicPointer called(NULL);
+  env_->Schedule(&SetBool, &called);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_TRUE(called.NoBarrier_Load() != NULL);
+}
+
 struct State {
   port::Mutex mu;
   int val;
@@ -6,6 +6,12 @@
 
 namespace leveldb {
 
+FilterPolicy::Builder::~Builder() { }
+
 FilterPolicy::~FilterPolicy() { }
 
+FilterPolicy::Builder* FilterPolicy::NewBuilder() const {
+  return NULL;
+}
+
 }  // namespace leveldb
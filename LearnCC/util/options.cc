@@ -17,12 +17,25 @@ namespace leveldb
     env(Env::Default()),
     info_log(NULL),
     write_buffer_size(4<<20),
+    allow_concurrent_memtable_write(false),
+    enable_pipelined_write(false),
     max_open_files(1000),
+    max_background_compactions(1),
+    max_subcompactions(1),
+    compaction_readahead_size(0),
+    deletion_compaction_ratio(0),
     block_cache(NULL),
+    compressed_block_cache(NULL),
+    persistent_cache(NULL),
+    row_cache(NULL),
     block_size(4096),
     block_restart_interval(16),
     compression(kSnappyCompression),
-    filter_policy(NULL)
+    filter_policy(NULL),
+    whole_table_filter(false),
+    prefix_extractor(NULL),
+    partition_index(false),
+    cache_index_and_filter_blocks(false)
     {
     }
     
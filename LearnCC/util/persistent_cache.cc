@@ -0,0 +1,422 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb
+{
+    
+    PersistentCache::~PersistentCache()
+    {
+    }
+    
+    namespace
+    {
+        // A cache file is a sequence of records, each of which is
+        //    checksum: uint32     // masked crc32c of the rest of the record
+        //    key_size: varint32
+        //    data_size: varint32
+        //    key: uint8[key_size]
+        //    data: uint8[data_size]
+        // A record cut short by a crash ends the file's valid contents.
+        
+        static const char kFileSuffix[] = ".pcache";
+        
+        static const size_t kChecksumSize = 4;
+        
+        struct CacheFile
+        {
+            uint64_t number;
+            uint64_t size;
+            RandomAccessFile* file;   // NULL while the file is being written
+            int refs;                 // Lookups reading it, plus one while it is cached
+            std::vector<std::string> keys;  // Of its records, some maybe replaced since
+        };
+        
+        // Where the record of a key is
+        struct Location
+        {
+            CacheFile* file;
+            uint64_t offset;
+            uint32_t size;            // Of the whole record
+            uint32_t data_size;       // The data is at the end of the record
+        };
+        
+        // Checks the record at the start of "input" and, if it is intact,
+        // sets *key and *data to its contents and *size to its length.
+        static bool ParseRecord(const Slice& input, Slice* key, Slice* data, uint32_t* size)
+        {
+            if (input.size() < kChecksumSize)
+            {
+                return false;
+            }
+            Slice rest(input.data() + kChecksumSize, input.size() - kChecksumSize);
+            uint32_t key_size, data_size;
+            if (!GetVarint32(&rest, &key_size) || !GetVarint32(&rest, &data_size) ||
+                rest.size() < static_cast<uint64_t>(key_size) + data_size)
+            {
+                return false;
+            }
+            const size_t length = (rest.data() - input.data()) + key_size + data_size;
+            const uint32_t crc = crc32c::Unmask(DecodeFixed32(input.data()));
+            if (crc32c::Value(input.data() + kChecksumSize, length - kChecksumSize) != crc)
+            {
+                return false;
+            }
+            *key = Slice(rest.data(), key_size);
+            *data = Slice(rest.data() + key_size, data_size);
+            *size = static_cast<uint32_t>(length);
+            return true;
+        }
+        
+        class FilePersistentCache : public PersistentCache
+        {
+        public:
+            FilePersistentCache(Env* env, const std::string& dir, uint64_t capacity)
+            : env_(env),
+            dir_(dir),
+            capacity_(capacity),
+            file_size_(std::max<uint64_t>(capacity / 16, 4096)),
+            writer_(NULL),
+            next_file_number_(1),
+            usage_(0)
+            {
+            }
+            
+            virtual ~FilePersistentCache()
+            {
+                if (writer_ != NULL)
+                {
+                    writer_->Close();
+                    delete writer_;
+                }
+                for (size_t i = 0; i < files_.size(); i++)
+                {
+                    Unref(files_[i]);
+                }
+            }
+            
+            // Indexes the records of the files found in dir_, oldest file
+            // first so that later records of a key replace earlier ones.
+            Status Recover()
+            {
+                env_->CreateDir(dir_);  // Ignore error: it may already exist
+                std::vector<std::string> children;
+                Status s = env_->GetChildren(dir_, &children);
+                if (!s.ok())
+                {
+                    return s;
+                }
+                std::vector<uint64_t> numbers;
+                for (size_t i = 0; i < children.size(); i++)
+                {
+                    Slice name(children[i]);
+                    uint64_t number;
+                    if (ConsumeDecimalNumber(&name, &number) && name == kFileSuffix)
+                    {
+                        numbers.push_back(number);
+                    }
+                }
+                std::sort(numbers.begin(), numbers.end());
+                
+                for (size_t i = 0; i < numbers.size(); i++)
+                {
+                    next_file_number_ = numbers[i] + 1;
+                    const std::string fname = FileName(numbers[i]);
+                    std::string contents;
+                    CacheFile* f = new CacheFile;
+                    f->number = numbers[i];
+                    f->size = 0;
+                    f->file = NULL;
+                    f->refs = 1;
+                    if (!ReadFileToString(env_, fname, &contents).ok() ||
+                        !env_->NewRandomAccessFile(fname, &f->file).ok())
+                    {
+                        // Unreadable files are simply not used
+                        delete f;
+                        env_->DeleteFile(fname);
+                        continue;
+                    }
+                    f->size = contents.size();
+                    Slice input(contents);
+                    Slice key, data;
+                    uint32_t size;
+                    while (ParseRecord(input, &key, &data, &size))
+                    {
+                        Location loc;
+                        loc.file = f;
+                        loc.offset = input.data() - contents.data();
+                        loc.size = size;
+                        loc.data_size = static_cast<uint32_t>(data.size());
+                        index_[key.ToString()] = loc;
+                        f->keys.push_back(key.ToString());
+                        input.remove_prefix(size);
+                    }
+                    files_.push_back(f);
+                    usage_ += f->size;
+                }
+                std::vector<uint64_t> evicted;
+                while (usage_ > capacity_ && !files_.empty())
+                {
+                    EvictOldest(&evicted);
+                }
+                DeleteFiles(evicted);
+                return Status::OK();
+            }
+            
+            virtual Status Insert(const Slice& key, const Slice& data)
+            {
+                std::string record(kChecksumSize, '\0');
+                PutVarint32(&record, static_cast<uint32_t>(key.size()));
+                PutVarint32(&record, static_cast<uint32_t>(data.size()));
+                record.append(key.data(), key.size());
+                record.append(data.data(), data.size());
+                const uint32_t crc = crc32c::Value(record.data() + kChecksumSize, record.size() - kChecksumSize);
+                EncodeFixed32(&record[0], crc32c::Mask(crc));
+                
+                // Inserts take turns at the file, but lookups, which only
+                // take mutex_, do not wait for its I/O.
+                MutexLock w(&write_mutex_);
+                if (writer_ == NULL)
+                {
+                    Status s = NewFile();
+                    if (!s.ok())
+                    {
+                        return s;
+                    }
+                }
+                Status s = writer_->Append(record);
+                if (!s.ok())
+                {
+                    return s;
+                }
+                
+                std::vector<uint64_t> evicted;
+                bool full;
+                {
+                    MutexLock l(&mutex_);
+                    CacheFile* f = files_.back();
+                    Location loc;
+                    loc.file = f;
+                    loc.offset = f->size;
+                    loc.size = static_cast<uint32_t>(record.size());
+                    loc.data_size = static_cast<uint32_t>(data.size());
+                    index_[key.ToString()] = loc;
+                    f->keys.push_back(key.ToString());
+                    active_contents_.append(record);
+                    f->size += record.size();
+                    usage_ += record.size();
+                    full = (f->size >= file_size_);
+                }
+                if (full)
+                {
+                    FinishFile(&evicted);
+                }
+                {
+                    MutexLock l(&mutex_);
+                    while (usage_ > capacity_ && files_.size() > 1)
+                    {
+                        EvictOldest(&evicted);
+                    }
+                }
+                DeleteFiles(evicted);
+                return Status::OK();
+            }
+            
+            virtual Status Lookup(const Slice& key, std::string* data)
+            {
+                Location loc;
+                {
+                    MutexLock l(&mutex_);
+                    std::map<std::string, Location>::const_iterator it = index_.find(key.ToString());
+                    if (it == index_.end())
+                    {
+                        return Status::NotFound(Slice());
+                    }
+                    loc = it->second;
+                    if (loc.file->file == NULL)
+                    {
+                        // The record is in the file being written, which is
+                        // also kept in memory.
+                        data->assign(active_contents_.data() + loc.offset + loc.size - loc.data_size, loc.data_size);
+                        return Status::OK();
+                    }
+                    loc.file->refs++;
+                }
+                
+                // Read without holding the lock.  The file stays open even
+                // if it is evicted meanwhile.
+                std::string scratch(loc.size, '\0');
+                Slice record, found_key, found_data;
+                uint32_t size;
+                Status s = loc.file->file->Read(loc.offset, loc.size, &record, &scratch[0]);
+                if (s.ok() &&
+                    (record.size() != loc.size || !ParseRecord(record, &found_key, &found_data, &size) ||
+                     found_key != key))
+                {
+                    s = Status::Corruption("bad persistent cache record");
+                }
+                if (s.ok())
+                {
+                    data->assign(found_data.data(), found_data.size());
+                }
+                
+                MutexLock l(&mutex_);
+                Unref(loc.file);
+                return s;
+            }
+            
+            virtual uint64_t GetUsage() const
+            {
+                MutexLock l(&mutex_);
+                return usage_;
+            }
+            
+        private:
+            std::string FileName(uint64_t number) const
+            {
+                char buf[100];
+                snprintf(buf, sizeof(buf), "/%06llu%s", static_cast<unsigned long long>(number), kFileSuffix);
+                return dir_ + buf;
+            }
+            
+            // Starts a new file for Insert() to append to.
+            // REQUIRES: write_mutex_ held, writer_ == NULL
+            Status NewFile()
+            {
+                const uint64_t number = next_file_number_++;
+                Status s = env_->NewWritableFile(FileName(number), &writer_);
+                if (!s.ok())
+                {
+                    writer_ = NULL;
+                    return s;
+                }
+                CacheFile* f = new CacheFile;
+                f->number = number;
+                f->size = 0;
+                f->file = NULL;
+                f->refs = 1;
+                MutexLock l(&mutex_);
+                files_.push_back(f);
+                return s;
+            }
+            
+            // Closes the file being written and reopens it for reading.
+            // Adds to *evicted the number of the file if it is dropped.
+            // REQUIRES: write_mutex_ held, mutex_ not held, writer_ != NULL
+            void FinishFile(std::vector<uint64_t>* evicted)
+            {
+                CacheFile* f = files_.back();
+                Status s = writer_->Close();
+                delete writer_;
+                writer_ = NULL;
+                RandomAccessFile* file = NULL;
+                if (s.ok())
+                {
+                    s = env_->NewRandomAccessFile(FileName(f->number), &file);
+                }
+                
+                MutexLock l(&mutex_);
+                active_contents_.clear();
+                if (s.ok())
+                {
+                    f->file = file;
+                } else
+                {
+                    // Its records cannot be read back, so drop them
+                    files_.pop_back();
+                    files_.push_front(f);
+                    EvictOldest(evicted);
+                }
+            }
+            
+            // Forgets the oldest file and the records in it, and adds its
+            // number to *evicted for DeleteFiles().
+            // REQUIRES: mutex_ held, the oldest file is not being written
+            void EvictOldest(std::vector<uint64_t>* evicted)
+            {
+                CacheFile* f = files_.front();
+                files_.pop_front();
+                for (size_t i = 0; i < f->keys.size(); i++)
+                {
+                    std::map<std::string, Location>::iterator it = index_.find(f->keys[i]);
+                    if (it != index_.end() && it->second.file == f)
+                    {
+                        index_.erase(it);
+                    }
+                }
+                usage_ -= f->size;
+                evicted->push_back(f->number);
+                Unref(f);
+            }
+            
+            // Deletes the files EvictOldest() dropped.  Lookups may still
+            // be reading them through their open handles.
+            // REQUIRES: mutex_ not held
+            void DeleteFiles(const std::vector<uint64_t>& numbers)
+            {
+                for (size_t i = 0; i < numbers.size(); i++)
+                {
+                    env_->DeleteFile(FileName(numbers[i]));
+                }
+            }
+            
+            // REQUIRES: mutex_ held
+            void Unref(CacheFile* f)
+            {
+                if (--f->refs == 0)
+                {
+                    delete f->file;
+                    delete f;
+                }
+            }
+            
+            Env* const env_;
+            const std::string dir_;
+            const uint64_t capacity_;
+            const uint64_t file_size_;
+            
+            // Held by Insert() for the whole of its work, so inserts are
+            // applied one at a time.  Changes to files_ hold both mutexes.
+            port::Mutex write_mutex_;
+            WritableFile* writer_;                    // Appends to files_.back(), if non-NULL
+            uint64_t next_file_number_;
+            
+            // Held briefly, to read or update the index
+            mutable port::Mutex mutex_;
+            std::deque<CacheFile*> files_;            // Oldest first
+            std::string active_contents_;             // What writer_ has appended
+            std::map<std::string, Location> index_;
+            uint64_t usage_;
+        };
+    }  // namespace
+    
+    Status NewPersistentCache(Env* env, const std::string& dir, uint64_t capacity, PersistentCache** result)
+    {
+        *result = NULL;
+        FilePersistentCache* cache = new FilePersistentCache(env, dir, capacity);
+        Status s = cache->Recover();
+        if (s.ok())
+        {
+            *result = cache;
+        } else
+        {
+            delete cache;
+        }
+        return s;
+    }
+    
+}  // namespace leveldb
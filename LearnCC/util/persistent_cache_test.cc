@@ -0,0 +1,259 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int k) {
+  std::string result;
+  PutFixed32(&result, k);
+  return result;
+}
+
+static bool IsCacheFile(const std::string& name) {
+  const std::string suffix = ".pcache";
+  return name.size() > suffix.size() &&
+         name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// A value of "size" bytes that depends on k
+static std::string Value(int k, int size) {
+  Random rnd(k);
+  std::string result;
+  test::RandomString(&rnd, size, &result);
+  return result;
+}
+
+class PersistentCacheTest {
+ public:
+  std::string dir_;
+  Env* env_;
+  PersistentCache* cache_;
+
+  PersistentCacheTest() : env_(Env::Default()), cache_(NULL) {
+    dir_ = test::TmpDir() + "/persistent_cache_test";
+    Destroy();
+  }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+    Destroy();
+  }
+
+  void Destroy() {
+    std::vector<std::string> files;
+    env_->GetChildren(dir_, &files);
+    for (size_t i = 0; i < files.size(); i++) {
+      env_->DeleteFile(dir_ + "/" + files[i]);
+    }
+    env_->DeleteDir(dir_);
+  }
+
+  // (Re)creates the cache on dir_, as after a restart
+  void Open(uint64_t capacity) {
+    delete cache_;
+    cache_ = NULL;
+    ASSERT_OK(NewPersistentCache(env_, dir_, capacity, &cache_));
+  }
+
+  std::string Lookup(int k) {
+    std::string data;
+    Status s = cache_->Lookup(Key(k), &data);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    }
+    ASSERT_OK(s);
+    return data;
+  }
+
+  int CacheFiles() {
+    std::vector<std::string> files;
+    env_->GetChildren(dir_, &files);
+    int count = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+      if (IsCacheFile(files[i])) count++;
+    }
+    return count;
+  }
+};
+
+TEST(PersistentCacheTest, InsertAndLookup) {
+  Open(1 << 20);
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  ASSERT_OK(cache_->Insert(Key(1), "one"));
+  ASSERT_OK(cache_->Insert(Key(2), ""));
+  ASSERT_EQ("one", Lookup(1));
+  ASSERT_EQ("", Lookup(2));
+  ASSERT_EQ("NOT_FOUND", Lookup(3));
+
+  ASSERT_OK(cache_->Insert(Key(1), "uno"));
+  ASSERT_EQ("uno", Lookup(1));
+  ASSERT_GT(cache_->GetUsage(), 0);
+}
+
+TEST(PersistentCacheTest, LookupFromFinishedFiles) {
+  // 64KB files: most entries end up in files that are no longer written
+  Open(1 << 20);
+  for (int k = 0; k < 100; k++) {
+    ASSERT_OK(cache_->Insert(Key(k), Value(k, 4000)));
+  }
+  ASSERT_GT(CacheFiles(), 4);
+  for (int k = 0; k < 100; k++) {
+    ASSERT_EQ(Value(k, 4000), Lookup(k)) << k;
+  }
+}
+
+TEST(PersistentCacheTest, SurvivesRestart) {
+  Open(1 << 20);
+  for (int k = 0; k < 100; k++) {
+    ASSERT_OK(cache_->Insert(Key(k), Value(k, 4000)));
+  }
+  ASSERT_OK(cache_->Insert(Key(7), "replaced"));
+  const uint64_t usage = cache_->GetUsage();
+
+  Open(1 << 20);
+  ASSERT_EQ(usage, cache_->GetUsage());
+  for (int k = 0; k < 100; k++) {
+    ASSERT_EQ(k == 7 ? "replaced" : Value(k, 4000), Lookup(k)) << k;
+  }
+
+  // New entries go to new files, after the recovered ones
+  ASSERT_OK(cache_->Insert(Key(100), "new"));
+  Open(1 << 20);
+  ASSERT_EQ("new", Lookup(100));
+  ASSERT_EQ("replaced", Lookup(7));
+}
+
+TEST(PersistentCacheTest, EvictsOldestFiles) {
+  const uint64_t kCapacity = 256 << 10;
+  Open(kCapacity);
+  for (int k = 0; k < 1000; k++) {
+    ASSERT_OK(cache_->Insert(Key(k), Value(k, 1000)));
+    ASSERT_LE(cache_->GetUsage(), kCapacity);
+  }
+  ASSERT_LE(CacheFiles(), 17);
+
+  // The most recent entries are kept, the first ones are gone
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+  for (int k = 900; k < 1000; k++) {
+    ASSERT_EQ(Value(k, 1000), Lookup(k)) << k;
+  }
+
+  // A smaller capacity after a restart evicts what no longer fits
+  Open(kCapacity / 4);
+  ASSERT_LE(cache_->GetUsage(), kCapacity / 4);
+  ASSERT_EQ(Value(999, 1000), Lookup(999));
+  ASSERT_EQ("NOT_FOUND", Lookup(900));
+}
+
+namespace {
+struct ConcurrentState {
+  PersistentCache* cache;
+  port::Mutex mu;
+  port::CondVar cv;
+  int running;
+  ConcurrentState() : cv(&mu), running(0) { }
+};
+
+struct ConcurrentThread {
+  ConcurrentState* state;
+  int id;
+};
+
+static void ConcurrentBody(void* arg) {
+  ConcurrentThread* t = reinterpret_cast<ConcurrentThread*>(arg);
+  PersistentCache* cache = t->state->cache;
+  Random rnd(301 + t->id);
+  for (int i = 0; i < 500; i++) {
+    const int k = t->id * 1000 + i;
+    ASSERT_OK(cache->Insert(Key(k), Value(k, 1000)));
+
+    // Earlier entries of any thread are found intact or not at all
+    const int other = rnd.Uniform(4) * 1000 + rnd.Uniform(i + 1);
+    std::string data;
+    Status s = cache->Lookup(Key(other), &data);
+    if (!s.IsNotFound()) {
+      ASSERT_OK(s);
+      ASSERT_EQ(Value(other, 1000), data) << other;
+    }
+  }
+  MutexLock l(&t->state->mu);
+  t->state->running--;
+  t->state->cv.SignalAll();
+}
+}  // namespace
+
+TEST(PersistentCacheTest, ConcurrentInsertsAndLookups) {
+  // Small files, so that threads roll them over and evict them
+  const uint64_t kCapacity = 256 << 10;
+  Open(kCapacity);
+  ConcurrentState state;
+  state.cache = cache_;
+  state.running = 4;
+  ConcurrentThread threads[4];
+  for (int id = 0; id < 4; id++) {
+    threads[id].state = &state;
+    threads[id].id = id;
+    env_->StartThread(ConcurrentBody, &threads[id]);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.running > 0) {
+      state.cv.Wait();
+    }
+  }
+  ASSERT_LE(cache_->GetUsage(), kCapacity);
+
+  // The thread that finished last has its last entry cached
+  int found = 0;
+  for (int id = 0; id < 4; id++) {
+    const std::string v = Lookup(id * 1000 + 499);
+    if (v != "NOT_FOUND") {
+      ASSERT_EQ(Value(id * 1000 + 499, 1000), v);
+      found++;
+    }
+  }
+  ASSERT_GT(found, 0);
+}
+
+TEST(PersistentCacheTest, TornRecord) {
+  Open(1 << 20);
+  ASSERT_OK(cache_->Insert(Key(1), "one"));
+  ASSERT_OK(cache_->Insert(Key(2), "two"));
+  delete cache_;
+  cache_ = NULL;
+
+  // Cut the last record short, as a crash during the append would
+  std::vector<std::string> files;
+  ASSERT_OK(env_->GetChildren(dir_, &files));
+  std::string fname;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (IsCacheFile(files[i])) fname = dir_ + "/" + files[i];
+  }
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname, &contents));
+  contents.resize(contents.size() - 1);
+  ASSERT_OK(WriteStringToFile(env_, contents, fname));
+
+  Open(1 << 20);
+  ASSERT_EQ("one", Lookup(1));
+  ASSERT_EQ("NOT_FOUND", Lookup(2));
+  ASSERT_OK(cache_->Insert(Key(2), "two"));
+  ASSERT_EQ("two", Lookup(2));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/slice_transform.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "leveldb/slice.h"
+
+namespace leveldb
+{
+    
+    SliceTransform::~SliceTransform() { }
+    
+    bool SliceTransform::SamePrefix(const Slice& a, const Slice& b) const
+    {
+        return a == b;
+    }
+    
+    namespace
+    {
+        class FixedPrefixTransform : public SliceTransform
+        {
+        public:
+            explicit FixedPrefixTransform(size_t prefix_len) : prefix_len_(prefix_len)
+            {
+                char buf[50];
+                snprintf(buf, sizeof(buf), "leveldb.FixedPrefix.%llu", static_cast<unsigned long long>(prefix_len));
+                name_ = buf;
+            }
+            
+            virtual const char* Name() const
+            {
+                return name_.c_str();
+            }
+            
+            virtual Slice Transform(const Slice& key) const
+            {
+                assert(InDomain(key));
+                return Slice(key.data(), prefix_len_);
+            }
+            
+            virtual bool InDomain(const Slice& key) const
+            {
+                return key.size() >= prefix_len_;
+            }
+            
+        private:
+            const size_t prefix_len_;
+            std::string name_;
+        };
+        
+        class DelimitedPrefixTransform : public SliceTransform
+        {
+        public:
+            explicit DelimitedPrefixTransform(char delimiter) : delimiter_(delimiter)
+            {
+                char buf[50];
+                snprintf(buf, sizeof(buf), "leveldb.DelimitedPrefix.%d", static_cast<unsigned char>(delimiter));
+                name_ = buf;
+            }
+            
+            virtual const char* Name() const
+            {
+                return name_.c_str();
+            }
+            
+            virtual Slice Transform(const Slice& key) const
+            {
+                const char* end = reinterpret_cast<const char*>(memchr(key.data(), delimiter_, key.size()));
+                assert(end != NULL);
+                return Slice(key.data(), end - key.data() + 1);
+            }
+            
+            virtual bool InDomain(const Slice& key) const
+            {
+                return memchr(key.data(), delimiter_, key.size()) != NULL;
+            }
+            
+        private:
+            const char delimiter_;
+            std::string name_;
+        };
+    }  // namespace
+    
+    const SliceTransform* NewFixedPrefixTransform(size_t prefix_len)
+    {
+        return new FixedPrefixTransform(prefix_len);
+    }
+    
+    const SliceTransform* NewDelimitedPrefixTransform(char delimiter)
+    {
+        return new DelimitedPrefixTransform(delimiter);
+    }
+    
+}  // namespace leveldb
@@ -0,0 +1,223 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb
+{
+    
+    namespace
+    {
+        // The slots of one thread, indexed by ThreadLocalPtr id.
+        struct ThreadData
+        {
+            port::AtomicPointer* entries;
+            uint32_t size;
+            ThreadData* prev;
+            ThreadData* next;
+        };
+        
+        // Process-wide registry of ids and of the threads that own slots.
+        class StaticMeta
+        {
+        public:
+            StaticMeta() : next_id_(0)
+            {
+                head_.entries = NULL;
+                head_.size = 0;
+                head_.prev = &head_;
+                head_.next = &head_;
+                if (pthread_key_create(&key_, &StaticMeta::OnThreadExit) != 0)
+                {
+                    abort();
+                }
+            }
+            
+            uint32_t NewId(ThreadLocalPtr::UnrefHandler handler)
+            {
+                MutexLock l(&mutex_);
+                uint32_t id;
+                if (!free_ids_.empty())
+                {
+                    id = free_ids_.back();
+                    free_ids_.pop_back();
+                    handlers_[id] = handler;
+                } else
+                {
+                    id = next_id_++;
+                    handlers_.push_back(handler);
+                }
+                return id;
+            }
+            
+            void ReclaimId(uint32_t id)
+            {
+                MutexLock l(&mutex_);
+                ThreadLocalPtr::UnrefHandler handler = handlers_[id];
+                for (ThreadData* t = head_.next; t != &head_; t = t->next)
+                {
+                    if (id < t->size)
+                    {
+                        void* ptr = t->entries[id].Acquire_Load();
+                        t->entries[id].Release_Store(NULL);
+                        if (ptr != NULL && handler != NULL)
+                        {
+                            (*handler)(ptr);
+                        }
+                    }
+                }
+                handlers_[id] = NULL;
+                free_ids_.push_back(id);
+            }
+            
+            // Return the slot of the calling thread for "id".
+            port::AtomicPointer* Slot(uint32_t id)
+            {
+                ThreadData* t = static_cast<ThreadData*>(pthread_getspecific(key_));
+                if (t == NULL)
+                {
+                    t = new ThreadData;
+                    t->entries = NULL;
+                    t->size = 0;
+                    MutexLock l(&mutex_);
+                    t->next = &head_;
+                    t->prev = head_.prev;
+                    t->prev->next = t;
+                    head_.prev = t;
+                    pthread_setspecific(key_, t);
+                }
+                if (id >= t->size)
+                {
+                    // Scrape() and ReclaimId() walk the entries of other
+                    // threads, so grow them under the lock.
+                    MutexLock l(&mutex_);
+                    uint32_t size = (t->size == 0) ? 8 : t->size;
+                    while (size <= id)
+                    {
+                        size *= 2;
+                    }
+                    port::AtomicPointer* entries = new port::AtomicPointer[size];
+                    for (uint32_t i = 0; i < size; i++)
+                    {
+                        entries[i].NoBarrier_Store(i < t->size ? t->entries[i].NoBarrier_Load() : NULL);
+                    }
+                    delete[] t->entries;
+                    t->entries = entries;
+                    t->size = size;
+                }
+                return &t->entries[id];
+            }
+            
+            void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement)
+            {
+                MutexLock l(&mutex_);
+                for (ThreadData* t = head_.next; t != &head_; t = t->next)
+                {
+                    if (id < t->size)
+                    {
+                        void* ptr = Exchange(&t->entries[id], replacement);
+                        if (ptr != NULL)
+                        {
+                            ptrs->push_back(ptr);
+                        }
+                    }
+                }
+            }
+            
+            static void* Exchange(port::AtomicPointer* slot, void* ptr)
+            {
+                void* old;
+                do
+                {
+                    old = slot->Acquire_Load();
+                } while (!slot->CompareAndSwap(old, ptr));
+                return old;
+            }
+            
+        private:
+            static void OnThreadExit(void* arg);
+            
+            port::Mutex mutex_;
+            pthread_key_t key_;
+            ThreadData head_;        // Circular list of threads that own slots
+            uint32_t next_id_;
+            std::vector<uint32_t> free_ids_;
+            std::vector<ThreadLocalPtr::UnrefHandler> handlers_;
+        };
+        
+        static port::OnceType meta_once = LEVELDB_ONCE_INIT;
+        static StaticMeta* meta = NULL;
+        
+        // Never deleted: threads may exit after static destructors have run.
+        static void InitMeta() { meta = new StaticMeta; }
+        
+        static StaticMeta* Meta()
+        {
+            port::InitOnce(&meta_once, &InitMeta);
+            return meta;
+        }
+        
+        void StaticMeta::OnThreadExit(void* arg)
+        {
+            ThreadData* t = static_cast<ThreadData*>(arg);
+            StaticMeta* m = Meta();
+            {
+                MutexLock l(&m->mutex_);
+                t->prev->next = t->next;
+                t->next->prev = t->prev;
+                for (uint32_t id = 0; id < t->size; id++)
+                {
+                    void* ptr = t->entries[id].Acquire_Load();
+                    if (ptr != NULL && m->handlers_[id] != NULL)
+                    {
+                        (*m->handlers_[id])(ptr);
+                    }
+                }
+            }
+            delete[] t->entries;
+            delete t;
+        }
+    }  // namespace
+    
+    ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(Meta()->NewId(handler))
+    {
+    }
+    
+    ThreadLocalPtr::~ThreadLocalPtr()
+    {
+        Meta()->ReclaimId(id_);
+    }
+    
+    void* ThreadLocalPtr::Get() const
+    {
+        return Meta()->Slot(id_)->Acquire_Load();
+    }
+    
+    void ThreadLocalPtr::Reset(void* ptr)
+    {
+        Meta()->Slot(id_)->Release_Store(ptr);
+    }
+    
+    void* ThreadLocalPtr::Swap(void* ptr)
+    {
+        return StaticMeta::Exchange(Meta()->Slot(id_), ptr);
+    }
+    
+    bool ThreadLocalPtr::CompareAndSwap(void* expected, void* ptr)
+    {
+        return Meta()->Slot(id_)->CompareAndSwap(expected, ptr);
+    }
+    
+    void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement)
+    {
+        Meta()->Scrape(id_, ptrs, replacement);
+    }
+    
+}  // namespace leveldb
@@ -0,0 +1,59 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace leveldb
+{
+    
+    // A ThreadLocalPtr gives every thread its own void* slot.  Unlike a
+    // thread-local variable there may be any number of instances (one per
+    // open DB, say), and the owner can collect the values of all threads at
+    // once with Scrape().
+    //
+    // When a thread exits, or the ThreadLocalPtr is destroyed, the handler
+    // passed to the constructor is called on every non-NULL value left
+    // behind.  Handlers run with an internal lock held and must not use any
+    // ThreadLocalPtr.
+    class ThreadLocalPtr
+    {
+    public:
+        typedef void (*UnrefHandler)(void* ptr);
+        
+        explicit ThreadLocalPtr(UnrefHandler handler = NULL);
+        ~ThreadLocalPtr();
+        
+        // Return the value of the calling thread (NULL if never set).
+        void* Get() const;
+        
+        // Set the value of the calling thread.
+        void Reset(void* ptr);
+        
+        // Set the value of the calling thread and return the previous one.
+        void* Swap(void* ptr);
+        
+        // If the value of the calling thread equals "expected", replace it
+        // with "ptr" and return true.  Else return false.
+        bool CompareAndSwap(void* expected, void* ptr);
+        
+        // Replace the value of every thread with "replacement" and append the
+        // previous non-NULL values to *ptrs.
+        void Scrape(std::vector<void*>* ptrs, void* replacement);
+        
+    private:
+        const uint32_t id_;
+        
+        // No copying allowed
+        ThreadLocalPtr(const ThreadLocalPtr&);
+        void operator=(const ThreadLocalPtr&);
+    };
+    
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
@@ -0,0 +1,196 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+
+// Counts handler calls; the values stored in the slots are ints.
+port::Mutex unref_mu;
+int unref_calls = 0;
+int unref_sum = 0;
+
+void CountUnref(void* ptr) {
+  MutexLock l(&unref_mu);
+  unref_calls++;
+  unref_sum += *static_cast<int*>(ptr);
+}
+
+void ResetCounts() {
+  MutexLock l(&unref_mu);
+  unref_calls = 0;
+  unref_sum = 0;
+}
+
+struct ThreadArg {
+  ThreadLocalPtr* tls;
+  int* value;
+  port::Mutex* mu;
+  port::CondVar* cv;
+  bool stored;     // Thread has set its value
+  bool release;    // Thread may exit
+  bool exited;
+  void* seen;      // Value the thread saw before setting its own
+};
+
+void SetAndWait(void* v) {
+  ThreadArg* arg = static_cast<ThreadArg*>(v);
+  arg->seen = arg->tls->Get();
+  arg->tls->Reset(arg->value);
+  MutexLock l(arg->mu);
+  arg->stored = true;
+  arg->cv->SignalAll();
+  while (!arg->release) {
+    arg->cv->Wait();
+  }
+}
+
+void SetAndExit(void* v) {
+  ThreadArg* arg = static_cast<ThreadArg*>(v);
+  arg->tls->Reset(arg->value);
+  MutexLock l(arg->mu);
+  arg->exited = true;
+  arg->cv->SignalAll();
+}
+
+}  // namespace
+
+class ThreadLocalTest { };
+
+TEST(ThreadLocalTest, Basic) {
+  ThreadLocalPtr a, b;
+  int x = 1, y = 2;
+  ASSERT_TRUE(a.Get() == NULL);
+  a.Reset(&x);
+  ASSERT_TRUE(a.Get() == &x);
+  ASSERT_TRUE(b.Get() == NULL);
+  ASSERT_TRUE(a.Swap(&y) == &x);
+  ASSERT_TRUE(a.Get() == &y);
+  ASSERT_TRUE(!a.CompareAndSwap(&x, NULL));
+  ASSERT_TRUE(a.CompareAndSwap(&y, &x));
+  ASSERT_TRUE(a.Get() == &x);
+}
+
+TEST(ThreadLocalTest, PerThreadAndScrape) {
+  ResetCounts();
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  ThreadLocalPtr tls(&CountUnref);
+  int main_value = 100;
+  tls.Reset(&main_value);
+
+  const int kThreads = 4;
+  int values[kThreads];
+  ThreadArg args[kThreads];
+  for (int i = 0; i < kThreads; i++) {
+    values[i] = i + 1;
+    args[i].tls = &tls;
+    args[i].value = &values[i];
+    args[i].mu = &mu;
+    args[i].cv = &cv;
+    args[i].stored = false;
+    args[i].release = false;
+    args[i].seen = &main_value;
+    Env::Default()->StartThread(&SetAndWait, &args[i]);
+  }
+  {
+    MutexLock l(&mu);
+    for (int i = 0; i < kThreads; i++) {
+      while (!args[i].stored) {
+        cv.Wait();
+      }
+    }
+  }
+  for (int i = 0; i < kThreads; i++) {
+    ASSERT_TRUE(args[i].seen == NULL);
+  }
+  ASSERT_TRUE(tls.Get() == &main_value);
+
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, NULL);
+  ASSERT_EQ(static_cast<size_t>(kThreads + 1), ptrs.size());
+  int sum = 0;
+  for (size_t i = 0; i < ptrs.size(); i++) {
+    sum += *static_cast<int*>(ptrs[i]);
+  }
+  ASSERT_EQ(100 + 1 + 2 + 3 + 4, sum);
+  ASSERT_TRUE(tls.Get() == NULL);
+
+  // Scraped values are the caller's responsibility, so threads exiting
+  // now have nothing to hand to the handler.
+  {
+    MutexLock l(&mu);
+    for (int i = 0; i < kThreads; i++) {
+      args[i].release = true;
+    }
+    cv.SignalAll();
+  }
+  Env::Default()->SleepForMicroseconds(100000);
+  MutexLock l(&unref_mu);
+  ASSERT_EQ(0, unref_calls);
+}
+
+TEST(ThreadLocalTest, HandlerOnThreadExit) {
+  ResetCounts();
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  ThreadLocalPtr tls(&CountUnref);
+  int value = 7;
+  ThreadArg arg;
+  arg.tls = &tls;
+  arg.value = &value;
+  arg.mu = &mu;
+  arg.cv = &cv;
+  arg.exited = false;
+  Env::Default()->StartThread(&SetAndExit, &arg);
+  {
+    MutexLock l(&mu);
+    while (!arg.exited) {
+      cv.Wait();
+    }
+  }
+  // The handler runs as the thread finishes, just after it signalled.
+  for (int i = 0; i < 100; i++) {
+    {
+      MutexLock l(&unref_mu);
+      if (unref_calls > 0) break;
+    }
+    Env::Default()->SleepForMicroseconds(10000);
+  }
+  MutexLock l(&unref_mu);
+  ASSERT_EQ(1, unref_calls);
+  ASSERT_EQ(7, unref_sum);
+}
+
+TEST(ThreadLocalTest, HandlerOnDestruction) {
+  ResetCounts();
+  int value = 5;
+  {
+    ThreadLocalPtr tls(&CountUnref);
+    tls.Reset(&value);
+  }
+  {
+    MutexLock l(&unref_mu);
+    ASSERT_EQ(1, unref_calls);
+    ASSERT_EQ(5, unref_sum);
+  }
+
+  // The id is reused without leaking the old value
+  ThreadLocalPtr tls2(&CountUnref);
+  ASSERT_TRUE(tls2.Get() == NULL);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}